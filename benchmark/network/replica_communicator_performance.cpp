@@ -0,0 +1,138 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <atomic>
+#include <chrono>
+
+#include "platform/networkstrate/async_replica_client.h"
+#include "platform/networkstrate/replica_communicator.h"
+#include "platform/proto/broadcast.pb.h"
+
+using namespace resdb;
+
+// Measure the broadcast throughput of ReplicaCommunicator from N threads.
+// The connections are replaced by clients which only count the messages,
+// so it measures the cost of the send path itself.
+
+void ShowUsage() { printf("[thread num] [messages per thread]\n"); }
+
+class CountingClient : public AsyncReplicaClient {
+ public:
+  CountingClient(boost::asio::io_service* io_service,
+                 std::atomic<uint64_t>* counter)
+      : AsyncReplicaClient(io_service, "127.0.0.1", 0), counter_(counter) {}
+
+  int SendMessage(const std::string& data) override {
+    BroadcastData broadcast_data;
+    broadcast_data.ParseFromString(data);
+    *counter_ += broadcast_data.data_size();
+    return 0;
+  }
+
+  // Each shared frame is preceded by its BroadcastData prefix.
+  int SendMessageParts(MessageParts parts) override {
+    *counter_ += parts.size() / 2;
+    return 0;
+  }
+
+ private:
+  std::atomic<uint64_t>* counter_;
+};
+
+class BenchmarkCommunicator : public ReplicaCommunicator {
+ public:
+  BenchmarkCommunicator(const std::vector<ReplicaInfo>& replicas,
+                        std::atomic<uint64_t>* counter)
+      : ReplicaCommunicator(replicas, nullptr, true, 1, 64),
+        counter_(counter) {}
+
+ protected:
+  AsyncReplicaClient* GetClientFromPool(const std::string& ip,
+                                        int port) override {
+    clients_.push_back(
+        std::make_unique<CountingClient>(&io_service_, counter_));
+    return clients_.back().get();
+  }
+
+ private:
+  boost::asio::io_service io_service_;
+  std::atomic<uint64_t>* counter_;
+  std::vector<std::unique_ptr<CountingClient>> clients_;
+};
+
+void Run(int replica_num, int thread_num, int msg_num) {
+  std::vector<ReplicaInfo> replicas;
+  for (int i = 1; i <= replica_num; ++i) {
+    ReplicaInfo replica;
+    replica.set_id(i);
+    replica.set_ip("127.0.0.1");
+    replica.set_port(20000 + i);
+    replicas.push_back(replica);
+  }
+
+  std::atomic<uint64_t> counter = 0;
+  auto communicator =
+      std::make_unique<BenchmarkCommunicator>(replicas, &counter);
+
+  Request request;
+  request.set_type(Request::TYPE_PREPARE);
+  request.set_data(std::string(256, 'a'));
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < thread_num; ++i) {
+    threads.push_back(std::thread([&]() {
+      for (int j = 0; j < msg_num; ++j) {
+        communicator->BroadCast(request);
+      }
+    }));
+  }
+  for (auto& th : threads) {
+    th.join();
+  }
+  uint64_t total = static_cast<uint64_t>(thread_num) * msg_num * replica_num;
+  while (counter < total) {
+    std::this_thread::yield();
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  printf("replicas:%2d threads:%2d broadcast:%.0f/s messages:%.0f/s\n",
+         replica_num, thread_num, thread_num * msg_num / seconds,
+         total / seconds);
+}
+
+int main(int argc, char** argv) {
+  int thread_num = 4;
+  int msg_num = 20000;
+  if (argc >= 2) {
+    thread_num = atoi(argv[1]);
+  }
+  if (argc >= 3) {
+    msg_num = atoi(argv[2]);
+  }
+  if (thread_num <= 0 || msg_num <= 0) {
+    ShowUsage();
+    exit(0);
+  }
+
+  for (int replica_num : {4, 16, 64}) {
+    Run(replica_num, thread_num, msg_num);
+  }
+}
@@ -0,0 +1,173 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+#include "common/utils/utils.h"
+#include "platform/consensus/execution/geo_global_executor.h"
+
+using namespace resdb;
+
+// Simulate the global ordering of GeoBFT with a skewed load: region 1
+// commits a batch every millisecond and each following region is slower,
+// the last one by [skew] times. Each region may fill the seqs other regions
+// are ahead with no-op batches once they have waited [idle timeout ms] on it,
+// which is compared against running without no-op batches.
+
+void ShowUsage() { printf("[regions] [seconds] [skew] [idle timeout ms]\n"); }
+
+// Record how long each batch waits from its commit in the region to the
+// global execution.
+class LatencyManager : public TransactionManager {
+ public:
+  std::unique_ptr<BatchUserResponse> ExecuteBatch(
+      const BatchUserRequest& request) override {
+    num_++;
+    wait_us_ += GetCurrentTime() - request.createtime();
+    return nullptr;
+  }
+
+  std::atomic<uint64_t> num_ = 0, wait_us_ = 0;
+};
+
+ResDBConfig GetConfig(int region_num) {
+  ResConfigData data;
+  for (int i = 1; i <= region_num; ++i) {
+    RegionInfo* region = data.add_region();
+    region->set_region_id(i);
+    ReplicaInfo* replica = region->add_replica_info();
+    replica->set_id(i);
+  }
+  data.set_self_region_id(1);
+  ReplicaInfo self_info;
+  self_info.set_id(1);
+  return ResDBConfig(data, self_info, KeyInfo(), CertificateInfo());
+}
+
+void Run(int region_num, double seconds, double skew, int idle_timeout_ms) {
+  auto manager = std::make_unique<LatencyManager>();
+  LatencyManager* latency = manager.get();
+  GeoGlobalExecutor executor(std::move(manager), GetConfig(region_num));
+
+  std::vector<std::atomic<uint64_t>> region_seqs(region_num);
+  std::atomic<uint64_t> batch_num = 0, noop_num = 0;
+  std::atomic<bool> stop = false;
+
+  auto send = [&](int region_id, uint64_t seq, bool noop) {
+    BatchUserRequest batch_request;
+    batch_request.set_createtime(GetCurrentTime());
+    batch_request.set_seq(seq);
+    if (noop) {
+      batch_request.set_noop(true);
+    } else {
+      batch_request.add_user_requests()->mutable_request()->set_data("test");
+    }
+    auto request = std::make_unique<Request>();
+    request->set_seq(seq);
+    request->mutable_region_info()->set_region_id(region_id);
+    batch_request.SerializeToString(request->mutable_data());
+    executor.OrderGeoRequest(std::move(request));
+  };
+
+  auto region_round = [&](int region_id) {
+    std::atomic<uint64_t>& seq = region_seqs[region_id - 1];
+    uint64_t interval_us =
+        1000 * pow(skew, region_num > 1 ? (region_id - 1.0) / (region_num - 1)
+                                        : 0);
+    uint64_t next_time = GetCurrentTime();
+    uint64_t behind_time = 0;
+    while (!stop) {
+      uint64_t now = GetCurrentTime();
+      // The local consensus is held back beyond the window.
+      if (now >= next_time && executor.IsInWindow(seq + 1)) {
+        send(region_id, ++seq, false);
+        batch_num++;
+        next_time += interval_us;
+      }
+
+      uint64_t max_seq = 0;
+      for (const auto& region_seq : region_seqs) {
+        max_seq = std::max<uint64_t>(max_seq, region_seq);
+      }
+      if (max_seq <= seq) {
+        behind_time = 0;
+      } else if (behind_time == 0) {
+        behind_time = now;
+      } else if (idle_timeout_ms > 0 &&
+                 now - behind_time >= idle_timeout_ms * 1000ull) {
+        while (seq < max_seq) {
+          send(region_id, ++seq, true);
+          noop_num++;
+        }
+        behind_time = 0;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(
+          std::min<uint64_t>(next_time - std::min(next_time, now), 1000)));
+    }
+  };
+
+  std::vector<std::thread> regions;
+  for (int i = 1; i <= region_num; ++i) {
+    regions.push_back(std::thread(region_round, i));
+  }
+  std::this_thread::sleep_for(
+      std::chrono::milliseconds(static_cast<int64_t>(seconds * 1000)));
+  stop = true;
+  for (auto& region : regions) {
+    region.join();
+  }
+  uint64_t executed = latency->num_;
+  executor.Stop();
+
+  printf(
+      "idle timeout:%d ms batches:%lu executed:%lu (%.0f batches/s) "
+      "no-op:%lu avg wait:%.1f ms\n",
+      idle_timeout_ms, batch_num.load(), executed, executed / seconds,
+      noop_num.load(),
+      executed ? latency->wait_us_ / 1000.0 / executed : 0.0);
+}
+
+int main(int argc, char** argv) {
+  int region_num = 4;
+  double seconds = 5;
+  double skew = 50;
+  int idle_timeout_ms = 20;
+  if (argc >= 2) {
+    region_num = atoi(argv[1]);
+  }
+  if (argc >= 3) {
+    seconds = atof(argv[2]);
+  }
+  if (argc >= 4) {
+    skew = atof(argv[3]);
+  }
+  if (argc >= 5) {
+    idle_timeout_ms = atoi(argv[4]);
+  }
+  if (region_num <= 0 || seconds <= 0 || skew < 1 || idle_timeout_ms <= 0) {
+    ShowUsage();
+    exit(0);
+  }
+
+  Run(region_num, seconds, skew, 0);
+  Run(region_num, seconds, skew, idle_timeout_ms);
+  return 0;
+}
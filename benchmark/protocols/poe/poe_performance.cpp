@@ -0,0 +1,171 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+#include "common/utils/utils.h"
+#include "platform/common/queue/lock_free_queue.h"
+#include "platform/consensus/ordering/poe/algorithm/poe.h"
+
+using namespace resdb;
+using namespace resdb::poe;
+
+// Run four PoE replicas in one process, the messages are delivered by
+// [worker threads] per replica. Print the committed transactions, the
+// resident memory and the window of each replica every second to check the
+// memory stays flat in a long run.
+
+void ShowUsage() { printf("[seconds] [window size] [worker threads]\n"); }
+
+constexpr int kReplicaNum = 4;
+
+struct Message {
+  int type;
+  std::string data;
+};
+
+uint64_t GetRSSBytes() {
+  std::ifstream statm("/proc/self/statm");
+  uint64_t size = 0, resident = 0;
+  statm >> size >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "-h") {
+    ShowUsage();
+    return 0;
+  }
+  int seconds = argc > 1 ? atoi(argv[1]) : 60;
+  uint32_t window_size = argc > 2 ? atoi(argv[2]) : 512;
+  int worker_num = argc > 3 ? atoi(argv[3]) : 4;
+
+  std::vector<std::unique_ptr<PoE>> replicas;
+  std::vector<std::unique_ptr<LockFreeQueue<Message>>> queues;
+  std::atomic<uint64_t> committed = 0;
+  std::atomic<bool> stop = false;
+  std::atomic<bool> client_done = false;
+
+  for (int i = 1; i <= kReplicaNum; ++i) {
+    replicas.push_back(
+        std::make_unique<PoE>(i, 1, kReplicaNum, nullptr, window_size));
+    queues.push_back(std::make_unique<LockFreeQueue<Message>>("poe"));
+  }
+  for (int i = 0; i < kReplicaNum; ++i) {
+    replicas[i]->SetBroadcastCallFunc(
+        [&](int type, const google::protobuf::Message& msg) {
+          std::string data;
+          msg.SerializeToString(&data);
+          for (auto& queue : queues) {
+            auto message = std::make_unique<Message>();
+            message->type = type;
+            message->data = data;
+            queue->Push(std::move(message));
+          }
+          return 0;
+        });
+    replicas[i]->SetSingleCallFunc(
+        [&](int type, const google::protobuf::Message& msg, int node_id) {
+          auto message = std::make_unique<Message>();
+          message->type = type;
+          msg.SerializeToString(&message->data);
+          queues[node_id - 1]->Push(std::move(message));
+          return 0;
+        });
+    replicas[i]->SetCommitFunc(
+        [&, i](const google::protobuf::Message& msg) {
+          if (i == 0) {
+            committed++;
+          }
+          return 0;
+        });
+  }
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < kReplicaNum; ++i) {
+    for (int j = 0; j < worker_num; ++j) {
+      workers.push_back(std::thread([&, i]() {
+        while (!client_done) {
+          auto message = queues[i]->Pop();
+          if (message == nullptr) {
+            continue;
+          }
+          if (message->type == MessageType::Propose) {
+            auto txn = std::make_unique<Transaction>();
+            txn->ParseFromString(message->data);
+            replicas[i]->ReceivePropose(std::move(txn));
+          } else if (message->type == MessageType::LowWatermark) {
+            auto watermark = std::make_unique<Watermark>();
+            watermark->ParseFromString(message->data);
+            replicas[i]->ReceiveWatermark(std::move(watermark));
+          } else if (message->type == MessageType::Prepare) {
+            auto proposal = std::make_unique<Proposal>();
+            proposal->ParseFromString(message->data);
+            replicas[i]->ReceivePrepare(std::move(proposal));
+          } else if (message->type == MessageType::Query) {
+            auto query = std::make_unique<TxnQuery>();
+            query->ParseFromString(message->data);
+            replicas[i]->ReceiveQuery(std::move(query));
+          } else if (message->type == MessageType::QueryResponse) {
+            auto response = std::make_unique<TxnQueryResponse>();
+            response->ParseFromString(message->data);
+            replicas[i]->ReceiveQueryResponse(std::move(response));
+          }
+        }
+      }));
+    }
+  }
+
+  std::thread client([&]() {
+    uint64_t id = 0;
+    while (!stop) {
+      auto txn = std::make_unique<Transaction>();
+      txn->set_data(std::string(128, 'a'));
+      txn->set_hash(std::to_string(id++));
+      replicas[0]->ReceiveTransaction(std::move(txn));
+    }
+    client_done = true;
+  });
+
+  uint64_t last_committed = 0;
+  for (int i = 1; i <= seconds; ++i) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    uint64_t num = committed;
+    printf("time:%ds committed:%lu (%lu txn/s) rss:%.1f MB\n", i, num,
+           num - last_committed, GetRSSBytes() / 1024.0 / 1024.0);
+    for (int j = 0; j < kReplicaNum; ++j) {
+      printf("  replica:%d low watermark:%ld active slots:%d\n", j + 1,
+             replicas[j]->GetLowWatermark(), replicas[j]->GetActiveSlotNum());
+    }
+    fflush(stdout);
+    last_committed = num;
+  }
+
+  stop = true;
+  // The workers keep committing until the client leaves the window.
+  client.join();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <chrono>
+
+#include "platform/consensus/ordering/poc/pow/miner_utils.h"
+#include "platform/consensus/ordering/poc/pow/mining_kernel.h"
+
+using namespace resdb;
+
+// Measure the hashes per second of one core for each mining kernel.
+
+void ShowUsage() { printf("[seconds]\n"); }
+
+double GetSeconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+int main(int argc, char** argv) {
+  double seconds = 2;
+  if (argc >= 2) {
+    seconds = atof(argv[1]);
+  }
+  if (seconds <= 0) {
+    ShowUsage();
+    exit(0);
+  }
+
+  std::string prefix(64, 0);
+  for (size_t i = 0; i < prefix.size(); ++i) {
+    prefix[i] = rand() & 0xff;
+  }
+
+  // The old path which builds the header string for each nonce.
+  {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t nonce = 0;
+    uint32_t found = 0;
+    while (GetSeconds(start) < seconds) {
+      for (int i = 0; i < 1024; ++i, ++nonce) {
+        std::string digest = GetHashValue(prefix + std::to_string(nonce));
+        found += IsValidDigest(digest, 64);
+      }
+    }
+    printf("%-8s lanes:%2d %.2f Mhash/s\n", "string", 1,
+           nonce / GetSeconds(start) / 1e6);
+  }
+
+  for (MiningKernel::Impl impl :
+       {MiningKernel::SCALAR, MiningKernel::SHA_NI, MiningKernel::SSE2,
+        MiningKernel::AVX2, MiningKernel::AVX512}) {
+    if (!MiningKernel::IsSupported(impl)) {
+      printf("%-8s not supported\n", MiningKernel::GetImplName(impl));
+      continue;
+    }
+    MiningKernel kernel(prefix, impl);
+    // A difficulty no nonce can meet, so every nonce in the range is hashed.
+    const uint64_t batch = 1 << 16;
+    uint64_t nonce = 0;
+    std::string digest;
+    auto start = std::chrono::steady_clock::now();
+    uint64_t next = 0;
+    while (GetSeconds(start) < seconds) {
+      kernel.Search(next, next + batch - 1, 1, 257, nullptr, &nonce, &digest);
+      next += batch;
+    }
+    printf("%-8s lanes:%2d %.2f Mhash/s\n", MiningKernel::GetImplName(impl),
+           kernel.GetLanes(), next / GetSeconds(start) / 1e6);
+  }
+  printf("best:%s\n", MiningKernel::GetImplName(MiningKernel::GetBestImpl()));
+  return 0;
+}
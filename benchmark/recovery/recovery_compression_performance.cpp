@@ -0,0 +1,147 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ctime>
+#include <filesystem>
+
+#include "chain/storage/memory_db.h"
+#include "platform/consensus/recovery/recovery.h"
+#include "proto/kv/kv.pb.h"
+
+using namespace resdb;
+
+// Measure the disk bytes and the cpu time per committed batch of the
+// recovery log for each codec. Each batch holds signed kv set requests and
+// is logged as the pre-prepare, prepare and commit messages.
+
+void ShowUsage() { printf("[batch num] [batch size] [log dir]\n"); }
+
+double GetCpuSeconds(std::clock_t start) {
+  return static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+}
+
+std::string GetBatch(int seq, int batch_size) {
+  BatchUserRequest batch;
+  for (int i = 0; i < batch_size; ++i) {
+    KVRequest kv_request;
+    kv_request.set_cmd(KVRequest::SET);
+    kv_request.set_key("key_" + std::to_string(seq * batch_size + i));
+    kv_request.set_value("value_" + std::to_string(rand() % 1000000));
+
+    auto* user_request = batch.add_user_requests();
+    user_request->mutable_request()->set_type(Request::TYPE_CLIENT_REQUEST);
+    kv_request.SerializeToString(
+        user_request->mutable_request()->mutable_data());
+    std::string signature(64, 0);
+    for (char& c : signature) {
+      c = rand() & 0xff;
+    }
+    user_request->mutable_signature()->set_signature(signature);
+    user_request->mutable_signature()->set_node_id(i % 4 + 1);
+  }
+  batch.set_seq(seq);
+  return batch.SerializeAsString();
+}
+
+int main(int argc, char** argv) {
+  int batch_num = 1000;
+  int batch_size = 100;
+  std::string dir = "/tmp/resdb_compression_benchmark";
+  if (argc >= 2) {
+    batch_num = atoi(argv[1]);
+  }
+  if (argc >= 3) {
+    batch_size = atoi(argv[2]);
+  }
+  if (argc >= 4) {
+    dir = argv[3];
+  }
+  if (batch_num <= 0 || batch_size <= 0) {
+    ShowUsage();
+    exit(0);
+  }
+
+  std::vector<std::string> batches;
+  uint64_t batch_bytes = 0;
+  for (int i = 1; i <= batch_num; ++i) {
+    batches.push_back(GetBatch(i, batch_size));
+    batch_bytes += batches.back().size();
+  }
+  printf("batch bytes:%.0f\n", static_cast<double>(batch_bytes) / batch_num);
+
+  std::unique_ptr<Storage> storage = storage::NewMemoryDB();
+  SystemInfo system_info;
+  for (ResConfigData::RecoveryCodec codec :
+       {ResConfigData::CODEC_NONE, ResConfigData::CODEC_SNAPPY,
+        ResConfigData::CODEC_ZLIB}) {
+    std::filesystem::remove_all(dir);
+    ResConfigData data;
+    data.set_recovery_enabled(true);
+    data.set_recovery_path(dir + "/log");
+    data.set_recovery_buffer_size(1024);
+    data.set_recovery_codec(codec);
+    ResDBConfig config(data, ReplicaInfo(), KeyInfo(), CertificateInfo());
+
+    double write_s = 0;
+    {
+      Recovery recovery(config, nullptr, &system_info, storage.get());
+      std::clock_t start = std::clock();
+      for (int i = 1; i <= batch_num; ++i) {
+        for (Request::Type type : {Request::TYPE_PRE_PREPARE,
+                                   Request::TYPE_PREPARE,
+                                   Request::TYPE_COMMIT}) {
+          Request request;
+          request.set_type(type);
+          request.set_seq(i);
+          if (type == Request::TYPE_PRE_PREPARE) {
+            request.set_data(batches[i - 1]);
+          }
+          request.set_hash(std::string(32, i & 0xff));
+          recovery.AddRequest(nullptr, &request);
+        }
+      }
+      write_s = GetCpuSeconds(start);
+    }
+
+    uint64_t disk_bytes = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+      disk_bytes += entry.file_size();
+    }
+
+    Recovery recovery(config, nullptr, &system_info, storage.get());
+    std::clock_t start = std::clock();
+    int64_t num = 0;
+    recovery.ReadLogs(
+        [&](const SystemInfoData& data) {},
+        [&](std::unique_ptr<Context> context,
+            std::unique_ptr<Request> request) { num++; },
+        nullptr);
+    double replay_s = GetCpuSeconds(start);
+
+    printf(
+        "codec:%-12s disk bytes per batch:%.0f write cpu per batch:%.1f us "
+        "replay cpu per batch:%.1f us records:%ld\n",
+        ResConfigData::RecoveryCodec_Name(codec).c_str(),
+        static_cast<double>(disk_bytes) / batch_num, write_s * 1e6 / batch_num,
+        replay_s * 1e6 / batch_num, num);
+  }
+
+  std::filesystem::remove_all(dir);
+  return 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <chrono>
+#include <filesystem>
+
+#include "chain/storage/memory_db.h"
+#include "platform/consensus/recovery/recovery.h"
+
+using namespace resdb;
+
+// Measure the restart time of Recovery on a synthetic log. The log is
+// written once and then opened and replayed with different numbers of
+// replay threads.
+
+void ShowUsage() { printf("[log size mb] [request kb] [log dir]\n"); }
+
+double GetSeconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+ResDBConfig GetConfig(const std::string& log_path, int thread_num) {
+  ResConfigData data;
+  data.set_recovery_enabled(true);
+  data.set_recovery_path(log_path);
+  data.set_recovery_buffer_size(1024);
+  data.set_recovery_replay_thread_num(thread_num);
+  return ResDBConfig(data, ReplicaInfo(), KeyInfo(), CertificateInfo());
+}
+
+int main(int argc, char** argv) {
+  int64_t size_mb = 2048;
+  int64_t request_kb = 64;
+  std::string dir = "/tmp/resdb_replay_benchmark";
+  if (argc >= 2) {
+    size_mb = atoll(argv[1]);
+  }
+  if (argc >= 3) {
+    request_kb = atoll(argv[2]);
+  }
+  if (argc >= 4) {
+    dir = argv[3];
+  }
+  if (size_mb <= 0 || request_kb <= 0) {
+    ShowUsage();
+    exit(0);
+  }
+
+  std::string log_path = dir + "/log";
+  std::filesystem::remove_all(dir);
+  std::unique_ptr<Storage> storage = storage::NewMemoryDB();
+  SystemInfo system_info;
+
+  int64_t request_num = size_mb * 1024 / request_kb;
+  {
+    Recovery recovery(GetConfig(log_path, 1), nullptr, &system_info,
+                      storage.get());
+    std::string payload(request_kb * 1024, 0);
+    for (size_t i = 0; i < payload.size(); ++i) {
+      payload[i] = rand() & 0xff;
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int64_t i = 1; i <= request_num; ++i) {
+      Request request;
+      request.set_type(Request::TYPE_PRE_PREPARE);
+      request.set_seq(i);
+      request.set_data(payload);
+      recovery.AddRequest(nullptr, &request);
+    }
+    printf("write %ld requests %ld MB: %.2f s\n", request_num, size_mb,
+           GetSeconds(start));
+  }
+
+  for (int thread_num : {1, 2, 4, 8}) {
+    auto start = std::chrono::steady_clock::now();
+    Recovery recovery(GetConfig(log_path, thread_num), nullptr, &system_info,
+                      storage.get());
+    double open_s = GetSeconds(start);
+
+    start = std::chrono::steady_clock::now();
+    int64_t num = 0;
+    recovery.ReadLogs(
+        [&](const SystemInfoData& data) {},
+        [&](std::unique_ptr<Context> context,
+            std::unique_ptr<Request> request) { num++; },
+        nullptr);
+    double replay_s = GetSeconds(start);
+    printf(
+        "threads:%d open:%.2f s replay:%.2f s requests:%ld %.1f MB/s "
+        "%.0f requests/s\n",
+        thread_num, open_s, replay_s, num, size_mb / replay_s,
+        num / replay_s);
+  }
+
+  std::filesystem::remove_all(dir);
+  return 0;
+}
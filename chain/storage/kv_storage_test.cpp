@@ -70,6 +70,26 @@ TEST_P(KVStorageTest, GetValue) {
   EXPECT_EQ(storage->GetValue("test_key"), "");
 }
 
+TEST_P(KVStorageTest, DelValue) {
+  EXPECT_EQ(storage->SetValue("test_key", "test_value"), 0);
+  EXPECT_EQ(storage->DelValue("test_key"), 0);
+  EXPECT_EQ(storage->GetValue("test_key"), "");
+}
+
+TEST_P(KVStorageTest, GetValuesWithPrefix) {
+  EXPECT_EQ(storage->SetValue("a/2", "v2"), 0);
+  EXPECT_EQ(storage->SetValue("a/1", "v1"), 0);
+  EXPECT_EQ(storage->SetValue("a", "v"), 0);
+  EXPECT_EQ(storage->SetValue("b/1", "v3"), 0);
+  EXPECT_EQ(storage->SetValue("a/3", "v4"), 0);
+  EXPECT_EQ(storage->DelValue("a/3"), 0);
+
+  std::vector<std::pair<std::string, std::string>> expected_list{
+      std::make_pair("a/1", "v1"), std::make_pair("a/2", "v2")};
+  EXPECT_EQ(storage->GetValuesWithPrefix("a/"), expected_list);
+  EXPECT_TRUE(storage->GetValuesWithPrefix("c/").empty());
+}
+
 TEST_P(KVStorageTest, GetEmptyValueWithVersion) {
   EXPECT_EQ(storage->GetValueWithVersion("test_key", 0),
             std::make_pair(std::string(""), 0));
@@ -305,6 +325,36 @@ TEST_P(KVStorageTest, BlockCacheSpecificTest) {
   }
 }
 
+TEST_P(KVStorageTest, StageAndApplySnapshot) {
+  storage->EnableStateDigest();
+  EXPECT_EQ(storage->SetValue("key1", "value1"), 0);
+  EXPECT_EQ(storage->SetValueWithVersion("key2", "value2", 0), 0);
+  EXPECT_TRUE(storage->CreateSnapshot(1));
+  std::string state_digest = storage->GetStateDigest();
+
+  std::vector<std::pair<std::string, std::string>> items;
+  EXPECT_EQ(storage->ReadSnapshot(1, "", 1 << 20, &items), 1);
+  ASSERT_EQ(items.size(), 2);
+  EXPECT_EQ(storage->SetValue("key3", "value3"), 0);
+
+  // The chunks must come in key order.
+  EXPECT_EQ(storage->StageSnapshot({items[1]}), 0);
+  EXPECT_EQ(storage->StageSnapshot({items[0]}), -2);
+  storage->ClearStagedSnapshot();
+
+  EXPECT_EQ(storage->StageSnapshot({items[0]}), 0);
+  EXPECT_EQ(storage->StageSnapshot({items[1]}), 0);
+  EXPECT_EQ(storage->GetStagedStateDigest(), state_digest);
+  EXPECT_EQ(storage->GetValue("key3"), "value3");
+
+  EXPECT_EQ(storage->ApplySnapshot(), 0);
+  EXPECT_EQ(storage->GetStateDigest(), state_digest);
+  EXPECT_EQ(storage->GetValue("key1"), "value1");
+  EXPECT_EQ(storage->GetValue("key3"), "");
+  EXPECT_EQ(storage->GetValueWithVersion("key2", 0),
+            std::make_pair(std::string("value2"), 1));
+}
+
 INSTANTIATE_TEST_CASE_P(KVStorageTest, KVStorageTest,
                         ::testing::Values(MEM, LEVELDB,
                                           LEVELDB_WITH_BLOCK_CACHE));
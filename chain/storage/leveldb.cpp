@@ -23,6 +23,9 @@
 #include <unistd.h>
 
 #include <cstdint>
+#include <filesystem>
+#include <shared_mutex>
+#include <unordered_map>
 
 #include "chain/storage/proto/kv.pb.h"
 #include "leveldb/options.h"
@@ -30,6 +33,104 @@
 namespace resdb {
 namespace storage {
 
+// Local bookkeeping key which is not part of the replicated state.
+const std::string ckpt_key = "leveldb_checkpoint";
+
+// The state digest is kept under this prefix, in the same batches as the data
+// it covers, so that it is never out of date after a crash. The keys are
+// local too.
+const std::string digest_prefix = "\xff" "leveldb_state_digest/";
+const std::string digest_prefix_end = "\xff" "leveldb_state_digest0";
+// Set when the saved digest covers all the data, to the bucket number.
+const std::string digest_meta_key = digest_prefix + "m";
+
+namespace {
+
+std::string GetStagingPath(const std::string& path) {
+  return path + "_staging";
+}
+
+std::string GetOldPath(const std::string& path) { return path + "_old"; }
+
+bool IsLocalKey(const leveldb::Slice& key) {
+  return key == ckpt_key || key.starts_with(digest_prefix);
+}
+
+// Move it past the local keys at its position.
+void SkipLocalKeys(leveldb::Iterator* it) {
+  while (it->Valid()) {
+    if (it->key().starts_with(digest_prefix)) {
+      it->Seek(digest_prefix_end);
+    } else if (it->key() == ckpt_key) {
+      it->Next();
+    } else {
+      break;
+    }
+  }
+}
+
+}  // namespace
+
+// Keeps the leaves and bucket states of the state digest in the data LevelDB.
+// The writes go to the batch of the data, and the leaves written since it was
+// last written are kept aside to be read back.
+class LevelDBLeafStore : public StateDigest::LeafStore {
+ public:
+  LevelDBLeafStore(leveldb::DB* db, leveldb::WriteBatch* batch)
+      : db_(db), batch_(batch) {}
+
+  bool Get(const std::string& key, std::string* leaf) override {
+    auto it = pending_.find(key);
+    if (it != pending_.end()) {
+      if (!it->second.has_value()) {
+        return false;
+      }
+      *leaf = *it->second;
+      return true;
+    }
+    return db_->Get(leveldb::ReadOptions(), GetLeafKey(key), leaf).ok();
+  }
+
+  void Put(const std::string& key, const std::string& leaf) override {
+    batch_->Put(GetLeafKey(key), leaf);
+    pending_[key] = leaf;
+  }
+
+  void Delete(const std::string& key) override {
+    batch_->Delete(GetLeafKey(key));
+    pending_[key] = std::nullopt;
+  }
+
+  void PutBucket(uint32_t bucket, const std::string& state) override {
+    if (state.empty()) {
+      batch_->Delete(GetBucketKey(bucket));
+    } else {
+      batch_->Put(GetBucketKey(bucket), state);
+    }
+  }
+
+  bool GetBucket(uint32_t bucket, std::string* state) override {
+    return db_->Get(leveldb::ReadOptions(), GetBucketKey(bucket), state).ok();
+  }
+
+  // Called once the batch is written.
+  void ClearPending() { pending_.clear(); }
+
+ private:
+  static std::string GetLeafKey(const std::string& key) {
+    return digest_prefix + "l" + key;
+  }
+
+  static std::string GetBucketKey(uint32_t bucket) {
+    return digest_prefix + "b" + std::to_string(bucket);
+  }
+
+ private:
+  leveldb::DB* db_;
+  leveldb::WriteBatch* batch_;
+  std::unordered_map<std::string, std::optional<std::string>> pending_;
+};
+
 std::unique_ptr<Storage> NewResLevelDB(const std::string& path,
                                        std::optional<LevelDBInfo> config) {
   if (config == std::nullopt) {
@@ -73,6 +174,23 @@ void ResLevelDB::CreateDB(const std::string& path) {
   LOG(ERROR) << "ResLevelDB Create DB: path:" << path
              << " write buffer size:" << write_buffer_size_
              << " batch size:" << write_batch_size_;
+  // Finish an ApplySnapshot() cut by a crash. The staged data has been
+  // verified once the old data is moved aside.
+  std::error_code ec;
+  std::string old_path = GetOldPath(path);
+  if (std::filesystem::exists(old_path)) {
+    if (!std::filesystem::exists(path)) {
+      std::string staging_path = GetStagingPath(path);
+      std::filesystem::rename(
+          std::filesystem::exists(staging_path) ? staging_path : old_path,
+          path, ec);
+      if (ec) {
+        LOG(ERROR) << "recover snapshot fail:" << ec.message();
+      }
+    }
+    std::filesystem::remove_all(old_path, ec);
+  }
+
   leveldb::Options options;
   options.create_if_missing = true;
   options.write_buffer_size = write_buffer_size_;
@@ -83,10 +201,21 @@ void ResLevelDB::CreateDB(const std::string& path) {
     db_ = std::unique_ptr<leveldb::DB>(db);
   }
   assert(status.ok());
+  path_ = path;
+
+  // The saved digest only covers the data while every write updates it, so
+  // the mark is dropped until EnableStateDigest() takes it over.
+  digest_meta_.clear();
+  if (db_->Get(leveldb::ReadOptions(), digest_meta_key, &digest_meta_).ok()) {
+    db_->Delete(leveldb::WriteOptions(), digest_meta_key);
+  }
   LOG(ERROR) << "Successfully opened LevelDB";
 }
 
 ResLevelDB::~ResLevelDB() {
+  for (auto& it : snapshots_) {
+    db_->ReleaseSnapshot(it.second);
+  }
   if (db_) {
     db_.reset();
   }
@@ -97,7 +226,8 @@ ResLevelDB::~ResLevelDB() {
 
 int ResLevelDB::SetValueWithSeq(const std::string& key,
                                 const std::string& value, uint64_t seq) {
-  std::string value_str = GetValue(key);
+  std::shared_lock<std::shared_mutex> lk(db_mutex_);
+  std::string value_str = GetValueInternal(key);
   ValueHistory history;
   if (!history.ParseFromString(value_str)) {
     LOG(ERROR) << "old_value parse fail";
@@ -126,7 +256,7 @@ int ResLevelDB::SetValueWithSeq(const std::string& key,
   LOG(ERROR) << " set value, string:" << key << " seq:" << seq
              << " last seq:" << last_seq;
   history.SerializeToString(&value_str);
-  int ret = SetValue(key, value_str);
+  int ret = SetValueInternal(key, value_str);
   if (ret) {
     return ret;
   }
@@ -136,7 +266,8 @@ int ResLevelDB::SetValueWithSeq(const std::string& key,
 
 std::pair<std::string, uint64_t> ResLevelDB::GetValueWithSeq(
     const std::string& key, uint64_t seq) {
-  std::string value_str = GetValue(key);
+  std::shared_lock<std::shared_mutex> lk(db_mutex_);
+  std::string value_str = GetValueInternal(key);
   ValueHistory history;
   if (!history.ParseFromString(value_str)) {
     LOG(ERROR) << "old_value parse fail";
@@ -159,26 +290,58 @@ std::pair<std::string, uint64_t> ResLevelDB::GetValueWithSeq(
 }
 
 int ResLevelDB::SetValue(const std::string& key, const std::string& value) {
+  std::shared_lock<std::shared_mutex> lk(db_mutex_);
+  return SetValueInternal(key, value);
+}
+
+int ResLevelDB::SetValueInternal(const std::string& key,
+                                 const std::string& value) {
+  if (key != ckpt_key) {
+    if (state_digest_ == nullptr) {
+      digest_meta_.clear();
+    }
+    UpdateStateDigest(key, value);
+  }
   if (block_cache_) {
     block_cache_->Put(key, value);
   }
   batch_.Put(key, value);
 
   if (batch_.ApproximateSize() >= write_batch_size_) {
-    leveldb::Status status = db_->Write(leveldb::WriteOptions(), &batch_);
-    if (status.ok()) {
-      batch_.Clear();
-      UpdateMetrics();
-      return 0;
-    } else {
-      LOG(ERROR) << "flush buffer fail:" << status.ToString();
+    if (!FlushInternal()) {
+      return -1;
+    }
+    UpdateMetricsInternal();
+  }
+  return 0;
+}
+
+int ResLevelDB::DelValue(const std::string& key) {
+  std::shared_lock<std::shared_mutex> lk(db_mutex_);
+  if (state_digest_ == nullptr) {
+    digest_meta_.clear();
+  }
+  RemoveStateDigest(key);
+  if (block_cache_) {
+    block_cache_->Put(key, "");
+  }
+  batch_.Delete(key);
+
+  if (batch_.ApproximateSize() >= write_batch_size_) {
+    if (!FlushInternal()) {
       return -1;
     }
+    UpdateMetricsInternal();
   }
   return 0;
 }
 
 std::string ResLevelDB::GetValue(const std::string& key) {
+  std::shared_lock<std::shared_mutex> lk(db_mutex_);
+  return GetValueInternal(key);
+}
+
+std::string ResLevelDB::GetValueInternal(const std::string& key) {
   std::string value;
   bool found_in_cache = false;
 
@@ -194,17 +357,19 @@ std::string ResLevelDB::GetValue(const std::string& key) {
     }
   }
 
-  UpdateMetrics();
+  UpdateMetricsInternal();
   return value;
 }
 
 std::string ResLevelDB::GetRange(const std::string& min_key,
                                  const std::string& max_key) {
+  std::shared_lock<std::shared_mutex> lk(db_mutex_);
   std::string values = "[";
   leveldb::Iterator* it = db_->NewIterator(leveldb::ReadOptions());
   bool first_iteration = true;
-  for (it->Seek(min_key); it->Valid() && it->key().ToString() <= max_key;
-       it->Next()) {
+  for (it->Seek(min_key), SkipLocalKeys(it);
+       it->Valid() && it->key().ToString() <= max_key;
+       it->Next(), SkipLocalKeys(it)) {
     if (!first_iteration) values.append(",");
     first_iteration = false;
     values.append(it->value().ToString());
@@ -215,7 +380,27 @@ std::string ResLevelDB::GetRange(const std::string& min_key,
   return values;
 }
 
+std::vector<std::pair<std::string, std::string>>
+ResLevelDB::GetValuesWithPrefix(const std::string& prefix) {
+  std::shared_lock<std::shared_mutex> lk(db_mutex_);
+  std::vector<std::pair<std::string, std::string>> resp;
+  leveldb::Iterator* it = db_->NewIterator(leveldb::ReadOptions());
+  for (it->Seek(prefix), SkipLocalKeys(it);
+       it->Valid() && it->key().starts_with(prefix);
+       it->Next(), SkipLocalKeys(it)) {
+    resp.push_back(
+        std::make_pair(it->key().ToString(), it->value().ToString()));
+  }
+  delete it;
+  return resp;
+}
+
 bool ResLevelDB::UpdateMetrics() {
+  std::shared_lock<std::shared_mutex> lk(db_mutex_);
+  return UpdateMetricsInternal();
+}
+
+bool ResLevelDB::UpdateMetricsInternal() {
   if (block_cache_ == nullptr) {
     return false;
   }
@@ -229,18 +414,253 @@ bool ResLevelDB::UpdateMetrics() {
 }
 
 bool ResLevelDB::Flush() {
+  std::shared_lock<std::shared_mutex> lk(db_mutex_);
+  return FlushInternal();
+}
+
+bool ResLevelDB::FlushInternal() {
+  if (state_digest_ != nullptr) {
+    state_digest_->Save();
+  }
   leveldb::Status status = db_->Write(leveldb::WriteOptions(), &batch_);
   if (status.ok()) {
     batch_.Clear();
+    if (leaf_store_ != nullptr) {
+      leaf_store_->ClearPending();
+    }
     return true;
   }
   LOG(ERROR) << "flush buffer fail:" << status.ToString();
   return false;
 }
 
+void ResLevelDB::NewStateDigest() {
+  auto store = std::make_unique<LevelDBLeafStore>(db_.get(), &batch_);
+  leaf_store_ = store.get();
+  state_digest_ = std::make_unique<StateDigest>(StateDigest::kDefaultBucketNum,
+                                                std::move(store));
+}
+
+void ResLevelDB::EnableStateDigest() {
+  std::unique_lock<std::shared_mutex> lk(db_mutex_);
+  EnableStateDigestInternal();
+}
+
+void ResLevelDB::EnableStateDigestInternal() {
+  if (state_digest_ != nullptr || !FlushInternal()) {
+    return;
+  }
+  std::string meta = std::to_string(StateDigest::kDefaultBucketNum);
+  if (digest_meta_ == meta) {
+    NewStateDigest();
+    if (state_digest_->Load()) {
+      batch_.Put(digest_meta_key, meta);
+      FlushInternal();
+      LOG(ERROR) << "state digest loaded";
+      return;
+    }
+    state_digest_.reset();
+    leaf_store_ = nullptr;
+  }
+
+  // The saved digest misses some writes, e.g. the digest was not enabled on
+  // the last run, so it is rebuilt from the data.
+  leveldb::ReadOptions read_options;
+  read_options.fill_cache = false;
+  leveldb::Iterator* it = db_->NewIterator(read_options);
+  for (it->Seek(digest_prefix);
+       it->Valid() && it->key().starts_with(digest_prefix); it->Next()) {
+    batch_.Delete(it->key());
+  }
+  delete it;
+  if (!FlushInternal()) {
+    return;
+  }
+
+  NewStateDigest();
+  it = db_->NewIterator(read_options);
+  uint64_t num = 0;
+  for (it->SeekToFirst(), SkipLocalKeys(it); it->Valid();
+       it->Next(), SkipLocalKeys(it)) {
+    UpdateStateDigest(it->key().ToString(), it->value().ToString());
+    num++;
+    if (batch_.ApproximateSize() >= kMaxRebuildBatchSize) {
+      FlushInternal();
+    }
+  }
+  delete it;
+  digest_meta_ = meta;
+  batch_.Put(digest_meta_key, meta);
+  FlushInternal();
+  LOG(ERROR) << "state digest rebuilt, keys:" << num;
+}
+
+bool ResLevelDB::CreateSnapshot(uint64_t seq) {
+  std::shared_lock<std::shared_mutex> db_lk(db_mutex_);
+  // The pending batch belongs to the state at seq.
+  if (!FlushInternal()) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lk(snapshot_mutex_);
+  auto it = snapshots_.find(seq);
+  if (it != snapshots_.end()) {
+    db_->ReleaseSnapshot(it->second);
+  }
+  snapshots_[seq] = db_->GetSnapshot();
+  while (snapshots_.size() > kMaxSnapshotNum) {
+    db_->ReleaseSnapshot(snapshots_.begin()->second);
+    snapshots_.erase(snapshots_.begin());
+  }
+  return true;
+}
+
+int ResLevelDB::ReadSnapshot(
+    uint64_t seq, const std::string& start_key, size_t max_bytes,
+    std::vector<std::pair<std::string, std::string>>* items) {
+  std::shared_lock<std::shared_mutex> db_lk(db_mutex_);
+  // Hold the lock so that the snapshot is not released while reading.
+  std::lock_guard<std::mutex> lk(snapshot_mutex_);
+  auto snapshot_it = snapshots_.find(seq);
+  if (snapshot_it == snapshots_.end()) {
+    return -1;
+  }
+  leveldb::ReadOptions options;
+  options.snapshot = snapshot_it->second;
+  options.fill_cache = false;
+  leveldb::Iterator* it = db_->NewIterator(options);
+  it->Seek(start_key);
+  if (!start_key.empty() && it->Valid() && it->key() == start_key) {
+    it->Next();
+  }
+  size_t bytes = 0;
+  for (SkipLocalKeys(it); it->Valid() && bytes < max_bytes;
+       it->Next(), SkipLocalKeys(it)) {
+    bytes += it->key().size() + it->value().size();
+    items->push_back(
+        std::make_pair(it->key().ToString(), it->value().ToString()));
+  }
+  int ret = it->Valid() ? 0 : 1;
+  delete it;
+  return ret;
+}
+
+int ResLevelDB::StageSnapshot(
+    const std::vector<std::pair<std::string, std::string>>& items) {
+  if (staging_db_ == nullptr) {
+    leveldb::Options options;
+    options.create_if_missing = true;
+    options.write_buffer_size = write_buffer_size_;
+    leveldb::DestroyDB(GetStagingPath(path_), options);
+    leveldb::DB* db = nullptr;
+    leveldb::Status status =
+        leveldb::DB::Open(options, GetStagingPath(path_), &db);
+    if (!status.ok()) {
+      LOG(ERROR) << "open staging db fail:" << status.ToString();
+      return -1;
+    }
+    staging_db_ = std::unique_ptr<leveldb::DB>(db);
+    // The leaves are staged with the data, so that the digest is loaded
+    // rather than rebuilt once the snapshot is applied.
+    staging_store_ =
+        std::make_unique<LevelDBLeafStore>(staging_db_.get(), &staging_batch_);
+    staged_digest_ = std::make_unique<StateDigestBuilder>(
+        StateDigest::kDefaultBucketNum, staging_store_.get());
+  }
+
+  staging_batch_.Clear();
+  for (const auto& item : items) {
+    if (IsLocalKey(item.first)) {
+      LOG(ERROR) << "invalid snapshot key:" << item.first;
+      return -2;
+    }
+    if (!staged_digest_->Add(item.first, item.second)) {
+      LOG(ERROR) << "snapshot key out of order:" << item.first;
+      return -2;
+    }
+    staging_batch_.Put(item.first, item.second);
+  }
+  return WriteStagingBatch();
+}
+
+int ResLevelDB::WriteStagingBatch() {
+  leveldb::Status status =
+      staging_db_->Write(leveldb::WriteOptions(), &staging_batch_);
+  staging_batch_.Clear();
+  staging_store_->ClearPending();
+  if (!status.ok()) {
+    LOG(ERROR) << "stage snapshot fail:" << status.ToString();
+    return -1;
+  }
+  return 0;
+}
+
+int ResLevelDB::ApplySnapshot() {
+  // The readers and writers hold db_mutex_ shared, so none of them uses the
+  // data while it is replaced.
+  std::unique_lock<std::shared_mutex> db_lk(db_mutex_);
+  if (staging_db_ == nullptr || !FlushInternal()) {
+    return -1;
+  }
+  // The checkpoint bookkeeping is local.
+  std::string ckpt;
+  if (db_->Get(leveldb::ReadOptions(), ckpt_key, &ckpt).ok()) {
+    staging_batch_.Put(ckpt_key, ckpt);
+  }
+  staged_digest_->Save();
+  staging_batch_.Put(digest_meta_key,
+                     std::to_string(StateDigest::kDefaultBucketNum));
+  int ret = WriteStagingBatch();
+  if (ret) {
+    ClearStagedSnapshot();
+    return ret;
+  }
+  staged_digest_.reset();
+  staging_store_.reset();
+  staging_db_.reset();
+
+  // Swap the directories instead of rewriting the data, so the state is
+  // replaced at once. CreateDB() finishes the swap after a crash.
+  std::lock_guard<std::mutex> lk(snapshot_mutex_);
+  for (auto& it : snapshots_) {
+    db_->ReleaseSnapshot(it.second);
+  }
+  snapshots_.clear();
+  bool digest_enabled = state_digest_ != nullptr;
+  state_digest_.reset();
+  leaf_store_ = nullptr;
+  db_.reset();
+  std::error_code ec;
+  std::filesystem::rename(path_, GetOldPath(path_), ec);
+  if (ec) {
+    LOG(ERROR) << "move data aside fail:" << ec.message();
+    ret = -1;
+  } else {
+    std::filesystem::rename(GetStagingPath(path_), path_, ec);
+  }
+  CreateDB(path_);
+  if (block_cache_) {
+    block_cache_->Flush();
+  }
+  if (digest_enabled) {
+    EnableStateDigestInternal();
+  }
+  return ret;
+}
+
+void ResLevelDB::ClearStagedSnapshot() {
+  staged_digest_.reset();
+  staging_store_.reset();
+  staging_batch_.Clear();
+  if (staging_db_ != nullptr) {
+    staging_db_.reset();
+    leveldb::DestroyDB(GetStagingPath(path_), leveldb::Options());
+  }
+}
+
 int ResLevelDB::SetValueWithVersion(const std::string& key,
                                     const std::string& value, int version) {
-  std::string value_str = GetValue(key);
+  std::shared_lock<std::shared_mutex> lk(db_mutex_);
+  std::string value_str = GetValueInternal(key);
   ValueHistory history;
   if (!history.ParseFromString(value_str)) {
     LOG(ERROR) << "old_value parse fail";
@@ -263,12 +683,13 @@ int ResLevelDB::SetValueWithVersion(const std::string& key,
   new_value->set_version(version + 1);
 
   history.SerializeToString(&value_str);
-  return SetValue(key, value_str);
+  return SetValueInternal(key, value_str);
 }
 
 std::pair<std::string, int> ResLevelDB::GetValueWithVersion(
     const std::string& key, int version) {
-  std::string value_str = GetValue(key);
+  std::shared_lock<std::shared_mutex> lk(db_mutex_);
+  std::string value_str = GetValueInternal(key);
   ValueHistory history;
   if (!history.ParseFromString(value_str)) {
     LOG(ERROR) << "old_value parse fail";
@@ -296,10 +717,12 @@ std::pair<std::string, int> ResLevelDB::GetValueWithVersion(
 // Return a map of <key, <value, version>>
 std::map<std::string, std::vector<std::pair<std::string, uint64_t>>>
 ResLevelDB::GetAllItemsWithSeq() {
+  std::shared_lock<std::shared_mutex> lk(db_mutex_);
   std::map<std::string, std::vector<std::pair<std::string, uint64_t>>> resp;
 
   leveldb::Iterator* it = db_->NewIterator(leveldb::ReadOptions());
-  for (it->SeekToFirst(); it->Valid(); it->Next()) {
+  for (it->SeekToFirst(), SkipLocalKeys(it); it->Valid();
+       it->Next(), SkipLocalKeys(it)) {
     ValueHistory history;
     if (!history.ParseFromString(it->value().ToString()) ||
         history.value_size() == 0) {
@@ -319,10 +742,12 @@ ResLevelDB::GetAllItemsWithSeq() {
 
 // Return a map of <key, <value, version>>
 std::map<std::string, std::pair<std::string, int>> ResLevelDB::GetAllItems() {
+  std::shared_lock<std::shared_mutex> lk(db_mutex_);
   std::map<std::string, std::pair<std::string, int>> resp;
 
   leveldb::Iterator* it = db_->NewIterator(leveldb::ReadOptions());
-  for (it->SeekToFirst(); it->Valid(); it->Next()) {
+  for (it->SeekToFirst(), SkipLocalKeys(it); it->Valid();
+       it->Next(), SkipLocalKeys(it)) {
     ValueHistory history;
     if (!history.ParseFromString(it->value().ToString()) ||
         history.value_size() == 0) {
@@ -340,11 +765,13 @@ std::map<std::string, std::pair<std::string, int>> ResLevelDB::GetAllItems() {
 
 std::map<std::string, std::pair<std::string, int>> ResLevelDB::GetKeyRange(
     const std::string& min_key, const std::string& max_key) {
+  std::shared_lock<std::shared_mutex> lk(db_mutex_);
   std::map<std::string, std::pair<std::string, int>> resp;
 
   leveldb::Iterator* it = db_->NewIterator(leveldb::ReadOptions());
-  for (it->Seek(min_key); it->Valid() && it->key().ToString() <= max_key;
-       it->Next()) {
+  for (it->Seek(min_key), SkipLocalKeys(it);
+       it->Valid() && it->key().ToString() <= max_key;
+       it->Next(), SkipLocalKeys(it)) {
     ValueHistory history;
     if (!history.ParseFromString(it->value().ToString()) ||
         history.value_size() == 0) {
@@ -363,8 +790,9 @@ std::map<std::string, std::pair<std::string, int>> ResLevelDB::GetKeyRange(
 // Return a list of <value, version>
 std::vector<std::pair<std::string, int>> ResLevelDB::GetHistory(
     const std::string& key, int min_version, int max_version) {
+  std::shared_lock<std::shared_mutex> lk(db_mutex_);
   std::vector<std::pair<std::string, int>> resp;
-  std::string value_str = GetValue(key);
+  std::string value_str = GetValueInternal(key);
   ValueHistory history;
   if (!history.ParseFromString(value_str)) {
     LOG(ERROR) << "old_value parse fail";
@@ -387,8 +815,9 @@ std::vector<std::pair<std::string, int>> ResLevelDB::GetHistory(
 // Return a list of <value, version>
 std::vector<std::pair<std::string, int>> ResLevelDB::GetTopHistory(
     const std::string& key, int top_number) {
+  std::shared_lock<std::shared_mutex> lk(db_mutex_);
   std::vector<std::pair<std::string, int>> resp;
-  std::string value_str = GetValue(key);
+  std::string value_str = GetValueInternal(key);
   ValueHistory history;
   if (!history.ParseFromString(value_str)) {
     LOG(ERROR) << "old_value parse fail";
@@ -404,8 +833,6 @@ std::vector<std::pair<std::string, int>> ResLevelDB::GetTopHistory(
   return resp;
 }
 
-const std::string ckpt_key = "leveldb_checkpoint";
-
 void ResLevelDB::UpdateLastCkpt(uint64_t seq) {
   LOG(ERROR) << " update ckpt seq:" << seq << " last:" << last_ckpt_
              << " update time:" << update_time_;
@@ -415,18 +842,23 @@ void ResLevelDB::UpdateLastCkpt(uint64_t seq) {
   last_ckpt_ = seq;
   update_time_++;
   if (update_time_ % 100 == 0 && last_ckpt_ > 0) {
-    SetLastCheckpoint(last_ckpt_);
+    SetLastCheckpointInternal(last_ckpt_);
     update_time_ = 0;
   }
 }
 
 int ResLevelDB::SetLastCheckpoint(uint64_t ckpt) {
+  std::shared_lock<std::shared_mutex> lk(db_mutex_);
+  return SetLastCheckpointInternal(ckpt);
+}
+
+int ResLevelDB::SetLastCheckpointInternal(uint64_t ckpt) {
   LOG(ERROR) << " update last ckpt :" << ckpt;
-  return SetValue(ckpt_key, std::to_string(ckpt));
+  return SetValueInternal(ckpt_key, std::to_string(ckpt));
 }
 
 uint64_t ResLevelDB::GetLastCheckpointInternal() {
-  std::string value = GetValue(ckpt_key);
+  std::string value = GetValueInternal(ckpt_key);
   if (value.empty()) {
     return 0;
   }
@@ -434,6 +866,7 @@ uint64_t ResLevelDB::GetLastCheckpointInternal() {
 }
 
 uint64_t ResLevelDB::GetLastCheckpoint() {
+  std::shared_lock<std::shared_mutex> lk(db_mutex_);
   if (last_ckpt_ > 0) {
     return last_ckpt_;
   }
@@ -20,7 +20,9 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <shared_mutex>
 #include <string>
 
 #include "chain/storage/proto/leveldb_config.pb.h"
@@ -33,6 +35,8 @@
 namespace resdb {
 namespace storage {
 
+class LevelDBLeafStore;
+
 std::unique_ptr<Storage> NewResLevelDB(
     const std::string& path, std::optional<LevelDBInfo> config = std::nullopt);
 std::unique_ptr<Storage> NewResLevelDB(
@@ -47,10 +51,13 @@ class ResLevelDB : public Storage {
                       uint64_t seq) override;
   int SetValue(const std::string& key, const std::string& value) override;
   std::string GetValue(const std::string& key) override;
+  int DelValue(const std::string& key) override;
   std::pair<std::string, uint64_t> GetValueWithSeq(const std::string& key,
                                                    uint64_t seq) override;
   std::string GetRange(const std::string& min_key,
                        const std::string& max_key) override;
+  std::vector<std::pair<std::string, std::string>> GetValuesWithPrefix(
+      const std::string& prefix) override;
 
   int SetValueWithVersion(const std::string& key, const std::string& value,
                           int version) override;
@@ -76,20 +83,57 @@ class ResLevelDB : public Storage {
 
   bool Flush() override;
 
+  // The digest is saved with the data and loaded back on the next run. It is
+  // only rebuilt from the data if some writes missed it.
+  void EnableStateDigest() override;
+
+  bool CreateSnapshot(uint64_t seq) override;
+  int ReadSnapshot(
+      uint64_t seq, const std::string& start_key, size_t max_bytes,
+      std::vector<std::pair<std::string, std::string>>* items) override;
+  // The chunks are staged in a LevelDB next to the data, which replaces the
+  // data directory when the snapshot is applied.
+  int StageSnapshot(
+      const std::vector<std::pair<std::string, std::string>>& items) override;
+  // Waits for the other calls to finish, the data is not used meanwhile.
+  int ApplySnapshot() override;
+  void ClearStagedSnapshot() override;
+
   virtual uint64_t GetLastCheckpoint() override;
 
   virtual int SetLastCheckpoint(uint64_t ckpt);
 
  private:
   void CreateDB(const std::string& path);
+  // The *Internal() calls expect db_mutex_ to be held.
+  int SetValueInternal(const std::string& key, const std::string& value);
+  std::string GetValueInternal(const std::string& key);
+  bool FlushInternal();
+  bool UpdateMetricsInternal();
+  void EnableStateDigestInternal();
+  int SetLastCheckpointInternal(uint64_t ckpt);
+  void NewStateDigest();
+  int WriteStagingBatch();
   uint64_t GetLastCheckpointInternal();
   void UpdateLastCkpt(uint64_t seq);
 
  private:
+  // Held shared by the calls that use db_ and unique while it is replaced.
+  std::shared_mutex db_mutex_;
   std::unique_ptr<leveldb::DB> db_ = nullptr;
+  std::unique_ptr<leveldb::DB> staging_db_ = nullptr;
+  std::string path_;
   ::leveldb::WriteBatch batch_;
+  ::leveldb::WriteBatch staging_batch_;
+  // Owned by state_digest_.
+  LevelDBLeafStore* leaf_store_ = nullptr;
+  std::unique_ptr<LevelDBLeafStore> staging_store_;
+  std::string digest_meta_;
   unsigned int write_buffer_size_ = 64 << 20;
   unsigned int write_batch_size_ = 1;
+  std::mutex snapshot_mutex_;
+  std::map<uint64_t, const leveldb::Snapshot*> snapshots_;
+  static constexpr size_t kMaxRebuildBatchSize = 4 << 20;
 
  protected:
   Stats* global_stats_ = nullptr;
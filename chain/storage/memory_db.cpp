@@ -21,20 +21,33 @@
 
 #include <glog/logging.h>
 
+#include "chain/storage/proto/kv.pb.h"
+
 namespace resdb {
 namespace storage {
 
+namespace {
+
+std::string GetSnapshotKey(StateDigest::Namespace ns, const std::string& key) {
+  return static_cast<char>(ns) + key;
+}
+
+}  // namespace
+
 std::unique_ptr<Storage> NewMemoryDB() { return std::make_unique<MemoryDB>(); }
 
 MemoryDB::MemoryDB() {}
 
 int MemoryDB::SetValue(const std::string& key, const std::string& value) {
+  std::unique_lock<std::shared_mutex> lk(mutex_);
   kv_map_[key] = value;
+  UpdateStateDigest(key, value);
   return 0;
 }
 
 std::string MemoryDB::GetRange(const std::string& min_key,
                                const std::string& max_key) {
+  std::shared_lock<std::shared_mutex> lk(mutex_);
   std::string values = "[";
   bool first_iteration = true;
   for (auto kv : kv_map_) {
@@ -48,7 +61,20 @@ std::string MemoryDB::GetRange(const std::string& min_key,
   return values;
 }
 
+std::vector<std::pair<std::string, std::string>> MemoryDB::GetValuesWithPrefix(
+    const std::string& prefix) {
+  std::shared_lock<std::shared_mutex> lk(mutex_);
+  std::vector<std::pair<std::string, std::string>> resp;
+  for (auto it = kv_map_.lower_bound(prefix);
+       it != kv_map_.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+       ++it) {
+    resp.push_back(*it);
+  }
+  return resp;
+}
+
 std::string MemoryDB::GetValue(const std::string& key) {
+  std::shared_lock<std::shared_mutex> lk(mutex_);
   auto search = kv_map_.find(key);
   if (search != kv_map_.end())
     return search->second;
@@ -57,8 +83,16 @@ std::string MemoryDB::GetValue(const std::string& key) {
   }
 }
 
+int MemoryDB::DelValue(const std::string& key) {
+  std::unique_lock<std::shared_mutex> lk(mutex_);
+  kv_map_.erase(key);
+  RemoveStateDigest(key);
+  return 0;
+}
+
 std::pair<std::string, uint64_t> MemoryDB::GetValueWithSeq(
     const std::string& key, uint64_t seq) {
+  std::shared_lock<std::shared_mutex> lk(mutex_);
   auto search_it = kv_map_with_seq_.find(key);
   if (search_it != kv_map_with_seq_.end() && search_it->second.size()) {
     auto it = search_it->second.end();
@@ -78,6 +112,7 @@ std::pair<std::string, uint64_t> MemoryDB::GetValueWithSeq(
 
 int MemoryDB::SetValueWithSeq(const std::string& key, const std::string& value,
                               uint64_t seq) {
+  std::unique_lock<std::shared_mutex> lk(mutex_);
   auto it = kv_map_with_seq_.find(key);
   if (it != kv_map_with_seq_.end() && it->second.back().second > seq) {
     LOG(ERROR) << " value seq not match. key:" << key << " db seq:"
@@ -89,11 +124,13 @@ int MemoryDB::SetValueWithSeq(const std::string& key, const std::string& value,
   while (kv_map_with_seq_[key].size() > max_history_) {
     kv_map_with_seq_[key].erase(kv_map_with_seq_[key].begin());
   }
+  UpdateStateDigest(key, value, seq, StateDigest::SEQ);
   return 0;
 }
 
 int MemoryDB::SetValueWithVersion(const std::string& key,
                                   const std::string& value, int version) {
+  std::unique_lock<std::shared_mutex> lk(mutex_);
   auto it = kv_map_with_v_.find(key);
   if ((it == kv_map_with_v_.end() && version != 0) ||
       (it != kv_map_with_v_.end() && it->second.back().second != version)) {
@@ -103,11 +140,13 @@ int MemoryDB::SetValueWithVersion(const std::string& key,
     return -2;
   }
   kv_map_with_v_[key].push_back(std::make_pair(value, version + 1));
+  UpdateStateDigest(key, value, version + 1, StateDigest::VERSION);
   return 0;
 }
 
 std::pair<std::string, int> MemoryDB::GetValueWithVersion(
     const std::string& key, int version) {
+  std::shared_lock<std::shared_mutex> lk(mutex_);
   auto search_it = kv_map_with_v_.find(key);
   if (search_it != kv_map_with_v_.end() && search_it->second.size()) {
     auto it = search_it->second.end();
@@ -130,6 +169,7 @@ std::pair<std::string, int> MemoryDB::GetValueWithVersion(
 
 std::map<std::string, std::vector<std::pair<std::string, uint64_t>>>
 MemoryDB::GetAllItemsWithSeq() {
+  std::shared_lock<std::shared_mutex> lk(mutex_);
   std::map<std::string, std::vector<std::pair<std::string, uint64_t>>> resp;
   for (const auto& it : kv_map_with_seq_) {
     LOG(ERROR) << " value num:" << it.second.size();
@@ -141,6 +181,7 @@ MemoryDB::GetAllItemsWithSeq() {
 }
 
 std::map<std::string, std::pair<std::string, int>> MemoryDB::GetAllItems() {
+  std::shared_lock<std::shared_mutex> lk(mutex_);
   std::map<std::string, std::pair<std::string, int>> resp;
 
   for (const auto& it : kv_map_with_v_) {
@@ -151,6 +192,7 @@ std::map<std::string, std::pair<std::string, int>> MemoryDB::GetAllItems() {
 
 std::map<std::string, std::pair<std::string, int>> MemoryDB::GetKeyRange(
     const std::string& min_key, const std::string& max_key) {
+  std::shared_lock<std::shared_mutex> lk(mutex_);
   LOG(ERROR) << "min key:" << min_key << " max key:" << max_key;
   std::map<std::string, std::pair<std::string, int>> resp;
   for (const auto& it : kv_map_with_v_) {
@@ -163,6 +205,7 @@ std::map<std::string, std::pair<std::string, int>> MemoryDB::GetKeyRange(
 
 std::vector<std::pair<std::string, int>> MemoryDB::GetHistory(
     const std::string& key, int min_version, int max_version) {
+  std::shared_lock<std::shared_mutex> lk(mutex_);
   std::vector<std::pair<std::string, int>> resp;
   auto search_it = kv_map_with_v_.find(key);
   if (search_it == kv_map_with_v_.end()) {
@@ -184,6 +227,7 @@ std::vector<std::pair<std::string, int>> MemoryDB::GetHistory(
 
 std::vector<std::pair<std::string, int>> MemoryDB::GetTopHistory(
     const std::string& key, int top_number) {
+  std::shared_lock<std::shared_mutex> lk(mutex_);
   std::vector<std::pair<std::string, int>> resp;
   auto search_it = kv_map_with_v_.find(key);
   if (search_it == kv_map_with_v_.end()) {
@@ -201,5 +245,156 @@ std::vector<std::pair<std::string, int>> MemoryDB::GetTopHistory(
   return resp;
 }
 
+void MemoryDB::EnableStateDigest() {
+  std::unique_lock<std::shared_mutex> lk(mutex_);
+  EnableStateDigestInternal();
+}
+
+void MemoryDB::EnableStateDigestInternal() {
+  if (state_digest_ != nullptr) {
+    return;
+  }
+  Storage::EnableStateDigest();
+  // Seed the digest with the data written before it was enabled.
+  for (const auto& it : kv_map_) {
+    UpdateStateDigest(it.first, it.second);
+  }
+  for (const auto& it : kv_map_with_v_) {
+    UpdateStateDigest(it.first, it.second.back().first,
+                      it.second.back().second, StateDigest::VERSION);
+  }
+  for (const auto& it : kv_map_with_seq_) {
+    UpdateStateDigest(it.first, it.second.back().first,
+                      it.second.back().second, StateDigest::SEQ);
+  }
+}
+
+bool MemoryDB::CreateSnapshot(uint64_t seq) {
+  std::shared_lock<std::shared_mutex> db_lk(mutex_);
+  auto snapshot = std::make_shared<std::map<std::string, std::string>>();
+  for (const auto& it : kv_map_) {
+    snapshot->emplace(GetSnapshotKey(StateDigest::PLAIN, it.first),
+                      it.second);
+  }
+  for (const auto& it : kv_map_with_v_) {
+    ValueHistory history;
+    for (const auto& value : it.second) {
+      Value* new_value = history.add_value();
+      new_value->set_value(value.first);
+      new_value->set_version(value.second);
+    }
+    history.SerializeToString(
+        &(*snapshot)[GetSnapshotKey(StateDigest::VERSION, it.first)]);
+  }
+  for (const auto& it : kv_map_with_seq_) {
+    ValueHistory history;
+    for (const auto& value : it.second) {
+      Value* new_value = history.add_value();
+      new_value->set_value(value.first);
+      new_value->set_seq(value.second);
+    }
+    history.SerializeToString(
+        &(*snapshot)[GetSnapshotKey(StateDigest::SEQ, it.first)]);
+  }
+  std::lock_guard<std::mutex> lk(snapshot_mutex_);
+  snapshots_[seq] = std::move(snapshot);
+  while (snapshots_.size() > kMaxSnapshotNum) {
+    snapshots_.erase(snapshots_.begin());
+  }
+  return true;
+}
+
+int MemoryDB::ReadSnapshot(
+    uint64_t seq, const std::string& start_key, size_t max_bytes,
+    std::vector<std::pair<std::string, std::string>>* items) {
+  std::shared_ptr<std::map<std::string, std::string>> snapshot;
+  {
+    std::lock_guard<std::mutex> lk(snapshot_mutex_);
+    auto it = snapshots_.find(seq);
+    if (it == snapshots_.end()) {
+      return -1;
+    }
+    snapshot = it->second;
+  }
+  auto it = start_key.empty() ? snapshot->begin()
+                              : snapshot->upper_bound(start_key);
+  size_t bytes = 0;
+  for (; it != snapshot->end() && bytes < max_bytes; ++it) {
+    bytes += it->first.size() + it->second.size();
+    items->push_back(*it);
+  }
+  return it == snapshot->end() ? 1 : 0;
+}
+
+int MemoryDB::StageSnapshot(
+    const std::vector<std::pair<std::string, std::string>>& items) {
+  if (staged_digest_ == nullptr) {
+    staged_digest_ = std::make_unique<StateDigestBuilder>();
+  }
+  for (const auto& item : items) {
+    if (item.first.empty()) {
+      LOG(ERROR) << "invalid snapshot key";
+      return -2;
+    }
+    auto ns = static_cast<StateDigest::Namespace>(item.first[0]);
+    std::string key = item.first.substr(1);
+    if (ns == StateDigest::PLAIN) {
+      if (!staged_digest_->Add(key, item.second)) {
+        LOG(ERROR) << "snapshot key out of order:" << key;
+        return -2;
+      }
+      staged_kv_map_[key] = item.second;
+      continue;
+    }
+
+    ValueHistory history;
+    if ((ns != StateDigest::VERSION && ns != StateDigest::SEQ) ||
+        !history.ParseFromString(item.second) || history.value_size() == 0) {
+      LOG(ERROR) << "invalid snapshot value, key:" << key;
+      return -2;
+    }
+    const Value& last = history.value(history.value_size() - 1);
+    if (!staged_digest_->Add(
+            key, last.value(),
+            ns == StateDigest::VERSION ? last.version() : last.seq(), ns)) {
+      LOG(ERROR) << "snapshot key out of order:" << key;
+      return -2;
+    }
+    for (const auto& value : history.value()) {
+      if (ns == StateDigest::VERSION) {
+        staged_kv_map_with_v_[key].push_back(
+            std::make_pair(value.value(), value.version()));
+      } else {
+        staged_kv_map_with_seq_[key].push_back(
+            std::make_pair(value.value(), value.seq()));
+      }
+    }
+  }
+  return 0;
+}
+
+int MemoryDB::ApplySnapshot() {
+  if (staged_digest_ == nullptr) {
+    return -1;
+  }
+  std::unique_lock<std::shared_mutex> lk(mutex_);
+  kv_map_.swap(staged_kv_map_);
+  kv_map_with_v_.swap(staged_kv_map_with_v_);
+  kv_map_with_seq_.swap(staged_kv_map_with_seq_);
+  ClearStagedSnapshot();
+  if (state_digest_ != nullptr) {
+    state_digest_.reset();
+    EnableStateDigestInternal();
+  }
+  return 0;
+}
+
+void MemoryDB::ClearStagedSnapshot() {
+  staged_kv_map_.clear();
+  staged_kv_map_with_v_.clear();
+  staged_kv_map_with_seq_.clear();
+  staged_digest_.reset();
+}
+
 }  // namespace storage
 }  // namespace resdb
@@ -22,6 +22,8 @@
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <unordered_map>
 
 #include "chain/storage/storage.h"
@@ -57,11 +59,14 @@ class MemoryDB : public Storage {
                       uint64_t seq) override;
   int SetValue(const std::string& key, const std::string& value) override;
   std::string GetValue(const std::string& key) override;
+  int DelValue(const std::string& key) override;
   std::pair<std::string, uint64_t> GetValueWithSeq(const std::string& key,
                                                    uint64_t seq) override;
 
   std::string GetRange(const std::string& min_key,
                        const std::string& max_key) override;
+  std::vector<std::pair<std::string, std::string>> GetValuesWithPrefix(
+      const std::string& prefix) override;
 
   int SetValueWithVersion(const std::string& key, const std::string& value,
                           int version) override;
@@ -83,12 +88,40 @@ class MemoryDB : public Storage {
   std::vector<std::pair<std::string, int>> GetTopHistory(const std::string& key,
                                                          int number) override;
 
+  void EnableStateDigest() override;
+
+  // A snapshot covers the values set with and without a version or seq: the
+  // key of an item is prefixed with its StateDigest::Namespace and the value
+  // of a versioned or seq key is its serialized ValueHistory.
+  bool CreateSnapshot(uint64_t seq) override;
+  int ReadSnapshot(
+      uint64_t seq, const std::string& start_key, size_t max_bytes,
+      std::vector<std::pair<std::string, std::string>>* items) override;
+  int StageSnapshot(
+      const std::vector<std::pair<std::string, std::string>>& items) override;
+  int ApplySnapshot() override;
+  void ClearStagedSnapshot() override;
+
+ private:
+  void EnableStateDigestInternal();
+
  private:
-  std::unordered_map<std::string, std::string> kv_map_;
+  // Held shared by the reads and unique by the writes, so that the maps can
+  // be swapped by ApplySnapshot().
+  std::shared_mutex mutex_;
+  std::map<std::string, std::string> kv_map_;
   std::unordered_map<std::string, std::list<std::pair<std::string, int>>>
       kv_map_with_v_;
   std::unordered_map<std::string, std::list<std::pair<std::string, uint64_t>>>
       kv_map_with_seq_;
+  std::map<std::string, std::string> staged_kv_map_;
+  std::unordered_map<std::string, std::list<std::pair<std::string, int>>>
+      staged_kv_map_with_v_;
+  std::unordered_map<std::string, std::list<std::pair<std::string, uint64_t>>>
+      staged_kv_map_with_seq_;
+  std::mutex snapshot_mutex_;
+  std::map<uint64_t, std::shared_ptr<std::map<std::string, std::string>>>
+      snapshots_;
 };
 
 }  // namespace storage
@@ -31,12 +31,16 @@ class MockStorage : public Storage {
   using ItemsType = std::map<std::string, ValueType>;
   using ValuesType = std::vector<ValueType>;
   using ValuesSeqType = std::map<std::string, std::vector<ValueSeqType>>;
+  using KeyValuesType = std::vector<std::pair<std::string, std::string>>;
 
   MOCK_METHOD(int, SetValue, (const std::string& key, const std::string& value),
               (override));
   MOCK_METHOD(std::string, GetValue, (const std::string& key), (override));
+  MOCK_METHOD(int, DelValue, (const std::string& key), (override));
   MOCK_METHOD(std::string, GetRange, (const std::string&, const std::string&),
               (override));
+  MOCK_METHOD(KeyValuesType, GetValuesWithPrefix, (const std::string&),
+              (override));
   MOCK_METHOD(ValueSeqType, GetValueWithSeq, (const std::string& key, uint64_t),
               (override));
 
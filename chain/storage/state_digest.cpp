@@ -0,0 +1,350 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "chain/storage/state_digest.h"
+
+#include <cryptopp/shake.h>
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "common/crypto/hash.h"
+
+namespace resdb {
+
+namespace {
+
+void AppendUint64(uint64_t v, std::string* out) {
+  for (int i = 0; i < 8; ++i) {
+    out->push_back(static_cast<char>((v >> (i * 8)) & 0xff));
+  }
+}
+
+std::string HashNode(const std::string& left, const std::string& right) {
+  return utils::CalculateSHA256Hash(left + right);
+}
+
+uint32_t RoundUpBucketNum(uint32_t bucket_num) {
+  uint32_t num = 1;
+  while (num < bucket_num) {
+    num <<= 1;
+  }
+  return num;
+}
+
+// FNV-1a, so that every replica maps a key to the same bucket.
+uint32_t GetBucket(const std::string& key, uint32_t bucket_num) {
+  uint32_t h = 2166136261u;
+  for (unsigned char c : key) {
+    h = (h ^ c) * 16777619u;
+  }
+  return h & (bucket_num - 1);
+}
+
+std::string GetLeafKey(const std::string& key, StateDigest::Namespace ns) {
+  return static_cast<char>(ns) + key;
+}
+
+std::string HashLeaf(const std::string& key, const std::string& value,
+                     uint64_t version, StateDigest::Namespace ns) {
+  std::string data;
+  data.reserve(key.size() + value.size() + 25);
+  data.push_back(static_cast<char>(ns));
+  AppendUint64(key.size(), &data);
+  data.append(key);
+  AppendUint64(value.size(), &data);
+  data.append(value);
+  AppendUint64(version, &data);
+  return utils::CalculateSHA256Hash(data);
+}
+
+// Expand a leaf to the lanes of a BucketHash.
+std::vector<uint16_t> ExpandLeaf(const std::string& leaf) {
+  std::string out(BucketHash::kLaneNum * 2, 0);
+  CryptoPP::SHAKE256 shake(out.size());
+  shake.CalculateDigest(reinterpret_cast<CryptoPP::byte*>(out.data()),
+                        reinterpret_cast<const CryptoPP::byte*>(leaf.data()),
+                        leaf.size());
+  std::vector<uint16_t> lanes(BucketHash::kLaneNum);
+  for (size_t i = 0; i < lanes.size(); ++i) {
+    lanes[i] = static_cast<uint8_t>(out[i * 2]) |
+               (static_cast<uint8_t>(out[i * 2 + 1]) << 8);
+  }
+  return lanes;
+}
+
+class MemoryLeafStore : public StateDigest::LeafStore {
+ public:
+  bool Get(const std::string& key, std::string* leaf) override {
+    auto it = leaves_.find(key);
+    if (it == leaves_.end()) {
+      return false;
+    }
+    *leaf = it->second;
+    return true;
+  }
+
+  void Put(const std::string& key, const std::string& leaf) override {
+    leaves_[key] = leaf;
+  }
+
+  void Delete(const std::string& key) override { leaves_.erase(key); }
+
+ private:
+  std::unordered_map<std::string, std::string> leaves_;
+};
+
+}  // namespace
+
+void BucketHash::Add(const std::string& leaf) {
+  if (lanes_.empty()) {
+    lanes_.resize(kLaneNum, 0);
+  }
+  std::vector<uint16_t> lanes = ExpandLeaf(leaf);
+  for (size_t i = 0; i < kLaneNum; ++i) {
+    lanes_[i] += lanes[i];
+  }
+  num_++;
+}
+
+void BucketHash::Remove(const std::string& leaf) {
+  if (num_ == 0) {
+    return;
+  }
+  if (--num_ == 0) {
+    lanes_.clear();
+    return;
+  }
+  std::vector<uint16_t> lanes = ExpandLeaf(leaf);
+  for (size_t i = 0; i < kLaneNum; ++i) {
+    lanes_[i] -= lanes[i];
+  }
+}
+
+std::string BucketHash::GetHash() const {
+  if (num_ == 0) {
+    return "";
+  }
+  return utils::CalculateSHA256Hash(Serialize());
+}
+
+std::string BucketHash::Serialize() const {
+  if (num_ == 0) {
+    return "";
+  }
+  std::string data;
+  data.reserve(8 + kLaneNum * 2);
+  AppendUint64(num_, &data);
+  for (uint16_t lane : lanes_) {
+    data.push_back(static_cast<char>(lane & 0xff));
+    data.push_back(static_cast<char>(lane >> 8));
+  }
+  return data;
+}
+
+bool BucketHash::Parse(const std::string& data) {
+  num_ = 0;
+  lanes_.clear();
+  if (data.empty()) {
+    return true;
+  }
+  if (data.size() != 8 + kLaneNum * 2) {
+    return false;
+  }
+  for (int i = 7; i >= 0; --i) {
+    num_ = (num_ << 8) | static_cast<uint8_t>(data[i]);
+  }
+  if (num_ == 0) {
+    return false;
+  }
+  lanes_.resize(kLaneNum);
+  for (size_t i = 0; i < kLaneNum; ++i) {
+    lanes_[i] = static_cast<uint8_t>(data[8 + i * 2]) |
+                (static_cast<uint8_t>(data[9 + i * 2]) << 8);
+  }
+  return true;
+}
+
+StateDigest::StateDigest(uint32_t bucket_num,
+                         std::unique_ptr<LeafStore> store) {
+  bucket_num_ = RoundUpBucketNum(bucket_num);
+  store_ = std::move(store);
+  if (store_ == nullptr) {
+    store_ = std::make_unique<MemoryLeafStore>();
+  }
+  buckets_.resize(bucket_num_);
+  is_dirty_.resize(bucket_num_, false);
+  is_unsaved_.resize(bucket_num_, false);
+  tree_.resize(bucket_num_ * 2);
+  for (uint32_t i = bucket_num_ - 1; i >= 1; --i) {
+    tree_[i] = HashNode(tree_[i * 2], tree_[i * 2 + 1]);
+  }
+}
+
+void StateDigest::MarkDirty(uint32_t bucket) {
+  if (!is_dirty_[bucket]) {
+    is_dirty_[bucket] = true;
+    dirty_.push_back(bucket);
+  }
+  if (!is_unsaved_[bucket]) {
+    is_unsaved_[bucket] = true;
+    unsaved_.push_back(bucket);
+  }
+}
+
+void StateDigest::Update(const std::string& key, const std::string& value,
+                         uint64_t version, Namespace ns) {
+  std::string leaf = HashLeaf(key, value, version, ns);
+  std::string leaf_key = GetLeafKey(key, ns);
+  uint32_t bucket = GetBucket(key, bucket_num_);
+  std::lock_guard<std::mutex> lk(mutex_);
+  std::string old_leaf;
+  if (store_->Get(leaf_key, &old_leaf)) {
+    if (old_leaf == leaf) {
+      return;
+    }
+    buckets_[bucket].Remove(old_leaf);
+  }
+  buckets_[bucket].Add(leaf);
+  store_->Put(leaf_key, leaf);
+  MarkDirty(bucket);
+}
+
+void StateDigest::Remove(const std::string& key, Namespace ns) {
+  std::string leaf_key = GetLeafKey(key, ns);
+  uint32_t bucket = GetBucket(key, bucket_num_);
+  std::lock_guard<std::mutex> lk(mutex_);
+  std::string old_leaf;
+  if (!store_->Get(leaf_key, &old_leaf)) {
+    return;
+  }
+  buckets_[bucket].Remove(old_leaf);
+  store_->Delete(leaf_key);
+  MarkDirty(bucket);
+}
+
+std::string StateDigest::GetRoot() {
+  std::lock_guard<std::mutex> lk(mutex_);
+  if (dirty_.empty()) {
+    return tree_[1];
+  }
+  std::vector<uint32_t> nodes;
+  nodes.reserve(dirty_.size());
+  for (uint32_t bucket : dirty_) {
+    tree_[bucket_num_ + bucket] = buckets_[bucket].GetHash();
+    is_dirty_[bucket] = false;
+    nodes.push_back(bucket_num_ + bucket);
+  }
+  dirty_.clear();
+
+  // Rehash the touched paths level by level so that shared parents are only
+  // computed once.
+  std::sort(nodes.begin(), nodes.end());
+  while (nodes[0] > 1) {
+    size_t num = 0;
+    for (uint32_t node : nodes) {
+      uint32_t parent = node / 2;
+      if (num == 0 || nodes[num - 1] != parent) {
+        nodes[num++] = parent;
+      }
+    }
+    nodes.resize(num);
+    for (uint32_t node : nodes) {
+      tree_[node] = HashNode(tree_[node * 2], tree_[node * 2 + 1]);
+    }
+  }
+  return tree_[1];
+}
+
+void StateDigest::Save() {
+  std::lock_guard<std::mutex> lk(mutex_);
+  for (uint32_t bucket : unsaved_) {
+    store_->PutBucket(bucket, buckets_[bucket].Serialize());
+    is_unsaved_[bucket] = false;
+  }
+  unsaved_.clear();
+}
+
+bool StateDigest::Load() {
+  std::lock_guard<std::mutex> lk(mutex_);
+  for (uint32_t i = 0; i < bucket_num_; ++i) {
+    std::string state;
+    if (!store_->GetBucket(i, &state)) {
+      state.clear();
+    }
+    if (!buckets_[i].Parse(state)) {
+      return false;
+    }
+    if (!buckets_[i].Empty()) {
+      MarkDirty(i);
+    }
+  }
+  // The states come from the store.
+  std::fill(is_unsaved_.begin(), is_unsaved_.end(), false);
+  unsaved_.clear();
+  return true;
+}
+
+StateDigestBuilder::StateDigestBuilder(uint32_t bucket_num,
+                                       StateDigest::LeafStore* store)
+    : bucket_num_(RoundUpBucketNum(bucket_num)),
+      store_(store),
+      buckets_(bucket_num_) {}
+
+StateDigestBuilder::~StateDigestBuilder() = default;
+
+bool StateDigestBuilder::Add(const std::string& key, const std::string& value,
+                             uint64_t version, StateDigest::Namespace ns) {
+  std::string leaf_key = GetLeafKey(key, ns);
+  if (has_key_ && leaf_key <= last_key_) {
+    return false;
+  }
+  std::string leaf = HashLeaf(key, value, version, ns);
+  buckets_[GetBucket(key, bucket_num_)].Add(leaf);
+  if (store_ != nullptr) {
+    store_->Put(leaf_key, leaf);
+  }
+  has_key_ = true;
+  last_key_ = std::move(leaf_key);
+  return true;
+}
+
+std::string StateDigestBuilder::GetRoot() {
+  std::vector<std::string> tree(bucket_num_ * 2);
+  for (uint32_t i = 0; i < bucket_num_; ++i) {
+    tree[bucket_num_ + i] = buckets_[i].GetHash();
+  }
+  for (uint32_t i = bucket_num_ - 1; i >= 1; --i) {
+    tree[i] = HashNode(tree[i * 2], tree[i * 2 + 1]);
+  }
+  return tree[1];
+}
+
+void StateDigestBuilder::Save() {
+  if (store_ == nullptr) {
+    return;
+  }
+  for (uint32_t i = 0; i < bucket_num_; ++i) {
+    if (!buckets_[i].Empty()) {
+      store_->PutBucket(i, buckets_[i].Serialize());
+    }
+  }
+}
+
+}  // namespace resdb
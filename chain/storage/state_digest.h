@@ -0,0 +1,146 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace resdb {
+
+// BucketHash is an additive multiset hash (LtHash16) over the leaves of a
+// bucket: a leaf is expanded to kLaneNum 16-bit lanes that are added to the
+// sum, so a leaf is added or removed without reading the other leaves.
+class BucketHash {
+ public:
+  static constexpr size_t kLaneNum = 1024;
+
+  void Add(const std::string& leaf);
+  void Remove(const std::string& leaf);
+  bool Empty() const { return num_ == 0; }
+
+  // Return the hash of the sum, or empty if there is no leaf.
+  std::string GetHash() const;
+
+  std::string Serialize() const;
+  bool Parse(const std::string& data);
+
+ private:
+  uint64_t num_ = 0;
+  // Allocated with the first leaf.
+  std::vector<uint16_t> lanes_;
+};
+
+// StateDigest keeps an authenticated digest of a key/value state that can be
+// updated incrementally. Keys are spread over a fixed number of buckets, each
+// summed up by a BucketHash, and the root is a binary Merkle tree over the
+// bucket hashes. Only the buckets touched since the last GetRoot() and their
+// paths to the root are rehashed.
+class StateDigest {
+ public:
+  // The key spaces of a storage. The same key in two namespaces is two
+  // different leaves.
+  enum Namespace : uint8_t {
+    PLAIN = 0,
+    VERSION = 1,
+    SEQ = 2,
+  };
+
+  // LeafStore keeps the leaf hashes, which are needed to take the old leaf
+  // of a key out of its bucket, and the bucket states of a persistent
+  // digest. A leaf is identified by its namespaced key.
+  class LeafStore {
+   public:
+    virtual ~LeafStore() = default;
+    // Return false if the key has no leaf.
+    virtual bool Get(const std::string& key, std::string* leaf) = 0;
+    virtual void Put(const std::string& key, const std::string& leaf) = 0;
+    virtual void Delete(const std::string& key) = 0;
+    virtual void PutBucket(uint32_t bucket, const std::string& state) {}
+    // Return false if the bucket state is not kept.
+    virtual bool GetBucket(uint32_t bucket, std::string* state) {
+      return false;
+    }
+  };
+
+  static constexpr uint32_t kDefaultBucketNum = 4096;
+
+  // The leaves are kept in memory if store is not provided.
+  StateDigest(uint32_t bucket_num = kDefaultBucketNum,
+              std::unique_ptr<LeafStore> store = nullptr);
+
+  // Set the leaf of key to (value, version), replacing the old one.
+  void Update(const std::string& key, const std::string& value,
+              uint64_t version = 0, Namespace ns = PLAIN);
+  void Remove(const std::string& key, Namespace ns = PLAIN);
+
+  std::string GetRoot();
+
+  // Write the states of the buckets changed since the last call to the
+  // store.
+  void Save();
+  // Read the bucket states back from the store. A bucket without a state is
+  // empty. Return false if a state is invalid.
+  bool Load();
+
+ private:
+  void MarkDirty(uint32_t bucket);
+
+ private:
+  std::mutex mutex_;
+  uint32_t bucket_num_;
+  std::unique_ptr<LeafStore> store_;
+  std::vector<BucketHash> buckets_;
+  // tree_[1] is the root and tree_[bucket_num_ + i] the hash of bucket i.
+  std::vector<std::string> tree_;
+  std::vector<bool> is_dirty_;
+  std::vector<uint32_t> dirty_;
+  std::vector<bool> is_unsaved_;
+  std::vector<uint32_t> unsaved_;
+};
+
+// StateDigestBuilder computes the root of a StateDigest from leaves added in
+// key order, which keeps a key from being added twice. If a store is
+// provided, the leaves are written to it and Save() writes the bucket states,
+// so that a StateDigest over the store can be loaded.
+class StateDigestBuilder {
+ public:
+  StateDigestBuilder(uint32_t bucket_num = StateDigest::kDefaultBucketNum,
+                     StateDigest::LeafStore* store = nullptr);
+  ~StateDigestBuilder();
+
+  // Return false if the namespaced key is not after the last one added.
+  bool Add(const std::string& key, const std::string& value,
+           uint64_t version = 0,
+           StateDigest::Namespace ns = StateDigest::PLAIN);
+  std::string GetRoot();
+  void Save();
+
+ private:
+  uint32_t bucket_num_;
+  StateDigest::LeafStore* store_;
+  std::vector<BucketHash> buckets_;
+  bool has_key_ = false;
+  std::string last_key_;
+};
+
+}  // namespace resdb
@@ -0,0 +1,166 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "chain/storage/state_digest.h"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+
+#include "chain/storage/leveldb.h"
+#include "chain/storage/memory_db.h"
+
+namespace resdb {
+namespace {
+
+TEST(StateDigestTest, IndependentOfWriteOrder) {
+  StateDigest digest1(16), digest2(16);
+  for (int i = 0; i < 100; ++i) {
+    digest1.Update("key" + std::to_string(i), "value" + std::to_string(i));
+  }
+  for (int i = 99; i >= 0; --i) {
+    digest2.Update("key" + std::to_string(i), "value" + std::to_string(i));
+  }
+  EXPECT_EQ(digest1.GetRoot(), digest2.GetRoot());
+}
+
+TEST(StateDigestTest, UpdateAndRemove) {
+  StateDigest digest(16);
+  std::string empty_root = digest.GetRoot();
+  digest.Update("key1", "value1");
+  std::string root1 = digest.GetRoot();
+  EXPECT_NE(root1, empty_root);
+
+  digest.Update("key2", "value2");
+  std::string root2 = digest.GetRoot();
+  EXPECT_NE(root2, root1);
+
+  // The same value with a different version is a different state.
+  digest.Update("key2", "value2", 1);
+  EXPECT_NE(digest.GetRoot(), root2);
+
+  digest.Update("key2", "value2");
+  EXPECT_EQ(digest.GetRoot(), root2);
+
+  digest.Remove("key2");
+  EXPECT_EQ(digest.GetRoot(), root1);
+  digest.Remove("key1");
+  EXPECT_EQ(digest.GetRoot(), empty_root);
+}
+
+TEST(StateDigestTest, Namespace) {
+  StateDigest digest1(16), digest2(16);
+  digest1.Update("key1", "value1", 0, StateDigest::PLAIN);
+  digest2.Update("key1", "value1", 0, StateDigest::SEQ);
+  EXPECT_NE(digest1.GetRoot(), digest2.GetRoot());
+
+  // Removing the key of another namespace keeps the leaf.
+  std::string root = digest2.GetRoot();
+  digest2.Remove("key1", StateDigest::PLAIN);
+  EXPECT_EQ(digest2.GetRoot(), root);
+}
+
+TEST(StateDigestTest, StorageDigest) {
+  std::unique_ptr<Storage> storage1 = storage::NewMemoryDB();
+  std::unique_ptr<Storage> storage2 = storage::NewMemoryDB();
+  EXPECT_TRUE(storage1->GetStateDigest().empty());
+
+  storage1->EnableStateDigest();
+  storage2->EnableStateDigest();
+  storage1->SetValue("key1", "value1");
+  storage1->SetValue("key2", "value2");
+  storage2->SetValue("key2", "value2");
+  EXPECT_NE(storage1->GetStateDigest(), storage2->GetStateDigest());
+
+  storage2->SetValue("key1", "value1");
+  EXPECT_EQ(storage1->GetStateDigest(), storage2->GetStateDigest());
+
+  storage1->DelValue("key1");
+  EXPECT_NE(storage1->GetStateDigest(), storage2->GetStateDigest());
+
+  // A value set with a seq is not the same state as a plain one.
+  storage2->DelValue("key1");
+  storage2->SetValueWithSeq("key1", "value1", 0);
+  EXPECT_NE(storage1->GetStateDigest(), storage2->GetStateDigest());
+}
+
+TEST(StateDigestTest, LevelDBDigest) {
+  std::string path = "/tmp/state_digest_test";
+  std::filesystem::remove_all(path);
+  std::unique_ptr<Storage> memory_db = storage::NewMemoryDB();
+  memory_db->EnableStateDigest();
+  {
+    std::unique_ptr<Storage> leveldb = storage::NewResLevelDB(path);
+    for (int i = 0; i < 100; ++i) {
+      std::string key = "key" + std::to_string(i);
+      leveldb->SetValue(key, "value");
+      memory_db->SetValue(key, "value");
+    }
+  }
+
+  // The leaves are rebuilt from the data written before.
+  std::unique_ptr<Storage> leveldb = storage::NewResLevelDB(path);
+  leveldb->EnableStateDigest();
+  EXPECT_EQ(leveldb->GetStateDigest(), memory_db->GetStateDigest());
+
+  leveldb->SetValue("key0", "new_value");
+  leveldb->DelValue("key1");
+  memory_db->SetValue("key0", "new_value");
+  memory_db->DelValue("key1");
+  EXPECT_EQ(leveldb->GetStateDigest(), memory_db->GetStateDigest());
+}
+
+TEST(StateDigestTest, LevelDBDigestSaved) {
+  std::string path = "/tmp/state_digest_test";
+  std::filesystem::remove_all(path);
+  std::unique_ptr<Storage> memory_db = storage::NewMemoryDB();
+  memory_db->EnableStateDigest();
+  {
+    std::unique_ptr<Storage> leveldb = storage::NewResLevelDB(path);
+    leveldb->EnableStateDigest();
+    for (int i = 0; i < 100; ++i) {
+      std::string key = "key" + std::to_string(i);
+      leveldb->SetValue(key, "value");
+      memory_db->SetValue(key, "value");
+    }
+    leveldb->DelValue("key1");
+    memory_db->DelValue("key1");
+  }
+
+  // The saved digest is loaded back and the leaves are not part of the data.
+  {
+    std::unique_ptr<Storage> leveldb = storage::NewResLevelDB(path);
+    leveldb->EnableStateDigest();
+    EXPECT_EQ(leveldb->GetStateDigest(), memory_db->GetStateDigest());
+    EXPECT_EQ(leveldb->GetValuesWithPrefix("").size(), 99);
+  }
+
+  // A write without the digest makes the saved one stale.
+  {
+    std::unique_ptr<Storage> leveldb = storage::NewResLevelDB(path);
+    leveldb->SetValue("key1", "value");
+  }
+  memory_db->SetValue("key1", "value");
+  std::unique_ptr<Storage> leveldb = storage::NewResLevelDB(path);
+  leveldb->EnableStateDigest();
+  EXPECT_EQ(leveldb->GetStateDigest(), memory_db->GetStateDigest());
+}
+
+}  // namespace
+}  // namespace resdb
@@ -20,9 +20,12 @@
 #pragma once
 
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "chain/storage/state_digest.h"
+
 namespace resdb {
 
 class Storage {
@@ -34,10 +37,15 @@ class Storage {
   virtual int SetValueWithSeq(const std::string& key, const std::string& value,
                               uint64_t seq) = 0;
   virtual std::string GetValue(const std::string& key) = 0;
+  virtual int DelValue(const std::string& key) = 0;
   virtual std::pair<std::string, uint64_t> GetValueWithSeq(
       const std::string& key, uint64_t seq) = 0;
   virtual std::string GetRange(const std::string& min_key,
                                const std::string& max_key) = 0;
+  // Return the <key, value>s set without a version or seq whose keys start
+  // with prefix, in key order.
+  virtual std::vector<std::pair<std::string, std::string>> GetValuesWithPrefix(
+      const std::string& prefix) = 0;
 
   virtual int SetValueWithVersion(const std::string& key,
                                   const std::string& value, int version) = 0;
@@ -65,8 +73,72 @@ class Storage {
 
   void SetMaxHistoryNum(int num) { max_history_ = num; }
 
+  // Start tracking a StateDigest over the key/values written to the storage.
+  virtual void EnableStateDigest() {
+    if (state_digest_ == nullptr) {
+      state_digest_ = std::make_unique<StateDigest>();
+    }
+  }
+
+  // Return the root of the state digest, or empty if it is not enabled.
+  std::string GetStateDigest() {
+    return state_digest_ ? state_digest_->GetRoot() : "";
+  }
+
+  // Keep a consistent view of the current key/values as the state at seq.
+  // Only the latest few snapshots are kept. Return false if the storage does
+  // not support snapshots.
+  virtual bool CreateSnapshot(uint64_t seq) { return false; }
+
+  // Read the key/values after start_key from the snapshot of seq until
+  // max_bytes is reached. Return -1 if the snapshot does not exist, 1 if all
+  // the remaining key/values are read and 0 otherwise.
+  virtual int ReadSnapshot(
+      uint64_t seq, const std::string& start_key, size_t max_bytes,
+      std::vector<std::pair<std::string, std::string>>* items) {
+    return -1;
+  }
+
+  // A snapshot read by ReadSnapshot() is installed in chunks: StageSnapshot()
+  // keeps them apart from the current key/values, GetStagedStateDigest()
+  // returns the state digest of what is staged and ApplySnapshot() replaces
+  // the key/values with it at once. The chunks must come in key order,
+  // StageSnapshot() returns -2 otherwise.
+  virtual int StageSnapshot(
+      const std::vector<std::pair<std::string, std::string>>& items) {
+    return -1;
+  }
+
+  std::string GetStagedStateDigest() {
+    return staged_digest_ ? staged_digest_->GetRoot() : "";
+  }
+
+  virtual int ApplySnapshot() { return -1; }
+
+  // Drop the staged key/values.
+  virtual void ClearStagedSnapshot() {}
+
+ protected:
+  void UpdateStateDigest(
+      const std::string& key, const std::string& value, uint64_t version = 0,
+      StateDigest::Namespace ns = StateDigest::PLAIN) {
+    if (state_digest_) {
+      state_digest_->Update(key, value, version, ns);
+    }
+  }
+
+  void RemoveStateDigest(const std::string& key,
+                         StateDigest::Namespace ns = StateDigest::PLAIN) {
+    if (state_digest_) {
+      state_digest_->Remove(key, ns);
+    }
+  }
+
  protected:
+  static constexpr size_t kMaxSnapshotNum = 3;
   uint32_t max_history_ = 10;
+  std::unique_ptr<StateDigest> state_digest_;
+  std::unique_ptr<StateDigestBuilder> staged_digest_;
 };
 
 }  // namespace resdb
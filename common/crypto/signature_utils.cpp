@@ -27,9 +27,22 @@
 #include <cryptopp/whrlpool.h>
 #include <glog/logging.h>
 
+#include <memory>
+#include <unordered_map>
+
 namespace resdb {
 namespace utils {
 
+namespace {
+
+typedef CryptoPP::ECDSA<CryptoPP::ECP, CryptoPP::SHA256>::Verifier
+    ECDSAVerifier;
+
+// Number of decoded keys kept by each thread.
+const size_t kMaxCachedKeyNum = 4096;
+
+}  // namespace
+
 bool RsaVerifyString(const std::string& message, const std::string& public_key,
                      const std::string& signature) {
   try {
@@ -92,6 +105,43 @@ bool ECDSAVerifyString(const std::string& message,
   return valid;
 }
 
+bool ECDSAVerifyStringWithKeyCache(const std::string& message,
+                                   const std::string& public_key,
+                                   const std::string& signature) {
+  thread_local std::unordered_map<std::string, std::unique_ptr<ECDSAVerifier>>
+      verifiers;
+
+  std::string decoded;
+  CryptoPP::StringSource(
+      signature, true,
+      new CryptoPP::HexDecoder(new CryptoPP::StringSink(decoded)));
+
+  auto it = verifiers.find(public_key);
+  if (it == verifiers.end()) {
+    if (verifiers.size() >= kMaxCachedKeyNum) {
+      verifiers.clear();
+    }
+    try {
+      CryptoPP::ECDSA<CryptoPP::ECP, CryptoPP::SHA256>::PublicKey
+          dsa_public_key;
+      dsa_public_key.Load(
+          CryptoPP::StringSource(public_key, true, new CryptoPP::HexDecoder())
+              .Ref());
+      it = verifiers
+               .insert(std::make_pair(
+                   public_key, std::make_unique<ECDSAVerifier>(dsa_public_key)))
+               .first;
+    } catch (...) {
+      LOG(ERROR) << "public key not valid";
+      return false;
+    }
+  }
+
+  return it->second->VerifyMessage(
+      reinterpret_cast<const CryptoPP::byte*>(message.data()), message.size(),
+      reinterpret_cast<const CryptoPP::byte*>(decoded.data()), decoded.size());
+}
+
 std::string RsaSignString(const std::string& private_key,
                           const std::string& message) {
   // decode and load private key (using pipeline)
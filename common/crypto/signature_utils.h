@@ -30,6 +30,12 @@ bool ECDSAVerifyString(const std::string& message,
                        const std::string& public_key,
                        const std::string& signature);
 
+// Same as ECDSAVerifyString, but the decoded public keys are cached in the
+// calling thread so that signatures from the same key only load it once.
+bool ECDSAVerifyStringWithKeyCache(const std::string& message,
+                                   const std::string& public_key,
+                                   const std::string& signature);
+
 std::string RsaSignString(const std::string& private_key,
                           const std::string& message);
 
@@ -17,6 +17,8 @@
  * under the License.
  */
 
+#pragma once
+
 #include <list>
 #include <unordered_map>
 
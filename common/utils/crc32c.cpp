@@ -0,0 +1,99 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/utils/crc32c.h"
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace resdb {
+
+namespace {
+
+// The reversed Castagnoli polynomial.
+constexpr uint32_t kPoly = 0x82f63b78;
+
+struct Crc32cTable {
+  Crc32cTable() {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (int j = 0; j < 8; ++j) {
+        crc = (crc >> 1) ^ (kPoly & (0 - (crc & 1)));
+      }
+      table[i] = crc;
+    }
+  }
+  uint32_t table[256];
+};
+
+uint32_t ExtendSoftware(uint32_t crc, const char* data, size_t len) {
+  static const Crc32cTable crc_table;
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < len; ++i) {
+    crc = crc_table.table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("sse4.2"))) uint32_t ExtendSSE42(uint32_t crc,
+                                                       const char* data,
+                                                       size_t len) {
+  uint64_t crc64 = crc;
+  while (len >= sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    crc64 = _mm_crc32_u64(crc64, word);
+    data += sizeof(word);
+    len -= sizeof(word);
+  }
+  crc = static_cast<uint32_t>(crc64);
+  while (len > 0) {
+    crc = _mm_crc32_u8(crc, static_cast<uint8_t>(*data));
+    ++data;
+    --len;
+  }
+  return crc;
+}
+
+#endif
+
+using ExtendFunc = uint32_t (*)(uint32_t, const char*, size_t);
+
+ExtendFunc GetExtendFunc() {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("sse4.2")) {
+    return ExtendSSE42;
+  }
+#endif
+  return ExtendSoftware;
+}
+
+}  // namespace
+
+uint32_t ExtendCrc32c(uint32_t crc, const char* data, size_t len) {
+  static const ExtendFunc extend = GetExtendFunc();
+  return ~extend(~crc, data, len);
+}
+
+}  // namespace resdb
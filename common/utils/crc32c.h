@@ -0,0 +1,35 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace resdb {
+
+// Extend the CRC32C (Castagnoli) checksum crc with the data. It uses the
+// SSE4.2 crc32 instruction if the cpu supports it.
+uint32_t ExtendCrc32c(uint32_t crc, const char* data, size_t len);
+
+inline uint32_t Crc32c(const char* data, size_t len) {
+  return ExtendCrc32c(0, data, len);
+}
+
+}  // namespace resdb
@@ -0,0 +1,53 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/utils/crc32c.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+namespace resdb {
+namespace {
+
+TEST(Crc32cTest, KnownValues) {
+  EXPECT_EQ(Crc32c("", 0), 0);
+  EXPECT_EQ(Crc32c("123456789", 9), 0xe3069283);
+
+  std::string zeros(32, 0);
+  EXPECT_EQ(Crc32c(zeros.data(), zeros.size()), 0x8a9136aa);
+  std::string ones(32, static_cast<char>(0xff));
+  EXPECT_EQ(Crc32c(ones.data(), ones.size()), 0x62a8ab43);
+}
+
+TEST(Crc32cTest, Extend) {
+  std::string data;
+  for (int i = 0; i < 1000; ++i) {
+    data.push_back(static_cast<char>(i * 31));
+  }
+  uint32_t crc = Crc32c(data.data(), data.size());
+  for (size_t split : {0, 1, 7, 8, 9, 500, 999, 1000}) {
+    uint32_t extended = ExtendCrc32c(Crc32c(data.data(), split),
+                                     data.data() + split, data.size() - split);
+    EXPECT_EQ(extended, crc) << "split:" << split;
+  }
+}
+
+}  // namespace
+}  // namespace resdb
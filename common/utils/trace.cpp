@@ -0,0 +1,316 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/utils/trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+
+namespace resdb {
+namespace trace {
+
+namespace {
+
+constexpr int kMaxThreads = 512;
+constexpr char kMagic[8] = {'R', 'D', 'B', 'T', 'R', 'A', 'C', 'E'};
+constexpr uint32_t kVersion = 1;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+};
+
+struct RingHeader {
+  uint64_t count;
+};
+
+struct EventInfo {
+  const char* name;
+  const char* fields[kMaxFields];
+};
+
+constexpr EventInfo kEventInfo[] = {
+#define RESDB_TRACE_EVENT_INFO(id, level, name, f0, f1, f2, f3) \
+  {name, {f0, f1, f2, f3}},
+    RESDB_TRACE_EVENTS(RESDB_TRACE_EVENT_INFO)
+#undef RESDB_TRACE_EVENT_INFO
+};
+
+internal::Ring rings[kMaxThreads];
+// The ring handed out to the threads once all the others are in use.
+internal::Ring dropped_ring;
+std::atomic<uint32_t> buffer_size(8192);
+
+char dump_path[256];
+const int kCrashSignals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+struct sigaction old_actions[sizeof(kCrashSignals) / sizeof(int)];
+
+// Return the ring to the pool when the thread exits. The records stay in the
+// dumps until the next owner overwrites them.
+struct RingReleaser {
+  internal::Ring* ring = nullptr;
+  ~RingReleaser() {
+    if (ring != nullptr) {
+      ring->in_use.store(false, std::memory_order_release);
+    }
+  }
+};
+
+bool WriteAll(int fd, const void* data, size_t len) {
+  const char* buf = static_cast<const char*>(data);
+  while (len > 0) {
+    ssize_t ret = write(fd, buf, len);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    buf += ret;
+    len -= ret;
+  }
+  return true;
+}
+
+void DumpHandler(int) {
+  int saved_errno = errno;
+  Dump(dump_path);
+  errno = saved_errno;
+}
+
+void CrashHandler(int sig) {
+  Dump(dump_path);
+  for (size_t i = 0; i < sizeof(kCrashSignals) / sizeof(int); ++i) {
+    if (kCrashSignals[i] == sig) {
+      sigaction(sig, &old_actions[i], nullptr);
+    }
+  }
+  raise(sig);
+}
+
+}  // namespace
+
+namespace internal {
+
+std::atomic<int> level(kTraceAnomaly);
+
+Ring* AcquireRing() {
+  static thread_local RingReleaser releaser;
+  uint32_t tid = syscall(SYS_gettid);
+  uint64_t size = 1;
+  while (size < buffer_size.load(std::memory_order_relaxed)) {
+    size <<= 1;
+  }
+  for (int i = 0; i < kMaxThreads; ++i) {
+    Ring* ring = &rings[i];
+    bool in_use = false;
+    if (ring->in_use.load(std::memory_order_relaxed) ||
+        !ring->in_use.compare_exchange_strong(in_use, true,
+                                              std::memory_order_acquire)) {
+      continue;
+    }
+    TraceRecord* records = ring->records.load(std::memory_order_relaxed);
+    if (records == nullptr || ring->mask + 1 != size) {
+      // The buffer size changed, the old records are dropped. The old buffer
+      // is not freed as a dump may still be reading it.
+      ring->records.store(nullptr, std::memory_order_release);
+      ring->head.store(0, std::memory_order_relaxed);
+      ring->mask = size - 1;
+      ring->records.store(new TraceRecord[size](), std::memory_order_release);
+    }
+    ring->tid = tid;
+    releaser.ring = ring;
+    thread_ring = ring;
+    return ring;
+  }
+  thread_ring = &dropped_ring;
+  return thread_ring;
+}
+
+uint64_t Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+}  // namespace internal
+
+void SetLevel(int level) {
+  internal::level.store(level, std::memory_order_relaxed);
+}
+
+int GetLevel() { return internal::level.load(std::memory_order_relaxed); }
+
+void SetBufferSize(uint32_t size) {
+  buffer_size.store(std::max<uint32_t>(size, 1), std::memory_order_relaxed);
+}
+
+int Dump(const char* path) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return -1;
+  }
+  FileHeader header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.record_size = sizeof(TraceRecord);
+  bool ok = WriteAll(fd, &header, sizeof(header));
+  for (int i = 0; i < kMaxThreads && ok; ++i) {
+    internal::Ring* ring = &rings[i];
+    TraceRecord* records = ring->records.load(std::memory_order_acquire);
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    if (records == nullptr || head == 0) {
+      continue;
+    }
+    uint64_t size = ring->mask + 1;
+    RingHeader ring_header;
+    ring_header.count = std::min(head, size);
+    uint64_t begin = (head - ring_header.count) & ring->mask;
+    uint64_t first = std::min(ring_header.count, size - begin);
+    ok = WriteAll(fd, &ring_header, sizeof(ring_header)) &&
+         WriteAll(fd, records + begin, first * sizeof(TraceRecord)) &&
+         WriteAll(fd, records, (ring_header.count - first) *
+                                   sizeof(TraceRecord));
+  }
+  close(fd);
+  return ok ? 0 : -1;
+}
+
+void InstallSignalHandler(const std::string& path) {
+  size_t len = std::min(path.size(), sizeof(dump_path) - 1);
+  memcpy(dump_path, path.data(), len);
+  dump_path[len] = '\0';
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sigemptyset(&sa.sa_mask);
+  sa.sa_handler = DumpHandler;
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGUSR2, &sa, nullptr);
+
+  sa.sa_handler = CrashHandler;
+  sa.sa_flags = SA_NODEFER;
+  for (size_t i = 0; i < sizeof(kCrashSignals) / sizeof(int); ++i) {
+    struct sigaction old;
+    sigaction(kCrashSignals[i], &sa, &old);
+    // Installed twice by several servers in one process.
+    if (old.sa_handler != CrashHandler) {
+      old_actions[i] = old;
+    }
+  }
+}
+
+absl::StatusOr<std::vector<TraceRecord>> ReadDump(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return absl::NotFoundError("open trace dump fail: " + path);
+  }
+  FileHeader header;
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    return absl::InvalidArgumentError("not a trace dump: " + path);
+  }
+  if (header.version != kVersion || header.record_size != sizeof(TraceRecord)) {
+    return absl::InvalidArgumentError("unsupported trace dump version");
+  }
+
+  file.seekg(0, std::ios::end);
+  uint64_t remaining = static_cast<uint64_t>(file.tellg()) - sizeof(header);
+  file.seekg(sizeof(header));
+
+  std::vector<TraceRecord> records;
+  RingHeader ring_header;
+  while (file.read(reinterpret_cast<char*>(&ring_header),
+                   sizeof(ring_header))) {
+    remaining -= sizeof(ring_header);
+    if (ring_header.count > remaining / sizeof(TraceRecord)) {
+      return absl::DataLossError("trace dump truncated");
+    }
+    remaining -= ring_header.count * sizeof(TraceRecord);
+    size_t begin = records.size();
+    records.resize(begin + ring_header.count);
+    if (!file.read(reinterpret_cast<char*>(&records[begin]),
+                   ring_header.count * sizeof(TraceRecord))) {
+      return absl::DataLossError("trace dump truncated");
+    }
+  }
+  std::stable_sort(records.begin(), records.end(),
+                   [](const TraceRecord& a, const TraceRecord& b) {
+                     return a.time_ns < b.time_ns;
+                   });
+  return records;
+}
+
+const char* GetEventName(uint16_t event) {
+  return event < kEventNum ? kEventInfo[event].name : nullptr;
+}
+
+std::string Format(const TraceRecord& record) {
+  char time_str[32];
+  snprintf(time_str, sizeof(time_str), "%lu.%09lu",
+           static_cast<unsigned long>(record.time_ns / 1000000000),
+           static_cast<unsigned long>(record.time_ns % 1000000000));
+
+  std::string ret = std::string(time_str) +
+                    " tid:" + std::to_string(record.tid) + " ";
+  const EventInfo* info =
+      record.event < kEventNum ? &kEventInfo[record.event] : nullptr;
+  if (info) {
+    ret += info->name;
+  } else {
+    ret += "event_" + std::to_string(record.event);
+  }
+  for (int i = 0; i < record.field_num && i < kMaxFields; ++i) {
+    ret += " ";
+    if (info && info->fields[i]) {
+      ret += info->fields[i];
+    } else {
+      ret += "f" + std::to_string(i);
+    }
+    ret += ":";
+    uint64_t bits = record.fields[i];
+    switch ((record.types >> (2 * i)) & 3) {
+      case kInt:
+        ret += std::to_string(static_cast<int64_t>(bits));
+        break;
+      case kDouble: {
+        double v;
+        memcpy(&v, &bits, sizeof(v));
+        ret += std::to_string(v);
+        break;
+      }
+      default:
+        ret += std::to_string(bits);
+        break;
+    }
+  }
+  return ret;
+}
+
+}  // namespace trace
+}  // namespace resdb
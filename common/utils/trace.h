@@ -0,0 +1,188 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "common/utils/trace_events.h"
+
+namespace resdb {
+namespace trace {
+
+// An event is recorded only if its level is not above the level set by
+// SetLevel(). kTraceAnomaly is the default.
+enum Level {
+  kTraceOff = 0,
+  kTraceAnomaly = 1,  // rejected or out of order messages.
+  kTraceSeq = 2,      // one event per sequence or transaction.
+  kTraceVerbose = 3,
+};
+
+enum Event : uint16_t {
+#define RESDB_TRACE_EVENT_ID(id, level, name, f0, f1, f2, f3) id,
+  RESDB_TRACE_EVENTS(RESDB_TRACE_EVENT_ID)
+#undef RESDB_TRACE_EVENT_ID
+      kEventNum,
+};
+
+constexpr int kMaxFields = 4;
+
+enum FieldType : uint8_t {
+  kUint = 0,
+  kInt = 1,
+  kDouble = 2,
+};
+
+// A fixed size record in the per-thread ring buffer. The fields keep the raw
+// 64 bits of the values and types holds 2 bits of FieldType for each one.
+// The tid is kept per record because the rings of the exited threads are
+// handed to the new ones.
+struct TraceRecord {
+  uint64_t time_ns;
+  uint16_t event;
+  uint8_t field_num;
+  uint8_t types;
+  uint32_t tid;
+  uint64_t fields[kMaxFields];
+};
+static_assert(sizeof(TraceRecord) == 48, "the dump layout changed");
+
+void SetLevel(int level);
+int GetLevel();
+
+// The records kept per thread, rounded up to a power of two. It applies to
+// the threads which record their first event afterwards.
+void SetBufferSize(uint32_t size);
+
+// Write the records of all the threads to path, oldest first in each thread.
+// It is async-signal-safe. The records being written meanwhile may be torn.
+int Dump(const char* path);
+
+// Dump to path on SIGUSR2 and before the crash on SIGSEGV, SIGBUS, SIGFPE,
+// SIGILL and SIGABRT. The previous handlers of the crash signals run after
+// the dump.
+void InstallSignalHandler(const std::string& path);
+
+// Read a dump written by Dump(), the records of all threads are merged by
+// time.
+absl::StatusOr<std::vector<TraceRecord>> ReadDump(const std::string& path);
+
+// "<time> tid:<tid> <event> <field>:<value> ...".
+std::string Format(const TraceRecord& record);
+
+const char* GetEventName(uint16_t event);
+
+namespace internal {
+
+constexpr uint8_t kEventLevel[] = {
+#define RESDB_TRACE_EVENT_LEVEL(id, level, name, f0, f1, f2, f3) level,
+    RESDB_TRACE_EVENTS(RESDB_TRACE_EVENT_LEVEL)
+#undef RESDB_TRACE_EVENT_LEVEL
+};
+
+extern std::atomic<int> level;
+
+// A single writer ring, the dumper reads head to find the records.
+struct Ring {
+  std::atomic<uint64_t> head{0};
+  std::atomic<TraceRecord*> records{nullptr};
+  uint64_t mask = 0;
+  // Only accessed by the owner.
+  uint32_t tid = 0;
+  std::atomic<bool> in_use{false};
+};
+
+// Take a free ring for the current thread, the records of its previous owner
+// are kept. It returns a ring without records if all of them are in use.
+Ring* AcquireRing();
+
+inline thread_local Ring* thread_ring = nullptr;
+
+uint64_t Now();
+
+template <typename T>
+inline uint64_t Encode(T value, uint8_t* type) {
+  static_assert(std::is_arithmetic<T>::value, "trace fields are numbers");
+  if constexpr (std::is_floating_point<T>::value) {
+    double v = value;
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    *type = kDouble;
+    return bits;
+  } else if constexpr (std::is_signed<T>::value) {
+    *type = kInt;
+    return static_cast<uint64_t>(static_cast<int64_t>(value));
+  } else {
+    *type = kUint;
+    return static_cast<uint64_t>(value);
+  }
+}
+
+}  // namespace internal
+
+inline bool Enabled(Event event) {
+  return internal::kEventLevel[event] <=
+         internal::level.load(std::memory_order_relaxed);
+}
+
+template <typename... Args>
+void Emit(Event event, Args... args) {
+  static_assert(sizeof...(Args) <= kMaxFields, "too many trace fields");
+  internal::Ring* ring = internal::thread_ring;
+  if (ring == nullptr) {
+    ring = internal::AcquireRing();
+  }
+  TraceRecord* records = ring->records.load(std::memory_order_relaxed);
+  if (records == nullptr) {
+    return;
+  }
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  TraceRecord* record = &records[head & ring->mask];
+  record->time_ns = internal::Now();
+  record->tid = ring->tid;
+  record->event = event;
+  record->field_num = sizeof...(Args);
+  uint8_t type = 0, types = 0;
+  int i = 0;
+  ((record->fields[i] = internal::Encode(args, &type),
+    types |= type << (2 * i), ++i),
+   ...);
+  record->types = types;
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+}  // namespace trace
+}  // namespace resdb
+
+// Record an event with up to 4 numeric fields. The fields are not evaluated
+// if the level of the event is disabled.
+#define RESDB_TRACE(event, ...)                                          \
+  do {                                                                   \
+    if (::resdb::trace::Enabled(::resdb::trace::event)) {                \
+      ::resdb::trace::Emit(::resdb::trace::event, ##__VA_ARGS__);        \
+    }                                                                    \
+  } while (0)
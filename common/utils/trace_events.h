@@ -0,0 +1,51 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+// The events recorded by RESDB_TRACE. Each entry is
+//   X(id, level, name, field0, field1, field2, field3)
+// and the unused fields are nullptr. The ids are written to the dumps, so
+// new events are appended at the end and old ones are never reordered.
+#define RESDB_TRACE_EVENTS(X)                                                 \
+  X(kCheckPointPending, kTraceVerbose, "ckpt.pending", "last_seq",            \
+    "pending_seq", nullptr, nullptr)                                          \
+  X(kCheckPointUpdate, kTraceSeq, "ckpt.update", "seq", "stable_seq",         \
+    "water_mark", nullptr)                                                    \
+  X(kCheckPointSeqGap, kTraceAnomaly, "ckpt.seq_gap", "last_seq", "seq",      \
+    nullptr, nullptr)                                                         \
+  X(kCheckPointAddCommit, kTraceSeq, "ckpt.add_commit", "seq", nullptr,       \
+    nullptr, nullptr)                                                         \
+  X(kCheckPointStatus, kTraceVerbose, "ckpt.status", "sender", "seq",         \
+    "primary", "view")                                                        \
+  X(kCommitmentExecuted, kTraceAnomaly, "commit.executed", "seq", nullptr,    \
+    nullptr, nullptr)                                                         \
+  X(kCommitmentResponse, kTraceSeq, "commit.response", "seq", "proxy",        \
+    nullptr, nullptr)                                                         \
+  X(kUtxoDuplicatedInput, kTraceAnomaly, "utxo.duplicated_input", "prev_id",  \
+    "out_idx", nullptr, nullptr)                                              \
+  X(kUtxoMissingInput, kTraceAnomaly, "utxo.missing_input", "prev_id",        \
+    "out_idx", nullptr, nullptr)                                              \
+  X(kPoEOutOfWindow, kTraceAnomaly, "poe.out_of_window", "seq", "low",        \
+    "high", nullptr)                                                          \
+  X(kPoECommit, kTraceSeq, "poe.commit", "seq", "view", nullptr, nullptr)     \
+  X(kMinerSliceStart, kTraceSeq, "miner.slice_start", "shift_idx", nullptr,   \
+    nullptr, nullptr)                                                         \
+  X(kMinerSliceDone, kTraceVerbose, "miner.slice_done", "slice", "step",      \
+    nullptr, nullptr)
@@ -0,0 +1,191 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/utils/trace.h"
+
+#include <gtest/gtest.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <thread>
+
+namespace resdb {
+namespace trace {
+namespace {
+
+std::string DumpPath(const std::string& name) {
+  return ::testing::TempDir() + "/" + name;
+}
+
+// The records of the thread tid.
+std::vector<TraceRecord> ReadThread(const std::string& path, uint32_t tid) {
+  auto records_or = ReadDump(path);
+  EXPECT_TRUE(records_or.ok());
+  std::vector<TraceRecord> ret;
+  for (const TraceRecord& record : *records_or) {
+    if (record.tid == tid) {
+      ret.push_back(record);
+    }
+  }
+  return ret;
+}
+
+class TraceTest : public ::testing::Test {
+ protected:
+  void TearDown() override { SetLevel(kTraceAnomaly); }
+};
+
+TEST_F(TraceTest, DumpAndFormat) {
+  SetLevel(kTraceSeq);
+  std::string path = DumpPath("trace_format");
+  uint32_t tid = 0;
+  std::thread th([&]() {
+    tid = syscall(SYS_gettid);
+    RESDB_TRACE(kCheckPointUpdate, uint64_t(10), 8, -1);
+    RESDB_TRACE(kPoECommit, 11, 0.5);
+  });
+  th.join();
+  EXPECT_EQ(Dump(path.c_str()), 0);
+
+  std::vector<TraceRecord> records = ReadThread(path, tid);
+  ASSERT_EQ(records.size(), 2);
+  EXPECT_EQ(records[0].event, kCheckPointUpdate);
+  EXPECT_EQ(records[0].field_num, 3);
+  EXPECT_EQ(records[0].fields[0], 10);
+  EXPECT_LE(records[0].time_ns, records[1].time_ns);
+
+  std::string line = Format(records[0]);
+  EXPECT_NE(line.find("tid:" + std::to_string(tid) +
+                      " ckpt.update seq:10 stable_seq:8 water_mark:-1"),
+            std::string::npos)
+      << line;
+  line = Format(records[1]);
+  EXPECT_NE(line.find("poe.commit seq:11 view:0.5"), std::string::npos)
+      << line;
+}
+
+TEST_F(TraceTest, LevelFilter) {
+  SetLevel(kTraceAnomaly);
+  std::string path = DumpPath("trace_level");
+  uint32_t tid = 0;
+  int evaluated = 0;
+  std::thread th([&]() {
+    tid = syscall(SYS_gettid);
+    RESDB_TRACE(kCheckPointAddCommit, ++evaluated);
+    RESDB_TRACE(kCheckPointSeqGap, 1, 3);
+    SetLevel(kTraceOff);
+    RESDB_TRACE(kCheckPointSeqGap, 2, 4);
+  });
+  th.join();
+  EXPECT_EQ(evaluated, 0);
+  EXPECT_EQ(Dump(path.c_str()), 0);
+
+  std::vector<TraceRecord> records = ReadThread(path, tid);
+  ASSERT_EQ(records.size(), 1);
+  EXPECT_EQ(records[0].event, kCheckPointSeqGap);
+  EXPECT_EQ(records[0].fields[1], 3);
+}
+
+TEST_F(TraceTest, KeepLatestRecords) {
+  SetLevel(kTraceSeq);
+  SetBufferSize(10);
+  std::string path = DumpPath("trace_wrap");
+  uint32_t tid = 0;
+  std::thread th([&]() {
+    tid = syscall(SYS_gettid);
+    for (int i = 0; i < 100; ++i) {
+      RESDB_TRACE(kCheckPointAddCommit, i);
+    }
+  });
+  th.join();
+  SetBufferSize(8192);
+  EXPECT_EQ(Dump(path.c_str()), 0);
+
+  // The size is rounded up to 16.
+  std::vector<TraceRecord> records = ReadThread(path, tid);
+  ASSERT_EQ(records.size(), 16);
+  for (int i = 0; i < 16; ++i) {
+    EXPECT_EQ(records[i].fields[0], 84 + i);
+  }
+}
+
+TEST_F(TraceTest, MergeThreads) {
+  SetLevel(kTraceSeq);
+  std::string path = DumpPath("trace_merge");
+  uint64_t start_time = internal::Now();
+  std::vector<std::thread> ths;
+  for (int i = 0; i < 4; ++i) {
+    ths.push_back(std::thread([i]() {
+      for (int j = 0; j < 1000; ++j) {
+        RESDB_TRACE(kCommitmentResponse, j, 1000 + i);
+      }
+    }));
+  }
+  for (auto& th : ths) {
+    th.join();
+  }
+  EXPECT_EQ(Dump(path.c_str()), 0);
+
+  auto records_or = ReadDump(path);
+  ASSERT_TRUE(records_or.ok());
+  int num = 0;
+  for (size_t i = 0; i < records_or->size(); ++i) {
+    const TraceRecord& record = (*records_or)[i];
+    if (i > 0) {
+      EXPECT_LE((*records_or)[i - 1].time_ns, record.time_ns);
+    }
+    if (record.event == kCommitmentResponse && record.time_ns >= start_time) {
+      num++;
+    }
+  }
+  EXPECT_EQ(num, 4000);
+}
+
+TEST_F(TraceTest, DumpOnCrash) {
+  std::string path = DumpPath("trace_crash");
+  unlink(path.c_str());
+  EXPECT_DEATH(
+      {
+        InstallSignalHandler(path);
+        RESDB_TRACE(kPoEOutOfWindow, 7, 1, 5);
+        raise(SIGSEGV);
+      },
+      "");
+
+  auto records_or = ReadDump(path);
+  ASSERT_TRUE(records_or.ok());
+  ASSERT_FALSE(records_or->empty());
+  const TraceRecord& record = records_or->back();
+  EXPECT_EQ(record.event, kPoEOutOfWindow);
+  EXPECT_EQ(record.fields[0], 7);
+}
+
+TEST_F(TraceTest, ReadInvalidDump) {
+  std::string path = DumpPath("trace_invalid");
+  FILE* file = fopen(path.c_str(), "w");
+  fputs("not a trace", file);
+  fclose(file);
+  EXPECT_FALSE(ReadDump(path).ok());
+  EXPECT_FALSE(ReadDump(DumpPath("trace_not_exist")).ok());
+}
+
+}  // namespace
+}  // namespace trace
+}  // namespace resdb
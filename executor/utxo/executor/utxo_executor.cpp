@@ -49,8 +49,36 @@ std::unique_ptr<std::string> UTXOExecutor::ExecuteData(
   return ret_str;
 }
 
-QueryExecutor::QueryExecutor(Transaction* transaction, Wallet* wallet)
-    : transaction_(transaction), wallet_(wallet) {}
+std::unique_ptr<google::protobuf::Message> UTXOExecutor::ParseData(
+    const std::string& client_request) {
+  UTXORequest utxo_request;
+  if (!utxo_request.ParseFromString(client_request)) {
+    LOG(ERROR) << "parse data fail";
+    return nullptr;
+  }
+
+  std::unique_ptr<VerifiedUTXO> verified_utxo =
+      std::make_unique<VerifiedUTXO>();
+  verified_utxo->set_verified_pub_key(
+      transaction_->VerifySignature(utxo_request.utxo()));
+  *verified_utxo->mutable_utxo() = std::move(*utxo_request.mutable_utxo());
+  return verified_utxo;
+}
+
+std::unique_ptr<std::string> UTXOExecutor::ExecuteRequest(
+    const google::protobuf::Message& request) {
+  const VerifiedUTXO& verified_utxo =
+      dynamic_cast<const VerifiedUTXO&>(request);
+
+  UTXOResponse response;
+  response.set_ret(transaction_->AddTransaction(verified_utxo));
+  std::unique_ptr<std::string> ret_str = std::make_unique<std::string>();
+  response.SerializeToString(ret_str.get());
+  return ret_str;
+}
+
+QueryExecutor::QueryExecutor(Transaction* transaction)
+    : transaction_(transaction) {}
 
 std::unique_ptr<std::string> QueryExecutor::Query(
     const std::string& request_str) {
@@ -61,14 +89,18 @@ std::unique_ptr<std::string> QueryExecutor::Query(
   }
 
   UTXOQueryResponse resp;
-  if (query.query_transaction()) {
+  if (query.query_range()) {
+    resp.set_next_id(transaction_->QueryUTXO(query.start_id(), query.limit(),
+                                             query.address(),
+                                             resp.mutable_utxos()));
+  } else if (query.query_transaction()) {
     std::vector<UTXO> utxos =
         transaction_->GetUTXO(query.end_id(), query.num());
-    for (const UTXO& utxo : utxos) {
-      *resp.add_utxos() = utxo;
+    for (UTXO& utxo : utxos) {
+      *resp.add_utxos() = std::move(utxo);
     }
   } else {
-    resp.set_value(wallet_->GetCoin(query.address()));
+    resp.set_value(transaction_->GetBalance(query.address()));
   }
   std::unique_ptr<std::string> resp_str = std::make_unique<std::string>();
   resp.SerializeToString(resp_str.get());
@@ -36,13 +36,22 @@ class UTXOExecutor : public TransactionManager {
 
   std::unique_ptr<std::string> ExecuteData(const std::string& request) override;
 
+ protected:
+  // Parse the request and check its signature. It is called by the
+  // prepare stage from multiple threads before the batch is executed.
+  std::unique_ptr<google::protobuf::Message> ParseData(
+      const std::string& request) override;
+  // Apply a request returned by ParseData() in order.
+  std::unique_ptr<std::string> ExecuteRequest(
+      const google::protobuf::Message& request) override;
+
  private:
   Transaction* transaction_;
 };
 
 class QueryExecutor : public CustomQuery {
  public:
-  QueryExecutor(Transaction* transaction, Wallet* wallet);
+  QueryExecutor(Transaction* transaction);
   virtual ~QueryExecutor() = default;
 
   virtual std::unique_ptr<std::string> Query(
@@ -50,7 +59,6 @@ class QueryExecutor : public CustomQuery {
 
  private:
   Transaction* transaction_;
-  Wallet* wallet_;
 };
 
 }  // namespace utxo
@@ -75,6 +75,83 @@ TEST(UTXOExecutorTest, AddUTXO) {
   }
 }
 
+TEST(UTXOExecutorTest, PrepareAndExecuteBatch) {
+  Config config;
+
+  SecretKey key = KeyGenerator ::GeneratorKeys(SignatureInfo::ECDSA);
+
+  {
+    auto* gensis_txn = config.mutable_genesis_transactions();
+    UTXO* utxo = gensis_txn->add_transactions();
+    UTXOOut* out = utxo->add_out();
+    out->set_address("0001");
+    out->set_value(1234);
+    out->set_pub_key(key.public_key());
+  }
+  Wallet wallet;
+  Transaction transaction(config, &wallet);
+  UTXOExecutor txn_manager(config, &transaction, &wallet);
+
+  BatchUserRequest batch_request;
+  {
+    UTXO utxo;
+    UTXOIn* in = utxo.add_in();
+    in->set_prev_id(0);
+    in->set_out_idx(0);
+
+    UTXOOut* out = utxo.add_out();
+    out->set_address("1234");
+    out->set_value(234);
+    out->set_pub_key(key.public_key());
+    utxo.set_address("0001");
+
+    std::string signature = utils::ECDSASignString(
+        key.private_key(), utxo.address() + std::to_string(0));
+    utxo.set_sig(signature);
+
+    UTXORequest request;
+    *request.mutable_utxo() = utxo;
+    request.SerializeToString(
+        batch_request.add_user_requests()->mutable_request()->mutable_data());
+  }
+  {
+    // Spend the output of the previous transaction in the same batch,
+    // so the signature can only be checked during the execution.
+    UTXO utxo;
+    UTXOIn* in = utxo.add_in();
+    in->set_prev_id(1);
+    in->set_out_idx(0);
+
+    UTXOOut* out = utxo.add_out();
+    out->set_address("4321");
+    out->set_value(100);
+    utxo.set_address("1234");
+
+    std::string signature = utils::ECDSASignString(
+        key.private_key(), utxo.address() + std::to_string(1));
+    utxo.set_sig(signature);
+
+    UTXORequest request;
+    *request.mutable_utxo() = utxo;
+    request.SerializeToString(
+        batch_request.add_user_requests()->mutable_request()->mutable_data());
+  }
+
+  auto data = txn_manager.Prepare(batch_request);
+  ASSERT_EQ(data->size(), 2);
+  auto responses = txn_manager.ExecuteBatchData(*data);
+  ASSERT_EQ(responses.size(), 2);
+
+  std::vector<int64_t> rets;
+  for (const auto& resp_str : responses) {
+    UTXOResponse response;
+    EXPECT_TRUE(response.ParseFromString(*resp_str));
+    rets.push_back(response.ret());
+  }
+  EXPECT_EQ(rets, std::vector<int64_t>({1, 2}));
+  EXPECT_EQ(wallet.GetCoin("4321"), 100);
+}
+
 }  // namespace
 }  // namespace utxo
 }  // namespace resdb
@@ -22,17 +22,25 @@
 #include <glog/logging.h>
 
 #include <iomanip>
+#include <set>
 #include <sstream>
 
 #include "common/crypto/hash.h"
 #include "common/crypto/signature_utils.h"
+#include "common/utils/trace.h"
 
 namespace resdb {
 namespace utxo {
 
-Transaction::Transaction(const Config& config, Wallet* wallet)
+Transaction::Transaction(const Config& config, Wallet* wallet,
+                         Storage* storage)
     : config_(config), wallet_(wallet) {
-  tx_mempool_ = std::make_unique<TxMempool>();
+  tx_mempool_ = std::make_unique<TxMempool>(storage, config_.cache_size());
+  if (tx_mempool_->Size() > 0) {
+    LOG(ERROR) << "utxo set recovered, skip genesis transactions. size:"
+               << tx_mempool_->Size();
+    return;
+  }
   for (const UTXO& trans : config_.genesis_transactions().transactions()) {
     int64_t transaction_id = tx_mempool_->AddUTXO(trans);
 
@@ -51,8 +59,33 @@ Transaction::Transaction(const Config& config, Wallet* wallet)
 
 Transaction::~Transaction() {}
 
+namespace {
+
+// The message signed by the owner of the inputs.
+std::string GetSignedMessage(const UTXO& utxo) {
+  int64_t verify_nonce = 0;
+  for (const UTXOIn& input : utxo.in()) {
+    verify_nonce += input.prev_id();
+  }
+  return utxo.address() + std::to_string(verify_nonce);
+}
+
+}  // namespace
+
 int64_t Transaction::AddTransaction(const UTXO& utxo) {
-  absl::StatusOr<std::vector<UTXOOut>> ins_or = GetInput(utxo);
+  return AddTransaction(utxo, "");
+}
+
+int64_t Transaction::AddTransaction(const VerifiedUTXO& verified_utxo) {
+  return AddTransaction(verified_utxo.utxo(),
+                        verified_utxo.verified_pub_key());
+}
+
+int64_t Transaction::AddTransaction(const UTXO& utxo,
+                                    const std::string& verified_pub_key) {
+  std::unique_lock<std::mutex> lk(mutex_);
+  absl::StatusOr<std::vector<UTXOOut>> ins_or =
+      GetInput(utxo, verified_pub_key);
   if (!ins_or.ok()) {
     LOG(ERROR) << "get input fail:" << ins_or.status().message();
     return -1;
@@ -79,7 +112,28 @@ int64_t Transaction::AddTransaction(const std::string& utxo_str) {
   return AddTransaction(utxo);
 }
 
-absl::StatusOr<std::vector<UTXOOut>> Transaction::GetInput(const UTXO& utxo) {
+std::string Transaction::VerifySignature(const UTXO& utxo) {
+  if (utxo.in_size() == 0 || utxo.sig().empty()) {
+    return "";
+  }
+  std::string public_key;
+  {
+    std::unique_lock<std::mutex> lk(mutex_);
+    public_key =
+        tx_mempool_->GetPubKey(utxo.in(0).prev_id(), utxo.in(0).out_idx());
+  }
+  if (public_key.empty()) {
+    return "";
+  }
+  if (!utils::ECDSAVerifyStringWithKeyCache(GetSignedMessage(utxo),
+                                            public_key, utxo.sig())) {
+    return "";
+  }
+  return public_key;
+}
+
+absl::StatusOr<std::vector<UTXOOut>> Transaction::GetInput(
+    const UTXO& utxo, const std::string& verified_pub_key) {
   std::vector<UTXOOut> utxos;
   if (utxo.in_size() == 0) {
     if (utxo.address() == "0000") {
@@ -87,20 +141,24 @@ absl::StatusOr<std::vector<UTXOOut>> Transaction::GetInput(const UTXO& utxo) {
     }
   }
 
-  int64_t verify_nonce = 0;
   std::string public_key;
+  std::set<std::pair<int64_t, int>> spent;
   for (const UTXOIn& input : utxo.in()) {
+    if (!spent.insert(std::make_pair(input.prev_id(), input.out_idx()))
+             .second) {
+      RESDB_TRACE(kUtxoDuplicatedInput, input.prev_id(), input.out_idx());
+      return absl::InvalidArgumentError("Input invalid.");
+    }
     absl::StatusOr<UTXOOut> utxo_or =
         tx_mempool_->GetUTXO(input.prev_id(), input.out_idx(), utxo.address());
     if (!utxo_or.ok()) {
-      LOG(ERROR) << "get pre utxo id fail:" << input.prev_id();
+      RESDB_TRACE(kUtxoMissingInput, input.prev_id(), input.out_idx());
       return utxo_or.status();
     }
     utxos.push_back(*utxo_or);
     if (public_key.empty()) {
       public_key = (*utxo_or).pub_key();
     }
-    verify_nonce += input.prev_id();
   }
 
   if (utxos.empty()) {
@@ -113,13 +171,15 @@ absl::StatusOr<std::vector<UTXOOut>> Transaction::GetInput(const UTXO& utxo) {
     return absl::InvalidArgumentError("Input invalid.");
   }
 
-  LOG(ERROR) << "get public key:" << public_key << " nonce:" << verify_nonce;
-
-  bool valid = utils::ECDSAVerifyString(
-      utxo.address() + std::to_string(verify_nonce), public_key, utxo.sig());
-  if (!valid) {
-    LOG(ERROR) << "key not valid";
-    return absl::InvalidArgumentError("Key invalid.");
+  // Outputs never change once added, so the signature does not need to be
+  // checked again if it has been verified with the same key.
+  if (verified_pub_key.empty() || verified_pub_key != public_key) {
+    bool valid = utils::ECDSAVerifyStringWithKeyCache(GetSignedMessage(utxo),
+                                                      public_key, utxo.sig());
+    if (!valid) {
+      LOG(ERROR) << "key not valid";
+      return absl::InvalidArgumentError("Key invalid.");
+    }
   }
 
   for (const UTXOOut& utxo : utxos) {
@@ -183,8 +243,21 @@ int Transaction::AddCoin(const UTXO& utxo) {
 }
 
 std::vector<UTXO> Transaction::GetUTXO(int64_t end_id, int num) {
+  std::unique_lock<std::mutex> lk(mutex_);
   return tx_mempool_->GetUTXO(end_id, num);
 }
 
+int64_t Transaction::QueryUTXO(
+    int64_t start_id, int limit, const std::string& address,
+    google::protobuf::RepeatedPtrField<UTXO>* utxos) {
+  std::unique_lock<std::mutex> lk(mutex_);
+  return tx_mempool_->QueryUTXO(start_id, limit, address, utxos);
+}
+
+int64_t Transaction::GetBalance(const std::string& address) {
+  std::unique_lock<std::mutex> lk(mutex_);
+  return wallet_->GetCoin(address);
+}
+
 }  // namespace utxo
 }  // namespace resdb
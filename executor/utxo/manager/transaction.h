@@ -19,7 +19,10 @@
 
 #pragma once
 
+#include <mutex>
+
 #include "absl/status/statusor.h"
+#include "chain/storage/storage.h"
 #include "executor/utxo/manager/tx_mempool.h"
 #include "executor/utxo/manager/wallet.h"
 #include "proto/utxo/config.pb.h"
@@ -30,26 +33,51 @@ namespace utxo {
 
 class Transaction {
  public:
-  Transaction(const Config& config, Wallet* wallet);
+  // If "storage" is provided, the UTXO set is kept in it and recovered
+  // from it after a restart. Otherwise it is kept in memory.
+  Transaction(const Config& config, Wallet* wallet,
+              Storage* storage = nullptr);
   ~Transaction();
 
   int64_t AddTransaction(const std::string& utxo_string);
   int64_t AddTransaction(const UTXO& utxo);
+  // Add a transaction whose signature has been checked by VerifySignature().
+  // The signature is checked again only if the key used by the inputs is not
+  // the verified one.
+  int64_t AddTransaction(const VerifiedUTXO& verified_utxo);
+
+  // Check the signature of "utxo" with the public key of its first input.
+  // It does not change any state and can be called from multiple threads
+  // ahead of AddTransaction().
+  // Return the public key that has verified the signature, or an empty string
+  // if the signature is invalid or the input does not exist yet.
+  std::string VerifySignature(const UTXO& utxo);
 
   std::vector<UTXO> GetUTXO(int64_t end_id, int num);
 
+  // Cursor based query of the transactions. See TxMempool::QueryUTXO().
+  int64_t QueryUTXO(int64_t start_id, int limit, const std::string& address,
+                    google::protobuf::RepeatedPtrField<UTXO>* utxos);
+
+  int64_t GetBalance(const std::string& address);
+
  private:
+  int64_t AddTransaction(const UTXO& utxo, const std::string& verified_pub_key);
   int AddCoin(const UTXO& utxo);
   bool VerifyUTXO(const UTXO& utxo, const std::vector<UTXOOut>& ins);
   int64_t GetUTXOOutValue(int64_t tx_id, int out_idx,
                           const std::string& address);
 
-  absl::StatusOr<std::vector<UTXOOut>> GetInput(const UTXO& utxo);
+  absl::StatusOr<std::vector<UTXOOut>> GetInput(
+      const UTXO& utxo, const std::string& verified_pub_key);
 
  private:
   std::unique_ptr<TxMempool> tx_mempool_;
   Config config_;
   Wallet* wallet_;
+  // The mempool and the wallet may share the same storage. Queries hold
+  // the lock so that they can be served while transactions are applied.
+  std::mutex mutex_;
 };
 
 }  // namespace utxo
@@ -112,6 +112,51 @@ TEST(TransanctionTest, DefaultUTXO) {
   EXPECT_EQ(wallet.GetCoin("1234"), 234);
 }
 
+TEST(TransanctionTest, VerifiedUTXO) {
+  SecretKey key = KeyGenerator ::GeneratorKeys(SignatureInfo::ECDSA);
+  SecretKey other_key = KeyGenerator ::GeneratorKeys(SignatureInfo::ECDSA);
+
+  Config config;
+  {
+    auto* gensis_txn = config.mutable_genesis_transactions();
+    UTXO* utxo = gensis_txn->add_transactions();
+    UTXOOut* out = utxo->add_out();
+    out->set_address("0001");
+    out->set_value(1234);
+    out->set_pub_key(key.public_key());
+  }
+
+  Wallet wallet;
+  Transaction transaction(config, &wallet);
+
+  UTXO utxo;
+  UTXOIn* in = utxo.add_in();
+  in->set_prev_id(0);
+  in->set_out_idx(0);
+
+  UTXOOut* out = utxo.add_out();
+  out->set_address("1234");
+  out->set_value(234);
+  utxo.set_address("0001");
+
+  utxo.set_sig(utils::ECDSASignString(other_key.private_key(),
+                                      utxo.address() + std::to_string(0)));
+  EXPECT_EQ(transaction.VerifySignature(utxo), "");
+
+  utxo.set_sig(utils::ECDSASignString(key.private_key(),
+                                      utxo.address() + std::to_string(0)));
+  EXPECT_EQ(transaction.VerifySignature(utxo), key.public_key());
+
+  VerifiedUTXO verified_utxo;
+  *verified_utxo.mutable_utxo() = utxo;
+  verified_utxo.set_verified_pub_key(transaction.VerifySignature(utxo));
+  EXPECT_EQ(transaction.AddTransaction(verified_utxo), 1);
+  // The input has been spent.
+  EXPECT_EQ(transaction.AddTransaction(verified_utxo), -1);
+
+  EXPECT_EQ(wallet.GetCoin("1234"), 234);
+}
+
 }  // namespace
 }  // namespace utxo
 }  // namespace resdb
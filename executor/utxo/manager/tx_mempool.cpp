@@ -21,102 +21,251 @@
 
 #include <glog/logging.h>
 
+#include <set>
+
+#include "chain/storage/memory_db.h"
+
 namespace resdb {
 namespace utxo {
 
-TxMempool::TxMempool() : id_(0) {}
+namespace {
+
+const int kDefaultCacheSize = 10000;
+const int kMaxQueryNum = 1000;
+const int kHistoryPageSize = 128;
+const char kNextIdKey[] = "utxo_next_id";
+
+// Ids are zero padded so that the transactions are sorted by id inside
+// ordered storages.
+std::string PaddedId(int64_t id) {
+  std::string id_str = std::to_string(id);
+  return std::string(20 - std::min<size_t>(20, id_str.size()), '0') + id_str;
+}
+
+std::string TxKey(int64_t id) { return "utxo_tx_" + PaddedId(id); }
+
+std::string OutKey(int64_t id, int out_idx) {
+  return "utxo_out_" + PaddedId(id) + "_" + std::to_string(out_idx);
+}
+
+// Each unspent output of an address has its own key under the address
+// prefix. The address is length prefixed so that the prefix of one address
+// does not cover the keys of another one.
+std::string AddrPrefix(const std::string& address) {
+  return "utxo_addr/" + std::to_string(address.size()) + "/" + address + "/";
+}
+
+std::string AddrKey(const std::string& address, int64_t id, int out_idx) {
+  return AddrPrefix(address) + PaddedId(id) + "_" + PaddedId(out_idx);
+}
+
+// The size and the pages of a history use disjoint prefixes, so that the
+// size key of one address never matches a page key of another one.
+std::string HistoryKey(const std::string& address) {
+  return "utxo_hist_meta/" + address;
+}
+
+std::string HistoryPageKey(const std::string& address, int64_t page) {
+  return "utxo_hist_page/" + address + "/" + PaddedId(page);
+}
+
+}  // namespace
+
+TxMempool::TxMempool() : TxMempool(nullptr) {}
+
+TxMempool::TxMempool(Storage* storage, int cache_size)
+    : storage_(storage), id_(0) {
+  if (storage_ == nullptr) {
+    local_storage_ = storage::NewMemoryDB();
+    storage_ = local_storage_.get();
+  }
+  cache_ = std::make_unique<LRUCache<std::string, std::string>>(
+      cache_size > 0 ? cache_size : kDefaultCacheSize);
+
+  std::string next_id = storage_->GetValue(kNextIdKey);
+  if (!next_id.empty()) {
+    id_ = std::stoll(next_id);
+    LOG(ERROR) << "recover utxo set from storage, next id:" << id_;
+  }
+}
+
 TxMempool::~TxMempool() {}
 
+int64_t TxMempool::Size() const { return id_; }
+
+std::string TxMempool::GetValue(const std::string& key) {
+  std::string value = cache_->Get(key);
+  if (value.empty()) {
+    value = storage_->GetValue(key);
+    if (!value.empty()) {
+      cache_->Put(key, value);
+    }
+  }
+  return value;
+}
+
+void TxMempool::SetValue(const std::string& key, const std::string& value) {
+  cache_->Put(key, value);
+  if (storage_->SetValue(key, value)) {
+    LOG(ERROR) << "write utxo storage fail, key:" << key;
+  }
+}
+
+void TxMempool::DelValue(const std::string& key) {
+  // An empty value is treated as a miss.
+  cache_->Put(key, "");
+  if (storage_->DelValue(key)) {
+    LOG(ERROR) << "delete utxo storage fail, key:" << key;
+  }
+}
+
+std::unique_ptr<UTXOOut> TxMempool::GetUnspentOut(int64_t id, int out_idx) {
+  std::string value = GetValue(OutKey(id, out_idx));
+  if (value.empty()) {
+    return nullptr;
+  }
+  auto out = std::make_unique<UTXOOut>();
+  if (!out->ParseFromString(value)) {
+    LOG(ERROR) << "parse utxo out fail:" << id << " idx:" << out_idx;
+    return nullptr;
+  }
+  return out;
+}
+
+std::unique_ptr<UTXO> TxMempool::GetTransaction(int64_t id) {
+  if (id < 0 || id >= id_) {
+    return nullptr;
+  }
+  std::string value = GetValue(TxKey(id));
+  if (value.empty()) {
+    return nullptr;
+  }
+  auto utxo = std::make_unique<UTXO>();
+  if (!utxo->ParseFromString(value)) {
+    LOG(ERROR) << "parse utxo fail:" << id;
+    return nullptr;
+  }
+  return utxo;
+}
+
+void TxMempool::AddAddressIndex(const std::string& address, int64_t id,
+                                int out_idx) {
+  UTXORef ref;
+  ref.set_transaction_id(id);
+  ref.set_out_idx(out_idx);
+  if (storage_->SetValue(AddrKey(address, id, out_idx),
+                         ref.SerializeAsString())) {
+    LOG(ERROR) << "write address index fail:" << address;
+  }
+}
+
+void TxMempool::RemoveAddressIndex(const std::string& address, int64_t id,
+                                   int out_idx) {
+  if (storage_->DelValue(AddrKey(address, id, out_idx))) {
+    LOG(ERROR) << "delete address index fail:" << address;
+  }
+}
+
 int64_t TxMempool::AddUTXO(const UTXO& utxo) {
-  LOG(ERROR) << "add utxo id:" << id_;
+  std::unique_lock<std::mutex> lk(mutex_);
   int64_t cur_id = id_++;
-  txs_[cur_id] = std::make_unique<UTXO>(utxo);
+
+  UTXO tx = utxo;
+  tx.set_transaction_id(cur_id);
+  for (int i = 0; i < tx.out_size(); ++i) {
+    UTXOOut* out = tx.mutable_out(i);
+    if (out->spent()) {
+      continue;
+    }
+    SetValue(OutKey(cur_id, i), out->SerializeAsString());
+    AddAddressIndex(out->address(), cur_id, i);
+  }
+  SetValue(TxKey(cur_id), tx.SerializeAsString());
+
+  std::set<std::string> addresses;
+  if (!tx.address().empty()) {
+    addresses.insert(tx.address());
+  }
+  for (const UTXOOut& out : tx.out()) {
+    if (!out.address().empty()) {
+      addresses.insert(out.address());
+    }
+  }
+  for (const std::string& address : addresses) {
+    AddHistory(address, cur_id);
+  }
+
+  SetValue(kNextIdKey, std::to_string(id_));
   return cur_id;
 }
 
 absl::StatusOr<UTXOOut> TxMempool::GetUTXO(int64_t id, int out_idx,
                                            const std::string& address) {
-  if (txs_.find(id) == txs_.end()) {
-    LOG(ERROR) << "no utxo:" << id;
-    return absl::InvalidArgumentError("id invalid.");
-  }
-
-  UTXO* utxo = txs_[id].get();
-
-  if (utxo->out_size() <= out_idx) {
+  std::unique_lock<std::mutex> lk(mutex_);
+  if (out_idx < 0) {
     LOG(ERROR) << " idx not found:" << out_idx << " id:" << id;
     return absl::InvalidArgumentError("id invalid.");
   }
 
-  if (utxo->out(out_idx).spent()) {
+  std::unique_ptr<UTXOOut> out = GetUnspentOut(id, out_idx);
+  if (out == nullptr) {
+    std::unique_ptr<UTXO> utxo = GetTransaction(id);
+    if (utxo == nullptr) {
+      LOG(ERROR) << "no utxo:" << id;
+      return absl::InvalidArgumentError("id invalid.");
+    }
+    if (utxo->out_size() <= out_idx) {
+      LOG(ERROR) << " idx not found:" << out_idx << " id:" << id;
+      return absl::InvalidArgumentError("id invalid.");
+    }
     LOG(ERROR) << " value has been spent:" << id << " idx:" << out_idx;
     return absl::InvalidArgumentError("id has been spent.");
   }
 
-  if (utxo->out(out_idx).address() != address) {
+  if (out->address() != address) {
     LOG(ERROR) << " address not match:" << address
-               << " utxo addr:" << utxo->out(out_idx).address();
+               << " utxo addr:" << out->address();
     return absl::InvalidArgumentError("address invalid.");
   }
-  return utxo->out(out_idx);
+  return *out;
 }
 
 int64_t TxMempool::GetUTXOOutValue(int64_t id, int out_idx,
                                    const std::string& address) {
-  if (txs_.find(id) == txs_.end()) {
-    LOG(ERROR) << "no utxo:" << id;
+  absl::StatusOr<UTXOOut> out_or = GetUTXO(id, out_idx, address);
+  if (!out_or.ok()) {
     return -1;
   }
-
-  UTXO* utxo = txs_[id].get();
-
-  if (utxo->out_size() <= out_idx) {
-    LOG(ERROR) << " idx not found:" << out_idx << " id:" << id;
-    return -1;
-  }
-
-  if (utxo->out(out_idx).spent()) {
-    LOG(ERROR) << " value has been spent:" << id << " idx:" << out_idx;
-    return -1;
-  }
-  if (utxo->out(out_idx).address() != address) {
-    LOG(ERROR) << " address not match:" << address
-               << " utxo addr:" << utxo->out(out_idx).address();
-    return -1;
-  }
-  return utxo->out(out_idx).value();
+  return (*out_or).value();
 }
 
 int64_t TxMempool::MarkSpend(int64_t id, int out_idx,
                              const std::string& address) {
-  if (txs_.find(id) == txs_.end()) {
-    LOG(ERROR) << "no utxo:" << id;
-    return -1;
-  }
-
-  UTXO* utxo = txs_[id].get();
-  if (utxo->out_size() <= out_idx) {
-    LOG(ERROR) << " idx not found:" << out_idx << " id:" << id;
+  std::unique_lock<std::mutex> lk(mutex_);
+  std::unique_ptr<UTXOOut> out = GetUnspentOut(id, out_idx);
+  if (out == nullptr) {
+    LOG(ERROR) << "no unspent utxo:" << id << " idx:" << out_idx;
     return -1;
   }
 
-  utxo->mutable_out(out_idx)->set_spent(true);
-  return utxo->out(out_idx).value();
+  DelValue(OutKey(id, out_idx));
+  RemoveAddressIndex(out->address(), id, out_idx);
+  return out->value();
 }
 
 std::vector<UTXO> TxMempool::GetUTXO(int64_t end_idx, int num) {
+  std::unique_lock<std::mutex> lk(mutex_);
   if (end_idx == -1) {
-    int64_t max_id = ((--txs_.end())->first);
-    end_idx = max_id;
+    end_idx = id_ - 1;
   }
 
   std::vector<UTXO> resp;
   for (int i = 0; i < num; ++i) {
-    if (txs_.find(end_idx - i) == txs_.end()) {
+    UTXO utxo;
+    if (!ReadTransaction(end_idx - i, &utxo)) {
       break;
     }
-    resp.push_back(*txs_[end_idx - i]);
-    resp.back().set_transaction_id(end_idx - i);
+    resp.push_back(std::move(utxo));
   }
 
   std::reverse(resp.begin(), resp.end());
@@ -124,5 +273,129 @@ std::vector<UTXO> TxMempool::GetUTXO(int64_t end_idx, int num) {
   return resp;
 }
 
+bool TxMempool::ReadTransaction(int64_t id, UTXO* utxo) {
+  if (id < 0 || id >= id_) {
+    return false;
+  }
+  std::string value = GetValue(TxKey(id));
+  if (value.empty() || !utxo->ParseFromString(value)) {
+    return false;
+  }
+  // Spent outputs have been pruned from the unspent set.
+  for (int i = 0; i < utxo->out_size(); ++i) {
+    utxo->mutable_out(i)->set_spent(GetUnspentOut(id, i) == nullptr);
+  }
+  return true;
+}
+
+int64_t TxMempool::QueryUTXO(int64_t start_id, int limit,
+                             const std::string& address,
+                             google::protobuf::RepeatedPtrField<UTXO>* utxos) {
+  std::unique_lock<std::mutex> lk(mutex_);
+  if (limit <= 0 || limit > kMaxQueryNum) {
+    limit = kMaxQueryNum;
+  }
+  start_id = std::max<int64_t>(start_id, 0);
+  if (!address.empty()) {
+    return QueryHistory(start_id, limit, address, utxos);
+  }
+
+  int64_t end_id = std::min<int64_t>(start_id + limit, id_);
+  for (int64_t id = start_id; id < end_id; ++id) {
+    if (!ReadTransaction(id, utxos->Add())) {
+      utxos->RemoveLast();
+      LOG(ERROR) << "read utxo fail:" << id;
+    }
+  }
+  return end_id < id_ ? end_id : -1;
+}
+
+void TxMempool::AddHistory(const std::string& address, int64_t id) {
+  int64_t size = GetHistorySize(address);
+  UTXOHistoryPage page = GetHistoryPage(address, size / kHistoryPageSize);
+  page.add_transaction_ids(id);
+  SetValue(HistoryPageKey(address, size / kHistoryPageSize),
+           page.SerializeAsString());
+  SetValue(HistoryKey(address), std::to_string(size + 1));
+}
+
+int64_t TxMempool::GetHistorySize(const std::string& address) {
+  std::string value = GetValue(HistoryKey(address));
+  return value.empty() ? 0 : std::stoll(value);
+}
+
+UTXOHistoryPage TxMempool::GetHistoryPage(const std::string& address,
+                                          int64_t page) {
+  UTXOHistoryPage history_page;
+  history_page.ParseFromString(GetValue(HistoryPageKey(address, page)));
+  return history_page;
+}
+
+int64_t TxMempool::QueryHistory(
+    int64_t start_id, int limit, const std::string& address,
+    google::protobuf::RepeatedPtrField<UTXO>* utxos) {
+  int64_t page_num =
+      (GetHistorySize(address) + kHistoryPageSize - 1) / kHistoryPageSize;
+
+  // Ids are added in increasing order. Find the first page whose last id
+  // is not smaller than start_id.
+  int64_t low = 0, high = page_num;
+  while (low < high) {
+    int64_t mid = (low + high) / 2;
+    UTXOHistoryPage page = GetHistoryPage(address, mid);
+    if (page.transaction_ids_size() == 0 ||
+        page.transaction_ids(page.transaction_ids_size() - 1) >= start_id) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+
+  int num = 0;
+  for (int64_t p = low; p < page_num; ++p) {
+    UTXOHistoryPage page = GetHistoryPage(address, p);
+    for (int64_t id : page.transaction_ids()) {
+      if (id < start_id) {
+        continue;
+      }
+      if (num >= limit) {
+        return id;
+      }
+      if (!ReadTransaction(id, utxos->Add())) {
+        utxos->RemoveLast();
+        LOG(ERROR) << "read utxo fail:" << id;
+        continue;
+      }
+      num++;
+    }
+  }
+  return -1;
+}
+
+std::string TxMempool::GetPubKey(int64_t id, int out_idx) {
+  std::unique_lock<std::mutex> lk(mutex_);
+  // Outputs are never changed once added, so the transaction record is
+  // enough even if the output has been spent.
+  std::unique_ptr<UTXO> utxo = GetTransaction(id);
+  if (utxo == nullptr || out_idx < 0 || utxo->out_size() <= out_idx) {
+    return "";
+  }
+  return utxo->out(out_idx).pub_key();
+}
+
+std::vector<UTXORef> TxMempool::GetUnspentUTXO(const std::string& address) {
+  std::unique_lock<std::mutex> lk(mutex_);
+  std::vector<UTXORef> refs;
+  for (const auto& item : storage_->GetValuesWithPrefix(AddrPrefix(address))) {
+    UTXORef ref;
+    if (!ref.ParseFromString(item.second)) {
+      LOG(ERROR) << "parse address index fail:" << item.first;
+      continue;
+    }
+    refs.push_back(std::move(ref));
+  }
+  return refs;
+}
+
 }  // namespace utxo
 }  // namespace resdb
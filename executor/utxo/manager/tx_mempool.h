@@ -19,15 +19,30 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+
 #include "absl/status/statusor.h"
+#include "chain/storage/storage.h"
+#include "common/lru/lru_cache.h"
 #include "proto/utxo/utxo.pb.h"
 
 namespace resdb {
 namespace utxo {
 
+// TxMempool keeps the UTXO set inside a Storage.
+// Each transaction is stored once under its id. Every unspent output is
+// indexed by (transaction id, out idx) and by its owner address. Outputs are
+// pruned from both indexes once they are spent. A bounded LRU cache sits in
+// front of the storage to serve the hot entries.
 class TxMempool {
  public:
+  // Use a private memory storage.
   TxMempool();
+  // "storage" is owned by the caller and must outlive the mempool.
+  // The state is recovered from the storage if it exists.
+  TxMempool(Storage* storage, int cache_size = 0);
   ~TxMempool();
 
   // Add a new utxo and return the transaction id.
@@ -40,14 +55,54 @@ class TxMempool {
   absl::StatusOr<UTXOOut> GetUTXO(int64_t id, int out_idx,
                                   const std::string& address);
 
-  // Mark the output of a trans has been spent.
+  // Mark the output of a trans has been spent and remove it from the
+  // unspent set.
   // Return the out value.
   int64_t MarkSpend(int64_t id, int out_idx, const std::string& address);
 
   std::vector<UTXO> GetUTXO(int64_t end_idx, int num);
 
+  // Add up to "limit" transactions with ids from "start_id" to "utxos" in
+  // increasing order. If "address" is not empty, only the transactions sent
+  // from or to it are added.
+  // Return the id to continue the query from, or -1 if there are no more
+  // transactions.
+  int64_t QueryUTXO(int64_t start_id, int limit, const std::string& address,
+                    google::protobuf::RepeatedPtrField<UTXO>* utxos);
+
+  // Return the public key of the output[out_idx] of transaction "id",
+  // whether it has been spent or not. Return an empty string if it does
+  // not exist.
+  std::string GetPubKey(int64_t id, int out_idx);
+
+  // Return the unspent outputs owned by "address".
+  std::vector<UTXORef> GetUnspentUTXO(const std::string& address);
+
+  // Return the number of transactions that have been added.
+  int64_t Size() const;
+
+ private:
+  std::unique_ptr<UTXOOut> GetUnspentOut(int64_t id, int out_idx);
+  std::unique_ptr<UTXO> GetTransaction(int64_t id);
+  void AddAddressIndex(const std::string& address, int64_t id, int out_idx);
+  void RemoveAddressIndex(const std::string& address, int64_t id, int out_idx);
+  bool ReadTransaction(int64_t id, UTXO* utxo);
+
+  void AddHistory(const std::string& address, int64_t id);
+  int64_t GetHistorySize(const std::string& address);
+  UTXOHistoryPage GetHistoryPage(const std::string& address, int64_t page);
+  int64_t QueryHistory(int64_t start_id, int limit, const std::string& address,
+                       google::protobuf::RepeatedPtrField<UTXO>* utxos);
+
+  std::string GetValue(const std::string& key);
+  void SetValue(const std::string& key, const std::string& value);
+  void DelValue(const std::string& key);
+
  private:
-  std::map<int64_t, std::unique_ptr<UTXO> > txs_;
+  std::unique_ptr<Storage> local_storage_;
+  Storage* storage_;
+  std::unique_ptr<LRUCache<std::string, std::string>> cache_;
+  std::mutex mutex_;
   std::atomic<int64_t> id_;
 };
 
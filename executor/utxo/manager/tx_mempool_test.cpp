@@ -22,6 +22,7 @@
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
+#include "chain/storage/memory_db.h"
 #include "common/test/test_macros.h"
 
 namespace resdb {
@@ -191,6 +192,165 @@ TEST(TxMempoolTest, GetList) {
   }
 }
 
+TEST(TxMempoolTest, GetEmptyList) {
+  TxMempool pool;
+  EXPECT_TRUE(pool.GetUTXO(-1, 2).empty());
+}
+
+TEST(TxMempoolTest, PruneSpentOutput) {
+  UTXO utxo;
+  {
+    auto out = utxo.add_out();
+    out->set_value(100);
+    out->set_address("0000");
+  }
+  {
+    auto out = utxo.add_out();
+    out->set_value(200);
+    out->set_address("0000");
+  }
+  utxo.set_address("0001");
+
+  TxMempool pool;
+  EXPECT_EQ(pool.AddUTXO(utxo), 0);
+  EXPECT_EQ(pool.GetUnspentUTXO("0000").size(), 2);
+
+  EXPECT_EQ(pool.MarkSpend(0, 0, "0000"), 100);
+  EXPECT_EQ(pool.MarkSpend(0, 0, "0000"), -1);
+
+  std::vector<UTXORef> refs = pool.GetUnspentUTXO("0000");
+  EXPECT_EQ(refs.size(), 1);
+  EXPECT_EQ(refs[0].transaction_id(), 0);
+  EXPECT_EQ(refs[0].out_idx(), 1);
+
+  auto value_or = pool.GetUTXO(0, 0, "0000");
+  EXPECT_FALSE(value_or.ok());
+
+  auto list = pool.GetUTXO(-1, 1);
+  EXPECT_EQ(list.size(), 1);
+  EXPECT_TRUE(list[0].out(0).spent());
+  EXPECT_FALSE(list[0].out(1).spent());
+}
+
+TEST(TxMempoolTest, UnspentOfAddressWithSamePrefix) {
+  // The outputs of "0000/1" are not listed under "0000".
+  TxMempool pool;
+  for (int i = 0; i < 4; ++i) {
+    UTXO utxo;
+    for (int j = 0; j < 2; ++j) {
+      auto out = utxo.add_out();
+      out->set_value(100);
+      out->set_address(i % 2 ? "0000/1" : "0000");
+    }
+    EXPECT_EQ(pool.AddUTXO(utxo), i);
+  }
+  EXPECT_EQ(pool.MarkSpend(2, 0, "0000"), 100);
+
+  std::vector<UTXORef> refs = pool.GetUnspentUTXO("0000");
+  ASSERT_EQ(refs.size(), 3);
+  EXPECT_EQ(refs[0].transaction_id(), 0);
+  EXPECT_EQ(refs[0].out_idx(), 0);
+  EXPECT_EQ(refs[1].transaction_id(), 0);
+  EXPECT_EQ(refs[1].out_idx(), 1);
+  EXPECT_EQ(refs[2].transaction_id(), 2);
+  EXPECT_EQ(refs[2].out_idx(), 1);
+  EXPECT_EQ(pool.GetUnspentUTXO("0000/1").size(), 4);
+}
+
+TEST(TxMempoolTest, QueryRange) {
+  TxMempool pool;
+  // Transaction i pays to address "000<i%2>".
+  for (int i = 0; i < 300; ++i) {
+    UTXO utxo;
+    auto out = utxo.add_out();
+    out->set_value(100);
+    out->set_address("000" + std::to_string(i % 2));
+    EXPECT_EQ(pool.AddUTXO(utxo), i);
+  }
+
+  {
+    google::protobuf::RepeatedPtrField<UTXO> utxos;
+    EXPECT_EQ(pool.QueryUTXO(10, 5, "", &utxos), 15);
+    ASSERT_EQ(utxos.size(), 5);
+    EXPECT_EQ(utxos[0].transaction_id(), 10);
+    EXPECT_EQ(utxos[4].transaction_id(), 14);
+  }
+  {
+    google::protobuf::RepeatedPtrField<UTXO> utxos;
+    EXPECT_EQ(pool.QueryUTXO(295, 10, "", &utxos), -1);
+    EXPECT_EQ(utxos.size(), 5);
+  }
+  {
+    google::protobuf::RepeatedPtrField<UTXO> utxos;
+    EXPECT_EQ(pool.QueryUTXO(260, 3, "0001", &utxos), 267);
+    ASSERT_EQ(utxos.size(), 3);
+    EXPECT_EQ(utxos[0].transaction_id(), 261);
+    EXPECT_EQ(utxos[1].transaction_id(), 263);
+    EXPECT_EQ(utxos[2].transaction_id(), 265);
+  }
+  {
+    google::protobuf::RepeatedPtrField<UTXO> utxos;
+    EXPECT_EQ(pool.QueryUTXO(0, 1000, "0000", &utxos), -1);
+    EXPECT_EQ(utxos.size(), 150);
+  }
+  {
+    google::protobuf::RepeatedPtrField<UTXO> utxos;
+    EXPECT_EQ(pool.QueryUTXO(0, 10, "0002", &utxos), -1);
+    EXPECT_EQ(utxos.size(), 0);
+  }
+}
+
+TEST(TxMempoolTest, QueryAddressWithPageSuffix) {
+  // The second address looks like a history page of the first one.
+  const std::string address = "0000";
+  const std::string page_address = "0000_00000000000000000000";
+  TxMempool pool;
+  for (int i = 0; i < 4; ++i) {
+    UTXO utxo;
+    auto out = utxo.add_out();
+    out->set_value(100);
+    out->set_address(i % 2 ? page_address : address);
+    EXPECT_EQ(pool.AddUTXO(utxo), i);
+  }
+
+  {
+    google::protobuf::RepeatedPtrField<UTXO> utxos;
+    EXPECT_EQ(pool.QueryUTXO(0, 10, address, &utxos), -1);
+    ASSERT_EQ(utxos.size(), 2);
+    EXPECT_EQ(utxos[0].transaction_id(), 0);
+    EXPECT_EQ(utxos[1].transaction_id(), 2);
+  }
+  {
+    google::protobuf::RepeatedPtrField<UTXO> utxos;
+    EXPECT_EQ(pool.QueryUTXO(0, 10, page_address, &utxos), -1);
+    ASSERT_EQ(utxos.size(), 2);
+    EXPECT_EQ(utxos[0].transaction_id(), 1);
+    EXPECT_EQ(utxos[1].transaction_id(), 3);
+  }
+}
+
+TEST(TxMempoolTest, RecoverFromStorage) {
+  std::unique_ptr<Storage> storage = storage::NewMemoryDB();
+  UTXO utxo;
+  auto out = utxo.add_out();
+  out->set_value(100);
+  out->set_address("0000");
+  utxo.set_address("0001");
+
+  {
+    TxMempool pool(storage.get());
+    EXPECT_EQ(pool.AddUTXO(utxo), 0);
+    EXPECT_EQ(pool.AddUTXO(utxo), 1);
+    EXPECT_EQ(pool.MarkSpend(0, 0, "0000"), 100);
+  }
+
+  TxMempool pool(storage.get());
+  EXPECT_EQ(pool.Size(), 2);
+  EXPECT_EQ(pool.GetUTXOOutValue(0, 0, "0000"), -1);
+  EXPECT_EQ(pool.GetUTXOOutValue(1, 0, "0000"), 100);
+  EXPECT_EQ(pool.AddUTXO(utxo), 2);
+}
+
 }  // namespace
 }  // namespace utxo
 }  // namespace resdb
@@ -21,18 +21,43 @@
 
 #include <glog/logging.h>
 
+#include "chain/storage/memory_db.h"
+
 namespace resdb {
 namespace utxo {
 
-Wallet::Wallet() {}
+namespace {
+
+std::string WalletKey(const std::string& address) {
+  return "utxo_wallet_" + address;
+}
+
+}  // namespace
+
+Wallet::Wallet() : Wallet(nullptr) {}
+
+Wallet::Wallet(Storage* storage) : storage_(storage) {
+  if (storage_ == nullptr) {
+    local_storage_ = storage::NewMemoryDB();
+    storage_ = local_storage_.get();
+  }
+}
+
 Wallet::~Wallet() {}
 
 int Wallet::AddCoin(const std::string& address, int64_t value) {
-  wallet_[address] += value;
-  return 0;
+  std::unique_lock<std::mutex> lk(mutex_);
+  std::string value_str = storage_->GetValue(WalletKey(address));
+  int64_t balance = value_str.empty() ? 0 : std::stoll(value_str);
+  return storage_->SetValue(WalletKey(address),
+                            std::to_string(balance + value));
 }
 
-int64_t Wallet::GetCoin(const std::string& address) { return wallet_[address]; }
+int64_t Wallet::GetCoin(const std::string& address) {
+  std::unique_lock<std::mutex> lk(mutex_);
+  std::string value_str = storage_->GetValue(WalletKey(address));
+  return value_str.empty() ? 0 : std::stoll(value_str);
+}
 
 }  // namespace utxo
 }  // namespace resdb
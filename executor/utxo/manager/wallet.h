@@ -19,14 +19,22 @@
 
 #pragma once
 
+#include <memory>
+#include <mutex>
+
+#include "chain/storage/storage.h"
 #include "proto/utxo/utxo.pb.h"
 
 namespace resdb {
 namespace utxo {
 
+// Wallet keeps the balance of each address inside a Storage.
 class Wallet {
  public:
+  // Use a private memory storage.
   Wallet();
+  // "storage" is owned by the caller and must outlive the wallet.
+  Wallet(Storage* storage);
   ~Wallet();
 
   int AddCoin(const std::string& address, int64_t value);
@@ -34,7 +42,9 @@ class Wallet {
   int64_t GetCoin(const std::string& address);
 
  private:
-  std::map<std::string, int64_t> wallet_;
+  std::unique_ptr<Storage> local_storage_;
+  Storage* storage_;
+  std::mutex mutex_;
 };
 
 }  // namespace utxo
@@ -22,6 +22,8 @@
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
+#include "chain/storage/memory_db.h"
+
 namespace resdb {
 namespace utxo {
 namespace {
@@ -35,6 +37,17 @@ TEST(WalletTest, AddCoin) {
   EXPECT_EQ(coin.GetCoin("4321"), 0);
 }
 
+TEST(WalletTest, RecoverFromStorage) {
+  std::unique_ptr<Storage> storage = storage::NewMemoryDB();
+  {
+    Wallet coin(storage.get());
+    coin.AddCoin("1234", 100);
+    coin.AddCoin("1234", -30);
+  }
+  Wallet coin(storage.get());
+  EXPECT_EQ(coin.GetCoin("1234"), 70);
+}
+
 }  // namespace
 }  // namespace utxo
 }  // namespace resdb
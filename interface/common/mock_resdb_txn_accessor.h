@@ -32,6 +32,10 @@ class MockResDBTxnAccessor : public ResDBTxnAccessor {
 
   MOCK_METHOD((absl::StatusOr<std::vector<std::pair<uint64_t, std::string>>>),
               GetTxn, (uint64_t, uint64_t), (override));
+  MOCK_METHOD(absl::Status, Subscribe,
+              (uint64_t, (std::function<void(uint64_t, const std::string&)>),
+               std::function<bool()>),
+              (override));
 };
 
 }  // namespace resdb
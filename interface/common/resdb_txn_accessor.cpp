@@ -25,6 +25,13 @@
 #include <thread>
 
 namespace resdb {
+namespace {
+
+constexpr uint32_t kSubscribeWindow = 1000;
+// The replica sends a heart beat every second.
+constexpr int kSubscribeTimeoutUs = 3000000;
+
+}  // namespace
 
 ResDBTxnAccessor::ResDBTxnAccessor(const ResDBConfig& config)
     : config_(config),
@@ -188,4 +195,84 @@ absl::StatusOr<uint64_t> ResDBTxnAccessor::GetBlockNumbers() {
   return resp.max_seq();
 }
 
+absl::Status ResDBTxnAccessor::Subscribe(
+    uint64_t start_seq,
+    std::function<void(uint64_t, const std::string&)> call_back,
+    std::function<bool()> is_stop) {
+  if (replicas_.empty()) {
+    return absl::InvalidArgumentError("no replica.");
+  }
+  uint64_t next_seq = start_seq;
+  for (size_t i = 0; !is_stop(); i = (i + 1) % replicas_.size()) {
+    SubscribeFromReplica(replicas_[i], &next_seq, call_back, is_stop);
+    if (!is_stop()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+  }
+  return absl::OkStatus();
+}
+
+void ResDBTxnAccessor::SubscribeFromReplica(
+    const ReplicaInfo& replica, uint64_t* next_seq,
+    const std::function<void(uint64_t, const std::string&)>& call_back,
+    const std::function<bool()>& is_stop) {
+  std::unique_ptr<NetChannel> client =
+      GetNetChannel(replica.ip(), replica.port());
+  client->IsLongConnection(true);
+
+  SubscribeRequest request;
+  request.set_start_seq(*next_seq);
+  request.set_window(kSubscribeWindow);
+  if (client->SendRequest(request, Request::TYPE_SUBSCRIBE)) {
+    LOG(ERROR) << "subscribe to replica:" << replica.id() << " fail";
+    return;
+  }
+  // Set the timeout after connecting as the socket is reset when connecting.
+  client->SetRecvTimeout(kSubscribeTimeoutUs);
+
+  while (!is_stop()) {
+    std::string response_str;
+    if (client->RecvRawMessageData(&response_str) <= 0) {
+      LOG(ERROR) << "recv from replica:" << replica.id() << " fail";
+      return;
+    }
+    ResDBMessage message;
+    SubscribeResponse response;
+    if (!message.ParseFromString(response_str) ||
+        !response.ParseFromString(message.data())) {
+      LOG(ERROR) << "parse subscribe response fail";
+      return;
+    }
+    if (response.out_of_range()) {
+      LOG(ERROR) << "seq:" << *next_seq
+                 << " is not available in replica:" << replica.id();
+      return;
+    }
+    uint64_t last_seq = *next_seq;
+    for (const Request& transaction : response.transactions()) {
+      if (*next_seq == 0) {
+        *next_seq = transaction.seq();
+      }
+      if (transaction.seq() < *next_seq) {
+        continue;
+      }
+      if (transaction.seq() > *next_seq) {
+        LOG(ERROR) << "miss seq:" << *next_seq
+                   << " from replica:" << replica.id();
+        return;
+      }
+      call_back(transaction.seq(), transaction.data());
+      (*next_seq)++;
+    }
+    if (*next_seq == last_seq) {
+      continue;
+    }
+    SubscribeAck ack;
+    ack.set_acked_seq(*next_seq - 1);
+    if (client->SendRawMessage(ack)) {
+      return;
+    }
+  }
+}
+
 }  // namespace resdb
@@ -19,6 +19,8 @@
 
 #pragma once
 
+#include <functional>
+
 #include "absl/status/statusor.h"
 #include "interface/rdbc/net_channel.h"
 #include "platform/config/resdb_config.h"
@@ -41,10 +43,26 @@ class ResDBTxnAccessor {
       uint64_t min_seq, uint64_t max_seq, const ReplicaInfo& replica);
   virtual absl::StatusOr<uint64_t> GetBlockNumbers();
 
+  // Subscribe the committed transactions from 'start_seq'. The transactions
+  // are passed to 'call_back' in seq order until 'is_stop' returns true.
+  // It switches to another replica and resumes from the next seq if the
+  // connection is broken.
+  virtual absl::Status Subscribe(
+      uint64_t start_seq,
+      std::function<void(uint64_t, const std::string&)> call_back,
+      std::function<bool()> is_stop);
+
  protected:
   virtual std::unique_ptr<NetChannel> GetNetChannel(const std::string& ip,
                                                     int port);
 
+ private:
+  // Receive transactions from one replica until the connection fails.
+  void SubscribeFromReplica(
+      const ReplicaInfo& replica, uint64_t* next_seq,
+      const std::function<void(uint64_t, const std::string&)>& call_back,
+      const std::function<bool()>& is_stop);
+
  private:
   ResDBConfig config_;
   std::vector<ReplicaInfo> replicas_;
@@ -158,5 +158,82 @@ TEST(ResDBTxnAccessorTest, GetTransactionsOneDelay) {
   EXPECT_THAT(*resp, ElementsAre(std::make_pair(1, "test_resp")));
 }
 
+std::string GetSubscribeResponse(const std::vector<uint64_t>& seqs) {
+  SubscribeResponse response;
+  response.set_heart_beat(seqs.empty());
+  for (uint64_t seq : seqs) {
+    Request* txn = response.add_transactions();
+    txn->set_seq(seq);
+    txn->set_data("txn_" + std::to_string(seq));
+  }
+  ResDBMessage message;
+  response.SerializeToString(message.mutable_data());
+  std::string message_str;
+  message.SerializeToString(&message_str);
+  return message_str;
+}
+
+TEST(ResDBTxnAccessorTest, Subscribe) {
+  ResDBConfig config({GenerateReplicaInfo(1, "127.0.0.1", 1234),
+                      GenerateReplicaInfo(2, "127.0.0.1", 1235),
+                      GenerateReplicaInfo(3, "127.0.0.1", 1236),
+                      GenerateReplicaInfo(4, "127.0.0.1", 1237)},
+                     GenerateReplicaInfo(1, "127.0.0.1", 1234));
+
+  bool stop = false;
+  MockResDBTxnAccessor client(config);
+  EXPECT_CALL(client, GetNetChannel)
+      .Times(2)
+      .WillRepeatedly(Invoke([&](const std::string& ip, int port) {
+        auto client = std::make_unique<MockNetChannel>(ip, port);
+        SubscribeRequest request;
+        request.set_start_seq(port == 1234 ? 1 : 3);
+        request.set_window(1000);
+        SubscribeAck ack;
+        ack.set_acked_seq(port == 1234 ? 2 : 3);
+        EXPECT_CALL(*client, SendRequest(EqualsProto(request),
+                                         Request::TYPE_SUBSCRIBE, _))
+            .WillOnce(Return(0));
+        EXPECT_CALL(*client, SendRawMessage(EqualsProto(ack)))
+            .WillOnce(Return(0));
+        if (port == 1234) {
+          // The connection is closed after sending 1 and 2.
+          EXPECT_CALL(*client, RecvRawMessageData)
+              .WillOnce(Invoke([&](std::string* resp) {
+                *resp = GetSubscribeResponse({1, 2});
+                return resp->size();
+              }))
+              .WillOnce(Return(0));
+        } else {
+          EXPECT_CALL(*client, RecvRawMessageData)
+              .WillOnce(Invoke([&](std::string* resp) {
+                *resp = GetSubscribeResponse({});
+                return resp->size();
+              }))
+              .WillOnce(Invoke([&](std::string* resp) {
+                *resp = GetSubscribeResponse({2, 3});
+                return resp->size();
+              }))
+              .WillOnce(Invoke([&](std::string* resp) {
+                stop = true;
+                return -1;
+              }));
+        }
+        return client;
+      }));
+
+  std::vector<std::pair<uint64_t, std::string>> txns;
+  absl::Status status = client.Subscribe(
+      1,
+      [&](uint64_t seq, const std::string& data) {
+        txns.push_back(std::make_pair(seq, data));
+      },
+      [&]() { return stop; });
+  EXPECT_TRUE(status.ok());
+  EXPECT_THAT(txns, ElementsAre(std::make_pair(1, "txn_1"),
+                                std::make_pair(2, "txn_2"),
+                                std::make_pair(3, "txn_3")));
+}
+
 }  // namespace
 }  // namespace resdb
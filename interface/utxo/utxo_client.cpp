@@ -70,6 +70,38 @@ std::vector<UTXO> UTXOClient::GetList(int64_t end_id, int num) {
   return utxo_list;
 }
 
+std::vector<UTXO> UTXOClient::GetRange(int64_t start_id, int limit,
+                                       const std::string& address,
+                                       int64_t* next_id) {
+  UTXOQuery query;
+  query.set_query_range(true);
+  query.set_start_id(start_id);
+  query.set_limit(limit);
+  query.set_address(address);
+
+  CustomQueryResponse response;
+  *next_id = -1;
+
+  int ret = SendRequest(query, Request::TYPE_CUSTOM_QUERY);
+  if (ret) {
+    LOG(ERROR) << "send request fail";
+    return std::vector<UTXO>();
+  }
+
+  ret = RecvRawMessage(&response);
+  if (ret) {
+    LOG(ERROR) << "recv response fail";
+    return std::vector<UTXO>();
+  }
+
+  UTXOQueryResponse utxo_response;
+  utxo_response.ParseFromString(response.resp_str());
+  *next_id = utxo_response.next_id();
+  return std::vector<UTXO>(
+      std::make_move_iterator(utxo_response.mutable_utxos()->begin()),
+      std::make_move_iterator(utxo_response.mutable_utxos()->end()));
+}
+
 int64_t UTXOClient::GetWallet(const std::string& address) {
   UTXOQuery query;
   query.set_query_transaction(false);
@@ -33,6 +33,13 @@ class UTXOClient : public TransactionConstructor {
 
   std::vector<UTXO> GetList(int64_t end_id, int num);
 
+  // Get up to "limit" transactions starting from "start_id". If "address" is
+  // not empty, only the transactions sent from or to it are returned.
+  // "next_id" is set to the start id of the next page, or -1 if there are no
+  // more transactions.
+  std::vector<UTXO> GetRange(int64_t start_id, int limit,
+                             const std::string& address, int64_t* next_id);
+
   int64_t GetWallet(const std::string& address);
 };
 
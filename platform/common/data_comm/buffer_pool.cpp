@@ -0,0 +1,124 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "platform/common/data_comm/buffer_pool.h"
+
+namespace resdb {
+
+BufferPool::Buffer::Buffer(BufferPool* pool, char* data, size_t capacity)
+    : pool_(pool), data_(data), capacity_(capacity) {}
+
+BufferPool::Buffer::Buffer(Buffer&& other)
+    : pool_(other.pool_), data_(other.data_), capacity_(other.capacity_) {
+  other.data_ = nullptr;
+  other.capacity_ = 0;
+}
+
+BufferPool::Buffer& BufferPool::Buffer::operator=(Buffer&& other) {
+  if (this != &other) {
+    Reset();
+    pool_ = other.pool_;
+    data_ = other.data_;
+    capacity_ = other.capacity_;
+    other.data_ = nullptr;
+    other.capacity_ = 0;
+  }
+  return *this;
+}
+
+BufferPool::Buffer::~Buffer() { Reset(); }
+
+char* BufferPool::Buffer::GetData() const { return data_; }
+
+size_t BufferPool::Buffer::GetCapacity() const { return capacity_; }
+
+void BufferPool::Buffer::Reset() {
+  if (data_ != nullptr) {
+    pool_->Release(data_, capacity_);
+    data_ = nullptr;
+    capacity_ = 0;
+  }
+}
+
+BufferPool::BufferPool(size_t min_size, size_t max_size,
+                       size_t max_cached_num)
+    : max_cached_num_(max_cached_num) {
+  for (size_t size = min_size; size <= max_size; size <<= 1) {
+    classes_.push_back(std::make_unique<SizeClass>());
+    classes_.back()->size = size;
+  }
+}
+
+BufferPool::~BufferPool() {
+  for (auto& size_class : classes_) {
+    for (char* data : size_class->buffers) {
+      delete[] data;
+    }
+  }
+}
+
+int BufferPool::GetClass(size_t size) const {
+  for (size_t i = 0; i < classes_.size(); ++i) {
+    if (classes_[i]->size >= size) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+BufferPool::Buffer BufferPool::Get(size_t size) {
+  int idx = GetClass(size);
+  if (idx < 0) {
+    in_use_bytes_ += size;
+    return Buffer(this, new char[size], size);
+  }
+  SizeClass* size_class = classes_[idx].get();
+  in_use_bytes_ += size_class->size;
+  {
+    std::lock_guard<std::mutex> lk(size_class->mutex);
+    if (!size_class->buffers.empty()) {
+      char* data = size_class->buffers.back();
+      size_class->buffers.pop_back();
+      cached_bytes_ -= size_class->size;
+      return Buffer(this, data, size_class->size);
+    }
+  }
+  return Buffer(this, new char[size_class->size], size_class->size);
+}
+
+void BufferPool::Release(char* data, size_t capacity) {
+  in_use_bytes_ -= capacity;
+  int idx = GetClass(capacity);
+  if (idx >= 0 && classes_[idx]->size == capacity) {
+    SizeClass* size_class = classes_[idx].get();
+    std::lock_guard<std::mutex> lk(size_class->mutex);
+    if (size_class->buffers.size() < max_cached_num_) {
+      size_class->buffers.push_back(data);
+      cached_bytes_ += capacity;
+      return;
+    }
+  }
+  delete[] data;
+}
+
+uint64_t BufferPool::GetInUseBytes() const { return in_use_bytes_; }
+
+uint64_t BufferPool::GetCachedBytes() const { return cached_bytes_; }
+
+}  // namespace resdb
@@ -0,0 +1,84 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace resdb {
+
+// BufferPool caches the released buffers in size classes of powers of two,
+// so that a buffer can be reused by the next request of a similar size.
+// Requests larger than the biggest class are allocated and freed directly.
+class BufferPool {
+ public:
+  // A buffer which goes back to its pool when it is destroyed.
+  class Buffer {
+   public:
+    Buffer() = default;
+    Buffer(BufferPool* pool, char* data, size_t capacity);
+    Buffer(Buffer&& other);
+    Buffer& operator=(Buffer&& other);
+    ~Buffer();
+
+    char* GetData() const;
+    size_t GetCapacity() const;
+    // Give the buffer back to the pool.
+    void Reset();
+
+   private:
+    BufferPool* pool_ = nullptr;
+    char* data_ = nullptr;
+    size_t capacity_ = 0;
+  };
+
+  // The classes go from min_size to max_size, each keeping at most
+  // max_cached_num released buffers.
+  BufferPool(size_t min_size = 1 << 10, size_t max_size = 4 << 20,
+             size_t max_cached_num = 64);
+  ~BufferPool();
+
+  // Get a buffer whose capacity is at least size.
+  Buffer Get(size_t size);
+
+  // The bytes of the buffers handed out and of the cached ones.
+  uint64_t GetInUseBytes() const;
+  uint64_t GetCachedBytes() const;
+
+ private:
+  void Release(char* data, size_t capacity);
+  // The index of the smallest class which fits size, or -1 if none does.
+  int GetClass(size_t size) const;
+
+ private:
+  struct SizeClass {
+    size_t size;
+    std::mutex mutex;
+    std::vector<char*> buffers;
+  };
+  std::vector<std::unique_ptr<SizeClass>> classes_;
+  size_t max_cached_num_;
+  std::atomic<uint64_t> in_use_bytes_ = 0;
+  std::atomic<uint64_t> cached_bytes_ = 0;
+};
+
+}  // namespace resdb
@@ -0,0 +1,85 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "platform/common/data_comm/buffer_pool.h"
+
+#include <gtest/gtest.h>
+
+namespace resdb {
+namespace {
+
+TEST(BufferPoolTest, ReuseBuffer) {
+  BufferPool pool(1024, 4096, 2);
+  char* data = nullptr;
+  {
+    BufferPool::Buffer buffer = pool.Get(1000);
+    EXPECT_EQ(buffer.GetCapacity(), 1024);
+    EXPECT_EQ(pool.GetInUseBytes(), 1024);
+    data = buffer.GetData();
+  }
+  EXPECT_EQ(pool.GetInUseBytes(), 0);
+  EXPECT_EQ(pool.GetCachedBytes(), 1024);
+
+  BufferPool::Buffer buffer = pool.Get(1024);
+  EXPECT_EQ(buffer.GetData(), data);
+  EXPECT_EQ(pool.GetCachedBytes(), 0);
+
+  BufferPool::Buffer large_buffer = pool.Get(3000);
+  EXPECT_EQ(large_buffer.GetCapacity(), 4096);
+  EXPECT_EQ(pool.GetInUseBytes(), 1024 + 4096);
+}
+
+TEST(BufferPoolTest, OversizedBuffer) {
+  BufferPool pool(1024, 4096, 2);
+  {
+    BufferPool::Buffer buffer = pool.Get(10000);
+    EXPECT_EQ(buffer.GetCapacity(), 10000);
+    EXPECT_EQ(pool.GetInUseBytes(), 10000);
+  }
+  EXPECT_EQ(pool.GetInUseBytes(), 0);
+  EXPECT_EQ(pool.GetCachedBytes(), 0);
+}
+
+TEST(BufferPoolTest, MaxCachedNum) {
+  BufferPool pool(1024, 4096, 2);
+  {
+    std::vector<BufferPool::Buffer> buffers;
+    for (int i = 0; i < 3; ++i) {
+      buffers.push_back(pool.Get(1024));
+    }
+  }
+  EXPECT_EQ(pool.GetCachedBytes(), 2 * 1024);
+}
+
+TEST(BufferPoolTest, MoveBuffer) {
+  BufferPool pool(1024, 4096, 2);
+  BufferPool::Buffer buffer = pool.Get(1024);
+  BufferPool::Buffer other = std::move(buffer);
+  EXPECT_EQ(buffer.GetData(), nullptr);
+  EXPECT_EQ(other.GetCapacity(), 1024);
+  other = pool.Get(2048);
+  EXPECT_EQ(pool.GetInUseBytes(), 2048);
+  EXPECT_EQ(pool.GetCachedBytes(), 1024);
+  other.Reset();
+  EXPECT_EQ(pool.GetInUseBytes(), 0);
+}
+
+}  // namespace
+
+}  // namespace resdb
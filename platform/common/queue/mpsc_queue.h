@@ -0,0 +1,147 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace resdb {
+
+// MPSCQueue is a bounded ring buffer for multiple producers and a single
+// consumer. Producers only take the lock to wake up the consumer when it is
+// waiting for new data.
+template <typename T>
+class MPSCQueue {
+ public:
+  // The capacity is rounded up to a power of 2.
+  MPSCQueue(size_t capacity = 4096) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    mask_ = size - 1;
+    cells_ = std::make_unique<Cell[]>(size);
+    for (size_t i = 0; i < size; ++i) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Return false if the queue is full.
+  bool TryPush(T&& data) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Cell* cell = nullptr;
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->data = std::move(data);
+    cell->seq.store(pos + 1, std::memory_order_release);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting_.load(std::memory_order_relaxed)) {
+      std::lock_guard<std::mutex> lk(mutex_);
+      cv_.notify_one();
+    }
+    return true;
+  }
+
+  // Wait until there is space in the queue.
+  void Push(T&& data) {
+    while (!TryPush(std::move(data))) {
+      std::this_thread::yield();
+    }
+  }
+
+  // Only called from the consumer.
+  bool TryPop(T* data) {
+    Cell* cell = &cells_[dequeue_pos_ & mask_];
+    if (cell->seq.load(std::memory_order_acquire) != dequeue_pos_ + 1) {
+      return false;
+    }
+    *data = std::move(cell->data);
+    cell->seq.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+    dequeue_pos_++;
+    return true;
+  }
+
+  // Pop at most 'max_num' items into 'items'. Wait at most 'timeout_us'
+  // if the queue is empty. Return the number of items popped.
+  size_t Pop(std::vector<T>* items, size_t max_num, int timeout_us) {
+    size_t num = PopAll(items, max_num);
+    if (num > 0 || timeout_us <= 0) {
+      return num;
+    }
+    std::unique_lock<std::mutex> lk(mutex_);
+    waiting_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    cv_.wait_for(lk, std::chrono::microseconds(timeout_us),
+                 [&] { return !Empty(); });
+    waiting_.store(false, std::memory_order_relaxed);
+    return PopAll(items, max_num);
+  }
+
+  // Only called from the consumer.
+  bool Empty() const {
+    return cells_[dequeue_pos_ & mask_].seq.load(std::memory_order_acquire) !=
+           dequeue_pos_ + 1;
+  }
+
+ private:
+  size_t PopAll(std::vector<T>* items, size_t max_num) {
+    size_t num = 0;
+    T data;
+    while (num < max_num && TryPop(&data)) {
+      items->push_back(std::move(data));
+      num++;
+    }
+    return num;
+  }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> seq;
+    T data;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_;
+  alignas(64) std::atomic<size_t> enqueue_pos_ = 0;
+  alignas(64) size_t dequeue_pos_ = 0;
+  std::atomic<bool> waiting_ = false;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+};
+
+}  // namespace resdb
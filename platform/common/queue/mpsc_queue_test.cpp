@@ -0,0 +1,83 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "platform/common/queue/mpsc_queue.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <thread>
+
+namespace resdb {
+namespace {
+
+using ::testing::ElementsAre;
+
+TEST(MPSCQueueTest, PushAndPop) {
+  MPSCQueue<std::string> queue(2);
+  EXPECT_TRUE(queue.Empty());
+  EXPECT_TRUE(queue.TryPush("1"));
+  EXPECT_TRUE(queue.TryPush("2"));
+  EXPECT_FALSE(queue.TryPush("3"));
+
+  std::vector<std::string> items;
+  EXPECT_EQ(queue.Pop(&items, 10, 0), 2);
+  EXPECT_THAT(items, ElementsAre("1", "2"));
+  EXPECT_TRUE(queue.Empty());
+  EXPECT_EQ(queue.Pop(&items, 10, 1000), 0);
+
+  EXPECT_TRUE(queue.TryPush("3"));
+  std::string item;
+  EXPECT_TRUE(queue.TryPop(&item));
+  EXPECT_EQ(item, "3");
+}
+
+TEST(MPSCQueueTest, MultiProducers) {
+  MPSCQueue<int> queue(16);
+  const int producer_num = 4;
+  const int item_num = 10000;
+  std::vector<std::thread> producers;
+  for (int i = 0; i < producer_num; ++i) {
+    producers.push_back(std::thread([&, i]() {
+      for (int j = 0; j < item_num; ++j) {
+        queue.Push(i * item_num + j);
+      }
+    }));
+  }
+
+  // Items from the same producer are popped in order.
+  std::vector<int> last(producer_num, -1);
+  int total = 0;
+  while (total < producer_num * item_num) {
+    std::vector<int> items;
+    total += queue.Pop(&items, 8, 100000);
+    for (int item : items) {
+      int producer = item / item_num;
+      EXPECT_GT(item, last[producer]);
+      last[producer] = item;
+    }
+  }
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  EXPECT_TRUE(queue.Empty());
+}
+
+}  // namespace
+}  // namespace resdb
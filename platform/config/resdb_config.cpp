@@ -76,6 +76,15 @@ ResDBConfig::ResDBConfig(const ResConfigData& config_data,
   if (config_data_.tcp_batch_num() == 0) {
     config_data_.set_tcp_batch_num(100);
   }
+  if (config_data_.max_coalesce_bytes() == 0) {
+    config_data_.set_max_coalesce_bytes(1 << 20);
+  }
+  if (config_data_.max_recv_frame_bytes() == 0) {
+    config_data_.set_max_recv_frame_bytes(1 << 30);
+  }
+  if (!config_data_.has_session_idle_timeout_s()) {
+    config_data_.set_session_idle_timeout_s(300);
+  }
   if (config_data_.max_process_txn() == 0) {
     config_data_.set_max_process_txn(64);
   }
@@ -243,6 +252,96 @@ uint32_t ResDBConfig::GetTcpBatchNum() const {
   return config_data_.tcp_batch_num();
 }
 
+uint32_t ResDBConfig::GetMaxCoalesceBytes() const {
+  return config_data_.max_coalesce_bytes();
+}
+
+uint32_t ResDBConfig::GetCoalesceDelayUs() const {
+  return config_data_.coalesce_delay_us();
+}
+
+bool ResDBConfig::IsTcpNoDelay() const {
+  return !config_data_.disable_tcp_nodelay();
+}
+
+bool ResDBConfig::IsTcpCork() const { return config_data_.enable_tcp_cork(); }
+
+uint32_t ResDBConfig::GetMaxRecvFrameBytes() const {
+  return config_data_.max_recv_frame_bytes();
+}
+
+uint32_t ResDBConfig::GetSessionIdleTimeoutS() const {
+  return config_data_.session_idle_timeout_s();
+}
+
+uint32_t ResDBConfig::GetStateTransferMinLag() const {
+  return config_data_.state_transfer_min_lag();
+}
+
+uint32_t ResDBConfig::GetStatusSyncIntervalMs() const {
+  return config_data_.status_sync_interval_ms()
+             ? config_data_.status_sync_interval_ms()
+             : 500;
+}
+
+uint32_t ResDBConfig::GetMaxRecoveryWindow() const {
+  return config_data_.max_recovery_window()
+             ? config_data_.max_recovery_window()
+             : 2000;
+}
+
+uint32_t ResDBConfig::GetMaxRecoveryInflight() const {
+  return config_data_.max_recovery_inflight()
+             ? config_data_.max_recovery_inflight()
+             : 4;
+}
+
+uint32_t ResDBConfig::GetGeoIdleTimeoutMs() const {
+  return config_data_.geo_idle_timeout_ms()
+             ? config_data_.geo_idle_timeout_ms()
+             : 1000;
+}
+
+uint32_t ResDBConfig::GetGeoMaxPendingBatches() const {
+  return config_data_.geo_max_pending_batches()
+             ? config_data_.geo_max_pending_batches()
+             : 1024;
+}
+
+uint32_t ResDBConfig::GetGeoDecodeThreadNum() const {
+  return config_data_.geo_decode_thread_num()
+             ? config_data_.geo_decode_thread_num()
+             : 2;
+}
+
+uint32_t ResDBConfig::GetGeoFetchTimeoutMs() const {
+  return config_data_.geo_fetch_timeout_ms()
+             ? config_data_.geo_fetch_timeout_ms()
+             : 500;
+}
+
+int ResDBConfig::GetTraceLevel() const {
+  return config_data_.has_trace_level() ? config_data_.trace_level() : 1;
+}
+
+uint32_t ResDBConfig::GetTraceBufferSize() const {
+  return config_data_.trace_buffer_size() ? config_data_.trace_buffer_size()
+                                          : 8192;
+}
+
+std::string ResDBConfig::GetTracePath() const {
+  if (!config_data_.trace_path().empty()) {
+    return config_data_.trace_path();
+  }
+  return "resdb_trace_" + std::to_string(self_info_.id()) + ".dat";
+}
+
+uint64_t ResDBConfig::GetSubscriptionCacheBytes() const {
+  return config_data_.subscription_cache_bytes() > 0
+             ? config_data_.subscription_cache_bytes()
+             : 64 << 20;
+}
+
 uint32_t ResDBConfig::GetViewchangeCommitTimeout() const {
   return config_data_.view_change_timeout_ms()
              ? config_data_.view_change_timeout_ms()
@@ -117,6 +117,36 @@ class ResDBConfig {
   uint32_t GetOutputWorkerNum() const;
   uint32_t GetTcpBatchNum() const;
 
+  // For the connections between replicas.
+  uint32_t GetMaxCoalesceBytes() const;
+  uint32_t GetCoalesceDelayUs() const;
+  bool IsTcpNoDelay() const;
+  bool IsTcpCork() const;
+  uint32_t GetMaxRecvFrameBytes() const;
+  uint32_t GetSessionIdleTimeoutS() const;
+
+  // The lag that triggers a state transfer, 0 if it is disabled.
+  uint32_t GetStateTransferMinLag() const;
+
+  // For detecting lagging replicas and fetching the missing requests.
+  uint32_t GetStatusSyncIntervalMs() const;
+  uint32_t GetMaxRecoveryWindow() const;
+  uint32_t GetMaxRecoveryInflight() const;
+
+  // For GeoBFT global ordering.
+  uint32_t GetGeoIdleTimeoutMs() const;
+  uint32_t GetGeoMaxPendingBatches() const;
+  uint32_t GetGeoDecodeThreadNum() const;
+  uint32_t GetGeoFetchTimeoutMs() const;
+
+  // For the binary event trace.
+  int GetTraceLevel() const;
+  uint32_t GetTraceBufferSize() const;
+  std::string GetTracePath() const;
+
+  // For the subscribers of the committed transactions.
+  uint64_t GetSubscriptionCacheBytes() const;
+
   // ViewChange Timeout
   uint32_t GetViewchangeCommitTimeout() const;
   void SetViewchangeCommitTimeout(uint64_t timeout_ms);
@@ -21,6 +21,8 @@
 
 #include <glog/logging.h>
 
+#include "common/utils/utils.h"
+
 namespace resdb {
 
 GeoGlobalExecutor::GeoGlobalExecutor(
@@ -30,9 +32,23 @@ GeoGlobalExecutor::GeoGlobalExecutor(
       config_(config),
       is_stop_(false) {
   global_stats_ = Stats::GetGlobalStats();
+  next_time_ = GetCurrentTime();
   region_size_ = config_.GetConfigData().region().size();
-  order_thread_ = std::thread(&GeoGlobalExecutor::OrderRound, this);
+  size_t pending_size = 1;
+  while (pending_size < config_.GetGeoMaxPendingBatches()) {
+    pending_size <<= 1;
+  }
+  pending_mask_ = pending_size - 1;
+  regions_.resize(region_size_);
+  for (RegionState& region : regions_) {
+    region.pending.resize(pending_size);
+  }
   my_region_ = config.GetConfigData().self_region_id();
+  order_thread_ = std::thread(&GeoGlobalExecutor::OrderRound, this);
+  for (uint32_t i = 0; i < config_.GetGeoDecodeThreadNum(); ++i) {
+    decode_threads_.push_back(
+        std::thread(&GeoGlobalExecutor::DecodeRound, this));
+  }
 }
 
 GeoGlobalExecutor::~GeoGlobalExecutor() { Stop(); }
@@ -42,16 +58,52 @@ void GeoGlobalExecutor::Stop() {
   if (order_thread_.joinable()) {
     order_thread_.join();
   }
+  for (auto& decode_thread : decode_threads_) {
+    if (decode_thread.joinable()) {
+      decode_thread.join();
+    }
+  }
 }
 
 void GeoGlobalExecutor::Execute(std::unique_ptr<Request> request) {
-  BatchUserRequest batch_request;
-  if (!batch_request.ParseFromString(request->data())) {
+  Apply(Decode(std::move(request)));
+}
+
+// Parse and check the batch. It runs on the decode threads and does not
+// touch the ordering state.
+std::unique_ptr<GeoGlobalExecutor::GeoBatch> GeoGlobalExecutor::Decode(
+    std::unique_ptr<Request> request) {
+  auto batch = std::make_unique<GeoBatch>();
+  batch->request = std::move(request);
+  batch->decode_time = GetCurrentTime();
+  auto batch_request = std::make_unique<BatchUserRequest>();
+  if (!batch_request->ParseFromString(batch->request->data())) {
     LOG(ERROR) << "[GeoGlobalExecutor] parse data fail!";
-    return;
+    return batch;
   }
-  if (request->data().empty()) {
+  if (batch->request->data().empty()) {
     LOG(ERROR) << "[GeoGlobalExecutor] request->data() is empty ";
+    return batch;
+  }
+  batch->batch_request = std::move(batch_request);
+  return batch;
+}
+
+// Execute a decoded batch in the global order.
+void GeoGlobalExecutor::Apply(std::unique_ptr<GeoBatch> batch) {
+  const Request& request = *batch->request;
+  int region_id = request.region_info().region_id();
+  if (global_stats_) {
+    global_stats_->GeoRegionWait(region_id,
+                                 GetCurrentTime() - batch->decode_time);
+  }
+  if (batch->batch_request == nullptr) {
+    return;
+  }
+  const BatchUserRequest& batch_request = *batch->batch_request;
+
+  if (batch_request.noop()) {
+    // An idle region has nothing to execute at this seq.
     return;
   }
 
@@ -61,8 +113,7 @@ void GeoGlobalExecutor::Execute(std::unique_ptr<Request> request) {
   if (global_transaction_manager_) {
     auto batch_response =
         global_transaction_manager_->ExecuteBatch(batch_request);
-    if (batch_response != nullptr &&
-        request->region_info().region_id() == my_region_) {
+    if (batch_response != nullptr && region_id == my_region_) {
       batch_response->set_createtime(batch_request.createtime());
       batch_response->set_local_id(batch_request.local_id());
       batch_response->set_proxy_id(batch_request.proxy_id());
@@ -75,52 +126,118 @@ void GeoGlobalExecutor::Execute(std::unique_ptr<Request> request) {
 bool GeoGlobalExecutor::IsStop() { return is_stop_; }
 
 int GeoGlobalExecutor::OrderGeoRequest(std::unique_ptr<Request> request) {
+  decode_queue_num_++;
   order_queue_.Push(std::move(request));
   return 0;
 }
 
+void GeoGlobalExecutor::DecodeRound() {
+  while (!IsStop()) {
+    auto request = order_queue_.Pop();
+    if (request == nullptr) {
+      continue;
+    }
+    decode_queue_num_--;
+    decoded_queue_.Push(Decode(std::move(request)));
+  }
+}
+
 void GeoGlobalExecutor::AddData() {
-  auto request = order_queue_.Pop();
-  if (request == nullptr) {
+  auto batch = decoded_queue_.Pop();
+  if (batch == nullptr) {
     return;
   }
   global_stats_->IncGeoRequest();
-  uint64_t seq_num = request->seq();
-  int region_id = request->region_info().region_id();
-  execute_map_[std::make_pair(seq_num, region_id)] = std::move(request);
+  uint64_t seq_num = batch->request->seq();
+  int region_id = batch->request->region_info().region_id();
+  if (region_id < 1 || region_id > static_cast<int>(region_size_)) {
+    LOG(ERROR) << "[GeoGlobalExecutor] unknown region:" << region_id;
+    return;
+  }
+  if (seq_num < next_seq_ ||
+      (seq_num == next_seq_ && region_id < next_region_)) {
+    // Executed already.
+    return;
+  }
+  if (seq_num > next_seq_ + pending_mask_) {
+    // Not taken by IsInWindow().
+    LOG(ERROR) << "[GeoGlobalExecutor] region:" << region_id
+               << " seq:" << seq_num << " is too far ahead of:" << next_seq_;
+    return;
+  }
+  std::unique_ptr<GeoBatch>& slot =
+      regions_[region_id - 1].pending[seq_num & pending_mask_];
+  if (slot != nullptr && slot->request->seq() == seq_num) {
+    // Sent by more than one replica of the region.
+    return;
+  }
+  if (slot == nullptr) {
+    pending_num_++;
+  }
+  slot = std::move(batch);
 }
 
-std::unique_ptr<Request> GeoGlobalExecutor::GetNextMap() {
-  if (execute_map_.empty()) {
-    return nullptr;
+void GeoGlobalExecutor::MoveToNext() {
+  std::lock_guard<std::mutex> lk(mutex_);
+  next_time_ = GetCurrentTime();
+  next_region_++;
+  if (next_region_ <= static_cast<int>(region_size_)) {
+    return;
   }
-  // LOG(ERROR) << "Next round seq: " << next_seq_ << ", current First in map: "
-  // << execute_map_.begin()->first << ", size: " <<
-
-  // LOG(ERROR)<<"get next seq:"<<next_seq_<<" region:"<<next_region_;
-  if (execute_map_.begin()->first == std::make_pair(next_seq_, next_region_)) {
-    std::unique_ptr<Request> res = std::move(execute_map_.begin()->second);
-    execute_map_.erase(execute_map_.begin());
-    next_region_++;
-    if (next_region_ > static_cast<int64_t>(region_size_)) {
-      next_region_ = 1;
-      next_seq_++;
-    }
-    return res;
+  next_region_ = 1;
+  next_seq_++;
+  // The ring has room for one more seq in each region.
+  if (next_seq_func_) {
+    next_seq_func_(next_seq_);
   }
-  return nullptr;
+}
+
+void GeoGlobalExecutor::SetNextSeqFunc(std::function<void(uint64_t)> func) {
+  std::lock_guard<std::mutex> lk(mutex_);
+  next_seq_func_ = std::move(func);
+  next_seq_func_(next_seq_);
+}
+
+bool GeoGlobalExecutor::IsInWindow(uint64_t seq) {
+  std::lock_guard<std::mutex> lk(mutex_);
+  return seq <= next_seq_ + pending_mask_;
+}
+
+uint64_t GeoGlobalExecutor::GetWaitingBatch(uint64_t* seq, int* region_id) {
+  std::lock_guard<std::mutex> lk(mutex_);
+  *seq = next_seq_;
+  *region_id = next_region_;
+  uint64_t now = GetCurrentTime();
+  return now > next_time_ ? now - next_time_ : 0;
+}
+
+// Get the batch of the next (seq, region) in the global order.
+std::unique_ptr<GeoGlobalExecutor::GeoBatch> GeoGlobalExecutor::GetNextMap() {
+  RegionState& region = regions_[next_region_ - 1];
+  std::unique_ptr<GeoBatch>& slot = region.pending[next_seq_ & pending_mask_];
+  if (slot == nullptr || slot->request->seq() != next_seq_) {
+    return nullptr;
+  }
+  std::unique_ptr<GeoBatch> res = std::move(slot);
+  pending_num_--;
+  MoveToNext();
+  return res;
 }
 
 void GeoGlobalExecutor::OrderRound() {
+  if (region_size_ == 0) {
+    return;
+  }
   while (!IsStop()) {
     AddData();
     while (!IsStop()) {
-      std::unique_ptr<Request> seq_map = GetNextMap();
-      if (seq_map == nullptr) {
+      std::unique_ptr<GeoBatch> batch = GetNextMap();
+      if (batch == nullptr) {
         break;
       }
-      Execute(std::move(seq_map));
+      Apply(std::move(batch));
     }
+    global_stats_->SetGeoQueueDepth(decode_queue_num_, pending_num_);
   }
 }
 
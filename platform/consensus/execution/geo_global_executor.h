@@ -18,9 +18,11 @@
  */
 
 #pragma once
+#include <functional>
 #include <mutex>
 #include <queue>
 #include <unordered_map>
+#include <vector>
 
 #include "executor/common/transaction_manager.h"
 #include "platform/common/queue/lock_free_queue.h"
@@ -42,28 +44,63 @@ class GeoGlobalExecutor {
 
   std::unique_ptr<BatchUserResponse> GetResponseMsg();
 
+  // Return false if seq is too far ahead of the global order to be buffered.
+  // Such a batch is not taken and has to be sent again later.
+  bool IsInWindow(uint64_t seq);
+  // func is called with the next seq of the global order each time it
+  // moves on, so the local batches can be held back to stay in the window.
+  void SetNextSeqFunc(std::function<void(uint64_t)> func);
+  // Set the (seq, region) the global order waits for and return how long it
+  // has waited in microseconds.
+  uint64_t GetWaitingBatch(uint64_t* seq, int* region_id);
+
  private:
-  using ExecuteMap =
-      std::map<std::pair<uint64_t, int>, std::unique_ptr<Request>>;
+  // A global batch decoded ahead of the ordering.
+  struct GeoBatch {
+    std::unique_ptr<Request> request;
+    // nullptr if the batch is invalid, it still takes its seq in the order.
+    std::unique_ptr<BatchUserRequest> batch_request;
+    uint64_t decode_time = 0;
+  };
 
   bool IsStop();
+  void DecodeRound();
   void OrderRound();
-  std::unique_ptr<Request> GetNextMap();
+  std::unique_ptr<GeoBatch> Decode(std::unique_ptr<Request> request);
+  void Apply(std::unique_ptr<GeoBatch> batch);
+  std::unique_ptr<GeoBatch> GetNextMap();
   void AddData();
+  void MoveToNext();
 
  protected:
+  // The batches of a region waiting for the global execution, a ring of
+  // the next GetGeoMaxPendingBatches() seqs indexed by seq.
+  struct RegionState {
+    std::vector<std::unique_ptr<GeoBatch>> pending;
+  };
+
   std::unique_ptr<TransactionManager> global_transaction_manager_;
   Stats* global_stats_;
   std::thread execute_round_thread_, order_thread_;
-  ExecuteMap execute_map_;
+  std::vector<std::thread> decode_threads_;
+  std::vector<RegionState> regions_;
+  uint64_t pending_mask_;
+  // The batches waiting to be decoded and waiting for their turn.
+  std::atomic<uint64_t> decode_queue_num_ = 0;
+  uint64_t pending_num_ = 0;
+  // Only changed by the order thread, which holds mutex_ to do it.
   uint64_t next_seq_ = 1;
   int next_region_ = 1;
+  // When the order moved to (next_seq_, next_region_).
+  uint64_t next_time_ = 0;
+  std::function<void(uint64_t)> next_seq_func_;
   size_t region_size_;
   ResDBConfig config_;
   std::atomic<bool> is_stop_;
   std::mutex mutex_;
   std::condition_variable cv_;
   LockFreeQueue<Request> order_queue_;
+  LockFreeQueue<GeoBatch> decoded_queue_;
   LockFreeQueue<BatchUserResponse> resp_queue_;
   int my_region_;
 };
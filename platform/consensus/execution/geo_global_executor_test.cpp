@@ -33,6 +33,7 @@ namespace resdb {
 namespace {
 
 using ::resdb::testing::EqualsProto;
+using ::testing::Invoke;
 using ::testing::Test;
 
 class GlobalExecutorTest : public Test {
@@ -90,6 +91,163 @@ TEST_F(GlobalExecutorTest, ExecuteFailed) {
   global_executor.Execute(std::make_unique<Request>(request));
 }
 
+TEST_F(GlobalExecutorTest, SkipNoopRegion) {
+  ResConfigData config_data;
+  for (int i = 1; i <= 2; ++i) {
+    RegionInfo* region = config_data.add_region();
+    region->set_region_id(i);
+    *region->add_replica_info() = GenerateReplicaInfo(i, "127.0.0.1", 1234 + i);
+  }
+  config_data.set_self_region_id(1);
+  ResDBConfig config(config_data, GenerateReplicaInfo(1, "127.0.0.1", 1235),
+                     KeyInfo(), CertificateInfo());
+
+  auto mock_executor = std::make_unique<MockTransactionManager>();
+  std::promise<bool> done;
+  std::future<bool> done_future = done.get_future();
+  std::vector<uint64_t> seqs;
+  EXPECT_CALL(*mock_executor, ExecuteBatch)
+      .Times(3)
+      .WillRepeatedly(Invoke([&](const BatchUserRequest& batch_request) {
+        seqs.push_back(batch_request.seq());
+        if (seqs.size() == 3) {
+          done.set_value(true);
+        }
+        return nullptr;
+      }));
+  GeoGlobalExecutor global_executor(std::move(mock_executor), config);
+
+  auto order = [&](int region_id, uint64_t seq,
+                   const BatchUserRequest& batch_request) {
+    auto request = std::make_unique<Request>();
+    request->set_seq(seq);
+    request->mutable_region_info()->set_region_id(region_id);
+    batch_request.SerializeToString(request->mutable_data());
+    global_executor.OrderGeoRequest(std::move(request));
+  };
+
+  // Region 2 is idle and fills seqs 1-3 with no-op batches.
+  for (uint64_t seq = 1; seq <= 3; ++seq) {
+    BatchUserRequest batch_request;
+    batch_request.add_user_requests()->mutable_request()->set_data("test");
+    batch_request.set_seq(seq);
+    order(1, seq, batch_request);
+  }
+  for (uint64_t seq = 1; seq <= 3; ++seq) {
+    BatchUserRequest noop;
+    noop.set_local_id(seq);
+    noop.set_noop(true);
+    order(2, seq, noop);
+  }
+
+  done_future.get();
+  EXPECT_EQ(seqs, std::vector<uint64_t>({1, 2, 3}));
+}
+
+TEST_F(GlobalExecutorTest, TakeBatchesInWindow) {
+  ResConfigData config_data;
+  for (int i = 1; i <= 2; ++i) {
+    RegionInfo* region = config_data.add_region();
+    region->set_region_id(i);
+    *region->add_replica_info() = GenerateReplicaInfo(i, "127.0.0.1", 1234 + i);
+  }
+  config_data.set_self_region_id(1);
+  config_data.set_geo_max_pending_batches(4);
+  ResDBConfig config(config_data, GenerateReplicaInfo(1, "127.0.0.1", 1235),
+                     KeyInfo(), CertificateInfo());
+
+  auto mock_executor = std::make_unique<MockTransactionManager>();
+  EXPECT_CALL(*mock_executor, ExecuteBatch).Times(2);
+  GeoGlobalExecutor global_executor(std::move(mock_executor), config);
+
+  std::promise<bool> done;
+  std::future<bool> done_future = done.get_future();
+  std::vector<uint64_t> next_seqs;
+  global_executor.SetNextSeqFunc([&](uint64_t seq) {
+    next_seqs.push_back(seq);
+    if (seq == 2) {
+      done.set_value(true);
+    }
+  });
+
+  EXPECT_TRUE(global_executor.IsInWindow(4));
+  EXPECT_FALSE(global_executor.IsInWindow(5));
+
+  for (int region_id = 1; region_id <= 2; ++region_id) {
+    BatchUserRequest batch_request;
+    batch_request.add_user_requests()->mutable_request()->set_data("test");
+    auto request = std::make_unique<Request>();
+    request->set_seq(1);
+    request->mutable_region_info()->set_region_id(region_id);
+    batch_request.SerializeToString(request->mutable_data());
+    global_executor.OrderGeoRequest(std::move(request));
+  }
+  done_future.get();
+  EXPECT_EQ(next_seqs, std::vector<uint64_t>({1, 2}));
+  EXPECT_TRUE(global_executor.IsInWindow(5));
+
+  // Region 1 has not sent seq 2.
+  uint64_t seq = 0;
+  int region_id = 0;
+  global_executor.GetWaitingBatch(&seq, &region_id);
+  EXPECT_EQ(seq, 2);
+  EXPECT_EQ(region_id, 1);
+}
+
+TEST_F(GlobalExecutorTest, ExecuteInOrderWithDecodeThreads) {
+  constexpr int kRegionNum = 4;
+  constexpr uint64_t kSeqNum = 50;
+  ResConfigData config_data;
+  for (int i = 1; i <= kRegionNum; ++i) {
+    RegionInfo* region = config_data.add_region();
+    region->set_region_id(i);
+    *region->add_replica_info() = GenerateReplicaInfo(i, "127.0.0.1", 1234 + i);
+  }
+  config_data.set_self_region_id(1);
+  config_data.set_geo_decode_thread_num(4);
+  ResDBConfig config(config_data, GenerateReplicaInfo(1, "127.0.0.1", 1235),
+                     KeyInfo(), CertificateInfo());
+
+  auto mock_executor = std::make_unique<MockTransactionManager>();
+  std::promise<bool> done;
+  std::future<bool> done_future = done.get_future();
+  std::vector<uint64_t> ids;
+  EXPECT_CALL(*mock_executor, ExecuteBatch)
+      .Times(kRegionNum * kSeqNum)
+      .WillRepeatedly(Invoke([&](const BatchUserRequest& batch_request) {
+        ids.push_back(batch_request.local_id());
+        if (ids.size() == kRegionNum * kSeqNum) {
+          done.set_value(true);
+        }
+        return nullptr;
+      }));
+  GeoGlobalExecutor global_executor(std::move(mock_executor), config);
+
+  // The regions deliver their batches backwards, the batches are decoded in
+  // parallel and executed by (seq, region).
+  std::vector<uint64_t> expected_ids;
+  for (uint64_t seq = 1; seq <= kSeqNum; ++seq) {
+    for (int region_id = 1; region_id <= kRegionNum; ++region_id) {
+      expected_ids.push_back(seq * kRegionNum + region_id);
+    }
+  }
+  for (uint64_t seq = kSeqNum; seq >= 1; --seq) {
+    for (int region_id = kRegionNum; region_id >= 1; --region_id) {
+      BatchUserRequest batch_request;
+      batch_request.add_user_requests()->mutable_request()->set_data("test");
+      batch_request.set_local_id(seq * kRegionNum + region_id);
+      auto request = std::make_unique<Request>();
+      request->set_seq(seq);
+      request->mutable_region_info()->set_region_id(region_id);
+      batch_request.SerializeToString(request->mutable_data());
+      global_executor.OrderGeoRequest(std::move(request));
+    }
+  }
+
+  done_future.get();
+  EXPECT_EQ(ids, expected_ids);
+}
+
 }  // namespace
 
 }  // namespace resdb
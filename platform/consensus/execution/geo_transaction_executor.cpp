@@ -35,6 +35,7 @@ GeoTransactionExecutor::GeoTransactionExecutor(
       replica_communicator_(std::move(replica_communicator)),
       local_transaction_manager_(std::move(local_transaction_manager)),
       is_stop_(false) {
+  global_stats_ = Stats::GetGlobalStats();
   geo_thread_ = std::thread(&GeoTransactionExecutor::SendGeoMessages, this);
 }
 
@@ -47,33 +48,56 @@ GeoTransactionExecutor::~GeoTransactionExecutor() {
 
 bool GeoTransactionExecutor::IsStop() { return is_stop_; }
 
+void GeoTransactionExecutor::UpdateGlobalSeq(uint64_t seq) {
+  std::lock_guard<std::mutex> lk(global_seq_mutex_);
+  global_seq_ = std::max(global_seq_, seq);
+  global_seq_cv_.notify_all();
+}
+
+bool GeoTransactionExecutor::WaitForGlobalSeq(uint64_t seq) {
+  std::unique_lock<std::mutex> lk(global_seq_mutex_);
+  while (!IsStop()) {
+    if (global_seq_cv_.wait_for(lk, std::chrono::milliseconds(100), [&] {
+          return global_seq_ == 0 ||
+                 seq < global_seq_ + config_.GetGeoMaxPendingBatches();
+        })) {
+      return true;
+    }
+  }
+  return false;
+}
+
 void GeoTransactionExecutor::SendGeoMessages() {
-  std::vector<std::unique_ptr<Request>> messages;
+  std::vector<std::unique_ptr<Request>> messages, headers;
   while (!IsStop()) {
     auto message = queue_.Pop(100);
     if (message != nullptr) {
-      messages.push_back(std::move(message));
+      messages.push_back(std::move(message->body));
+      headers.push_back(std::move(message->header));
       while (!IsStop() && messages.size() < batch_size_) {
         auto message = queue_.Pop(0);
         if (message == nullptr) {
           break;
         }
-        messages.push_back(std::move(message));
+        messages.push_back(std::move(message->body));
+        headers.push_back(std::move(message->header));
         if (messages.size() >= batch_size_) {
           break;
         }
       }
     }
     if (messages.size() > 0) {
-      SendBatchGeoMessage(messages);
+      SendBatchGeoMessage(messages, headers);
       messages.clear();
+      headers.clear();
     }
   }
   return;
 }
 
 void GeoTransactionExecutor::SendBatchGeoMessage(
-    const std::vector<std::unique_ptr<Request>>& batch_geo_request) {
+    const std::vector<std::unique_ptr<Request>>& batch_geo_request,
+    const std::vector<std::unique_ptr<Request>>& headers) {
   ResConfigData config_data = config_.GetConfigData();
 
   int self_send = replica_communicator_->SendBatchMessage(
@@ -83,31 +107,49 @@ void GeoTransactionExecutor::SendBatchGeoMessage(
   }
   // Only for primary node: send out GEO_REQUEST to other regions.
   if (config_.GetSelfInfo().id() == system_info_->GetPrimaryId()) {
+    uint64_t body_bytes = 0, header_bytes = 0;
+    for (const auto& request : batch_geo_request) {
+      body_bytes += request->ByteSizeLong();
+    }
+    for (const auto& header : headers) {
+      header_bytes += header->ByteSizeLong();
+    }
+    uint64_t wan_bytes = 0;
     for (const auto& region : config_data.region()) {
-      if (region.region_id() == config_data.self_region_id()) {
+      if (region.region_id() == config_data.self_region_id() ||
+          region.replica_info_size() == 0) {
         continue;
       }
       // maximum number of faulty replicas in this region
       int max_faulty = (region.replica_info_size() - 1) / 3;
       int num_request_sent = 0;
-      for (const auto& replica : region.replica_info()) {
+      // Rotate the replica receiving the body.
+      int start = batch_geo_request[0]->seq() % region.replica_info_size();
+      for (int i = 0; i < region.replica_info_size(); ++i) {
         // send to f + 1 replicas in the region
         if (num_request_sent > max_faulty) {
           break;
         }
-        int ret =
-            replica_communicator_->SendBatchMessage(batch_geo_request, replica);
+        const auto& replica =
+            region.replica_info((start + i) % region.replica_info_size());
+        bool send_body = num_request_sent == 0;
+        int ret = replica_communicator_->SendBatchMessage(
+            send_body ? batch_geo_request : headers, replica);
         if (ret >= 0) {
           num_request_sent++;
+          wan_bytes += send_body ? body_bytes : header_bytes;
         }
       }
     }
-    // LOG(ERROR) << "local executor send out geo message";
+    global_stats_->GeoWanSend(batch_geo_request.size(), wan_bytes);
   }
 }
 
 std::unique_ptr<BatchUserResponse> GeoTransactionExecutor::ExecuteBatch(
     const BatchUserRequest& request) {
+  if (!WaitForGlobalSeq(request.seq())) {
+    return nullptr;
+  }
   std::unique_ptr<Request> geo_request = resdb::NewRequest(
       Request::TYPE_GEO_REQUEST, Request(), config_.GetSelfInfo().id(),
       config_.GetConfigData().self_region_id());
@@ -117,10 +159,37 @@ std::unique_ptr<BatchUserResponse> GeoTransactionExecutor::ExecuteBatch(
   geo_request->set_hash(SignatureVerifier::CalculateHash(
       geo_request->data() + std::to_string(request.seq()) +
       std::to_string(config_.GetConfigData().self_region_id())));
+  auto header = std::make_unique<Request>(*geo_request);
+
+  // The certificate only needs a quorum of the commit signatures.
+  size_t quorum = config_.GetMinDataReceiveNum();
+  const auto& certs = request.committed_certs().committed_certs();
+  Certs quorum_certs;
+  for (int i = 0; i < certs.size() && i < static_cast<int>(quorum); ++i) {
+    *quorum_certs.add_committed_certs() = certs[i];
+  }
+  if (static_cast<size_t>(certs.size()) > quorum) {
+    BatchUserRequest body(request);
+    *body.mutable_committed_certs() = quorum_certs;
+    body.SerializeToString(geo_request->mutable_data());
+  } else {
+    request.SerializeToString(geo_request->mutable_data());
+  }
 
-  request.SerializeToString(geo_request->mutable_data());
+  BatchUserRequest header_request;
+  header_request.set_createtime(request.createtime());
+  header_request.set_local_id(request.local_id());
+  header_request.set_seq(request.seq());
+  header_request.set_hash(request.hash());
+  header_request.set_proxy_id(request.proxy_id());
+  header_request.set_header_only(true);
+  *header_request.mutable_committed_certs() = std::move(quorum_certs);
+  header_request.SerializeToString(header->mutable_data());
 
-  queue_.Push(std::move(geo_request));
+  auto message = std::make_unique<GeoMessage>();
+  message->body = std::move(geo_request);
+  message->header = std::move(header);
+  queue_.Push(std::move(message));
   return nullptr;
 }
 
@@ -18,10 +18,14 @@
  */
 
 #pragma once
+#include <condition_variable>
+#include <mutex>
+
 #include "executor/common/transaction_manager.h"
 #include "platform/config/resdb_config.h"
 #include "platform/consensus/execution/system_info.h"
 #include "platform/networkstrate/replica_communicator.h"
+#include "platform/statistic/stats.h"
 
 namespace resdb {
 
@@ -37,10 +41,27 @@ class GeoTransactionExecutor : public TransactionManager {
       const BatchUserRequest& request) override;
   bool IsStop();
 
+  // Set the next seq of the global order. A local batch more than
+  // GetGeoMaxPendingBatches() seqs ahead of it waits, which holds the local
+  // consensus back instead of piling up batches in the other regions.
+  void UpdateGlobalSeq(uint64_t seq);
+
  private:
+  // A committed batch to send to the other regions and its header, which
+  // only carries the hash and the certificate.
+  struct GeoMessage {
+    std::unique_ptr<Request> body;
+    std::unique_ptr<Request> header;
+  };
+
+  // Return false if stopped while waiting.
+  bool WaitForGlobalSeq(uint64_t seq);
   void SendGeoMessages();
+  // The body goes to one of the f+1 replicas of each region and the header
+  // to the others.
   void SendBatchGeoMessage(
-      const std::vector<std::unique_ptr<Request>>& requests);
+      const std::vector<std::unique_ptr<Request>>& requests,
+      const std::vector<std::unique_ptr<Request>>& headers);
 
  protected:
   ResDBConfig config_;
@@ -49,8 +70,13 @@ class GeoTransactionExecutor : public TransactionManager {
   std::unique_ptr<TransactionManager> local_transaction_manager_ = nullptr;
   std::thread geo_thread_;
   size_t batch_size_ = 50;
-  LockFreeQueue<Request> queue_;
+  LockFreeQueue<GeoMessage> queue_;
   std::atomic<bool> is_stop_;
+  std::mutex global_seq_mutex_;
+  std::condition_variable global_seq_cv_;
+  // 0 until the global order reports it, the batches are not held then.
+  uint64_t global_seq_ = 0;
+  Stats* global_stats_;
 
   std::vector<std::unique_ptr<BatchUserRequest>> messages_;
 };
@@ -145,6 +145,136 @@ TEST(LocalExecutorTest, PrimaryNodeBroadcast) {
   done_future.get();
 }
 
+TEST(LocalExecutorTest, SendBodyOncePerRegion) {
+  auto mock_executor = std::make_unique<MockTransactionManager>();
+  auto replica_communicator = std::make_unique<MockReplicaCommunicator>();
+  ResConfigData config_data = ResConfigData();
+  config_data.set_self_region_id(1);
+
+  RegionInfo* region = config_data.add_region();
+  region->set_region_id(1);
+  for (int i = 1; i <= 4; ++i) {
+    *region->add_replica_info() =
+        GenerateReplicaInfo(i, "127.0.0.1", 10000 + i);
+  }
+  region = config_data.add_region();
+  region->set_region_id(2);
+  for (int i = 6; i <= 9; ++i) {
+    *region->add_replica_info() =
+        GenerateReplicaInfo(i, "127.0.0.1", 10000 + i);
+  }
+
+  ResDBConfig config =
+      ResDBConfig(config_data, GenerateReplicaInfo(1, "127.0.0.1", 10001),
+                  KeyInfo(), CertificateInfo());
+  auto system_info = std::make_unique<SystemInfo>(config);
+  system_info->SetPrimary(1);
+
+  BatchUserRequest batch_request;
+  batch_request.set_seq(1);
+  batch_request.set_hash("hash");
+  for (int i = 0; i < 100; ++i) {
+    batch_request.add_user_requests()->mutable_request()->set_data(
+        std::string(100, 'a'));
+  }
+  for (int i = 1; i <= 4; ++i) {
+    SignatureInfo* sig =
+        batch_request.mutable_committed_certs()->add_committed_certs();
+    sig->set_node_id(i);
+    sig->set_signature(std::string(64, 's'));
+  }
+
+  std::map<int64_t, BatchUserRequest> sent;
+  std::promise<bool> done;
+  std::future<bool> done_future = done.get_future();
+  EXPECT_CALL(*replica_communicator, SendBatchMessage)
+      .Times(3)
+      .WillRepeatedly(Invoke([&](const std::vector<std::unique_ptr<Request>>&
+                                     messages,
+                                 const ReplicaInfo& replica) {
+        sent[replica.id()].ParseFromString(messages[0]->data());
+        if (sent.size() == 3) {
+          done.set_value(true);
+        }
+        return 0;
+      }));
+
+  GeoTransactionExecutor local_executor(config, std::move(system_info),
+                                        std::move(replica_communicator),
+                                        std::move(mock_executor));
+  local_executor.ExecuteBatch(batch_request);
+  done_future.get();
+
+  // Replica 7 gets the body and replica 8 the header.
+  ASSERT_EQ(sent.count(7), 1);
+  ASSERT_EQ(sent.count(8), 1);
+  const BatchUserRequest& body = sent[7];
+  const BatchUserRequest& header = sent[8];
+  EXPECT_FALSE(body.header_only());
+  EXPECT_EQ(body.user_requests_size(), 100);
+  EXPECT_TRUE(header.header_only());
+  EXPECT_EQ(header.user_requests_size(), 0);
+  EXPECT_EQ(header.hash(), "hash");
+  EXPECT_EQ(header.seq(), 1);
+  // Only a quorum of the signatures is sent.
+  EXPECT_EQ(body.committed_certs().committed_certs_size(), 3);
+  EXPECT_EQ(header.committed_certs().committed_certs_size(), 3);
+
+  LOG(ERROR) << "body bytes:" << body.ByteSizeLong()
+             << " header bytes:" << header.ByteSizeLong();
+}
+
+TEST(LocalExecutorTest, WaitForGlobalOrder) {
+  auto replica_communicator = std::make_unique<MockReplicaCommunicator>();
+  ResConfigData config_data = ResConfigData();
+  config_data.set_self_region_id(1);
+  config_data.set_geo_max_pending_batches(4);
+  RegionInfo* region = config_data.add_region();
+  region->set_region_id(1);
+  *region->add_replica_info() = GenerateReplicaInfo(1, "127.0.0.1", 10001);
+
+  ResDBConfig config =
+      ResDBConfig(config_data, GenerateReplicaInfo(1, "127.0.0.1", 10001),
+                  KeyInfo(), CertificateInfo());
+  auto system_info = std::make_unique<SystemInfo>(config);
+  system_info->SetPrimary(2);
+
+  std::atomic<int> sent_num = 0;
+  EXPECT_CALL(*replica_communicator, SendBatchMessage)
+      .WillRepeatedly(Invoke([&](const std::vector<std::unique_ptr<Request>>&
+                                     messages,
+                                 const ReplicaInfo& replica) {
+        sent_num += messages.size();
+        return 0;
+      }));
+
+  GeoTransactionExecutor local_executor(
+      config, std::move(system_info), std::move(replica_communicator),
+      std::make_unique<MockTransactionManager>());
+  local_executor.UpdateGlobalSeq(1);
+
+  // Seqs 1-4 are in the window of the global order, seq 5 waits for it to
+  // move on.
+  std::thread execute_thread([&] {
+    for (uint64_t seq = 1; seq <= 5; ++seq) {
+      BatchUserRequest batch_request;
+      batch_request.set_seq(seq);
+      local_executor.ExecuteBatch(batch_request);
+    }
+  });
+  while (sent_num < 4) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  EXPECT_EQ(sent_num, 4);
+
+  local_executor.UpdateGlobalSeq(2);
+  execute_thread.join();
+  while (sent_num < 5) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+}
+
 }  // namespace
 
 }  // namespace resdb
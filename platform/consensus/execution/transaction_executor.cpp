@@ -120,6 +120,51 @@ Storage* TransactionExecutor::GetStorage() {
   return transaction_manager_ ? transaction_manager_->GetStorage() : nullptr;
 }
 
+void TransactionExecutor::EnableStateDigest() {
+  Storage* storage = GetStorage();
+  if (storage == nullptr) {
+    LOG(ERROR) << "no storage to build the state digest";
+    return;
+  }
+  storage->EnableStateDigest();
+  enable_state_digest_ = true;
+}
+
+void TransactionExecutor::EnableSnapshot() {
+  if (GetStorage() == nullptr) {
+    return;
+  }
+  enable_snapshot_ = true;
+}
+
+void TransactionExecutor::RecordCheckPointState(uint64_t seq) {
+  if (!enable_state_digest_ || seq % config_.GetCheckPointWaterMark()) {
+    return;
+  }
+  if (enable_snapshot_ && !GetStorage()->CreateSnapshot(seq)) {
+    LOG(ERROR) << "create snapshot fail, seq:" << seq;
+  }
+  std::string digest = GetStorage()->GetStateDigest();
+  std::lock_guard<std::mutex> lk(digest_mutex_);
+  state_digests_[seq] = std::move(digest);
+  // Only keep the latest few in case nobody collects them.
+  while (state_digests_.size() > 16) {
+    state_digests_.erase(state_digests_.begin());
+  }
+}
+
+std::string TransactionExecutor::GetStateDigest(uint64_t seq) {
+  std::lock_guard<std::mutex> lk(digest_mutex_);
+  std::string digest;
+  auto it = state_digests_.find(seq);
+  if (it != state_digests_.end()) {
+    digest = std::move(it->second);
+  }
+  state_digests_.erase(state_digests_.begin(),
+                       state_digests_.upper_bound(seq));
+  return digest;
+}
+
 void TransactionExecutor::SetPreExecuteFunc(PreExecuteFunc pre_exec_func) {
   pre_exec_func_ = pre_exec_func;
 }
@@ -137,6 +182,41 @@ uint64_t TransactionExecutor::GetMaxPendingExecutedSeq() {
 void TransactionExecutor::SetPendingExecutedSeq(int seq) {
   // LOG(ERROR)<<" seq next pending seq:"<<seq;
   next_execute_seq_ = seq;
+  // The seqs may jump forward after installing a checkpoint state.
+  last_seq_ = seq - 1;
+  min_execute_seq_ = seq;
+}
+
+void TransactionExecutor::Pause() {
+  std::unique_lock<std::mutex> lk(pause_mutex_);
+  paused_ = true;
+  while (executing_ > 0 && !IsStop()) {
+    pause_cv_.wait_for(lk, std::chrono::milliseconds(100));
+  }
+}
+
+void TransactionExecutor::Resume() {
+  {
+    std::lock_guard<std::mutex> lk(pause_mutex_);
+    paused_ = false;
+  }
+  pause_cv_.notify_all();
+}
+
+void TransactionExecutor::StartExecute() {
+  std::unique_lock<std::mutex> lk(pause_mutex_);
+  while (paused_ && !IsStop()) {
+    pause_cv_.wait_for(lk, std::chrono::milliseconds(100));
+  }
+  executing_++;
+}
+
+void TransactionExecutor::EndExecute() {
+  {
+    std::lock_guard<std::mutex> lk(pause_mutex_);
+    executing_--;
+  }
+  pause_cv_.notify_all();
 }
 
 bool TransactionExecutor::NeedResponse() {
@@ -163,6 +243,11 @@ void TransactionExecutor::AddNewData(std::unique_ptr<Request> message) {
 }
 
 std::unique_ptr<Request> TransactionExecutor::GetNextData() {
+  // Drop the seqs that are covered by an installed checkpoint state.
+  while (!candidates_.empty() &&
+         candidates_.begin()->first < next_execute_seq_) {
+    candidates_.erase(candidates_.begin());
+  }
   if (candidates_.empty() || candidates_.begin()->first != next_execute_seq_) {
     return nullptr;
   }
@@ -220,12 +305,21 @@ void TransactionExecutor::ExecuteMessage() {
       if (message == nullptr) {
         continue;
       }
+      // Wait in the execution order, so that the requests before are
+      // already counted in by Pause().
+      StartExecute();
+      if (message->seq() < min_execute_seq_) {
+        // Covered by an installed checkpoint state.
+        EndExecute();
+        continue;
+      }
       if (transaction_manager_ && transaction_manager_->IsOutOfOrder()) {
         need_execute = false;
       }
       RegisterExecute(message->seq());
     }
     Execute(std::move(message), need_execute);
+    EndExecute();
   }
 }
 
@@ -235,7 +329,9 @@ void TransactionExecutor::ExecuteMessageOutOfOrder() {
     if (message == nullptr) {
       continue;
     }
+    StartExecute();
     OnlyExecute(std::move(message));
+    EndExecute();
   }
 }
 
@@ -306,6 +402,7 @@ void TransactionExecutor::Execute(std::unique_ptr<Request> request,
     if (execute_thread_num_ == 1) {
       response = transaction_manager_->ExecuteBatchWithSeq(request->seq(),
                                                            *batch_request_p);
+      RecordCheckPointState(request->seq());
     } else {
       std::vector<std::unique_ptr<std::string>> response_v;
 
@@ -334,6 +431,7 @@ void TransactionExecutor::Execute(std::unique_ptr<Request> request,
         response_v = transaction_manager_->ExecuteBatchDataWithSeq(
             request->seq(), *data_p);
       }
+      RecordCheckPointState(request->seq());
       FinishExecute(request->seq());
 
       if (response == nullptr) {
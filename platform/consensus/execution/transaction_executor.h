@@ -53,8 +53,14 @@ class TransactionExecutor {
 
   // The max seq S that can be executed (have received all the seq before S).
   uint64_t GetMaxPendingExecutedSeq();
+  // The queued requests before seq are dropped.
   void SetPendingExecutedSeq(int seq);
 
+  // Wait for the requests being executed and hold back the others until
+  // Resume(), so that the storage can be replaced in between.
+  void Pause();
+  void Resume();
+
   // When a transaction is ready to be executed (have received all the seq
   // before Txn) PreExecute func will be called.
   void SetPreExecuteFunc(PreExecuteFunc func);
@@ -67,6 +73,16 @@ class TransactionExecutor {
 
   Storage* GetStorage();
 
+  // Maintain a state digest on the storage and record its root after
+  // executing each checkpoint seq.
+  void EnableStateDigest();
+  // Return the state digest recorded at seq, or empty if there is none.
+  // Digests recorded before seq are dropped.
+  std::string GetStateDigest(uint64_t seq);
+  // Also keep a storage snapshot at each checkpoint seq to serve state
+  // transfers.
+  void EnableSnapshot();
+
   void RegisterExecute(int64_t seq);
   void WaitForExecute(int64_t seq);
   void FinishExecute(int64_t seq);
@@ -80,6 +96,8 @@ class TransactionExecutor {
   void OrderMessage();
   void ExecuteMessage();
   void ExecuteMessageOutOfOrder();
+  void StartExecute();
+  void EndExecute();
 
   void AddNewData(std::unique_ptr<Request> message);
   std::unique_ptr<Request> GetNextData();
@@ -87,6 +105,7 @@ class TransactionExecutor {
   bool IsStop();
 
   void UpdateMaxExecutedSeq(uint64_t seq);
+  void RecordCheckPointState(uint64_t seq);
 
   bool SetFlag(uint64_t uid, int f);
   void ClearPromise(uint64_t uid);
@@ -119,6 +138,15 @@ class TransactionExecutor {
   std::condition_variable cv_;
   std::mutex mutex_, e_mutex_;
   int32_t last_seq_ = 0;
+  std::atomic<uint64_t> min_execute_seq_ = 0;
+  std::mutex pause_mutex_;
+  std::condition_variable pause_cv_;
+  bool paused_ = false;
+  int executing_ = 0;
+  std::atomic<bool> enable_state_digest_ = false;
+  std::atomic<bool> enable_snapshot_ = false;
+  std::mutex digest_mutex_;
+  std::map<uint64_t, std::string> state_digests_;
 
   enum PrepareType {
     Start_Prepare = 1,
@@ -68,6 +68,40 @@ TEST(TransactionExecutorTest, ExecuteOne) {
   done_future.get();
 }
 
+TEST(TransactionExecutorTest, PauseExecution) {
+  std::promise<bool> done;
+  std::future<bool> done_future = done.get_future();
+
+  ResDBConfig config = GetResDBConfig();
+  Request request;
+  request.set_seq(1);
+
+  BatchUserRequest batch_request;
+  batch_request.add_user_requests()->mutable_request()->set_data("execute_1");
+  batch_request.SerializeToString(request.mutable_data());
+
+  SystemInfo system_info(config);
+  auto mock_executor = std::make_unique<MockTransactionExecutorDataImpl>();
+
+  EXPECT_CALL(*mock_executor, ExecuteData)
+      .WillOnce(Invoke([&](const std::string& input) {
+        done.set_value(true);
+        return nullptr;
+      }));
+  TransactionExecutor executor(
+      config,
+      [&](std::unique_ptr<Request>, std::unique_ptr<BatchUserResponse> resp) {},
+      &system_info, std::move(mock_executor));
+
+  executor.Pause();
+  EXPECT_EQ(executor.Commit(std::make_unique<Request>(request)), 0);
+  EXPECT_EQ(done_future.wait_for(std::chrono::milliseconds(200)),
+            std::future_status::timeout);
+
+  executor.Resume();
+  done_future.get();
+}
+
 TEST(TransactionExecutorTest, MaxPendingExecuteSeq) {
   Stats::GetGlobalStats()->Stop();
   ResDBConfig config = GetResDBConfig();
@@ -21,11 +21,28 @@
 
 namespace resdb {
 
+namespace {
+
+// The local executor is destroyed after the global executor, which stops
+// calling it then.
+std::unique_ptr<GeoTransactionExecutor> WithGlobalExecutor(
+    std::unique_ptr<GeoTransactionExecutor> local_executor,
+    GeoGlobalExecutor* global_executor) {
+  GeoTransactionExecutor* executor = local_executor.get();
+  global_executor->SetNextSeqFunc(
+      [executor](uint64_t seq) { executor->UpdateGlobalSeq(seq); });
+  return local_executor;
+}
+
+}  // namespace
+
 ConsensusManagerGeoPBFT::ConsensusManagerGeoPBFT(
     const ResDBConfig& config,
     std::unique_ptr<GeoTransactionExecutor> local_executor,
     std::unique_ptr<GeoGlobalExecutor> global_executor)
-    : ConsensusManagerPBFT(config, std::move(local_executor)) {
+    : ConsensusManagerPBFT(config,
+                           WithGlobalExecutor(std::move(local_executor),
+                                              global_executor.get())) {
   commitment_ = std::make_unique<GeoPBFTCommitment>(
       std::move(global_executor), config, std::make_unique<SystemInfo>(config),
       GetBroadCastClient(), GetSignatureVerifier());
@@ -37,6 +54,9 @@ int ConsensusManagerGeoPBFT::ConsensusCommit(std::unique_ptr<Context> context,
   switch (request->type()) {
     case Request::TYPE_GEO_REQUEST:
       return commitment_->GeoProcessCcm(std::move(context), std::move(request));
+    case Request::TYPE_GEO_FETCH:
+      return commitment_->GeoProcessFetch(std::move(context),
+                                          std::move(request));
   }
   return ConsensusManagerPBFT::ConsensusCommit(std::move(context),
                                                std::move(request));
@@ -21,10 +21,28 @@
 
 #include <glog/logging.h>
 
+#include "common/utils/utils.h"
 #include "platform/consensus/ordering/common/transaction_utils.h"
 
 namespace resdb {
 
+namespace {
+
+// The commit certificates sign the hash of the batch as it was proposed,
+// before the executor set the fields cleared here.
+std::string GetProposedHash(const BatchUserRequest& request) {
+  BatchUserRequest proposed(request);
+  proposed.clear_seq();
+  proposed.clear_hash();
+  proposed.clear_proxy_id();
+  proposed.clear_committed_certs();
+  std::string data;
+  proposed.SerializeToString(&data);
+  return SignatureVerifier::CalculateHash(data);
+}
+
+}  // namespace
+
 GeoPBFTCommitment::GeoPBFTCommitment(
     std::unique_ptr<GeoGlobalExecutor> global_executor,
     const ResDBConfig& config, std::unique_ptr<SystemInfo> system_info,
@@ -36,8 +54,17 @@ GeoPBFTCommitment::GeoPBFTCommitment(
       replica_communicator_(std::move(replica_communicator)),
       verifier_(verifier) {
   global_stats_ = Stats::GetGlobalStats();
+  uint64_t local_size = 1;
+  while (local_size < config_.GetGeoMaxPendingBatches()) {
+    local_size <<= 1;
+  }
+  local_batches_.resize(local_size);
+  local_mask_ = local_size - 1;
   executed_thread_ =
       std::thread(&GeoPBFTCommitment::PostProcessExecutedMsg, this);
+  if (config_.GetConfigData().region_size() > 1) {
+    idle_thread_ = std::thread(&GeoPBFTCommitment::MonitorIdleRegion, this);
+  }
 }
 
 GeoPBFTCommitment::~GeoPBFTCommitment() {
@@ -45,23 +72,71 @@ GeoPBFTCommitment::~GeoPBFTCommitment() {
   if (executed_thread_.joinable()) {
     executed_thread_.join();
   }
+  if (idle_thread_.joinable()) {
+    idle_thread_.join();
+  }
 }
 
 bool GeoPBFTCommitment::VerifyCerts(const BatchUserRequest& request,
-                                    const std::string& raw_data) {
-  if (verifier_) {
-    std::string hash = request.hash();
-    for (const auto& sig : request.committed_certs().committed_certs()) {
-      bool valid = verifier_->VerifyMessage(hash, sig);
-      if (!valid) {
-        LOG(ERROR) << "sign is not valid:" << sig.DebugString();
-        return false;
+                                    uint32_t sender_region) {
+  if (verifier_ == nullptr) {
+    // The commits are not signed.
+    return true;
+  }
+  std::set<int64_t> region_replicas;
+  for (const auto& region : config_.GetConfigData().region()) {
+    if (static_cast<uint32_t>(region.region_id()) == sender_region) {
+      for (const auto& replica : region.replica_info()) {
+        region_replicas.insert(replica.id());
       }
     }
   }
+  if (region_replicas.empty()) {
+    LOG(ERROR) << "unknown region:" << sender_region;
+    return false;
+  }
+  int f = (region_replicas.size() - 1) / 3;
+  size_t quorum = 2 * f + 1;
+
+  std::set<int64_t> signers;
+  const std::string& hash = request.hash();
+  for (const auto& sig : request.committed_certs().committed_certs()) {
+    if (!region_replicas.count(sig.node_id()) ||
+        signers.count(sig.node_id())) {
+      LOG(ERROR) << "sign is not from a new replica of region:"
+                 << sender_region << " node:" << sig.node_id();
+      continue;
+    }
+    if (!verifier_->VerifyMessage(hash, sig)) {
+      LOG(ERROR) << "sign is not valid:" << sig.DebugString();
+      return false;
+    }
+    signers.insert(sig.node_id());
+  }
+  if (signers.size() < quorum) {
+    LOG(ERROR) << "certificate has " << signers.size() << " signers, "
+               << quorum << " needed, region:" << sender_region;
+    return false;
+  }
   return true;
 }
 
+bool GeoPBFTCommitment::IsCertifiedBody(uint64_t seq, uint32_t sender_region,
+                                        const BatchUserRequest& request) {
+  if (GetProposedHash(request) != request.hash()) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lk(mutex_);
+  auto it = pending_bodies_.find(std::make_pair(sender_region, seq));
+  return it == pending_bodies_.end() || it->second.hash.empty() ||
+         it->second.hash == request.hash();
+}
+
+bool GeoPBFTCommitment::IsReceived(uint64_t seq, uint32_t sender_region) {
+  std::lock_guard<std::mutex> lk(mutex_);
+  return seq < min_seq_ || checklist_[seq % (1 << 20)].count(sender_region);
+}
+
 bool GeoPBFTCommitment::AddNewReq(uint64_t seq, uint32_t sender_region) {
   std::lock_guard<std::mutex> lk(mutex_);
   if (seq < min_seq_) {
@@ -69,9 +144,133 @@ bool GeoPBFTCommitment::AddNewReq(uint64_t seq, uint32_t sender_region) {
   }
   // LOG(ERROR)<<"add req seq:"<<seq<<" regioin:"<<sender_region;
   auto ret = checklist_[seq % (1 << 20)].insert(sender_region);
+  if (ret.second) {
+    pending_bodies_.erase(std::make_pair(sender_region, seq));
+  }
   return ret.second;
 }
 
+bool GeoPBFTCommitment::IsPendingInWindow(uint32_t sender_region,
+                                          uint64_t seq) {
+  return sender_region >= 1 &&
+         sender_region <=
+             static_cast<uint32_t>(config_.GetConfigData().region_size()) &&
+         seq >= min_seq_ && seq - min_seq_ < config_.GetGeoMaxPendingBatches();
+}
+
+void GeoPBFTCommitment::AddHeader(const Request& request,
+                                  const std::string& hash) {
+  uint32_t sender_region = request.region_info().region_id();
+  std::lock_guard<std::mutex> lk(mutex_);
+  if (!IsPendingInWindow(sender_region, request.seq())) {
+    // Fetched once the global order waits for it.
+    LOG(ERROR) << "drop the header of seq:" << request.seq()
+               << " region:" << sender_region << " min seq:" << min_seq_;
+    return;
+  }
+  if (checklist_[request.seq() % (1 << 20)].count(sender_region)) {
+    return;
+  }
+  PendingBody& pending =
+      pending_bodies_[std::make_pair(sender_region, request.seq())];
+  if (pending.recv_time == 0) {
+    pending.recv_time = GetCurrentTime();
+  }
+  if (pending.hash.empty()) {
+    pending.hash = hash;
+  }
+}
+
+void GeoPBFTCommitment::FetchMissingBodies() {
+  // (region, seq, the times fetched).
+  std::vector<std::tuple<uint32_t, uint64_t, int>> fetches;
+  {
+    uint64_t timeout = config_.GetGeoFetchTimeoutMs() * 1000ull;
+    uint64_t now = GetCurrentTime();
+    uint64_t waiting_seq = 0;
+    int waiting_region = 0;
+    bool stalled = global_executor_->GetWaitingBatch(
+                       &waiting_seq, &waiting_region) >= timeout;
+    std::lock_guard<std::mutex> lk(mutex_);
+    // The batches below the seq the global order waits for have all been
+    // taken, so the pending bodies only need the window above it.
+    min_seq_ = std::max(min_seq_, waiting_seq);
+    if (stalled && IsPendingInWindow(waiting_region, waiting_seq) &&
+        !checklist_[waiting_seq % (1 << 20)].count(waiting_region)) {
+      // Neither the batch nor its header was taken, e.g. it came ahead of
+      // the window. Any body matching its certificate is taken.
+      PendingBody& pending =
+          pending_bodies_[std::make_pair(waiting_region, waiting_seq)];
+      if (pending.recv_time == 0) {
+        pending.recv_time = now - timeout;
+      }
+    }
+    for (auto it = pending_bodies_.begin(); it != pending_bodies_.end();) {
+      if (it->first.second < min_seq_) {
+        it = pending_bodies_.erase(it);
+        continue;
+      }
+      if (now - it->second.recv_time >= timeout) {
+        it->second.recv_time = now;
+        fetches.push_back(std::make_tuple(it->first.first, it->first.second,
+                                          it->second.fetch_num++));
+      }
+      ++it;
+    }
+  }
+
+  ResConfigData config_data = config_.GetConfigData();
+  for (const auto& [region_id, seq, fetch_num] : fetches) {
+    for (const auto& region : config_data.region()) {
+      if (region.region_id() != region_id ||
+          region.replica_info_size() == 0) {
+        continue;
+      }
+      // Ask the next replica of the region on each timeout.
+      const ReplicaInfo& replica =
+          region.replica_info(fetch_num % region.replica_info_size());
+      std::unique_ptr<Request> fetch = resdb::NewRequest(
+          Request::TYPE_GEO_FETCH, Request(), config_.GetSelfInfo().id(),
+          config_data.self_region_id());
+      fetch->set_seq(seq);
+      LOG(ERROR) << "fetch the body of seq:" << seq << " region:" << region_id
+                 << " from:" << replica.id();
+      replica_communicator_->SendMessage(*fetch, replica);
+    }
+  }
+}
+
+void GeoPBFTCommitment::AddLocalBatch(const Request& request) {
+  std::lock_guard<std::mutex> lk(local_mutex_);
+  local_batches_[request.seq() & local_mask_] =
+      std::make_unique<Request>(request);
+}
+
+int GeoPBFTCommitment::GeoProcessFetch(std::unique_ptr<Context> context,
+                                       std::unique_ptr<Request> request) {
+  std::unique_ptr<Request> batch;
+  {
+    std::lock_guard<std::mutex> lk(local_mutex_);
+    const auto& local_batch = local_batches_[request->seq() & local_mask_];
+    if (local_batch == nullptr || local_batch->seq() != request->seq()) {
+      return -2;
+    }
+    batch = std::make_unique<Request>(*local_batch);
+  }
+  ResConfigData config_data = config_.GetConfigData();
+  for (const auto& region : config_data.region()) {
+    if (region.region_id() != request->region_info().region_id()) {
+      continue;
+    }
+    for (const auto& replica : region.replica_info()) {
+      if (replica.id() == request->sender_id()) {
+        return replica_communicator_->SendMessage(*batch, replica);
+      }
+    }
+  }
+  return -2;
+}
+
 void GeoPBFTCommitment::UpdateSeq(uint64_t seq) {
   std::lock_guard<std::mutex> lk(mutex_);
   if (seq > min_seq_) {
@@ -82,7 +281,7 @@ void GeoPBFTCommitment::UpdateSeq(uint64_t seq) {
 int GeoPBFTCommitment::GeoProcessCcm(std::unique_ptr<Context> context,
                                      std::unique_ptr<Request> request) {
   int sender_region_id = request->region_info().region_id();
-  if (!AddNewReq(request->seq(), sender_region_id)) {
+  if (IsReceived(request->seq(), sender_region_id)) {
     // LOG(ERROR) << "geo_request already received, from sender id: "
     //		       << request->sender_id() << " seq:" << request->seq() <<"
     // region:"<<sender_region_id
@@ -98,15 +297,42 @@ int GeoPBFTCommitment::GeoProcessCcm(std::unique_ptr<Context> context,
   }
 
   if (!batch_request.has_committed_certs() ||
-      !VerifyCerts(batch_request, request->data())) {
+      !VerifyCerts(batch_request, sender_region_id)) {
     // CheckCertificates
     LOG(ERROR) << "no certs";
     return -2;
   }
+  if (!global_executor_->IsInWindow(request->seq())) {
+    // Fetched once the global order waits for it.
+    LOG(ERROR) << "seq:" << request->seq() << " region:" << sender_region_id
+               << " is too far ahead of the global order";
+    return -2;
+  }
+  if (batch_request.header_only()) {
+    // The body is broadcast by the replica of this region receiving it.
+    AddHeader(*request, batch_request.hash());
+    return 0;
+  }
+  // The body may come from any replica, e.g. the one answering a fetch.
+  if (!IsCertifiedBody(request->seq(), sender_region_id, batch_request)) {
+    LOG(ERROR) << "body does not match its certificate, seq:" << request->seq()
+               << " region:" << sender_region_id
+               << " from:" << request->sender_id();
+    return -2;
+  }
+  if (!AddNewReq(request->seq(), sender_region_id)) {
+    return 1;
+  }
+  // Only a body matching its certificate moves the seq of its region, a
+  // header alone does not.
+  UpdateRegionSeq(sender_region_id, request->seq());
   // return global_executor_->OrderGeoRequest(std::move(request));
 
   ResConfigData config_data = config_.GetConfigData();
   int self_region_id = config_data.self_region_id();
+  if (sender_region_id == self_region_id) {
+    AddLocalBatch(*request);
+  }
   // LOG(ERROR)<<"get request seq:"<<request->seq()<<" from:"<<sender_region_id;
   // if the request comes from another region, do local broadcast
   if (sender_region_id != self_region_id) {
@@ -120,6 +346,76 @@ int GeoPBFTCommitment::GeoProcessCcm(std::unique_ptr<Context> context,
   return global_executor_->OrderGeoRequest(std::move(request));
 }
 
+void GeoPBFTCommitment::UpdateRegionSeq(int region_id, uint64_t seq) {
+  std::lock_guard<std::mutex> lk(seq_mutex_);
+  if (region_id == config_.GetConfigData().self_region_id()) {
+    local_seq_ = std::max(local_seq_, seq);
+  } else {
+    remote_seq_ = std::max(remote_seq_, seq);
+  }
+  if (remote_seq_ <= local_seq_) {
+    behind_time_ = 0;
+  } else if (behind_time_ == 0) {
+    behind_time_ = GetCurrentTime();
+  }
+}
+
+void GeoPBFTCommitment::MonitorIdleRegion() {
+  uint64_t timeout = config_.GetGeoIdleTimeoutMs() * 1000ull;
+  while (!stop_) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(
+        std::min<uint32_t>(config_.GetGeoIdleTimeoutMs(), 100)));
+    FetchMissingBodies();
+    if (config_.GetSelfInfo().id() != system_info_->GetPrimaryId()) {
+      continue;
+    }
+    uint64_t from_seq = 0, seq_num = 0;
+    {
+      std::lock_guard<std::mutex> lk(seq_mutex_);
+      uint64_t now = GetCurrentTime();
+      if (behind_time_ > 0 && now - behind_time_ >= timeout) {
+        from_seq = local_seq_ + 1;
+        // The global execution does not get further ahead than its ring.
+        seq_num = std::min<uint64_t>(remote_seq_ - local_seq_,
+                                     config_.GetGeoMaxPendingBatches());
+        // Give the no-op batches a timeout to be committed.
+        behind_time_ = now;
+      }
+    }
+    for (uint64_t i = 0; i < seq_num; ++i) {
+      ProposeNoopBatch(from_seq + i);
+    }
+  }
+}
+
+int GeoPBFTCommitment::ProposeNoopBatch(uint64_t seq) {
+  std::unique_ptr<Request> new_request = resdb::NewRequest(
+      Request::TYPE_NEW_TXNS, Request(), config_.GetSelfInfo().id());
+
+  // The seq only tells the no-op batches apart. Proposing a seq again before
+  // its no-op is committed gives the same hash, which is dropped as a
+  // duplicate.
+  BatchUserRequest batch_request;
+  batch_request.set_local_id(seq);
+  batch_request.set_noop(true);
+  batch_request.SerializeToString(new_request->mutable_data());
+  if (verifier_) {
+    auto signature_or = verifier_->SignMessage(new_request->data());
+    if (!signature_or.ok()) {
+      LOG(ERROR) << "Sign message fail";
+      return -2;
+    }
+    *new_request->mutable_data_signature() = *signature_or;
+  }
+  new_request->set_hash(SignatureVerifier::CalculateHash(new_request->data()));
+  new_request->set_proxy_id(config_.GetSelfInfo().id());
+
+  LOG(ERROR) << "propose no-op batch for seq:" << seq;
+  replica_communicator_->SendMessage(*new_request,
+                                     system_info_->GetPrimaryId());
+  return 0;
+}
+
 int GeoPBFTCommitment::PostProcessExecutedMsg() {
   while (!stop_) {
     auto batch_resp = global_executor_->GetResponseMsg();
@@ -41,16 +41,45 @@ class GeoPBFTCommitment {
 
   int GeoProcessCcm(std::unique_ptr<Context> context,
                     std::unique_ptr<Request> request);
+  // Send a batch of this region to a replica which only got its header.
+  int GeoProcessFetch(std::unique_ptr<Context> context,
+                      std::unique_ptr<Request> request);
 
  private:
-  bool VerifyCerts(const BatchUserRequest& request,
-                   const std::string& raw_data);
+  // Return false unless 2f+1 distinct replicas of the sender region signed
+  // the hash of the batch, f being the faulty replicas the region tolerates.
+  bool VerifyCerts(const BatchUserRequest& request, uint32_t sender_region);
 
+  // Return false if the batch is not the one its commit certificates sign,
+  // or not the one certified by the header received for it.
+  bool IsCertifiedBody(uint64_t seq, uint32_t sender_region,
+                       const BatchUserRequest& request);
+  bool IsReceived(uint64_t seq, uint32_t sender_region);
   bool AddNewReq(uint64_t seq, uint32_t sender_region);
   void UpdateSeq(uint64_t seq);
+  // A body is only waited for from a region of the config and within
+  // GetGeoMaxPendingBatches() seqs above min_seq_. Expects mutex_ held.
+  bool IsPendingInWindow(uint32_t sender_region, uint64_t seq);
+  // Wait for the body of a batch whose header arrived.
+  void AddHeader(const Request& request, const std::string& hash);
+  // Fetch the bodies which did not arrive within GetGeoFetchTimeoutMs() from
+  // the region which committed them.
+  void FetchMissingBodies();
+  void AddLocalBatch(const Request& request);
 
   int PostProcessExecutedMsg();
 
+  // Track the highest global seq of the certified bodies received from this
+  // region and from the others.
+  void UpdateRegionSeq(int region_id, uint64_t seq);
+  // The primary commits a no-op batch for each global seq this region is
+  // behind once a batch from another region has waited GetGeoIdleTimeoutMs()
+  // on it, so an idle region does not block the global execution. The missing
+  // bodies are fetched from the same thread.
+  void MonitorIdleRegion();
+  // Propose the no-op batch meant to fill seq.
+  int ProposeNoopBatch(uint64_t seq);
+
  private:
   std::unique_ptr<GeoGlobalExecutor> global_executor_;
   std::atomic<bool> stop_;
@@ -61,8 +90,26 @@ class GeoPBFTCommitment {
   SignatureVerifier* verifier_;
   Stats* global_stats_;
   std::mutex mutex_;
-  std::thread executed_thread_;
+  std::thread executed_thread_, idle_thread_;
   uint64_t min_seq_ = 0;
+  struct PendingBody {
+    uint64_t recv_time = 0;
+    int fetch_num = 0;
+    // The hash signed by the certificate of the header, empty if only the
+    // global order waits for the batch.
+    std::string hash;
+  };
+  // The (region, seq) of the batches whose header arrived but not the body,
+  // bounded by IsPendingInWindow().
+  std::map<std::pair<uint32_t, uint64_t>, PendingBody> pending_bodies_;
+  std::mutex local_mutex_;
+  // The recent batches committed by this region, indexed by seq.
+  std::vector<std::unique_ptr<Request>> local_batches_;
+  uint64_t local_mask_ = 0;
+  std::mutex seq_mutex_;
+  uint64_t local_seq_ = 0, remote_seq_ = 0;
+  // Since when another region has been ahead of this one, 0 if it is not.
+  uint64_t behind_time_ = 0;
 };
 
 }  // namespace resdb
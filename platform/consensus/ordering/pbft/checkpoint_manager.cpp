@@ -21,6 +21,10 @@
 
 #include <glog/logging.h>
 
+#include <algorithm>
+
+#include "common/utils/trace.h"
+#include "common/utils/utils.h"
 #include "platform/consensus/ordering/pbft/transaction_utils.h"
 #include "platform/proto/checkpoint_info.pb.h"
 
@@ -38,6 +42,13 @@ CheckPointManager::CheckPointManager(const ResDBConfig& config,
       highest_prepared_seq_(0),
       sys_info_(sys_info) {
   current_stable_seq_ = 0;
+  ckpt_votes_.resize(kCheckPointWindow);
+  // Large enough to cover the seqs held by the collector pool.
+  size_t committed_size = 1;
+  while (committed_size < 8 * config_.GetMaxProcessTxn()) {
+    committed_size <<= 1;
+  }
+  committed_status_.resize(committed_size, 0);
   if (config_.GetConfigData().enable_viewchange()) {
     config_.EnableCheckPoint(true);
   }
@@ -66,15 +77,80 @@ void CheckPointManager::Stop() {
   }
 }
 
+void CheckPointManager::SetExecutor(TransactionExecutor* executor) {
+  executor_ = executor;
+  if (executor_ && config_.IsCheckPointEnabled()) {
+    executor_->EnableStateDigest();
+    if (config_.GetStateTransferMinLag() > 0) {
+      executor_->EnableSnapshot();
+    }
+  }
+}
+
 void CheckPointManager::SetResetExecute(
     std::function<void(uint64_t seq)> func) {
   reset_execute_func_ = func;
 }
 
+void CheckPointManager::PauseExecute() {
+  if (executor_) {
+    executor_->Pause();
+  }
+}
+
+void CheckPointManager::ResumeExecute() {
+  if (executor_) {
+    executor_->Resume();
+  }
+}
+
+void CheckPointManager::SetStateTransferHandler(
+    std::function<void()> handler) {
+  state_transfer_func_ = handler;
+}
+
 std::string GetHash(const std::string& h1, const std::string& h2) {
   return SignatureVerifier::CalculateHash(h1 + h2);
 }
 
+bool CheckPointManager::GetCheckPointState(uint64_t seq,
+                                           std::string* request_hash,
+                                           std::string* state_digest) {
+  std::lock_guard<std::mutex> lk(mutex_);
+  auto it = ckpt_state_.find(seq);
+  if (it == ckpt_state_.end()) {
+    return false;
+  }
+  *request_hash = it->second.first;
+  *state_digest = it->second.second;
+  return true;
+}
+
+void CheckPointManager::InstallStableCheckPoint(
+    const StableCheckPoint& stable_ckpt, const std::string& request_hash,
+    const std::string& state_digest) {
+  uint64_t seq = stable_ckpt.seq();
+  LOG(ERROR) << "install stable checkpoint:" << seq;
+  {
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (seq > current_stable_seq_) {
+      stable_ckpt_ = stable_ckpt;
+      current_stable_seq_ = seq;
+    }
+    ckpt_state_[seq] = std::make_pair(request_hash, state_digest);
+  }
+  {
+    std::lock_guard<std::mutex> lk(lt_mutex_);
+    last_hash_ = request_hash;
+  }
+  if (reset_execute_func_) {
+    reset_execute_func_(seq + 1);
+  } else {
+    SetLastCommit(seq);
+  }
+  BroadcastRecovery(seq + 1, seq + 500);
+}
+
 uint64_t CheckPointManager::GetStableCheckpoint() {
   std::lock_guard<std::mutex> lk(mutex_);
   return current_stable_seq_;
@@ -136,26 +212,84 @@ int CheckPointManager::ProcessCheckPoint(std::unique_ptr<Context> context,
 
   {
     std::lock_guard<std::mutex> lk(mutex_);
-    auto res =
-        sender_ckpt_[std::make_pair(checkpoint_seq, checkpoint_data.hash())]
-            .insert(sender_id);
-    if (res.second) {
-      sign_ckpt_[std::make_pair(checkpoint_seq, checkpoint_data.hash())]
-          .push_back(checkpoint_data.hash_signature());
-      new_data_++;
+    // Replicas vote for their checkpoints in order, so anything at or
+    // below the sender's watermark is a duplicate or stale.
+    uint64_t& sender_watermark = sender_watermark_[sender_id];
+    if (checkpoint_seq <= sender_watermark) {
+      LOG(ERROR) << "checkpoint seq:" << checkpoint_seq
+                 << " from:" << sender_id
+                 << " below watermark:" << sender_watermark;
+      return 0;
     }
-    if (sender_ckpt_[std::make_pair(checkpoint_seq, checkpoint_data.hash())]
-            .size() == 1) {
-      for (auto& hash_ : checkpoint_data.hashs()) {
-        hash_ckpt_[std::make_pair(checkpoint_seq, checkpoint_data.hash())]
-            .push_back(hash_);
+    sender_watermark = checkpoint_seq;
+
+    uint64_t low_watermark = GetLowWatermark();
+    if (checkpoint_seq <= low_watermark ||
+        checkpoint_seq > low_watermark + kCheckPointWindow * water_mark) {
+      LOG(ERROR) << "checkpoint seq:" << checkpoint_seq
+                 << " out of window, low watermark:" << low_watermark;
+    } else {
+      std::vector<SignatureInfo>& votes =
+          GetCheckPointSlot(checkpoint_seq)->votes[checkpoint_data.hash()];
+      votes.push_back(checkpoint_data.hash_signature());
+      if (votes.size() ==
+          static_cast<size_t>(config_.GetMinCheckpointReceiveNum())) {
+        std::lock_guard<std::mutex> lt_lk(lt_mutex_);
+        if (checkpoint_seq > committable_seq_) {
+          committable_seq_ = checkpoint_seq;
+          committable_hash_ = checkpoint_data.hash();
+          sem_post(&committable_seq_signal_);
+        }
+      }
+      if (votes.size() ==
+              static_cast<size_t>(config_.GetMinDataReceiveNum()) &&
+          checkpoint_seq > stable_candidate_seq_) {
+        stable_candidate_seq_ = checkpoint_seq;
+        stable_candidate_hash_ = checkpoint_data.hash();
+        new_data_++;
+        Notify();
       }
     }
-    Notify();
   }
+  UpdatePeerStatus(sender_id, checkpoint_seq);
   return 0;
 }
 
+// The votes at or below the low watermark are dropped. It follows the stable
+// checkpoint, or the checkpoints f+1 replicas have voted for once this
+// replica falls behind by more than the window, so neither faulty replicas
+// nor a lagging one can keep the votes growing. Must be called with mutex_
+// held.
+uint64_t CheckPointManager::GetLowWatermark() {
+  uint64_t low_watermark = current_stable_seq_;
+  size_t f = config_.GetMaxMaliciousReplicaNum();
+  if (sender_watermark_.size() <= f) {
+    return low_watermark;
+  }
+  std::vector<uint64_t> seqs;
+  for (const auto& it : sender_watermark_) {
+    seqs.push_back(it.second);
+  }
+  std::nth_element(seqs.begin(), seqs.begin() + f, seqs.end(),
+                   std::greater<uint64_t>());
+  uint64_t span = (kCheckPointWindow - 1) * config_.GetCheckPointWaterMark();
+  if (seqs[f] > low_watermark + span) {
+    low_watermark = seqs[f] - span;
+  }
+  return low_watermark;
+}
+
+CheckPointManager::CheckPointSlot* CheckPointManager::GetCheckPointSlot(
+    uint64_t seq) {
+  CheckPointSlot* slot =
+      &ckpt_votes_[seq / config_.GetCheckPointWaterMark() % kCheckPointWindow];
+  if (slot->seq != seq) {
+    slot->seq = seq;
+    slot->votes.clear();
+  }
+  return slot;
+}
+
 void CheckPointManager::Notify() {
   std::lock_guard<std::mutex> lk(cv_mutex_);
   cv_.notify_all();
@@ -170,6 +304,7 @@ bool CheckPointManager::Wait() {
 
 void CheckPointManager::CheckHealthy() {
   uint32_t current_time = time(nullptr);
+  std::lock_guard<std::mutex> lk(status_mutex_);
 
   std::map<uint64_t, int> seqs;
 
@@ -206,31 +341,29 @@ void CheckPointManager::CheckHealthy() {
 }
 
 void CheckPointManager::UpdateStableCheckPointStatus() {
-  uint64_t last_committable_seq = 0;
   while (!stop_) {
     if (!Wait()) {
       continue;
     }
     uint64_t stable_seq = 0;
-    std::string stable_hash;
     {
       std::lock_guard<std::mutex> lk(mutex_);
-      for (auto it : sender_ckpt_) {
-        if (it.second.size() >=
-            static_cast<size_t>(config_.GetMinCheckpointReceiveNum())) {
-          committable_seq_ = it.first.first;
-          committable_hash_ = it.first.second;
-          std::set<uint32_t> senders_ =
-              sender_ckpt_[std::make_pair(committable_seq_, committable_hash_)];
-          sem_post(&committable_seq_signal_);
-        }
-        if (it.second.size() >=
-            static_cast<size_t>(config_.GetMinDataReceiveNum())) {
-          stable_seq = it.first.first;
-          stable_hash = it.first.second;
+      new_data_ = 0;
+      stable_seq = stable_candidate_seq_;
+      const CheckPointSlot& slot =
+          ckpt_votes_[stable_seq / config_.GetCheckPointWaterMark() %
+                      kCheckPointWindow];
+      if (current_stable_seq_ < stable_seq && slot.seq == stable_seq) {
+        ckpt_state_.erase(ckpt_state_.begin(),
+                          ckpt_state_.lower_bound(stable_seq));
+        stable_ckpt_.set_seq(stable_seq);
+        stable_ckpt_.set_hash(stable_candidate_hash_);
+        stable_ckpt_.mutable_signatures()->Clear();
+        for (const auto& vote : slot.votes.at(stable_candidate_hash_)) {
+          *stable_ckpt_.add_signatures() = vote;
         }
+        current_stable_seq_ = stable_seq;
       }
-      new_data_ = 0;
     }
 
     LOG(ERROR) << "current stable seq:" << current_stable_seq_
@@ -238,31 +371,6 @@ void CheckPointManager::UpdateStableCheckPointStatus() {
     if (stable_seq == 0) {
       continue;
     }
-    std::vector<SignatureInfo> votes;
-    if (current_stable_seq_ < stable_seq) {
-      std::lock_guard<std::mutex> lk(mutex_);
-      votes = sign_ckpt_[std::make_pair(stable_seq, stable_hash)];
-      std::set<uint32_t> senders_ =
-          sender_ckpt_[std::make_pair(stable_seq, stable_hash)];
-
-      auto it = sender_ckpt_.begin();
-      while (it != sender_ckpt_.end()) {
-        if (it->first.first <= stable_seq) {
-          sign_ckpt_.erase(sign_ckpt_.find(it->first));
-          auto tmp = it++;
-          sender_ckpt_.erase(tmp);
-        } else {
-          it++;
-        }
-      }
-      stable_ckpt_.set_seq(stable_seq);
-      stable_ckpt_.set_hash(stable_hash);
-      stable_ckpt_.mutable_signatures()->Clear();
-      for (auto vote : votes) {
-        *stable_ckpt_.add_signatures() = vote;
-      }
-      current_stable_seq_ = stable_seq;
-    }
     UpdateStableCheckPointCallback(current_stable_seq_);
   }
 }
@@ -288,7 +396,7 @@ void CheckPointManager::SetLastCommit(uint64_t seq) {
   LOG(ERROR) << " set last commit:" << seq;
   last_seq_ = seq;
   std::lock_guard<std::mutex> lk(lt_mutex_);
-  committed_status_.clear();
+  std::fill(committed_status_.begin(), committed_status_.end(), 0);
 }
 
 uint64_t CheckPointManager::GetLastCommit() { return last_seq_; }
@@ -305,35 +413,170 @@ int CheckPointManager::ProcessStatusSync(std::unique_ptr<Context> context,
   uint32_t primary_id = checkpoint_data.primary_id();
   uint32_t view = checkpoint_data.view();
 
-  status_[sender_id] = seq;
-  last_update_time_[sender_id] = time(nullptr);
-  view_status_[sender_id] = std::make_pair(primary_id, view);
-  LOG(ERROR) << " received from :" << sender_id << " commit status:" << seq
-             << " primary:" << primary_id << " view:" << view;
+  uint64_t reset_seq = 0;
+  {
+    std::lock_guard<std::mutex> lk(status_mutex_);
+    status_[sender_id] = seq;
+    last_update_time_[sender_id] = time(nullptr);
+    view_status_[sender_id] = std::make_pair(primary_id, view);
+    reset_seq = CheckStatus(GetCurrentTime());
+  }
+  ResetExecute(reset_seq);
+  RESDB_TRACE(kCheckPointStatus, sender_id, seq, primary_id, view);
   return 0;
 }
 
-void CheckPointManager::CheckStatus(uint64_t last_seq) {
+// A checkpoint from a replica also tells how far it has committed.
+void CheckPointManager::UpdatePeerStatus(uint32_t sender_id, uint64_t seq) {
+  uint64_t reset_seq = 0;
+  {
+    std::lock_guard<std::mutex> lk(status_mutex_);
+    status_[sender_id] = std::max(status_[sender_id], seq);
+    reset_seq = CheckStatus(GetCurrentTime());
+  }
+  ResetExecute(reset_seq);
+}
+
+void CheckPointManager::ResetExecute(uint64_t seq) {
+  if (seq > 0 && reset_execute_func_) {
+    reset_execute_func_(seq);
+  }
+}
+
+// Check whether this replica falls behind each time a replica reports its
+// progress. It fetches the missing requests if f+1 replicas are ahead and
+// it either has not committed anything for a sync interval or is behind by
+// more than kMinRecoveryWindow. Must be called with status_mutex_ held.
+// Returns the seq to reset the execution to, 0 if it is not stalled.
+uint64_t CheckPointManager::CheckStatus(uint64_t now) {
+  if (!config_.IsCheckPointEnabled()) {
+    return 0;
+  }
   std::vector<uint64_t> seqs;
   for (auto it : status_) {
     seqs.push_back(it.second);
   }
 
   sort(seqs.begin(), seqs.end());
-  int f = config_.GetMaxMaliciousReplicaNum();
+  size_t f = config_.GetMaxMaliciousReplicaNum();
 
   if (seqs.size() <= f + 1) {
-    return;
+    return 0;
+  }
+  // At least f+1 replicas have committed up to target.
+  uint64_t target = seqs[seqs.size() - f - 1];
+  uint64_t last_seq = last_seq_;
+  if (last_seq >= target) {
+    recovery_ranges_.clear();
+    lag_time_ = 0;
+    return 0;
+  }
+
+  if (lag_time_ == 0 || last_seq != lag_seq_) {
+    lag_seq_ = last_seq;
+    lag_time_ = now;
+  }
+  uint64_t gap = target - last_seq;
+  bool stalled = now - lag_time_ >= config_.GetStatusSyncIntervalMs() * 1000ull;
+  if (!stalled && gap < kMinRecoveryWindow) {
+    return 0;
+  }
+
+  LOG(ERROR) << " check last seq:" << last_seq << " target seq:" << target
+             << " stalled:" << stalled;
+  if (state_transfer_func_ && gap >= config_.GetStateTransferMinLag()) {
+    // Too far behind, install the latest stable state instead. The ranges in
+    // flight are dropped so that they do not reset the execution meanwhile.
+    recovery_ranges_.clear();
+    state_transfer_func_();
+    return 0;
+  }
+  return FetchMissingRequests(last_seq, target, now, stalled);
+}
+
+// Keep up to GetMaxRecoveryInflight() ranges in flight, each sent to a
+// replica which has committed it. A replica starts with a range that
+// splits the gap evenly; the range doubles each time the replica answers
+// before the timeout and halves each time it does not.
+// The execution is reset only if nothing is in flight and it has made no
+// progress for a sync interval.
+uint64_t CheckPointManager::FetchMissingRequests(uint64_t last_seq,
+                                                 uint64_t target, uint64_t now,
+                                                 bool stalled) {
+  uint64_t timeout = config_.GetStatusSyncIntervalMs() * 4000ull;
+  uint64_t max_window = std::max<uint64_t>(config_.GetMaxRecoveryWindow(),
+                                           kMinRecoveryWindow);
+  for (auto it = recovery_ranges_.begin(); it != recovery_ranges_.end();) {
+    auto window_it = recovery_window_.find(it->second.replica);
+    if (it->second.max_seq <= last_seq) {
+      window_it->second = std::min(window_it->second * 2, max_window);
+      it = recovery_ranges_.erase(it);
+    } else if (now - it->second.send_time >= timeout) {
+      window_it->second =
+          std::max(window_it->second / 2, kMinRecoveryWindow);
+      it = recovery_ranges_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  uint64_t reset_seq = 0;
+  if (recovery_ranges_.empty() && stalled) {
+    reset_seq = last_seq + 1;
+  }
+
+  size_t max_inflight = std::max<uint32_t>(config_.GetMaxRecoveryInflight(), 1);
+  uint64_t next = last_seq + 1;
+  while (next <= target && recovery_ranges_.size() < max_inflight) {
+    auto it = recovery_ranges_.upper_bound(next);
+    if (it != recovery_ranges_.begin() &&
+        std::prev(it)->second.max_seq >= next) {
+      next = std::prev(it)->second.max_seq + 1;
+      continue;
+    }
+
+    // Pick the next replica that has committed next.
+    uint32_t replica = 0;
+    auto status_it = status_.upper_bound(next_recovery_replica_);
+    for (size_t i = 0; i < status_.size(); ++i, ++status_it) {
+      if (status_it == status_.end()) {
+        status_it = status_.begin();
+      }
+      if (status_it->first != config_.GetSelfInfo().id() &&
+          status_it->second >= next) {
+        replica = status_it->first;
+        break;
+      }
+    }
+    if (replica == 0) {
+      break;
+    }
+    next_recovery_replica_ = replica;
+
+    uint64_t window =
+        recovery_window_
+            .emplace(replica, std::clamp((target - last_seq) / max_inflight,
+                                         kMinRecoveryWindow, max_window))
+            .first->second;
+    uint64_t max_seq = std::min(std::min(target, status_[replica]),
+                                next + window - 1);
+    if (it != recovery_ranges_.end()) {
+      max_seq = std::min(max_seq, it->first - 1);
+    }
+    recovery_ranges_[next] = RecoveryRange{max_seq, replica, now};
+    SendRecovery(next, max_seq, replica);
+    next = max_seq + 1;
   }
-  // uint64_t min_seq = seqs[f + 1];
-  uint64_t min_seq = seqs.back();
+  return reset_seq;
+}
 
-  LOG(ERROR) << " check last seq:" << last_seq << " max seq:" << min_seq;
-  if (last_seq < min_seq) {
-    // need recovery from others
-    reset_execute_func_(last_seq + 1);
-    BroadcastRecovery(last_seq + 1, std::min(min_seq, last_seq + 500));
+uint64_t CheckPointManager::GetRecoveryHorizon() {
+  std::lock_guard<std::mutex> lk(status_mutex_);
+  uint64_t horizon = last_seq_ + 1000;
+  if (!recovery_ranges_.empty()) {
+    horizon = std::max(horizon, recovery_ranges_.rbegin()->second.max_seq);
   }
+  return horizon;
 }
 
 void CheckPointManager::CheckSysStatus() {
@@ -342,6 +585,7 @@ void CheckPointManager::CheckSysStatus() {
   std::map<std::pair<int, uint64_t>, int> views;
   int current_primary = 0;
   uint64_t current_view = 0;
+  std::lock_guard<std::mutex> lk(status_mutex_);
   for (auto it : view_status_) {
     views[it.second]++;
     if (views[it.second] >= 2 * f + 1) {
@@ -360,8 +604,6 @@ void CheckPointManager::CheckSysStatus() {
 }
 
 void CheckPointManager::SyncStatus() {
-  uint64_t last_check_seq = 0;
-  uint64_t last_time = 0;
   while (!stop_) {
     uint64_t last_seq = last_seq_;
 
@@ -375,22 +617,19 @@ void CheckPointManager::SyncStatus() {
     replica_communicator_->BroadCast(*checkpoint_request);
 
     LOG(ERROR) << " sync status last seq:" << last_seq
-               << " last time:" << last_time
                << " primary:" << sys_info_->GetPrimaryId()
                << " view:" << sys_info_->GetCurrentView();
-    if (last_check_seq == last_seq && last_time > 5) {
-      CheckStatus(last_seq);
-      last_time = 0;
-    }
     CheckSysStatus();
-
-    if (last_seq != last_check_seq) {
-      last_check_seq = last_seq;
-      last_time = 0;
-    }
     CheckHealthy();
-    sleep(10);
-    last_time++;
+    uint64_t reset_seq = 0;
+    {
+      // Retry the recovery ranges even if no status arrives.
+      std::lock_guard<std::mutex> lk(status_mutex_);
+      reset_seq = CheckStatus(GetCurrentTime());
+    }
+    ResetExecute(reset_seq);
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(config_.GetStatusSyncIntervalMs()));
   }
 }
 
@@ -404,8 +643,8 @@ void CheckPointManager::UpdateCheckPointStatus() {
   while (!stop_) {
     std::unique_ptr<Request> request = nullptr;
     if (!pendings.empty()) {
-      LOG(ERROR) << " last seq:" << last_seq_
-                 << " pending:" << pendings.begin()->second->seq();
+      RESDB_TRACE(kCheckPointPending, last_seq_,
+                  pendings.begin()->second->seq());
       if (pendings.begin()->second->seq() == last_seq_ + 1) {
         request = std::move(pendings.begin()->second);
         pendings.erase(pendings.begin());
@@ -419,10 +658,8 @@ void CheckPointManager::UpdateCheckPointStatus() {
     }
     std::string hash_ = request->hash();
     uint64_t current_seq = request->seq();
-    LOG(ERROR) << "update checkpoint seq :" << last_seq_
-               << " current:" << current_seq;
     if (current_seq != last_seq_ + 1) {
-      LOG(ERROR) << "seq invalid:" << last_seq_ << " current:" << current_seq;
+      RESDB_TRACE(kCheckPointSeqGap, last_seq_, current_seq);
       if (current_seq > last_seq_ + 1) {
         pendings[current_seq] = std::move(request);
       }
@@ -435,11 +672,18 @@ void CheckPointManager::UpdateCheckPointStatus() {
     }
     bool is_recovery = request->is_recovery();
 
-    LOG(ERROR) << " current seq:" << current_seq << " water mark:" << water_mark
-               << " current stable seq:" << current_stable_seq_;
+    RESDB_TRACE(kCheckPointUpdate, current_seq, current_stable_seq_.load(),
+                water_mark);
     if (current_seq > 0 && current_seq % water_mark == 0) {
       last_ckpt_seq = current_seq;
-      BroadcastCheckPoint(last_ckpt_seq, last_hash_, stable_hashs, stable_seqs);
+      std::string state_digest =
+          executor_ ? executor_->GetStateDigest(current_seq) : "";
+      {
+        std::lock_guard<std::mutex> lk(mutex_);
+        ckpt_state_[current_seq] = std::make_pair(last_hash_, state_digest);
+      }
+      BroadcastCheckPoint(last_ckpt_seq, last_hash_, state_digest,
+                          stable_hashs, stable_seqs);
     }
     ClearCommittedStatus(current_seq);
   }
@@ -447,12 +691,20 @@ void CheckPointManager::UpdateCheckPointStatus() {
 }
 
 void CheckPointManager::BroadcastCheckPoint(
-    uint64_t seq, const std::string& hash,
+    uint64_t seq, const std::string& request_hash,
+    const std::string& state_digest,
     const std::vector<std::string>& stable_hashs,
     const std::vector<uint64_t>& stable_seqs) {
   CheckPointData checkpoint_data;
   std::unique_ptr<Request> checkpoint_request = NewRequest(
       Request::TYPE_CHECKPOINT, Request(), config_.GetSelfInfo().id());
+  // Votes are grouped by hash, so replicas only agree on a checkpoint if
+  // both the request chain and the executed state match.
+  std::string hash = request_hash;
+  if (!state_digest.empty()) {
+    hash = GetHash(request_hash, state_digest);
+    checkpoint_data.set_state_digest(state_digest);
+  }
   checkpoint_data.set_seq(seq);
   checkpoint_data.set_hash(hash);
   if (verifier_) {
@@ -480,6 +732,20 @@ void CheckPointManager::BroadcastRecovery(uint64_t min_seq, uint64_t max_seq) {
   replica_communicator_->BroadCast(*recovery_request);
 }
 
+void CheckPointManager::SendRecovery(uint64_t min_seq, uint64_t max_seq,
+                                     uint32_t replica) {
+  RecoveryRequest recovery_data;
+  std::unique_ptr<Request> recovery_request = NewRequest(
+      Request::TYPE_RECOVERY_DATA, Request(), config_.GetSelfInfo().id());
+  recovery_data.set_min_seq(min_seq);
+  recovery_data.set_max_seq(max_seq);
+  recovery_data.SerializeToString(recovery_request->mutable_data());
+
+  LOG(ERROR) << " recovery request [" << min_seq << "," << max_seq
+             << "] to:" << replica;
+  replica_communicator_->SendMessage(*recovery_request, replica);
+}
+
 void CheckPointManager::WaitSignal() {
   std::unique_lock<std::mutex> lk(mutex_);
   signal_.wait(lk, [&] { return !stable_hash_queue_.Empty(); });
@@ -527,9 +793,9 @@ uint64_t CheckPointManager::GetUnstableCkpt() {
 }
 
 void CheckPointManager::AddCommitState(uint64_t seq) {
-  LOG(ERROR) << " add commited state:" << seq;
+  RESDB_TRACE(kCheckPointAddCommit, seq);
   std::lock_guard<std::mutex> lk(lt_mutex_);
-  committed_status_[seq] = true;
+  committed_status_[seq & (committed_status_.size() - 1)] = seq;
 }
 
 bool CheckPointManager::IsCommitted(uint64_t seq) {
@@ -537,17 +803,15 @@ bool CheckPointManager::IsCommitted(uint64_t seq) {
   if (seq < last_seq_) {
     return true;
   }
-  return committed_status_.find(seq) != committed_status_.end();
+  return committed_status_[seq & (committed_status_.size() - 1)] == seq;
 }
 
 void CheckPointManager::ClearCommittedStatus(uint64_t seq) {
   std::lock_guard<std::mutex> lk(lt_mutex_);
-  while (!committed_status_.empty()) {
-    if (committed_status_.begin()->first <= seq) {
-      committed_status_.erase(committed_status_.begin());
-    } else {
-      break;
-    }
+  // The older seqs are below last_seq_ and their slots get reused.
+  uint64_t& status = committed_status_[seq & (committed_status_.size() - 1)];
+  if (status == seq) {
+    status = 0;
   }
 }
 
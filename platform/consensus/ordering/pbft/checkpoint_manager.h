@@ -67,7 +67,7 @@ class CheckPointManager : public CheckPoint {
   void WaitSignal();
   std::unique_ptr<std::pair<uint64_t, std::string>> PopStableSeqHash();
 
-  void SetExecutor(TransactionExecutor* executor) { executor_ = executor; }
+  void SetExecutor(TransactionExecutor* executor);
 
   uint64_t GetHighestPreparedSeq();
 
@@ -88,22 +88,50 @@ class CheckPointManager : public CheckPoint {
 
   void SetResetExecute(std::function<void(uint64_t seq)>);
 
+  // Hold back the execution, e.g. while the state is replaced.
+  void PauseExecute();
+  void ResumeExecute();
+
+  // Called instead of fetching the missing requests once the replica is
+  // behind by at least GetStateTransferMinLag() seqs.
+  void SetStateTransferHandler(std::function<void()> handler);
+
+  // Get the request hash and the state digest of the local checkpoint at seq.
+  bool GetCheckPointState(uint64_t seq, std::string* request_hash,
+                          std::string* state_digest);
+
+  // Continue from a stable checkpoint whose state has been installed from
+  // other replicas and fetch the requests after it.
+  void InstallStableCheckPoint(const StableCheckPoint& stable_ckpt,
+                               const std::string& request_hash,
+                               const std::string& state_digest);
+
+  // The largest seq accepted from the recovery responses.
+  uint64_t GetRecoveryHorizon();
+
  private:
   void UpdateCheckPointStatus();
   void UpdateStableCheckPointStatus();
   void BroadcastCheckPoint(uint64_t seq, const std::string& hash,
+                           const std::string& state_digest,
                            const std::vector<std::string>& stable_hashs,
                            const std::vector<uint64_t>& stable_seqs);
 
   void Notify();
   bool Wait();
   void BroadcastRecovery(uint64_t min_seq, uint64_t max_seq);
+  void SendRecovery(uint64_t min_seq, uint64_t max_seq, uint32_t replica);
 
   void SyncStatus();
   void StatusProcess();
-  void CheckStatus(uint64_t last_seq);
+  void UpdatePeerStatus(uint32_t sender_id, uint64_t seq);
+  uint64_t CheckStatus(uint64_t now);
+  uint64_t FetchMissingRequests(uint64_t last_seq, uint64_t target,
+                                uint64_t now, bool stalled);
+  void ResetExecute(uint64_t seq);
   void CheckSysStatus();
   void CheckHealthy();
+  uint64_t GetLowWatermark();
 
  protected:
   uint64_t last_executed_seq_ = 0;
@@ -112,11 +140,6 @@ class CheckPointManager : public CheckPoint {
   std::thread checkpoint_thread_, stable_checkpoint_thread_, status_thread_;
   SignatureVerifier* verifier_;
   std::atomic<bool> stop_;
-  std::map<std::pair<uint64_t, std::string>, std::set<uint32_t>> sender_ckpt_;
-  std::map<std::pair<uint64_t, std::string>, std::vector<SignatureInfo>>
-      sign_ckpt_;
-  std::map<std::pair<uint64_t, std::string>, std::vector<std::string>>
-      hash_ckpt_;
   std::atomic<uint64_t> current_stable_seq_;
   std::mutex mutex_;
   LockFreeQueue<Request> data_queue_;
@@ -131,19 +154,58 @@ class CheckPointManager : public CheckPoint {
   std::mutex lt_mutex_, seq_mutex_;
   uint64_t last_seq_ = 0;
   uint64_t max_seq_ = 0;
-  TransactionExecutor* executor_;
+  TransactionExecutor* executor_ = nullptr;
   std::atomic<uint64_t> highest_prepared_seq_;
   uint64_t committable_seq_ = 0;
   std::string last_hash_, committable_hash_;
   sem_t committable_seq_signal_;
+  std::mutex status_mutex_;
   std::map<int, uint64_t> status_;
   std::map<int, int> last_update_time_;
   int replica_timeout_ = 60;
   uint64_t unstable_check_ckpt_;
-  std::map<int, uint64_t> committed_status_;
+  // Ring of the committed seqs above last_seq_, indexed by seq & mask.
+  std::vector<uint64_t> committed_status_;
   std::function<void(uint64_t)> reset_execute_func_;
   SystemInfo* sys_info_;
   std::map<int, std::pair<int, uint64_t>> view_status_;
+  std::function<void()> state_transfer_func_;
+  // <request hash, state digest> of the checkpoints not yet stable.
+  std::map<uint64_t, std::pair<std::string, std::string>> ckpt_state_;
+
+  // The smallest range fetched from a replica while catching up.
+  static constexpr uint64_t kMinRecoveryWindow = 500;
+  struct RecoveryRange {
+    uint64_t max_seq;
+    uint32_t replica;
+    uint64_t send_time;
+  };
+  // The recovery ranges in flight, keyed by their first seq.
+  std::map<uint64_t, RecoveryRange> recovery_ranges_;
+  // The range size of each replica, adjusted by how fast it answers.
+  std::map<uint32_t, uint64_t> recovery_window_;
+  uint32_t next_recovery_replica_ = 0;
+  // The last committed seq when the lag was checked and since when it has
+  // not changed.
+  uint64_t lag_seq_ = 0, lag_time_ = 0;
+
+  // The number of checkpoints above the low watermark whose votes are kept.
+  static constexpr uint64_t kCheckPointWindow = 16;
+  // The votes of one checkpoint seq grouped by hash. Each sender votes once
+  // per seq, so a slot holds at most one signature per replica.
+  struct CheckPointSlot {
+    uint64_t seq = 0;
+    std::map<std::string, std::vector<SignatureInfo>> votes;
+  };
+  // Ring indexed by seq / water mark. A slot whose seq is not in the
+  // window is stale and reset before it is reused.
+  std::vector<CheckPointSlot> ckpt_votes_;
+  CheckPointSlot* GetCheckPointSlot(uint64_t seq);
+  // The highest checkpoint seq voted by each sender.
+  std::map<uint32_t, uint64_t> sender_watermark_;
+  // The highest seq which has collected 2f+1 votes, and its hash.
+  uint64_t stable_candidate_seq_ = 0;
+  std::string stable_candidate_hash_;
 };
 
 }  // namespace resdb
@@ -23,7 +23,9 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <atomic>
 #include <future>
+#include <set>
 
 #include "common/crypto/mock_signature_verifier.h"
 #include "common/test/test_macros.h"
@@ -293,6 +295,201 @@ TEST_F(CheckPointManagerTest, Votes) {
   EXPECT_EQ(ckpt.signatures_size(), 3);
 }
 
+TEST_F(CheckPointManagerTest, VotesOutOfWindow) {
+  config_.SetViewchangeCommitTimeout(100);
+  std::mutex mutex;
+  std::condition_variable cv;
+  int64_t stable_seq = 0;
+  MyCheckPointManager manager(config_, &replica_communicator_, nullptr,
+                              [&](int64_t seq) {
+                                std::lock_guard<std::mutex> lk(mutex);
+                                stable_seq = seq;
+                                cv.notify_all();
+                              });
+  EXPECT_CALL(replica_communicator_, BroadCast).Times(::testing::AnyNumber());
+  EXPECT_CALL(replica_communicator_, SendMessage(_, ::testing::An<int64_t>()))
+      .Times(::testing::AnyNumber());
+
+  auto vote = [&](uint32_t sender_id, uint64_t seq) {
+    CheckPointData checkpoint_data;
+    std::unique_ptr<Request> checkpoint_request =
+        NewRequest(Request::TYPE_CHECKPOINT, Request(), sender_id);
+    checkpoint_data.set_seq(seq);
+    checkpoint_data.set_hash("hash" + std::to_string(seq));
+    checkpoint_data.SerializeToString(checkpoint_request->mutable_data());
+    EXPECT_EQ(manager.ProcessCheckPoint(std::make_unique<Context>(),
+                                        std::move(checkpoint_request)),
+              0);
+  };
+  auto wait_stable = [&](int64_t seq, int timeout_ms) {
+    std::unique_lock<std::mutex> lk(mutex);
+    return cv.wait_for(lk, std::chrono::milliseconds(timeout_ms),
+                       [&] { return stable_seq == seq; });
+  };
+
+  // A single replica far ahead is ignored.
+  vote(4, 5000);
+  // Duplicated votes are only counted once.
+  vote(1, 5);
+  vote(1, 5);
+  vote(2, 5);
+  EXPECT_FALSE(wait_stable(5, 300));
+  vote(3, 5);
+  EXPECT_TRUE(wait_stable(5, 5000));
+
+  // f+1 replicas are far ahead, the window moves to their checkpoints.
+  for (int i = 1; i <= 3; ++i) {
+    vote(i, 500);
+  }
+  EXPECT_TRUE(wait_stable(500, 5000));
+  EXPECT_EQ(manager.GetStableCheckpointWithVotes().seq(), 500);
+  EXPECT_EQ(manager.GetStableCheckpointWithVotes().signatures_size(), 3);
+}
+
+void SendStatus(CheckPointManager* manager, uint32_t sender_id, uint64_t seq) {
+  CheckPointData checkpoint_data;
+  checkpoint_data.set_seq(seq);
+  std::unique_ptr<Request> request =
+      NewRequest(Request::TYPE_STATUS_SYNC, Request(), sender_id);
+  checkpoint_data.SerializeToString(request->mutable_data());
+  EXPECT_EQ(manager->ProcessStatusSync(std::make_unique<Context>(),
+                                       std::move(request)),
+            0);
+}
+
+struct RecoveryRange {
+  uint64_t min_seq;
+  uint64_t max_seq;
+  int64_t replica;
+};
+
+TEST_F(CheckPointManagerTest, FetchRangesOnStatus) {
+  SystemInfo sys_info;
+  CheckPointManager manager(config_, &replica_communicator_, nullptr,
+                            &sys_info);
+
+  std::mutex mutex;
+  std::vector<RecoveryRange> ranges;
+  EXPECT_CALL(replica_communicator_, BroadCast).Times(::testing::AnyNumber());
+  EXPECT_CALL(replica_communicator_, SendMessage(_, ::testing::An<int64_t>()))
+      .WillRepeatedly(Invoke(
+          [&](const google::protobuf::Message& message, int64_t replica) {
+            Request request;
+            request.CopyFrom(message);
+            RecoveryRequest recovery;
+            recovery.ParseFromString(request.data());
+            std::lock_guard<std::mutex> lk(mutex);
+            ranges.push_back({recovery.min_seq(), recovery.max_seq(), replica});
+          }));
+
+  // The execution is making progress, it is not reset.
+  std::atomic<int> reset_num = 0;
+  manager.SetResetExecute([&](uint64_t seq) { reset_num++; });
+
+  // The ranges are fetched once f+1 replicas report they are ahead,
+  // without waiting for the sync interval.
+  for (int i = 2; i <= 4; ++i) {
+    SendStatus(&manager, i, 5000);
+  }
+  EXPECT_EQ(reset_num, 0);
+
+  std::lock_guard<std::mutex> lk(mutex);
+  ASSERT_EQ(ranges.size(), 4);
+  uint64_t next = 1;
+  std::set<int64_t> replicas;
+  for (const auto& range : ranges) {
+    EXPECT_EQ(range.min_seq, next);
+    EXPECT_EQ(range.max_seq - range.min_seq + 1, 1250);
+    EXPECT_NE(range.replica, 1);
+    replicas.insert(range.replica);
+    next = range.max_seq + 1;
+  }
+  EXPECT_EQ(next, 5001);
+  EXPECT_EQ(replicas.size(), 3);
+  EXPECT_EQ(manager.GetRecoveryHorizon(), 5000);
+}
+
+TEST_F(CheckPointManagerTest, ShrinkRangesOnTimeout) {
+  ResConfigData config_data = GetConfigData();
+  config_data.set_status_sync_interval_ms(100);
+  ResDBConfig config(config_data, GenerateReplicaInfo(1, "127.0.0.1", 1234),
+                     KeyInfo(), CertificateInfo());
+  config.EnableCheckPoint(true);
+
+  SystemInfo sys_info;
+  CheckPointManager manager(config, &replica_communicator_, nullptr,
+                            &sys_info);
+
+  std::mutex mutex;
+  std::vector<RecoveryRange> ranges;
+  EXPECT_CALL(replica_communicator_, BroadCast).Times(::testing::AnyNumber());
+  EXPECT_CALL(replica_communicator_, SendMessage(_, ::testing::An<int64_t>()))
+      .WillRepeatedly(Invoke(
+          [&](const google::protobuf::Message& message, int64_t replica) {
+            Request request;
+            request.CopyFrom(message);
+            RecoveryRequest recovery;
+            recovery.ParseFromString(request.data());
+            std::lock_guard<std::mutex> lk(mutex);
+            ranges.push_back({recovery.min_seq(), recovery.max_seq(), replica});
+          }));
+
+  // The reset may take the status lock.
+  std::mutex reset_mutex;
+  std::vector<uint64_t> reset_seqs;
+  manager.SetResetExecute([&](uint64_t seq) {
+    manager.GetRecoveryHorizon();
+    std::lock_guard<std::mutex> lk(reset_mutex);
+    reset_seqs.push_back(seq);
+  });
+
+  for (int i = 2; i <= 4; ++i) {
+    SendStatus(&manager, i, 20000);
+  }
+  {
+    std::lock_guard<std::mutex> lk(mutex);
+    ASSERT_EQ(ranges.size(), 4);
+    for (const auto& range : ranges) {
+      EXPECT_EQ(range.max_seq - range.min_seq + 1, 2000);
+    }
+    ranges.clear();
+  }
+
+  // No replica answers, the ranges are sent again with smaller windows.
+  usleep(600000);
+  std::lock_guard<std::mutex> lk(mutex);
+  ASSERT_GE(ranges.size(), 4);
+  EXPECT_EQ(ranges[0].min_seq, 1);
+  for (const auto& range : ranges) {
+    EXPECT_LE(range.max_seq - range.min_seq + 1, 1000);
+  }
+  // The execution has stalled since the first ranges were sent.
+  std::lock_guard<std::mutex> reset_lk(reset_mutex);
+  ASSERT_FALSE(reset_seqs.empty());
+  EXPECT_EQ(reset_seqs[0], 1);
+}
+
+TEST_F(CheckPointManagerTest, CommitStateAfterSetLastCommit) {
+  SystemInfo sys_info;
+  CheckPointManager manager(config_, &replica_communicator_, nullptr,
+                            &sys_info);
+  EXPECT_CALL(replica_communicator_, BroadCast).Times(::testing::AnyNumber());
+
+  manager.AddCommitState(12);
+  EXPECT_TRUE(manager.IsCommitted(12));
+
+  // The ring keeps its size, the old states are dropped.
+  manager.SetLastCommit(10);
+  EXPECT_FALSE(manager.IsCommitted(12));
+  EXPECT_TRUE(manager.IsCommitted(9));
+
+  manager.AddCommitState(11);
+  manager.AddCommitState(1000000);
+  EXPECT_TRUE(manager.IsCommitted(11));
+  EXPECT_TRUE(manager.IsCommitted(1000000));
+  EXPECT_FALSE(manager.IsCommitted(13));
+}
+
 /*
 TEST_F(CheckPointManagerTest, SetTimeoutHandler) {
   CheckPointManager manager(config_, &replica_communicator_, nullptr);
@@ -22,6 +22,7 @@
 #include <glog/logging.h>
 #include <unistd.h>
 
+#include "common/utils/trace.h"
 #include "common/utils/utils.h"
 #include "platform/consensus/ordering/pbft/transaction_utils.h"
 
@@ -73,7 +74,7 @@ int Commitment::ProcessNewRequest(std::unique_ptr<Context> context,
 
   if (uint64_t seq =
           duplicate_manager_->CheckIfExecuted(user_request->hash())) {
-    LOG(ERROR) << "This request is already executed with seq: " << seq;
+    RESDB_TRACE(kCommitmentExecuted, seq);
     user_request->set_seq(seq);
     message_manager_->SendResponse(std::move(user_request));
     return -2;
@@ -338,7 +339,8 @@ int Commitment::PostProcessExecutedMsg() {
     request.set_current_view(batch_resp->current_view());
     request.set_proxy_id(batch_resp->proxy_id());
     request.set_primary_id(batch_resp->primary_id());
-    LOG(ERROR) << "send back to proxy:" << batch_resp->proxy_id();
+    RESDB_TRACE(kCommitmentResponse, batch_resp->seq(),
+                batch_resp->proxy_id());
     batch_resp->SerializeToString(request.mutable_data());
     replica_communicator_->SendMessage(request, request.proxy_id());
   }
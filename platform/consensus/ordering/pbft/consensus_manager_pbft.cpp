@@ -31,6 +31,7 @@ ConsensusManagerPBFT::ConsensusManagerPBFT(
     std::unique_ptr<CustomQuery> query_executor)
     : ConsensusManager(config),
       system_info_(std::make_unique<SystemInfo>(config)),
+      subscription_manager_(std::make_unique<SubscriptionManager>(config)),
       checkpoint_manager_(std::make_unique<CheckPointManager>(
           config, GetBroadCastClient(), GetSignatureVerifier(),
           system_info_.get())),
@@ -63,6 +64,15 @@ ConsensusManagerPBFT::ConsensusManagerPBFT(
   global_stats_ = Stats::GetGlobalStats();
 
   view_change_manager_->SetDuplicateManager(commitment_->GetDuplicateManager());
+  if (config_.GetStateTransferMinLag() > 0) {
+    state_transfer_manager_ = std::make_unique<StateTransferManager>(
+        config_, checkpoint_manager_.get(), GetBroadCastClient(),
+        GetSignatureVerifier(), message_manager_->GetStorage());
+    checkpoint_manager_->SetStateTransferHandler(
+        [&]() { state_transfer_manager_->RequestState(); });
+  }
+  subscription_manager_->SetRecovery(recovery_.get());
+  message_manager_->SetSubscriptionManager(subscription_manager_.get());
 
   recovery_->ReadLogs(
       [&](const SystemInfoData& data) {
@@ -78,6 +88,11 @@ ConsensusManagerPBFT::ConsensusManagerPBFT(
   LOG(ERROR) << " recovery is done";
 }
 
+ConsensusManagerPBFT::~ConsensusManagerPBFT() {
+  // The subscribers read from the recovery logs.
+  subscription_manager_->Stop();
+}
+
 void ConsensusManagerPBFT::SetNeedCommitQC(bool need_qc) {
   commitment_->SetNeedCommitQC(need_qc);
 }
@@ -266,11 +281,26 @@ int ConsensusManagerPBFT::InternalConsensusCommit(
                                             std::move(request));
     case Request::TYPE_CUSTOM_QUERY:
       return query_->ProcessCustomQuery(std::move(context), std::move(request));
+    case Request::TYPE_SUBSCRIBE:
+      return subscription_manager_->ProcessSubscribe(std::move(context),
+                                                     std::move(request));
     case Request::TYPE_RECOVERY_DATA:
       return ProcessRecoveryData(std::move(context), std::move(request));
     case Request::TYPE_RECOVERY_DATA_RESP:
       return ProcessRecoveryDataResponse(std::move(context),
                                          std::move(request));
+    case Request::TYPE_STATE_TRANSFER:
+      if (state_transfer_manager_ == nullptr) {
+        return -2;
+      }
+      return state_transfer_manager_->ProcessStateTransfer(std::move(context),
+                                                           std::move(request));
+    case Request::TYPE_STATE_TRANSFER_RESP:
+      if (state_transfer_manager_ == nullptr) {
+        return -2;
+      }
+      return state_transfer_manager_->ProcessStateTransferResponse(
+          std::move(context), std::move(request));
   }
   return 0;
 }
@@ -354,7 +384,7 @@ void ConsensusManagerPBFT::RemoteRecoveryProcess() {
       }
 
       uint64_t last_seq = checkpoint_manager_->GetLastCommit();
-      if (seq - last_seq > 1000) {
+      if (seq > checkpoint_manager_->GetRecoveryHorizon()) {
         LOG(ERROR) << " check seq:" << seq << " last:" << last_seq
                    << " data is missing, skip.";
         continue;
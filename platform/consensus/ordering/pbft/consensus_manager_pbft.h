@@ -27,6 +27,8 @@
 #include "platform/consensus/ordering/pbft/performance_manager.h"
 #include "platform/consensus/ordering/pbft/query.h"
 #include "platform/consensus/ordering/pbft/response_manager.h"
+#include "platform/consensus/ordering/pbft/state_transfer_manager.h"
+#include "platform/consensus/ordering/pbft/subscription_manager.h"
 #include "platform/consensus/ordering/pbft/viewchange_manager.h"
 #include "platform/consensus/recovery/recovery.h"
 #include "platform/networkstrate/consensus_manager.h"
@@ -38,7 +40,7 @@ class ConsensusManagerPBFT : public ConsensusManager {
   ConsensusManagerPBFT(const ResDBConfig& config,
                        std::unique_ptr<TransactionManager> executor,
                        std::unique_ptr<CustomQuery> query_executor = nullptr);
-  virtual ~ConsensusManagerPBFT() = default;
+  virtual ~ConsensusManagerPBFT();
 
   int ConsensusCommit(std::unique_ptr<Context> context,
                       std::unique_ptr<Request> request) override;
@@ -77,6 +79,10 @@ class ConsensusManagerPBFT : public ConsensusManager {
 
  protected:
   std::unique_ptr<SystemInfo> system_info_;
+  // Outlives checkpoint_manager_, which calls into it.
+  std::unique_ptr<StateTransferManager> state_transfer_manager_;
+  // Created before the message manager which publishes to it.
+  std::unique_ptr<SubscriptionManager> subscription_manager_;
   std::unique_ptr<CheckPointManager> checkpoint_manager_;
   std::unique_ptr<MessageManager> message_manager_;
   std::unique_ptr<Commitment> commitment_;
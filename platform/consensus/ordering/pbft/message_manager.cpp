@@ -37,6 +37,9 @@ MessageManager::MessageManager(
           config,
           [&](std::unique_ptr<Request> request,
               std::unique_ptr<BatchUserResponse> resp_msg) {
+            if (subscription_manager_) {
+              subscription_manager_->AddCommittedRequest(*request);
+            }
             if (request->is_recovery()) {
               if (checkpoint_manager_) {
                 checkpoint_manager_->AddCommitData(std::move(request));
@@ -234,6 +237,9 @@ void MessageManager::SetNextCommitSeq(int seq) {
   SetHighestPreparedSeq(seq);
   collector_pool_->Reset(seq);
   checkpoint_manager_->SetLastCommit(seq - 1);
+  if (subscription_manager_) {
+    subscription_manager_->SetNextSeq(seq);
+  }
   return transaction_executor_->SetPendingExecutedSeq(seq);
 }
 
@@ -266,6 +272,10 @@ void MessageManager::SetDuplicateManager(DuplicateManager* manager) {
   transaction_executor_->SetDuplicateManager(manager);
 }
 
+void MessageManager::SetSubscriptionManager(SubscriptionManager* manager) {
+  subscription_manager_ = manager;
+}
+
 void MessageManager::SendResponse(std::unique_ptr<Request> request) {
   std::unique_ptr<BatchUserResponse> response =
       std::make_unique<BatchUserResponse>();
@@ -32,6 +32,7 @@
 #include "platform/config/resdb_config.h"
 #include "platform/consensus/ordering/pbft/checkpoint_manager.h"
 #include "platform/consensus/ordering/pbft/lock_free_collector_pool.h"
+#include "platform/consensus/ordering/pbft/subscription_manager.h"
 #include "platform/consensus/ordering/pbft/transaction_collector.h"
 #include "platform/consensus/ordering/pbft/transaction_utils.h"
 #include "platform/networkstrate/server_comm.h"
@@ -103,6 +104,9 @@ class MessageManager {
 
   void SetDuplicateManager(DuplicateManager* manager);
 
+  // The executed requests will be published to the subscribers.
+  void SetSubscriptionManager(SubscriptionManager* manager);
+
   void SendResponse(std::unique_ptr<Request> request);
 
   LockFreeCollectorPool* GetCollectorPool();
@@ -122,6 +126,7 @@ class MessageManager {
   ChainState* txn_db_;
   SystemInfo* system_info_;
   CheckPointManager* checkpoint_manager_;
+  SubscriptionManager* subscription_manager_ = nullptr;
   std::map<uint64_t, std::vector<std::unique_ptr<RequestInfo>>>
       committed_proof_;
   std::map<uint64_t, Request> committed_data_;
@@ -0,0 +1,263 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "platform/consensus/ordering/pbft/state_transfer_manager.h"
+
+#include <glog/logging.h>
+
+#include <set>
+
+#include "common/utils/utils.h"
+#include "platform/consensus/ordering/pbft/transaction_utils.h"
+
+namespace resdb {
+
+StateTransferManager::StateTransferManager(
+    const ResDBConfig& config, CheckPointManager* checkpoint_manager,
+    ReplicaCommunicator* replica_communicator, SignatureVerifier* verifier,
+    Storage* storage)
+    : config_(config),
+      checkpoint_manager_(checkpoint_manager),
+      replica_communicator_(replica_communicator),
+      verifier_(verifier),
+      storage_(storage) {
+  for (const auto& replica : config_.GetReplicaInfos()) {
+    if (replica.id() != config_.GetSelfInfo().id()) {
+      peers_.push_back(replica.id());
+    }
+  }
+}
+
+bool StateTransferManager::InProgress() {
+  std::lock_guard<std::mutex> lk(mutex_);
+  return in_progress_;
+}
+
+void StateTransferManager::RequestState() {
+  std::lock_guard<std::mutex> lk(mutex_);
+  if (peers_.empty() || storage_ == nullptr) {
+    return;
+  }
+  uint64_t now = GetCurrentTime();
+  if (in_progress_) {
+    if (now - last_active_time_ <
+        config_.GetViewchangeCommitTimeout() * 1000ull) {
+      return;
+    }
+    LOG(ERROR) << "state transfer from:" << peers_[peer_idx_]
+               << " timeout, resume from the next replica";
+    peer_idx_ = (peer_idx_ + 1) % peers_.size();
+  } else {
+    LOG(ERROR) << "start state transfer, last commit:"
+               << checkpoint_manager_->GetLastCommit();
+    in_progress_ = true;
+    start_time_ = now;
+  }
+  SendRequest();
+}
+
+void StateTransferManager::SendRequest() {
+  StateTransferRequest transfer_request;
+  transfer_request.set_seq(stable_ckpt_.seq());
+  transfer_request.set_start_key(last_key_);
+  transfer_request.set_max_bytes(kChunkBytes);
+
+  std::unique_ptr<Request> request = NewRequest(
+      Request::TYPE_STATE_TRANSFER, Request(), config_.GetSelfInfo().id());
+  transfer_request.SerializeToString(request->mutable_data());
+  last_active_time_ = GetCurrentTime();
+  replica_communicator_->SendMessage(*request, peers_[peer_idx_]);
+}
+
+// Drop the fetched data and start over from the next peer.
+void StateTransferManager::Restart() {
+  stable_ckpt_.Clear();
+  request_hash_.clear();
+  state_digest_.clear();
+  storage_->ClearStagedSnapshot();
+  last_key_.clear();
+  item_num_ = 0;
+  peer_idx_ = (peer_idx_ + 1) % peers_.size();
+  SendRequest();
+}
+
+int StateTransferManager::ProcessStateTransfer(
+    std::unique_ptr<Context> context, std::unique_ptr<Request> request) {
+  StateTransferRequest transfer_request;
+  if (!transfer_request.ParseFromString(request->data())) {
+    LOG(ERROR) << "parse state transfer request fail";
+    return -2;
+  }
+  if (storage_ == nullptr) {
+    return -2;
+  }
+
+  StateTransferResponse response;
+  *response.mutable_stable_ckpt() =
+      checkpoint_manager_->GetStableCheckpointWithVotes();
+  uint64_t seq = response.stable_ckpt().seq();
+  if (seq == 0 ||
+      !checkpoint_manager_->GetCheckPointState(
+          seq, response.mutable_request_hash(),
+          response.mutable_state_digest())) {
+    LOG(ERROR) << "no checkpoint state to transfer, stable seq:" << seq;
+    return -2;
+  }
+
+  // A newer checkpoint is sent from the beginning.
+  std::string start_key =
+      transfer_request.seq() == seq ? transfer_request.start_key() : "";
+  size_t max_bytes = kChunkBytes;
+  if (transfer_request.max_bytes() > 0) {
+    max_bytes = std::min<size_t>(max_bytes, transfer_request.max_bytes());
+  }
+  std::vector<std::pair<std::string, std::string>> items;
+  int ret = storage_->ReadSnapshot(seq, start_key, max_bytes, &items);
+  if (ret < 0) {
+    LOG(ERROR) << "no snapshot for checkpoint:" << seq;
+    return -2;
+  }
+  for (auto& item : items) {
+    auto* new_item = response.add_items();
+    new_item->set_key(std::move(item.first));
+    new_item->set_value(std::move(item.second));
+  }
+  response.set_done(ret == 1);
+
+  std::unique_ptr<Request> response_data = NewRequest(
+      Request::TYPE_STATE_TRANSFER_RESP, Request(), config_.GetSelfInfo().id());
+  response.SerializeToString(response_data->mutable_data());
+  replica_communicator_->SendMessage(*response_data, request->sender_id());
+  return 0;
+}
+
+bool StateTransferManager::IsValidProof(
+    const StateTransferResponse& response) {
+  const StableCheckPoint& stable_ckpt = response.stable_ckpt();
+  if (response.state_digest().empty() ||
+      SignatureVerifier::CalculateHash(response.request_hash() +
+                                       response.state_digest()) !=
+          stable_ckpt.hash()) {
+    return false;
+  }
+  if (verifier_ == nullptr) {
+    return true;
+  }
+  std::set<uint32_t> senders;
+  for (const auto& signature : stable_ckpt.signatures()) {
+    if (!verifier_->VerifyMessage(stable_ckpt.hash(), signature)) {
+      return false;
+    }
+    senders.insert(signature.node_id());
+  }
+  return static_cast<int>(senders.size()) >= config_.GetMinDataReceiveNum();
+}
+
+int StateTransferManager::ProcessStateTransferResponse(
+    std::unique_ptr<Context> context, std::unique_ptr<Request> request) {
+  StateTransferResponse response;
+  if (!response.ParseFromString(request->data())) {
+    LOG(ERROR) << "parse state transfer response fail";
+    return -2;
+  }
+
+  std::lock_guard<std::mutex> lk(mutex_);
+  if (!in_progress_ || request->sender_id() != peers_[peer_idx_]) {
+    return 0;
+  }
+  last_active_time_ = GetCurrentTime();
+
+  uint64_t seq = response.stable_ckpt().seq();
+  if (seq <= checkpoint_manager_->GetLastCommit()) {
+    LOG(ERROR) << "checkpoint:" << seq << " has been committed, stop transfer";
+    in_progress_ = false;
+    return 0;
+  }
+  if (seq != stable_ckpt_.seq()) {
+    if (!IsValidProof(response)) {
+      LOG(ERROR) << "invalid checkpoint proof from:" << request->sender_id()
+                 << " seq:" << seq;
+      Restart();
+      return -2;
+    }
+    stable_ckpt_ = response.stable_ckpt();
+    request_hash_ = response.request_hash();
+    state_digest_ = response.state_digest();
+    storage_->ClearStagedSnapshot();
+    last_key_.clear();
+    item_num_ = 0;
+  }
+
+  std::vector<std::pair<std::string, std::string>> items;
+  items.reserve(response.items_size());
+  for (auto& item : *response.mutable_items()) {
+    items.push_back(std::make_pair(std::move(*item.mutable_key()),
+                                   std::move(*item.mutable_value())));
+  }
+  if (storage_->StageSnapshot(items)) {
+    LOG(ERROR) << "stage state fail, checkpoint:" << seq
+               << " from:" << request->sender_id();
+    Restart();
+    return -2;
+  }
+  if (!items.empty()) {
+    last_key_ = items.back().first;
+  }
+  item_num_ += items.size();
+  LOG(ERROR) << "receive state of checkpoint:" << seq
+             << " items:" << items.size() << " total:" << item_num_
+             << " done:" << response.done();
+  if (response.done()) {
+    Install();
+  } else {
+    SendRequest();
+  }
+  return 0;
+}
+
+void StateTransferManager::Install() {
+  if (storage_->GetStagedStateDigest() != state_digest_) {
+    LOG(ERROR) << "state digest mismatch, checkpoint:" << stable_ckpt_.seq();
+    Restart();
+    return;
+  }
+  // Nothing is executed while the state is replaced, and the execution
+  // resumes after the installed checkpoint.
+  checkpoint_manager_->PauseExecute();
+  int ret = storage_->ApplySnapshot();
+  if (ret == 0) {
+    checkpoint_manager_->InstallStableCheckPoint(stable_ckpt_, request_hash_,
+                                                 state_digest_);
+  }
+  checkpoint_manager_->ResumeExecute();
+  if (ret) {
+    LOG(ERROR) << "apply snapshot fail, checkpoint:" << stable_ckpt_.seq();
+    Restart();
+    return;
+  }
+  LOG(ERROR) << "install state of checkpoint:" << stable_ckpt_.seq()
+             << " items:" << item_num_
+             << " time(us):" << GetCurrentTime() - start_time_;
+  in_progress_ = false;
+  stable_ckpt_.Clear();
+  last_key_.clear();
+  item_num_ = 0;
+}
+
+}  // namespace resdb
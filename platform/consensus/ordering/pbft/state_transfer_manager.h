@@ -0,0 +1,85 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <mutex>
+
+#include "chain/storage/storage.h"
+#include "common/crypto/signature_verifier.h"
+#include "platform/config/resdb_config.h"
+#include "platform/consensus/ordering/pbft/checkpoint_manager.h"
+#include "platform/networkstrate/replica_communicator.h"
+#include "platform/proto/checkpoint_info.pb.h"
+#include "platform/proto/resdb.pb.h"
+
+namespace resdb {
+
+// StateTransferManager brings a replica that fell far behind to the latest
+// stable checkpoint without replaying the whole history.
+// A peer serves the storage snapshot taken when it executed the checkpoint in
+// chunks. The receiver stages them in its storage and resumes from the last
+// key it got, possibly from another peer. It checks the digest of the staged
+// state against the checkpoint proof, installs the state and then only fetches
+// the requests after the checkpoint.
+class StateTransferManager {
+ public:
+  StateTransferManager(const ResDBConfig& config,
+                       CheckPointManager* checkpoint_manager,
+                       ReplicaCommunicator* replica_communicator,
+                       SignatureVerifier* verifier, Storage* storage);
+
+  // Start a transfer, or resume it from the next peer if the current one
+  // has not answered within the timeout.
+  void RequestState();
+  bool InProgress();
+
+  int ProcessStateTransfer(std::unique_ptr<Context> context,
+                           std::unique_ptr<Request> request);
+  int ProcessStateTransferResponse(std::unique_ptr<Context> context,
+                                   std::unique_ptr<Request> request);
+
+ private:
+  void SendRequest();
+  void Restart();
+  bool IsValidProof(const StateTransferResponse& response);
+  void Install();
+
+ private:
+  static constexpr size_t kChunkBytes = 1 << 20;
+
+  ResDBConfig config_;
+  CheckPointManager* checkpoint_manager_;
+  ReplicaCommunicator* replica_communicator_;
+  SignatureVerifier* verifier_;
+  Storage* storage_;
+  std::vector<uint32_t> peers_;
+
+  std::mutex mutex_;
+  bool in_progress_ = false;
+  size_t peer_idx_ = 0;
+  uint64_t start_time_ = 0, last_active_time_ = 0;
+  // The checkpoint being fetched.
+  StableCheckPoint stable_ckpt_;
+  std::string request_hash_, state_digest_;
+  std::string last_key_;
+  uint64_t item_num_ = 0;
+};
+
+}  // namespace resdb
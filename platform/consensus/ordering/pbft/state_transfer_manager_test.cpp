@@ -0,0 +1,246 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "platform/consensus/ordering/pbft/state_transfer_manager.h"
+
+#include <glog/logging.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <deque>
+
+#include "chain/storage/memory_db.h"
+#include "common/test/test_macros.h"
+#include "common/utils/utils.h"
+#include "platform/config/resdb_config_utils.h"
+#include "platform/networkstrate/mock_replica_communicator.h"
+
+namespace resdb {
+namespace {
+
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::NiceMock;
+using ::testing::Test;
+
+ResConfigData GetConfigData() {
+  std::string json =
+      "{ "
+      " \"region\":{ "
+      "  \"replica_info\": { "
+      "  \"id\": 1, "
+      "  \"ip\": \"127.0.0.1\", "
+      "  \"port\": 1234 "
+      "   },"
+      "  \"replica_info\": { "
+      "  \"id\": 2, "
+      "  \"ip\": \"127.0.0.1\", "
+      "  \"port\": 1235 "
+      "   },"
+      "  \"replica_info\": { "
+      "  \"id\": 3, "
+      "  \"ip\": \"127.0.0.1\", "
+      "  \"port\": 1236 "
+      "   },"
+      "  \"replica_info\": { "
+      "  \"id\": 4, "
+      "  \"ip\": \"127.0.0.1\", "
+      "  \"port\": 1237 "
+      "   },"
+      " },"
+      "\"view_change_timeout_ms\": 100"
+      "}";
+  return resdb::testing::ParseFromText<ResConfigData>(json);
+}
+
+// The source replica 1 has executed kCheckPointSeq seqs and serves its stable
+// checkpoint to replica 4, which has executed nothing.
+class StateTransferManagerTest : public Test {
+ public:
+  static constexpr uint64_t kCheckPointSeq = 100;
+  static constexpr int kBatchSize = 400;
+  static constexpr int kKeyNum = 4000;
+
+  StateTransferManagerTest()
+      : src_config_(GetConfigData(), GenerateReplicaInfo(1, "127.0.0.1", 1234),
+                    KeyInfo(), CertificateInfo()),
+        dst_config_(GetConfigData(), GenerateReplicaInfo(4, "127.0.0.1", 1237),
+                    KeyInfo(), CertificateInfo()),
+        src_storage_(storage::NewMemoryDB()),
+        dst_storage_(storage::NewMemoryDB()),
+        src_ckpt_(src_config_, &src_comm_, nullptr, &src_sys_info_),
+        dst_ckpt_(dst_config_, &dst_comm_, nullptr, &dst_sys_info_),
+        src_manager_(src_config_, &src_ckpt_, &src_comm_, nullptr,
+                     src_storage_.get()),
+        dst_manager_(dst_config_, &dst_ckpt_, &dst_comm_, nullptr,
+                     dst_storage_.get()) {
+    src_storage_->EnableStateDigest();
+    dst_storage_->EnableStateDigest();
+
+    ON_CALL(dst_comm_, SendMessage(_, ::testing::An<int64_t>()))
+        .WillByDefault(Invoke(
+            [&](const google::protobuf::Message& message, int64_t node_id) {
+              Request request;
+              request.CopyFrom(message);
+              to_src_.push_back(std::make_pair(node_id, request));
+            }));
+    ON_CALL(src_comm_, SendMessage(_, ::testing::An<int64_t>()))
+        .WillByDefault(Invoke(
+            [&](const google::protobuf::Message& message, int64_t node_id) {
+              Request request;
+              request.CopyFrom(message);
+              to_dst_.push_back(request);
+            }));
+  }
+
+  // Execute the history on storage: every seq writes a batch of keys.
+  void Replay(Storage* storage) {
+    for (uint64_t seq = 1; seq <= kCheckPointSeq; ++seq) {
+      for (int i = 0; i < kBatchSize; ++i) {
+        int key = (seq * kBatchSize + i) % kKeyNum;
+        storage->SetValue("key" + std::to_string(key),
+                          std::string(1000, 'a' + seq % 26));
+      }
+    }
+  }
+
+  void SetupSource(bool valid_proof = true) {
+    Replay(src_storage_.get());
+    src_storage_->CreateSnapshot(kCheckPointSeq);
+    std::string request_hash = "request_hash";
+    std::string state_digest = src_storage_->GetStateDigest();
+    StableCheckPoint stable_ckpt;
+    stable_ckpt.set_seq(kCheckPointSeq);
+    stable_ckpt.set_hash(valid_proof ? SignatureVerifier::CalculateHash(
+                                           request_hash + state_digest)
+                                     : "invalid");
+    src_ckpt_.InstallStableCheckPoint(stable_ckpt, request_hash,
+                                      state_digest);
+  }
+
+  // Deliver the messages between the two replicas. The response is
+  // dropped if drop returns true.
+  void Run(int max_message = 1000,
+           std::function<bool(const Request&)> drop = nullptr) {
+    while (!to_src_.empty() && max_message-- > 0) {
+      auto [node_id, request] = to_src_.front();
+      to_src_.pop_front();
+      request.set_sender_id(dst_config_.GetSelfInfo().id());
+      src_manager_.ProcessStateTransfer(std::make_unique<Context>(),
+                                        std::make_unique<Request>(request));
+      while (!to_dst_.empty()) {
+        Request response = to_dst_.front();
+        to_dst_.pop_front();
+        if (drop && drop(response)) {
+          continue;
+        }
+        // Every peer serves the same state in the test.
+        response.set_sender_id(node_id);
+        dst_manager_.ProcessStateTransferResponse(
+            std::make_unique<Context>(), std::make_unique<Request>(response));
+      }
+    }
+  }
+
+ protected:
+  ResDBConfig src_config_, dst_config_;
+  NiceMock<MockReplicaCommunicator> src_comm_, dst_comm_;
+  SystemInfo src_sys_info_, dst_sys_info_;
+  std::unique_ptr<Storage> src_storage_, dst_storage_;
+  CheckPointManager src_ckpt_, dst_ckpt_;
+  StateTransferManager src_manager_, dst_manager_;
+  std::deque<std::pair<int64_t, Request>> to_src_;
+  std::deque<Request> to_dst_;
+};
+
+TEST_F(StateTransferManagerTest, CatchUpFromSnapshot) {
+  SetupSource();
+
+  RecoveryRequest recovery;
+  EXPECT_CALL(dst_comm_, BroadCast).WillOnce(Invoke([&](const auto& message) {
+    Request request;
+    request.CopyFrom(message);
+    recovery.ParseFromString(request.data());
+  }));
+
+  uint64_t start_time = GetCurrentTime();
+  dst_manager_.RequestState();
+  Run();
+  uint64_t transfer_time = GetCurrentTime() - start_time;
+
+  EXPECT_FALSE(dst_manager_.InProgress());
+  EXPECT_EQ(dst_storage_->GetStateDigest(), src_storage_->GetStateDigest());
+  EXPECT_EQ(dst_storage_->GetValue("key1"), src_storage_->GetValue("key1"));
+  EXPECT_EQ(dst_ckpt_.GetStableCheckpoint(), kCheckPointSeq);
+  EXPECT_EQ(dst_ckpt_.GetLastCommit(), kCheckPointSeq);
+  // Only the requests after the checkpoint are fetched.
+  EXPECT_EQ(recovery.min_seq(), kCheckPointSeq + 1);
+
+  std::unique_ptr<Storage> replay_storage = storage::NewMemoryDB();
+  replay_storage->EnableStateDigest();
+  start_time = GetCurrentTime();
+  Replay(replay_storage.get());
+  uint64_t replay_time = GetCurrentTime() - start_time;
+  EXPECT_EQ(replay_storage->GetStateDigest(), dst_storage_->GetStateDigest());
+
+  LOG(ERROR) << "catch up " << kCheckPointSeq << " seqs, state transfer(us):"
+             << transfer_time << " replay(us):" << replay_time;
+}
+
+TEST_F(StateTransferManagerTest, ResumeFromNextReplica) {
+  SetupSource();
+
+  // Replica 1 stops answering after the first chunk.
+  int responses = 0;
+  dst_manager_.RequestState();
+  Run(1000, [&](const Request& response) { return ++responses == 2; });
+  EXPECT_TRUE(dst_manager_.InProgress());
+
+  // Nothing happens before the timeout.
+  dst_manager_.RequestState();
+  EXPECT_TRUE(to_src_.empty());
+
+  usleep(200000);
+  dst_manager_.RequestState();
+  ASSERT_EQ(to_src_.size(), 1);
+  EXPECT_EQ(to_src_.front().first, 2);
+  StateTransferRequest request;
+  request.ParseFromString(to_src_.front().second.data());
+  EXPECT_EQ(request.seq(), kCheckPointSeq);
+  EXPECT_FALSE(request.start_key().empty());
+
+  Run();
+  EXPECT_FALSE(dst_manager_.InProgress());
+  EXPECT_EQ(dst_storage_->GetStateDigest(), src_storage_->GetStateDigest());
+  EXPECT_EQ(dst_ckpt_.GetLastCommit(), kCheckPointSeq);
+}
+
+TEST_F(StateTransferManagerTest, RejectInvalidProof) {
+  SetupSource(/*valid_proof=*/false);
+  dst_storage_->SetValue("key1", "local");
+
+  dst_manager_.RequestState();
+  Run(10);
+  EXPECT_TRUE(dst_manager_.InProgress());
+  EXPECT_EQ(dst_storage_->GetValue("key1"), "local");
+  EXPECT_EQ(dst_ckpt_.GetLastCommit(), 0);
+}
+
+}  // namespace
+}  // namespace resdb
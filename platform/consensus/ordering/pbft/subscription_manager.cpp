@@ -0,0 +1,264 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "platform/consensus/ordering/pbft/subscription_manager.h"
+
+#include <glog/logging.h>
+
+#include <thread>
+
+namespace resdb {
+namespace {
+
+constexpr int kMaxSubscriberNum = 64;
+constexpr uint32_t kDefaultWindow = 1000;
+constexpr uint32_t kMaxBatchSize = 100;
+// Wait at most 5s for an ack once the window is full.
+constexpr int kAckTimeoutUs = 5000000;
+
+void AddTransaction(const Request& request, SubscribeResponse* response) {
+  Request* txn = response->add_transactions();
+  txn->set_data(request.data());
+  txn->set_hash(request.hash());
+  txn->set_seq(request.seq());
+  txn->set_proxy_id(request.proxy_id());
+}
+
+}  // namespace
+
+SubscriptionManager::SubscriptionManager(const ResDBConfig& config,
+                                         size_t cache_size)
+    : config_(config),
+      cache_size_(cache_size),
+      max_cache_bytes_(config.GetSubscriptionCacheBytes()) {}
+
+SubscriptionManager::~SubscriptionManager() { Stop(); }
+
+void SubscriptionManager::SetRecovery(Recovery* recovery) {
+  recovery_ = recovery;
+}
+
+void SubscriptionManager::Stop() {
+  std::unique_lock<std::mutex> lk(mutex_);
+  stop_ = true;
+  cv_.notify_all();
+  cv_.wait(lk, [&] { return subscriber_num_ == 0; });
+}
+
+void SubscriptionManager::AddCommittedRequest(const Request& request) {
+  std::unique_lock<std::mutex> lk(mutex_);
+  if (request.seq() < next_seq_) {
+    return;
+  }
+  // Nobody reads the cache without subscribers, the ones that come later
+  // read the older requests from the recovery logs.
+  pending_[request.seq()] =
+      subscriber_num_ > 0 ? std::make_unique<Request>(request) : nullptr;
+  uint64_t next_seq = next_seq_;
+  PublishPending();
+  if (next_seq_ > next_seq) {
+    cv_.notify_all();
+  }
+}
+
+void SubscriptionManager::PublishPending() {
+  while (!pending_.empty() && pending_.begin()->first == next_seq_) {
+    std::unique_ptr<Request> request = std::move(pending_.begin()->second);
+    pending_.erase(pending_.begin());
+    next_seq_++;
+    if (request == nullptr) {
+      // The cache only holds consecutive seqs.
+      ClearCache();
+      continue;
+    }
+    cache_bytes_ += request->ByteSizeLong();
+    cache_.push_back(std::move(request));
+    while (cache_.size() > cache_size_ || cache_bytes_ > max_cache_bytes_) {
+      cache_bytes_ -= cache_.front()->ByteSizeLong();
+      cache_.pop_front();
+      cache_min_seq_++;
+    }
+  }
+}
+
+void SubscriptionManager::ClearCache() {
+  cache_.clear();
+  cache_bytes_ = 0;
+  cache_min_seq_ = next_seq_;
+}
+
+void SubscriptionManager::SetNextSeq(uint64_t seq) {
+  std::unique_lock<std::mutex> lk(mutex_);
+  if (seq <= next_seq_) {
+    return;
+  }
+  LOG(ERROR) << "subscription jumps to seq:" << seq
+             << " from seq:" << next_seq_;
+  next_seq_ = seq;
+  ClearCache();
+  pending_.erase(pending_.begin(), pending_.lower_bound(seq));
+  PublishPending();
+  cv_.notify_all();
+}
+
+uint64_t SubscriptionManager::GetMaxSeq() {
+  std::unique_lock<std::mutex> lk(mutex_);
+  return next_seq_ - 1;
+}
+
+int SubscriptionManager::GetSubscriberNum() {
+  std::unique_lock<std::mutex> lk(mutex_);
+  return subscriber_num_;
+}
+
+size_t SubscriptionManager::GetCachedNum() {
+  std::unique_lock<std::mutex> lk(mutex_);
+  return cache_.size();
+}
+
+int SubscriptionManager::ProcessSubscribe(std::unique_ptr<Context> context,
+                                          std::unique_ptr<Request> request) {
+  if (context == nullptr || context->client == nullptr) {
+    return -2;
+  }
+  SubscribeRequest subscribe_request;
+  if (!subscribe_request.ParseFromString(request->data())) {
+    LOG(ERROR) << "parse subscribe request fail";
+    return -2;
+  }
+  {
+    std::unique_lock<std::mutex> lk(mutex_);
+    if (stop_ || subscriber_num_ >= kMaxSubscriberNum) {
+      LOG(ERROR) << "reject subscriber, current subscribers:"
+                 << subscriber_num_;
+      return -2;
+    }
+    subscriber_num_++;
+  }
+  std::thread(&SubscriptionManager::Serve, this, std::move(context->client),
+              subscribe_request)
+      .detach();
+  return 0;
+}
+
+void SubscriptionManager::Serve(std::unique_ptr<NetChannel> client,
+                                const SubscribeRequest& request) {
+  uint64_t window = request.window() > 0 ? request.window() : kDefaultWindow;
+  uint64_t next_seq =
+      request.start_seq() > 0 ? request.start_seq() : GetMaxSeq() + 1;
+  uint64_t acked_seq = next_seq - 1;
+  LOG(INFO) << "start subscription from seq:" << next_seq
+            << " window:" << window;
+
+  client->SetRecvTimeout(kAckTimeoutUs);
+  while (true) {
+    uint64_t inflight = next_seq - 1 - acked_seq;
+    if (inflight >= window) {
+      // The subscriber acks each batch in order, so an ack without progress
+      // means the connection has been closed.
+      SubscribeAck ack;
+      if (client->RecvRawMessage(&ack) || ack.acked_seq() <= acked_seq) {
+        LOG(ERROR) << "wait for subscriber ack fail, seq:" << next_seq;
+        break;
+      }
+      acked_seq = std::min(ack.acked_seq(), next_seq - 1);
+      continue;
+    }
+
+    SubscribeResponse response;
+    {
+      std::unique_lock<std::mutex> lk(mutex_);
+      cv_.wait_for(lk, std::chrono::seconds(1),
+                   [&] { return stop_ || next_seq < next_seq_; });
+      if (stop_) {
+        break;
+      }
+      response.set_max_seq(next_seq_ - 1);
+    }
+
+    if (!GetTransactions(
+            next_seq, std::min<uint64_t>(kMaxBatchSize, window - inflight),
+            &response)) {
+      LOG(ERROR) << "subscribe seq:" << next_seq << " is not available";
+      response.set_out_of_range(true);
+      client->SendRawMessage(response);
+      break;
+    }
+    if (response.transactions_size() == 0) {
+      response.set_heart_beat(true);
+    }
+    if (client->SendRawMessage(response)) {
+      LOG(ERROR) << "send to subscriber fail, seq:" << next_seq;
+      break;
+    }
+    next_seq += response.transactions_size();
+  }
+  client.reset();
+
+  std::unique_lock<std::mutex> lk(mutex_);
+  subscriber_num_--;
+  if (subscriber_num_ == 0) {
+    ClearCache();
+  }
+  cv_.notify_all();
+}
+
+bool SubscriptionManager::GetTransactions(uint64_t seq, size_t num,
+                                          SubscribeResponse* response) {
+  {
+    std::unique_lock<std::mutex> lk(mutex_);
+    if (seq >= cache_min_seq_) {
+      for (uint64_t i = seq - cache_min_seq_; i < cache_.size() && num > 0;
+           ++i, --num) {
+        AddTransaction(*cache_[i], response);
+      }
+      return true;
+    }
+    num = std::min<uint64_t>(num, cache_min_seq_ - seq);
+  }
+  return GetTransactionsFromLogs(seq, num, response);
+}
+
+bool SubscriptionManager::GetTransactionsFromLogs(uint64_t seq, size_t num,
+                                                  SubscribeResponse* response) {
+  if (recovery_ == nullptr || !recovery_->IsEnabled()) {
+    return false;
+  }
+  auto res = recovery_->GetDataFromRecoveryFiles(seq, seq + num - 1);
+  for (uint64_t i = seq; i < seq + num; ++i) {
+    auto it = res.find(i);
+    if (it == res.end()) {
+      break;
+    }
+    const Request* proposal = nullptr;
+    for (const auto& data : it->second) {
+      if (data.second->type() == Request::TYPE_PRE_PREPARE) {
+        proposal = data.second.get();
+        break;
+      }
+    }
+    if (proposal == nullptr) {
+      break;
+    }
+    AddTransaction(*proposal, response);
+  }
+  return response->transactions_size() > 0;
+}
+
+}  // namespace resdb
@@ -0,0 +1,103 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+
+#include "platform/config/resdb_config.h"
+#include "platform/consensus/recovery/recovery.h"
+#include "platform/networkstrate/server_comm.h"
+#include "platform/proto/resdb.pb.h"
+
+namespace resdb {
+
+// SubscriptionManager pushes the committed transactions to the subscribers.
+// A subscriber sends a SubscribeRequest with the seq it starts from and keeps
+// the connection open. The committed transactions are sent in seq order as
+// SubscribeResponse batches and each subscriber has at most 'window'
+// transactions not acked by SubscribeAck. While there are subscribers, the
+// recent transactions are kept in memory, at most 'cache_size' of them and
+// GetSubscriptionCacheBytes() in total. The others are read from the recovery
+// logs so that a subscriber can resume from the last seq it received after
+// reconnecting.
+class SubscriptionManager {
+ public:
+  SubscriptionManager(const ResDBConfig& config, size_t cache_size = 10000);
+  ~SubscriptionManager();
+
+  // The recovery logs serve the seqs which are not in the cache.
+  void SetRecovery(Recovery* recovery);
+
+  void Stop();
+
+  // Add a request once it has been executed. Requests can be added out of
+  // order and are published in seq order.
+  void AddCommittedRequest(const Request& request);
+
+  // Skip the seqs before 'seq', used when the executor jumps to a new seq.
+  void SetNextSeq(uint64_t seq);
+
+  // Take over the connection from the context and serve the subscriber
+  // in a new thread.
+  int ProcessSubscribe(std::unique_ptr<Context> context,
+                       std::unique_ptr<Request> request);
+
+  // The max seq that has been published.
+  uint64_t GetMaxSeq();
+  int GetSubscriberNum();
+  // The requests kept in memory.
+  size_t GetCachedNum();
+
+ private:
+  void Serve(std::unique_ptr<NetChannel> client,
+             const SubscribeRequest& request);
+  // Get at most 'num' transactions from 'seq'.
+  // Return false if 'seq' is no longer available.
+  bool GetTransactions(uint64_t seq, size_t num, SubscribeResponse* response);
+  bool GetTransactionsFromLogs(uint64_t seq, size_t num,
+                               SubscribeResponse* response);
+  // Move the pending requests from next_seq_ to the cache, with mutex_ held.
+  void PublishPending();
+  // Drop the cache, with mutex_ held.
+  void ClearCache();
+
+ private:
+  ResDBConfig config_;
+  Recovery* recovery_ = nullptr;
+  size_t cache_size_;
+  uint64_t max_cache_bytes_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  // Committed requests waiting for the requests before them, only the seq
+  // is kept if there is no subscriber.
+  std::map<uint64_t, std::unique_ptr<Request>> pending_;
+  // Published requests [cache_min_seq_, next_seq_ - 1].
+  std::deque<std::unique_ptr<Request>> cache_;
+  uint64_t cache_bytes_ = 0;
+  uint64_t cache_min_seq_ = 1;
+  uint64_t next_seq_ = 1;
+  int subscriber_num_ = 0;
+  bool stop_ = false;
+};
+
+}  // namespace resdb
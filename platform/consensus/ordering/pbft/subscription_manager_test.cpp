@@ -0,0 +1,205 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "platform/consensus/ordering/pbft/subscription_manager.h"
+
+#include <glog/logging.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <future>
+
+#include "interface/rdbc/mock_net_channel.h"
+#include "platform/config/resdb_config_utils.h"
+
+namespace resdb {
+namespace {
+
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::Test;
+
+ResDBConfig GenerateConfig(const ResConfigData& data = ResConfigData()) {
+  return ResDBConfig({GenerateReplicaInfo(1, "127.0.0.1", 1234),
+                      GenerateReplicaInfo(2, "127.0.0.1", 1235),
+                      GenerateReplicaInfo(3, "127.0.0.1", 1236),
+                      GenerateReplicaInfo(4, "127.0.0.1", 1237)},
+                     GenerateReplicaInfo(1, "127.0.0.1", 1234), data);
+}
+
+Request GetRequest(uint64_t seq) {
+  Request request;
+  request.set_seq(seq);
+  request.set_data("data_" + std::to_string(seq));
+  return request;
+}
+
+std::unique_ptr<Request> GetSubscribeRequest(uint64_t start_seq,
+                                             uint32_t window) {
+  SubscribeRequest subscribe_request;
+  subscribe_request.set_start_seq(start_seq);
+  subscribe_request.set_window(window);
+  auto request = std::make_unique<Request>();
+  request->set_type(Request::TYPE_SUBSCRIBE);
+  subscribe_request.SerializeToString(request->mutable_data());
+  return request;
+}
+
+class SubscriptionManagerTest : public Test {
+ protected:
+  SubscriptionManagerTest() : manager_(GenerateConfig(), 10) {}
+
+  SubscriptionManager manager_;
+};
+
+TEST_F(SubscriptionManagerTest, PublishInOrder) {
+  manager_.AddCommittedRequest(GetRequest(2));
+  EXPECT_EQ(manager_.GetMaxSeq(), 0);
+  manager_.AddCommittedRequest(GetRequest(1));
+  EXPECT_EQ(manager_.GetMaxSeq(), 2);
+  manager_.AddCommittedRequest(GetRequest(1));
+  manager_.AddCommittedRequest(GetRequest(3));
+  EXPECT_EQ(manager_.GetMaxSeq(), 3);
+
+  manager_.SetNextSeq(10);
+  manager_.AddCommittedRequest(GetRequest(4));
+  EXPECT_EQ(manager_.GetMaxSeq(), 9);
+  manager_.AddCommittedRequest(GetRequest(10));
+  EXPECT_EQ(manager_.GetMaxSeq(), 10);
+}
+
+TEST_F(SubscriptionManagerTest, SubscribeWithWindow) {
+  std::promise<bool> done;
+  std::future<bool> done_future = done.get_future();
+
+  auto client = std::make_unique<MockNetChannel>("127.0.0.1", 0);
+  std::vector<uint64_t> received;
+  uint64_t acked_seq = 0;
+  EXPECT_CALL(*client, SendRawMessage)
+      .WillRepeatedly(Invoke([&](const google::protobuf::Message& message) {
+        const SubscribeResponse& response =
+            dynamic_cast<const SubscribeResponse&>(message);
+        EXPECT_FALSE(response.out_of_range());
+        // The window is 2.
+        EXPECT_LE(received.size() + response.transactions_size(),
+                  acked_seq + 2);
+        for (const Request& txn : response.transactions()) {
+          EXPECT_EQ(txn.data(), "data_" + std::to_string(txn.seq()));
+          received.push_back(txn.seq());
+        }
+        if (received.size() == 5) {
+          done.set_value(true);
+          return -1;
+        }
+        return 0;
+      }));
+  EXPECT_CALL(*client, RecvRawMessage)
+      .WillRepeatedly(Invoke([&](google::protobuf::Message* message) {
+        acked_seq = received.size();
+        dynamic_cast<SubscribeAck*>(message)->set_acked_seq(acked_seq);
+        return 0;
+      }));
+
+  auto context = std::make_unique<Context>();
+  context->client = std::move(client);
+  EXPECT_EQ(manager_.ProcessSubscribe(std::move(context),
+                                      GetSubscribeRequest(1, 2)),
+            0);
+  for (int i = 5; i >= 1; --i) {
+    manager_.AddCommittedRequest(GetRequest(i));
+  }
+  done_future.get();
+  EXPECT_THAT(received, ::testing::ElementsAre(1, 2, 3, 4, 5));
+  manager_.Stop();
+  EXPECT_EQ(manager_.GetSubscriberNum(), 0);
+}
+
+TEST_F(SubscriptionManagerTest, SubscribeOutOfRange) {
+  // Nothing is cached without subscribers and there are no recovery logs.
+  for (int i = 1; i <= 12; ++i) {
+    manager_.AddCommittedRequest(GetRequest(i));
+  }
+  EXPECT_EQ(manager_.GetCachedNum(), 0);
+
+  std::promise<bool> done;
+  std::future<bool> done_future = done.get_future();
+  auto client = std::make_unique<MockNetChannel>("127.0.0.1", 0);
+  EXPECT_CALL(*client, SendRawMessage)
+      .WillOnce(Invoke([&](const google::protobuf::Message& message) {
+        const SubscribeResponse& response =
+            dynamic_cast<const SubscribeResponse&>(message);
+        EXPECT_TRUE(response.out_of_range());
+        EXPECT_EQ(response.max_seq(), 12);
+        done.set_value(true);
+        return 0;
+      }));
+
+  auto context = std::make_unique<Context>();
+  context->client = std::move(client);
+  EXPECT_EQ(manager_.ProcessSubscribe(std::move(context),
+                                      GetSubscribeRequest(2, 10)),
+            0);
+  done_future.get();
+  manager_.Stop();
+}
+
+TEST_F(SubscriptionManagerTest, CacheWhileSubscribed) {
+  ResConfigData data;
+  data.set_subscription_cache_bytes(3 * GetRequest(1).ByteSizeLong());
+  SubscriptionManager manager(GenerateConfig(data), 10);
+  manager.AddCommittedRequest(GetRequest(1));
+  EXPECT_EQ(manager.GetCachedNum(), 0);
+
+  // The subscriber does not ack until the end.
+  std::promise<bool> done;
+  std::future<bool> done_future = done.get_future();
+  auto client = std::make_unique<MockNetChannel>("127.0.0.1", 0);
+  EXPECT_CALL(*client, SendRawMessage).WillRepeatedly(Invoke([&](auto&) {
+    return 0;
+  }));
+  EXPECT_CALL(*client, RecvRawMessage).WillRepeatedly(Invoke([&](auto*) {
+    done_future.wait();
+    return -1;
+  }));
+  auto context = std::make_unique<Context>();
+  context->client = std::move(client);
+  EXPECT_EQ(
+      manager.ProcessSubscribe(std::move(context), GetSubscribeRequest(0, 1)),
+      0);
+
+  // The cache keeps the last 3 requests within its bytes.
+  for (int i = 2; i <= 6; ++i) {
+    manager.AddCommittedRequest(GetRequest(i));
+  }
+  EXPECT_EQ(manager.GetCachedNum(), 3);
+
+  // The cache is dropped with the last subscriber.
+  done.set_value(true);
+  manager.Stop();
+  EXPECT_EQ(manager.GetCachedNum(), 0);
+}
+
+TEST_F(SubscriptionManagerTest, SubscribeWithoutClient) {
+  EXPECT_EQ(manager_.ProcessSubscribe(std::make_unique<Context>(),
+                                      GetSubscribeRequest(1, 10)),
+            -2);
+}
+
+}  // namespace
+}  // namespace resdb
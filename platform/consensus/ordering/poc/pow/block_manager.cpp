@@ -79,8 +79,9 @@ int BlockManager::SetNewMiningBlock(
   request_candidate_.SerializeToString(new_block->mutable_transaction_data());
   new_block->set_min_seq(request_candidate_.min_seq());
   new_block->set_max_seq(request_candidate_.max_seq());
+  new_mining_tree_ = std::make_unique<MerkleTree>(request_candidate_);
   *new_block->mutable_header()->mutable_merkle_hash() =
-      Merkle::MakeHash(request_candidate_);
+      new_mining_tree_->GetRootHash();
   new_block->set_miner(config_.GetSelfInfo().id());
   new_block->set_block_time(GetCurrentTime());
 
@@ -141,8 +142,10 @@ int BlockManager::Commit() {
   request_candidate_.Clear();
   uint64_t mining_time = GetCurrentTime() - new_mining_block_->block_time();
   new_mining_block_->set_mining_time(mining_time);
-  int ret = AddNewBlock(std::move(new_mining_block_));
+  int ret =
+      AddNewBlock(std::move(new_mining_block_), std::move(new_mining_tree_));
   new_mining_block_ = nullptr;
+  new_mining_tree_ = nullptr;
   return ret;
 }
 
@@ -151,7 +154,8 @@ int BlockManager::Commit(std::unique_ptr<Block> new_block) {
   return AddNewBlock(std::move(new_block));
 }
 
-int BlockManager::AddNewBlock(std::unique_ptr<Block> new_block) {
+int BlockManager::AddNewBlock(std::unique_ptr<Block> new_block,
+                              std::unique_ptr<MerkleTree> merkle_tree) {
   {
     std::unique_lock<std::mutex> lck(mtx_);
     if (new_block->header().height() != GetCurrentHeightNoLock() + 1) {
@@ -173,7 +177,9 @@ int BlockManager::AddNewBlock(std::unique_ptr<Block> new_block) {
     // new_block->mining_time()/1000000000.0);
     miner_->Terminate();
     request_candidate_.Clear();
+    uint64_t height = new_block->header().height();
     block_list_.push_back(std::move(new_block));
+    CacheMerkleTree(height, std::move(merkle_tree));
     Execute(*block_list_.back());
   }
   return 0;
@@ -266,6 +272,59 @@ bool BlockManager::VerifyBlock(const Block* block) {
   return Merkle::MakeHash(client_request) == block->header().merkle_hash();
 }
 
+absl::StatusOr<MerkleProof> BlockManager::GetMerkleProof(uint64_t height,
+                                                         uint64_t index) {
+  const Block* block = nullptr;
+  std::shared_ptr<const MerkleTree> tree;
+  {
+    std::unique_lock<std::mutex> lck(mtx_);
+    if (height == 0 || height > GetCurrentHeightNoLock()) {
+      return absl::NotFoundError("block not found");
+    }
+    block = block_list_[height - 1].get();
+    auto it = merkle_trees_.find(height);
+    if (it != merkle_trees_.end()) {
+      tree = it->second;
+    }
+  }
+
+  if (tree == nullptr) {
+    // Build the tree outside the lock, committed blocks are never modified.
+    BatchClientTransactions client_request;
+    if (!client_request.ParseFromString(block->transaction_data())) {
+      LOG(ERROR) << "parse transaction fail";
+      return absl::InternalError("parse transaction fail");
+    }
+    tree = std::make_shared<const MerkleTree>(client_request);
+    if (!(tree->GetRootHash() == block->header().merkle_hash())) {
+      LOG(ERROR) << "merkle root not match, height:" << height;
+      return absl::InternalError("merkle root not match");
+    }
+    std::unique_lock<std::mutex> lck(mtx_);
+    CacheMerkleTree(height, tree);
+  }
+
+  absl::StatusOr<MerkleProof> proof = tree->GetProof(index);
+  if (proof.ok()) {
+    proof->set_height(height);
+  }
+  return proof;
+}
+
+// Keep the tree if the block is among the latest ones and drop the trees
+// which fall out of them. Called with mtx_ held.
+void BlockManager::CacheMerkleTree(
+    uint64_t height, std::shared_ptr<const MerkleTree> merkle_tree) {
+  uint64_t current_height = GetCurrentHeightNoLock();
+  if (merkle_tree != nullptr && height + kMerkleTreeCacheNum > current_height) {
+    merkle_trees_.emplace(height, std::move(merkle_tree));
+  }
+  while (!merkle_trees_.empty() &&
+         merkle_trees_.begin()->first + kMerkleTreeCacheNum <= current_height) {
+    merkle_trees_.erase(merkle_trees_.begin());
+  }
+}
+
 uint64_t BlockManager::GetCurrentHeight() {
   std::unique_lock<std::mutex> lck(mtx_);
   return GetCurrentHeightNoLock();
@@ -20,7 +20,9 @@
 #pragma once
 
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "platform/config/resdb_poc_config.h"
+#include "platform/consensus/ordering/poc/pow/merkle.h"
 #include "platform/consensus/ordering/poc/pow/miner.h"
 #include "platform/consensus/ordering/poc/proto/pow.pb.h"
 #include "platform/statistic/stats.h"
@@ -66,6 +68,10 @@ class BlockManager {
   // Obtain the block with height 'height'.
   Block* GetBlockByHeight(uint64_t height);
 
+  // Get the inclusion proof of the transaction at 'index' inside the
+  // committed block with height 'height'.
+  absl::StatusOr<MerkleProof> GetMerkleProof(uint64_t height, uint64_t index);
+
   // Get the height of committed block with max height.
   uint64_t GetCurrentHeight();
   uint64_t GetLastSeq();
@@ -79,8 +85,11 @@ class BlockManager {
 
  private:
   HashValue GetPreviousBlcokHash();
-  int AddNewBlock(std::unique_ptr<Block> new_block);
+  int AddNewBlock(std::unique_ptr<Block> new_block,
+                  std::unique_ptr<MerkleTree> merkle_tree = nullptr);
   uint64_t GetCurrentHeightNoLock();
+  void CacheMerkleTree(uint64_t height,
+                       std::shared_ptr<const MerkleTree> merkle_tree);
   void Execute(const Block& block);
   void SaveClientTransactions(
       std::unique_ptr<BatchClientTransactions> client_request);
@@ -94,6 +103,13 @@ class BlockManager {
   std::vector<std::unique_ptr<Block> > block_list_ GUARDED_BY(mtx_);
   // The current minning block.
   std::unique_ptr<Block> new_mining_block_;
+  std::unique_ptr<MerkleTree> new_mining_tree_;
+  // The merkle trees of the latest kMerkleTreeCacheNum committed blocks,
+  // built on the first proof request unless the block was mined locally.
+  // The trees of the older blocks are rebuilt on each request.
+  static constexpr uint64_t kMerkleTreeCacheNum = 64;
+  std::map<uint64_t, std::shared_ptr<const MerkleTree> > merkle_trees_
+      GUARDED_BY(mtx_);
   BatchClientTransactions request_candidate_;
 
   Stats* global_stats_;
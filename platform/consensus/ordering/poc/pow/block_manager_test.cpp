@@ -297,6 +297,94 @@ TEST_F(BlockManagerTest, MineACommittedSeq) {
   }
 }
 
+TEST_F(BlockManagerTest, GetMerkleProof) {
+  BlockManager block_manager(config_);
+  std::unique_ptr<BatchClientTransactions> batch_client_request =
+      std::make_unique<BatchClientTransactions>();
+  for (int i = 1; i <= 3; ++i) {
+    auto client_request = batch_client_request->add_transactions();
+    client_request->set_seq(i);
+    client_request->set_transaction_data("test" + std::to_string(i));
+  }
+  batch_client_request->set_min_seq(1);
+  batch_client_request->set_max_seq(3);
+
+  Block* block =
+      GenerateNewBlock(&block_manager, std::move(batch_client_request));
+  ASSERT_TRUE(block != nullptr);
+  EXPECT_TRUE(block_manager.Mine().ok());
+  HashValue root = block->header().merkle_hash();
+  EXPECT_EQ(block_manager.Commit(), 0);
+
+  for (int i = 0; i < 3; ++i) {
+    absl::StatusOr<MerkleProof> proof = block_manager.GetMerkleProof(1, i);
+    ASSERT_TRUE(proof.ok());
+    EXPECT_EQ(proof->height(), 1);
+    EXPECT_TRUE(MerkleTree::VerifyProof("test" + std::to_string(i + 1), *proof,
+                                        root));
+  }
+  EXPECT_FALSE(block_manager.GetMerkleProof(1, 3).ok());
+  EXPECT_FALSE(block_manager.GetMerkleProof(2, 0).ok());
+}
+
+// Serve the proof of a block committed from others.
+TEST_F(BlockManagerTest, GetMerkleProofFromCommittedBlock) {
+  BlockManager block_manager(config_);
+  std::unique_ptr<BatchClientTransactions> batch_client_request =
+      std::make_unique<BatchClientTransactions>();
+  for (int i = 1; i <= 5; ++i) {
+    auto client_request = batch_client_request->add_transactions();
+    client_request->set_seq(i);
+    client_request->set_transaction_data("test" + std::to_string(i));
+  }
+  batch_client_request->set_min_seq(1);
+  batch_client_request->set_max_seq(5);
+
+  Block* block =
+      GenerateNewBlock(&block_manager, std::move(batch_client_request));
+  ASSERT_TRUE(block != nullptr);
+  std::unique_ptr<Block> d_block = std::make_unique<Block>(*block);
+  HashValue root = block->header().merkle_hash();
+  EXPECT_EQ(block_manager.Commit(std::move(d_block)), 0);
+
+  absl::StatusOr<MerkleProof> proof = block_manager.GetMerkleProof(1, 4);
+  ASSERT_TRUE(proof.ok());
+  EXPECT_TRUE(MerkleTree::VerifyProof("test5", *proof, root));
+}
+
+// The trees of the old blocks are dropped from the cache but their proofs
+// can still be served.
+TEST_F(BlockManagerTest, GetMerkleProofFromOldBlock) {
+  BlockManager block_manager(config_);
+  std::vector<HashValue> roots;
+  for (int height = 1; height <= 100; ++height) {
+    BatchClientTransactions batch_client_request;
+    for (int i = 1; i <= 3; ++i) {
+      auto client_request = batch_client_request.add_transactions();
+      client_request->set_seq(i);
+      client_request->set_transaction_data("test" + std::to_string(height) +
+                                           "_" + std::to_string(i));
+    }
+    auto block = std::make_unique<Block>();
+    block->mutable_header()->set_height(height);
+    *block->mutable_header()->mutable_merkle_hash() =
+        Merkle::MakeHash(batch_client_request);
+    batch_client_request.SerializeToString(block->mutable_transaction_data());
+    roots.push_back(block->header().merkle_hash());
+    EXPECT_EQ(block_manager.Commit(std::move(block)), 0);
+    absl::StatusOr<MerkleProof> proof = block_manager.GetMerkleProof(1, 2);
+    ASSERT_TRUE(proof.ok());
+    EXPECT_TRUE(MerkleTree::VerifyProof("test1_3", *proof, roots[0]));
+  }
+
+  for (int height = 1; height <= 100; ++height) {
+    absl::StatusOr<MerkleProof> proof = block_manager.GetMerkleProof(height, 0);
+    ASSERT_TRUE(proof.ok());
+    EXPECT_TRUE(MerkleTree::VerifyProof("test" + std::to_string(height) + "_1",
+                                        *proof, roots[height - 1]));
+  }
+}
+
 // Commit a mined block with invalid height.
 TEST_F(BlockManagerTest, CommitWithInvalidHeight) {
   BlockManager block_manager(config_);
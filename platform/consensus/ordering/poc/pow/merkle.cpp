@@ -19,29 +19,183 @@
 
 #include "platform/consensus/ordering/poc/pow/merkle.h"
 
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
 #include "platform/consensus/ordering/poc/pow/miner_utils.h"
 
 namespace resdb {
 namespace {
 
-std::string TrverseMakeHash(const BatchClientTransactions& transaction,
-                            int l_idx, int r_idx) {
-  if (l_idx == r_idx) {
-    return GetHashValue(transaction.transactions(l_idx).transaction_data());
+constexpr size_t kDigestSize = 32;
+// Levels smaller than this are hashed in the calling thread.
+constexpr size_t kParallelThreshold = 1024;
+
+}  // namespace
+
+MerkleTree::MerkleTree(const BatchClientTransactions& transaction,
+                       int thread_num)
+    : thread_num_(thread_num) {
+  if (thread_num_ <= 0) {
+    thread_num_ = std::max(1u, std::thread::hardware_concurrency());
   }
-  int mid = (l_idx + r_idx) >> 1;
+  Build(transaction);
+}
 
-  std::string l_chd = TrverseMakeHash(transaction, l_idx, mid);
-  std::string r_chd = TrverseMakeHash(transaction, mid + 1, r_idx);
-  return GetHashValue(l_chd + r_chd);
+void MerkleTree::ParallelFor(size_t num,
+                             const std::function<void(size_t)>& func) const {
+  size_t thread_num = std::min<size_t>(thread_num_, num / kParallelThreshold);
+  if (thread_num <= 1) {
+    for (size_t i = 0; i < num; ++i) {
+      func(i);
+    }
+    return;
+  }
+  std::vector<std::thread> ths;
+  size_t chunk = (num + thread_num - 1) / thread_num;
+  for (size_t start = 0; start < num; start += chunk) {
+    size_t end = std::min(num, start + chunk);
+    ths.push_back(std::thread([&func, start, end]() {
+      for (size_t i = start; i < end; ++i) {
+        func(i);
+      }
+    }));
+  }
+  for (auto& th : ths) {
+    th.join();
+  }
 }
 
-}  // namespace
+void MerkleTree::Build(const BatchClientTransactions& transaction) {
+  leaf_num_ = transaction.transactions_size();
+  if (leaf_num_ == 0) {
+    return;
+  }
+
+  std::string leaves(leaf_num_ * kDigestSize, 0);
+  ParallelFor(leaf_num_, [&](size_t i) {
+    const std::string& data = transaction.transactions(i).transaction_data();
+    GetHashValue(data.data(), data.size(), &leaves[i * kDigestSize]);
+  });
+  levels_.push_back(std::move(leaves));
+  if (leaf_num_ == 1) {
+    return;
+  }
+
+  // Split the leaves down to the lowest internal level, each range there
+  // holds one or two leaves.
+  size_t bottom_num = 1;
+  while (bottom_num * 2 < leaf_num_) {
+    bottom_num *= 2;
+  }
+  std::vector<std::pair<size_t, size_t>> ranges = {{0, leaf_num_ - 1}};
+  while (ranges.size() < bottom_num) {
+    std::vector<std::pair<size_t, size_t>> next;
+    for (const auto& range : ranges) {
+      size_t mid = (range.first + range.second) >> 1;
+      next.push_back(std::make_pair(range.first, mid));
+      next.push_back(std::make_pair(mid + 1, range.second));
+    }
+    ranges = std::move(next);
+  }
+
+  std::string bottom(bottom_num * kDigestSize, 0);
+  const std::string& leaf_level = levels_[0];
+  ParallelFor(bottom_num, [&](size_t i) {
+    const char* child = &leaf_level[ranges[i].first * kDigestSize];
+    if (ranges[i].first == ranges[i].second) {
+      memcpy(&bottom[i * kDigestSize], child, kDigestSize);
+    } else {
+      GetHashValue(child, kDigestSize * 2, &bottom[i * kDigestSize]);
+    }
+  });
+  for (const auto& range : ranges) {
+    range_start_.push_back(range.first);
+  }
+  levels_.push_back(std::move(bottom));
+
+  while (levels_.back().size() > kDigestSize) {
+    const std::string& children = levels_.back();
+    size_t num = children.size() / kDigestSize / 2;
+    std::string parents(num * kDigestSize, 0);
+    ParallelFor(num, [&](size_t i) {
+      GetHashValue(&children[i * kDigestSize * 2], kDigestSize * 2,
+                   &parents[i * kDigestSize]);
+    });
+    levels_.push_back(std::move(parents));
+  }
+}
+
+size_t MerkleTree::GetLeafNum() const { return leaf_num_; }
+
+HashValue MerkleTree::GetRootHash() const {
+  if (levels_.empty()) {
+    return HashValue();
+  }
+  return DigestToHash(levels_.back());
+}
+
+std::string MerkleTree::GetDigest(size_t level, size_t idx) const {
+  return levels_[level].substr(idx * kDigestSize, kDigestSize);
+}
+
+absl::StatusOr<MerkleProof> MerkleTree::GetProof(size_t index) const {
+  if (index >= leaf_num_) {
+    return absl::InvalidArgumentError("transaction index out of range");
+  }
+  MerkleProof proof;
+  proof.set_index(index);
+  if (leaf_num_ == 1) {
+    return proof;
+  }
+
+  size_t idx =
+      std::upper_bound(range_start_.begin(), range_start_.end(), index) -
+      range_start_.begin() - 1;
+  size_t range_end = idx + 1 < range_start_.size() ? range_start_[idx + 1] - 1
+                                                   : leaf_num_ - 1;
+  if (range_start_[idx] != range_end) {
+    MerkleProof::Node* node = proof.add_path();
+    bool left = index != range_start_[idx];
+    node->set_digest(GetDigest(0, left ? index - 1 : index + 1));
+    node->set_left(left);
+  }
+  for (size_t level = 1; level + 1 < levels_.size(); ++level) {
+    MerkleProof::Node* node = proof.add_path();
+    node->set_digest(GetDigest(level, idx ^ 1));
+    node->set_left(idx & 1);
+    idx >>= 1;
+  }
+  return proof;
+}
+
+bool MerkleTree::VerifyProof(const std::string& transaction_data,
+                             const MerkleProof& proof, const HashValue& root) {
+  char digest[kDigestSize];
+  char buf[kDigestSize * 2];
+  GetHashValue(transaction_data.data(), transaction_data.size(), digest);
+  for (const MerkleProof::Node& node : proof.path()) {
+    if (node.digest().size() != kDigestSize) {
+      LOG(ERROR) << "invalid proof digest size:" << node.digest().size();
+      return false;
+    }
+    if (node.left()) {
+      memcpy(buf, node.digest().data(), kDigestSize);
+      memcpy(buf + kDigestSize, digest, kDigestSize);
+    } else {
+      memcpy(buf, digest, kDigestSize);
+      memcpy(buf + kDigestSize, node.digest().data(), kDigestSize);
+    }
+    GetHashValue(buf, sizeof(buf), digest);
+  }
+  return DigestToHash(std::string(digest, kDigestSize)) == root;
+}
 
 HashValue Merkle::MakeHash(const BatchClientTransactions& transaction) {
-  std::string root_hash =
-      TrverseMakeHash(transaction, 0, transaction.transactions_size() - 1);
-  return DigestToHash(root_hash);
+  return MerkleTree(transaction).GetRootHash();
 }
 
 }  // namespace resdb
@@ -19,10 +19,54 @@
 
 #pragma once
 
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
 #include "platform/consensus/ordering/poc/proto/pow.pb.h"
 
 namespace resdb {
 
+// MerkleTree keeps all the levels of the merkle tree over the transactions of
+// a block so that inclusion proofs can be served after the block is built.
+//
+// The tree splits [l, r] at (l + r) / 2 like the recursive definition used by
+// the blocks, so the leaves lie on the last two levels. It is built level by
+// level: the lowest level hashes the leaf pairs of each range, the levels
+// above are perfect. Each level is a flat buffer of 32 bytes digests, so the
+// input of a parent is the 64 bytes of its two children in place. Large
+// levels are hashed in parallel.
+class MerkleTree {
+ public:
+  // thread_num = 0 uses the hardware concurrency.
+  MerkleTree(const BatchClientTransactions& transaction, int thread_num = 0);
+
+  size_t GetLeafNum() const;
+  HashValue GetRootHash() const;
+
+  // Get the proof of the transaction at index. The height of the proof
+  // is left unset.
+  absl::StatusOr<MerkleProof> GetProof(size_t index) const;
+
+  // Verify that the transaction data is included in the tree with root.
+  static bool VerifyProof(const std::string& transaction_data,
+                          const MerkleProof& proof, const HashValue& root);
+
+ private:
+  void Build(const BatchClientTransactions& transaction);
+  void ParallelFor(size_t num, const std::function<void(size_t)>& func) const;
+  std::string GetDigest(size_t level, size_t idx) const;
+
+ private:
+  int thread_num_;
+  size_t leaf_num_ = 0;
+  // levels_[0] holds the leaves, the last level holds the root.
+  std::vector<std::string> levels_;
+  // The first leaf covered by each node of levels_[1].
+  std::vector<size_t> range_start_;
+};
+
 class Merkle {
  public:
   static HashValue MakeHash(const BatchClientTransactions& transaction);
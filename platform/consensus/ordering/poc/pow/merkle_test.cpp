@@ -31,6 +31,26 @@
 namespace resdb {
 namespace {
 
+// The recursive definition used before the tree was built level by level.
+std::string MakeRecursiveHash(const BatchClientTransactions& transaction,
+                              int l_idx, int r_idx) {
+  if (l_idx == r_idx) {
+    return GetHashValue(transaction.transactions(l_idx).transaction_data());
+  }
+  int mid = (l_idx + r_idx) >> 1;
+  return GetHashValue(MakeRecursiveHash(transaction, l_idx, mid) +
+                      MakeRecursiveHash(transaction, mid + 1, r_idx));
+}
+
+BatchClientTransactions GetTransactions(int num) {
+  BatchClientTransactions transactions;
+  for (int i = 1; i <= num; ++i) {
+    transactions.add_transactions()->set_transaction_data("txn_" +
+                                                          std::to_string(i));
+  }
+  return transactions;
+}
+
 TEST(MerkleTest, GetHashFromOneTxn) {
   BatchClientTransactions transactions;
   transactions.add_transactions()->set_transaction_data("txn_1");
@@ -61,5 +81,57 @@ TEST(MerkleTest, GetHashFromThreeTxn) {
             "1cee75f552290940e8f7b195b5e573fafe3db67eadcea19a76bcecd1df94d8cd");
 }
 
+TEST(MerkleTest, SameAsRecursiveHash) {
+  for (int num = 1; num <= 70; ++num) {
+    BatchClientTransactions transactions = GetTransactions(num);
+    EXPECT_EQ(GetHashDigest(Merkle::MakeHash(transactions)),
+              MakeRecursiveHash(transactions, 0, num - 1))
+        << "num:" << num;
+  }
+}
+
+TEST(MerkleTest, ParallelBuild) {
+  BatchClientTransactions transactions = GetTransactions(5000);
+  MerkleTree tree(transactions, 4);
+  EXPECT_EQ(tree.GetLeafNum(), 5000u);
+  EXPECT_EQ(tree.GetRootHash(), MerkleTree(transactions, 1).GetRootHash());
+  EXPECT_EQ(GetHashDigest(tree.GetRootHash()),
+            MakeRecursiveHash(transactions, 0, 4999));
+}
+
+TEST(MerkleTest, VerifyProof) {
+  for (int num = 1; num <= 33; ++num) {
+    BatchClientTransactions transactions = GetTransactions(num);
+    MerkleTree tree(transactions);
+    HashValue root = tree.GetRootHash();
+    for (int i = 0; i < num; ++i) {
+      absl::StatusOr<MerkleProof> proof = tree.GetProof(i);
+      ASSERT_TRUE(proof.ok());
+      EXPECT_EQ(proof->index(), i);
+      EXPECT_TRUE(MerkleTree::VerifyProof(
+          transactions.transactions(i).transaction_data(), *proof, root))
+          << "num:" << num << " index:" << i;
+      EXPECT_FALSE(MerkleTree::VerifyProof("fake", *proof, root));
+    }
+    EXPECT_FALSE(tree.GetProof(num).ok());
+  }
+}
+
+TEST(MerkleTest, VerifyTamperedProof) {
+  BatchClientTransactions transactions = GetTransactions(10);
+  MerkleTree tree(transactions);
+  absl::StatusOr<MerkleProof> proof = tree.GetProof(3);
+  ASSERT_TRUE(proof.ok());
+  ASSERT_GT(proof->path_size(), 0);
+
+  MerkleProof tampered = *proof;
+  tampered.mutable_path(0)->set_left(!tampered.path(0).left());
+  EXPECT_FALSE(MerkleTree::VerifyProof("txn_4", tampered, tree.GetRootHash()));
+
+  tampered = *proof;
+  tampered.mutable_path(0)->set_digest("short");
+  EXPECT_FALSE(MerkleTree::VerifyProof("txn_4", tampered, tree.GetRootHash()));
+}
+
 }  // namespace
 }  // namespace resdb
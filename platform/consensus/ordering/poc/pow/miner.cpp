@@ -23,10 +23,13 @@
 #include <glog/logging.h>
 
 #include <boost/format.hpp>
+#include <memory>
 #include <thread>
 
 #include "common/crypto/signature_verifier.h"
+#include "common/utils/trace.h"
 #include "platform/consensus/ordering/poc/pow/miner_utils.h"
+#include "platform/consensus/ordering/poc/pow/mining_kernel.h"
 
 namespace resdb {
 
@@ -93,7 +96,7 @@ absl::Status Miner::Mine(Block* new_block) {
     LOG(ERROR) << "skip fake fail";
     return absl::NotFoundError("solution not found");
   }
-  LOG(ERROR) << " start mine block slice:" << shift_idx_;
+  RESDB_TRACE(kMinerSliceStart, shift_idx_);
   stop_ = false;
   std::vector<std::pair<uint64_t, uint64_t>> slices = GetMiningSlices();
 
@@ -106,37 +109,55 @@ absl::Status Miner::Mine(Block* new_block) {
     std::vector<std::thread> ths;
     std::atomic<bool> solution_found = false;
 
+    std::string header_hash;
+    header_hash += GetHashDigest(header.pre_hash());
+    header_hash += GetHashDigest(header.merkle_hash());
+    // The kernel needs both digests. Blocks with an empty digest, like the
+    // first block without a pre_hash, hash the header string directly.
+    std::unique_ptr<MiningKernel> kernel;
+    if (header_hash.size() == 64) {
+      kernel = std::make_unique<MiningKernel>(header_hash);
+    }
+
     uint64_t step = static_cast<uint64_t>(worker_num_);
     for (uint32_t i = 0; i < worker_num_; ++i) {
       uint64_t current_slice_start = i + min_slice;
 
       ths.push_back(std::thread(
           [&](Block::Header header, std::pair<uint64_t, uint64_t> slice) {
-            std::string header_hash;
-            header_hash += GetHashDigest(header.pre_hash());
-            header_hash += GetHashDigest(header.merkle_hash());
-
-            for (uint64_t nonce = slice.first;
-                 nonce <= max_slice && !stop_ && !solution_found;
-                 nonce += step) {
-              // LOG(ERROR)<<" miner min:"<<slice.first<<" max:"<<max_slice<<"
-              // nonce"<<nonce;
-              header.set_nonce(nonce);
-              std::string str_value =
-                  header_hash + std::to_string(header.nonce());
-              std::string hash_digest = GetHashValue(str_value);
-
-              if (IsValidDigest(hash_digest, difficulty_)) {
-                solution_found = true;
-                *new_block->mutable_hash() = DigestToHash(hash_digest);
-                *new_block->mutable_header() = header;
-                LOG(ERROR) << "nonce:" << nonce
-                           << " hex string:" << GetDigestHexString(hash_digest)
-                           << " target:" << difficulty_;
+            uint64_t nonce = 0;
+            std::string hash_digest;
+            auto should_stop = [&]() { return stop_ || solution_found; };
+            bool found = false;
+            if (kernel != nullptr) {
+              found = kernel->Search(slice.first, max_slice, step, difficulty_,
+                                     should_stop, &nonce, &hash_digest);
+            } else {
+              for (nonce = slice.first; nonce <= max_slice && !should_stop();
+                   nonce += step) {
+                hash_digest = GetHashValue(header_hash + std::to_string(nonce));
+                if (IsValidDigest(hash_digest, difficulty_)) {
+                  found = true;
+                  break;
+                }
+                if (max_slice - nonce < step) {
+                  break;
+                }
+              }
+            }
+            if (found) {
+              if (solution_found.exchange(true)) {
                 return;
               }
+              header.set_nonce(nonce);
+              *new_block->mutable_hash() = DigestToHash(hash_digest);
+              *new_block->mutable_header() = header;
+              LOG(ERROR) << "nonce:" << nonce
+                         << " hex string:" << GetDigestHexString(hash_digest)
+                         << " target:" << difficulty_;
+              return;
             }
-            LOG(ERROR) << "mine done slice:" << slice.first << " len:" << step;
+            RESDB_TRACE(kMinerSliceDone, slice.first, step);
           },
           header, std::make_pair(current_slice_start, 0)));
     }
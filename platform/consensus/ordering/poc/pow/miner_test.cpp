@@ -122,6 +122,22 @@ TEST_F(MinerTest, Mine) {
       MessageDifferencer::Equals(block.hash(), DigestToHash(expected_hash)));
 }
 
+// The first block does not have a pre_hash.
+TEST_F(MinerTest, MineWithoutPreHash) {
+  ResDBPoCConfig config = GetConfig(1, 1);
+  config.SetMaxNonceBit(20);
+  config.SetDifficulty(4);
+  Miner miner(config);
+
+  Block block;
+  *block.mutable_header()->mutable_merkle_hash() =
+      DigestToHash(GetHashValue("merkle_hash"));
+  block.mutable_header()->set_height(1);
+
+  EXPECT_TRUE(miner.Mine(&block).ok());
+  EXPECT_TRUE(miner.IsValidHash(&block));
+}
+
 TEST_F(MinerTest, MineFail) {
   ResDBPoCConfig config = GetConfig(3);
   config.SetMaxNonceBit(3);
@@ -19,6 +19,7 @@
 
 #include "platform/consensus/ordering/poc/pow/miner_utils.h"
 
+#include <cryptopp/sha.h>
 #include <glog/logging.h>
 
 #include <boost/format.hpp>
@@ -89,6 +90,14 @@ std::string GetHashValue(const std::string& data) {
       SignatureVerifier::CalculateHash(data));
 }
 
+void GetHashValue(const char* data, size_t len, char* digest) {
+  CryptoPP::byte inner[CryptoPP::SHA256::DIGESTSIZE];
+  CryptoPP::SHA256().CalculateDigest(
+      inner, reinterpret_cast<const CryptoPP::byte*>(data), len);
+  CryptoPP::SHA256().CalculateDigest(reinterpret_cast<CryptoPP::byte*>(digest),
+                                     inner, sizeof(inner));
+}
+
 int CmpHash(const HashValue& h1, const HashValue& h2) {
   if (h1.bits_size() != 4 || h2.bits_size() != 4) return -1;
   for (int i = 0; i < 4; ++i) {
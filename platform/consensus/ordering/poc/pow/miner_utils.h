@@ -27,6 +27,10 @@ namespace resdb {
 // and return the binary string.
 std::string GetHashValue(const std::string& data);
 
+// Same as GetHashValue() but hashes len bytes from data into the 32 bytes
+// buffer digest without allocation.
+void GetHashValue(const char* data, size_t len, char* digest);
+
 // Convert the hexadecimal string digest to binary type.
 HashValue DigestToHash(const std::string& value);
 
@@ -0,0 +1,454 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "platform/consensus/ordering/poc/pow/mining_kernel.h"
+
+#include <glog/logging.h>
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace resdb {
+namespace {
+
+constexpr int kMaxLanes = 16;
+
+constexpr uint32_t kInitState[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                    0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                    0x1f83d9ab, 0x5be0cd19};
+
+alignas(64) constexpr uint32_t kRoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+uint32_t LoadBigEndian(const uint8_t* p) {
+  return (static_cast<uint32_t>(p[0]) << 24) |
+         (static_cast<uint32_t>(p[1]) << 16) |
+         (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+// Build the second message block: the decimal nonce followed by the SHA-256
+// padding. The message is 64 + len bytes and len <= 20, so the padding
+// always fits into this block.
+ALWAYS_INLINE void EncodeNonce(uint64_t nonce, uint32_t w[16]) {
+  uint8_t block[64] = {0};
+  char digits[20];
+  int len = 0;
+  do {
+    digits[len++] = '0' + nonce % 10;
+    nonce /= 10;
+  } while (nonce > 0);
+  for (int i = 0; i < len; ++i) {
+    block[i] = digits[len - 1 - i];
+  }
+  block[len] = 0x80;
+  for (int i = 0; i < 14; ++i) {
+    w[i] = LoadBigEndian(block + i * 4);
+  }
+  w[14] = 0;
+  w[15] = (64 + len) * 8;
+}
+
+// The compression works on a generic lane type: uint32_t for the scalar path
+// or a vector of uint32_t for the multi-buffer paths.
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+template <typename V>
+ALWAYS_INLINE void Compress(V state[8], V w[16]) {
+  V a = state[0], b = state[1], c = state[2], d = state[3];
+  V e = state[4], f = state[5], g = state[6], h = state[7];
+#pragma GCC unroll 64
+  for (int t = 0; t < 64; ++t) {
+    if (t >= 16) {
+      V w15 = w[(t - 15) & 15];
+      V w2 = w[(t - 2) & 15];
+      w[t & 15] += (ROTR(w2, 17) ^ ROTR(w2, 19) ^ (w2 >> 10)) +
+                   w[(t - 7) & 15] +
+                   (ROTR(w15, 7) ^ ROTR(w15, 18) ^ (w15 >> 3));
+    }
+    V t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + (g ^ (e & (f ^ g))) +
+           kRoundConstants[t] + w[t & 15];
+    V t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) | (c & (a | b)));
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+// Hash N nonces with each lane of V holding one of them. The message words
+// are transposed so that block[i][lane] is word i of the lane.
+template <typename V, int N>
+ALWAYS_INLINE void HashLanesImpl(const uint32_t midstate[8],
+                                 const uint64_t* nonces, uint32_t* out) {
+  alignas(64) uint32_t block[16][N];
+  for (int lane = 0; lane < N; ++lane) {
+    uint32_t w[16];
+    EncodeNonce(nonces[lane], w);
+    for (int i = 0; i < 16; ++i) {
+      block[i][lane] = w[i];
+    }
+  }
+
+  V w[16];
+  V state[8];
+  for (int i = 0; i < 16; ++i) {
+    memcpy(&w[i], block[i], sizeof(V));
+  }
+  for (int i = 0; i < 8; ++i) {
+    state[i] = V{} + midstate[i];
+  }
+  Compress(state, w);
+
+  // The outer hash is a single block holding the 32 bytes inner digest.
+  for (int i = 0; i < 8; ++i) {
+    w[i] = state[i];
+    w[i + 8] = V{};
+    state[i] = V{} + kInitState[i];
+  }
+  w[8] = V{} + 0x80000000;
+  w[15] = V{} + 256;
+  Compress(state, w);
+
+  for (int i = 0; i < 8; ++i) {
+    memcpy(out + i * N, &state[i], sizeof(V));
+  }
+}
+
+void HashScalar(const uint32_t midstate[8], const uint64_t* nonces,
+                uint32_t* out) {
+  HashLanesImpl<uint32_t, 1>(midstate, nonces, out);
+}
+
+#if defined(__x86_64__)
+
+typedef uint32_t V4 __attribute__((vector_size(16)));
+typedef uint32_t V8 __attribute__((vector_size(32)));
+typedef uint32_t V16 __attribute__((vector_size(64)));
+
+__attribute__((target("sse2"))) void HashSSE2(const uint32_t midstate[8],
+                                              const uint64_t* nonces,
+                                              uint32_t* out) {
+  HashLanesImpl<V4, 4>(midstate, nonces, out);
+}
+
+__attribute__((target("avx2"))) void HashAVX2(const uint32_t midstate[8],
+                                              const uint64_t* nonces,
+                                              uint32_t* out) {
+  HashLanesImpl<V8, 8>(midstate, nonces, out);
+}
+
+__attribute__((target("avx512f"))) void HashAVX512(const uint32_t midstate[8],
+                                                   const uint64_t* nonces,
+                                                   uint32_t* out) {
+  HashLanesImpl<V16, 16>(midstate, nonces, out);
+}
+
+// One block compression with the SHA extensions. w holds the message words
+// in host order.
+__attribute__((target("sha,sse4.1"))) void CompressSHANI(uint32_t state[8],
+                                                         const uint32_t w[16]) {
+  __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state));
+  __m128i state1 =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4));
+  tmp = _mm_shuffle_epi32(tmp, 0xB1);                // CDAB
+  state1 = _mm_shuffle_epi32(state1, 0x1B);          // EFGH
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);  // ABEF
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0);       // CDGH
+  const __m128i abef = state0;
+  const __m128i cdgh = state1;
+
+  __m128i msg[4];
+  for (int i = 0; i < 4; ++i) {
+    msg[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w + i * 4));
+  }
+#pragma GCC unroll 16
+  for (int g = 0; g < 16; ++g) {
+    if (g >= 4) {
+      __m128i cur = _mm_sha256msg1_epu32(msg[g & 3], msg[(g + 1) & 3]);
+      cur = _mm_add_epi32(
+          cur, _mm_alignr_epi8(msg[(g + 3) & 3], msg[(g + 2) & 3], 4));
+      msg[g & 3] = _mm_sha256msg2_epu32(cur, msg[(g + 3) & 3]);
+    }
+    __m128i m = _mm_add_epi32(
+        msg[g & 3], _mm_load_si128(reinterpret_cast<const __m128i*>(
+                        kRoundConstants + g * 4)));
+    state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+    m = _mm_shuffle_epi32(m, 0x0E);
+    state0 = _mm_sha256rnds2_epu32(state0, state1, m);
+  }
+  state0 = _mm_add_epi32(state0, abef);
+  state1 = _mm_add_epi32(state1, cdgh);
+
+  tmp = _mm_shuffle_epi32(state0, 0x1B);        // FEBA
+  state1 = _mm_shuffle_epi32(state1, 0xB1);     // DCHG
+  state0 = _mm_blend_epi16(tmp, state1, 0xF0);  // DCBA
+  state1 = _mm_alignr_epi8(state1, tmp, 8);     // HGFE
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state), state0);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), state1);
+}
+
+// The SHA extensions work on one stream, the nonces are hashed one after
+// another to fill the lanes.
+__attribute__((target("sha,sse4.1"))) void HashSHANI(
+    const uint32_t midstate[8], const uint64_t* nonces, uint32_t* out) {
+  for (int lane = 0; lane < 4; ++lane) {
+    uint32_t w[16];
+    uint32_t state[8];
+    EncodeNonce(nonces[lane], w);
+    memcpy(state, midstate, sizeof(state));
+    CompressSHANI(state, w);
+
+    memcpy(w, state, sizeof(state));
+    memset(w + 8, 0, sizeof(uint32_t) * 8);
+    w[8] = 0x80000000;
+    w[15] = 256;
+    memcpy(state, kInitState, sizeof(state));
+    CompressSHANI(state, w);
+    for (int i = 0; i < 8; ++i) {
+      out[i * 4 + lane] = state[i];
+    }
+  }
+}
+
+bool HasSHAExtension() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  return (ebx & bit_SHA) && __builtin_cpu_supports("sse4.1");
+}
+
+#endif
+
+// Check the leading zero bits of the state words of one lane.
+bool HasLeadingZeros(const uint32_t* state, int stride, uint32_t difficulty) {
+  for (int i = 0; i < 8; ++i) {
+    uint32_t word = state[i * stride];
+    if (difficulty <= 32) {
+      return difficulty == 0 || (word >> (32 - difficulty)) == 0;
+    }
+    if (word != 0) {
+      return false;
+    }
+    difficulty -= 32;
+  }
+  return difficulty == 0;
+}
+
+std::string ToDigest(const uint32_t* state, int stride) {
+  std::string digest(32, 0);
+  for (int i = 0; i < 8; ++i) {
+    uint32_t word = state[i * stride];
+    for (int j = 0; j < 4; ++j) {
+      digest[i * 4 + j] = static_cast<char>(word >> (24 - j * 8));
+    }
+  }
+  return digest;
+}
+
+}  // namespace
+
+MiningKernel::MiningKernel(const std::string& prefix, Impl impl) {
+  if (prefix.size() != 64) {
+    LOG(ERROR) << "invalid header prefix size:" << prefix.size();
+  }
+  uint8_t block[64] = {0};
+  memcpy(block, prefix.data(), std::min<size_t>(prefix.size(), 64));
+  uint32_t w[16];
+  for (int i = 0; i < 16; ++i) {
+    w[i] = LoadBigEndian(block + i * 4);
+  }
+  memcpy(midstate_, kInitState, sizeof(midstate_));
+  Compress<uint32_t>(midstate_, w);
+
+  if (impl == AUTO) {
+    impl = GetBestImpl();
+  } else if (!IsSupported(impl)) {
+    LOG(ERROR) << GetImplName(impl) << " is not supported, use scalar";
+    impl = SCALAR;
+  }
+  impl_ = impl;
+}
+
+bool MiningKernel::IsSupported(Impl impl) {
+  switch (impl) {
+    case AUTO:
+    case SCALAR:
+      return true;
+#if defined(__x86_64__)
+    case SHA_NI:
+      return HasSHAExtension();
+    case SSE2:
+      return __builtin_cpu_supports("sse2");
+    case AVX2:
+      return __builtin_cpu_supports("avx2");
+    case AVX512:
+      return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+      return false;
+  }
+}
+
+MiningKernel::Impl MiningKernel::GetBestImpl() {
+  static const Impl best = []() {
+    for (Impl impl : {AVX512, SHA_NI, AVX2, SSE2}) {
+      if (IsSupported(impl)) {
+        return impl;
+      }
+    }
+    return SCALAR;
+  }();
+  return best;
+}
+
+const char* MiningKernel::GetImplName(Impl impl) {
+  switch (impl) {
+    case AUTO:
+      return "auto";
+    case SCALAR:
+      return "scalar";
+    case SHA_NI:
+      return "sha-ni";
+    case SSE2:
+      return "sse2";
+    case AVX2:
+      return "avx2";
+    case AVX512:
+      return "avx512";
+  }
+  return "unknown";
+}
+
+MiningKernel::Impl MiningKernel::GetImpl() const { return impl_; }
+
+int MiningKernel::GetLanes() const {
+  switch (impl_) {
+    case SHA_NI:
+    case SSE2:
+      return 4;
+    case AVX2:
+      return 8;
+    case AVX512:
+      return 16;
+    default:
+      return 1;
+  }
+}
+
+void MiningKernel::HashLanes(const uint64_t* nonces, uint32_t* state) const {
+  switch (impl_) {
+#if defined(__x86_64__)
+    case SHA_NI:
+      HashSHANI(midstate_, nonces, state);
+      return;
+    case SSE2:
+      HashSSE2(midstate_, nonces, state);
+      return;
+    case AVX2:
+      HashAVX2(midstate_, nonces, state);
+      return;
+    case AVX512:
+      HashAVX512(midstate_, nonces, state);
+      return;
+#endif
+    default:
+      HashScalar(midstate_, nonces, state);
+  }
+}
+
+std::string MiningKernel::Hash(uint64_t nonce) const {
+  uint64_t nonces[kMaxLanes];
+  uint32_t state[8 * kMaxLanes];
+  for (int i = 0; i < kMaxLanes; ++i) {
+    nonces[i] = nonce;
+  }
+  HashLanes(nonces, state);
+  return ToDigest(state, GetLanes());
+}
+
+bool MiningKernel::Search(uint64_t start, uint64_t end, uint64_t step,
+                          uint32_t difficulty,
+                          const std::function<bool()>& should_stop,
+                          uint64_t* nonce, std::string* digest) const {
+  if (step == 0 || start > end) {
+    return false;
+  }
+  const int lanes = GetLanes();
+  uint64_t nonces[kMaxLanes];
+  alignas(64) uint32_t state[8 * kMaxLanes];
+  uint64_t next = start;
+  bool done = false;
+  while (!done) {
+    if (should_stop && should_stop()) {
+      return false;
+    }
+    int num = 0;
+    while (num < lanes && !done) {
+      nonces[num++] = next;
+      if (end - next < step) {
+        done = true;
+      } else {
+        next += step;
+      }
+    }
+    for (int i = num; i < lanes; ++i) {
+      nonces[i] = nonces[num - 1];
+    }
+    HashLanes(nonces, state);
+    for (int i = 0; i < num; ++i) {
+      if (HasLeadingZeros(state + i, lanes, difficulty)) {
+        *nonce = nonces[i];
+        *digest = ToDigest(state + i, lanes);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+}  // namespace resdb
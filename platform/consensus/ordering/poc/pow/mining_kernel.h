@@ -0,0 +1,80 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace resdb {
+
+// MiningKernel searches the nonces of a block header for a PoW solution.
+// The header hash is SHA256(SHA256(prefix + std::to_string(nonce))) where the
+// prefix holds the 64 bytes of the pre_hash and merkle_hash digests. The
+// prefix fills exactly one SHA-256 block, so its midstate is computed once
+// and each nonce only costs two compressions over a fixed buffer.
+// Several nonces are hashed per call using multi-buffer SIMD lanes
+// (SSE2: 4, AVX2: 8, AVX-512: 16) or the SHA extensions, selected at runtime
+// from the cpu features, with a scalar fallback.
+class MiningKernel {
+ public:
+  enum Impl {
+    AUTO = 0,
+    SCALAR = 1,
+    SHA_NI = 2,
+    SSE2 = 3,
+    AVX2 = 4,
+    AVX512 = 5,
+  };
+
+  // prefix must be 64 bytes: the pre_hash digest followed by the merkle
+  // digest.
+  MiningKernel(const std::string& prefix, Impl impl = AUTO);
+
+  // Returns true if the cpu is able to run impl.
+  static bool IsSupported(Impl impl);
+  static Impl GetBestImpl();
+  static const char* GetImplName(Impl impl);
+
+  Impl GetImpl() const;
+  // The number of nonces hashed in one pass.
+  int GetLanes() const;
+
+  // Returns the 32 bytes digest of the header with nonce.
+  std::string Hash(uint64_t nonce) const;
+
+  // Search the nonces start, start + step, ... up to end (inclusive) for a
+  // digest with at least difficulty leading zero bits. should_stop is polled
+  // once per pass. Returns true with the nonce and its digest if found.
+  bool Search(uint64_t start, uint64_t end, uint64_t step, uint32_t difficulty,
+              const std::function<bool()>& should_stop, uint64_t* nonce,
+              std::string* digest) const;
+
+ private:
+  // Hash GetLanes() nonces and write the final state words of each lane to
+  // state[word * lanes + lane].
+  void HashLanes(const uint64_t* nonces, uint32_t* state) const;
+
+ private:
+  uint32_t midstate_[8];
+  Impl impl_;
+};
+
+}  // namespace resdb
@@ -0,0 +1,102 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "platform/consensus/ordering/poc/pow/mining_kernel.h"
+
+#include <gtest/gtest.h>
+
+#include "platform/consensus/ordering/poc/pow/miner_utils.h"
+
+namespace resdb {
+namespace {
+
+std::string GetPrefix() {
+  std::string prefix;
+  for (int i = 0; i < 64; ++i) {
+    prefix.push_back(static_cast<char>(i * 37 + 11));
+  }
+  return prefix;
+}
+
+std::vector<MiningKernel::Impl> GetSupportedImpls() {
+  std::vector<MiningKernel::Impl> impls;
+  for (MiningKernel::Impl impl :
+       {MiningKernel::SCALAR, MiningKernel::SHA_NI, MiningKernel::SSE2,
+        MiningKernel::AVX2, MiningKernel::AVX512}) {
+    if (MiningKernel::IsSupported(impl)) {
+      impls.push_back(impl);
+    }
+  }
+  return impls;
+}
+
+TEST(MiningKernelTest, HashMatchesHeaderHash) {
+  std::string prefix = GetPrefix();
+  std::vector<uint64_t> nonces = {0,          1,        9,
+                                  10,         12345678, 1ull << 40,
+                                  1ull << 63, ~0ull};
+  for (MiningKernel::Impl impl : GetSupportedImpls()) {
+    MiningKernel kernel(prefix, impl);
+    EXPECT_EQ(kernel.GetImpl(), impl);
+    for (uint64_t nonce : nonces) {
+      EXPECT_EQ(kernel.Hash(nonce),
+                GetHashValue(prefix + std::to_string(nonce)))
+          << MiningKernel::GetImplName(impl) << " nonce:" << nonce;
+    }
+  }
+}
+
+TEST(MiningKernelTest, SearchFindsFirstSolution) {
+  std::string prefix = GetPrefix();
+  uint32_t difficulty = 8;
+
+  uint64_t expected_nonce = 0;
+  for (uint64_t nonce = 3;; nonce += 5) {
+    if (IsValidDigest(GetHashValue(prefix + std::to_string(nonce)),
+                      difficulty)) {
+      expected_nonce = nonce;
+      break;
+    }
+  }
+
+  for (MiningKernel::Impl impl : GetSupportedImpls()) {
+    MiningKernel kernel(prefix, impl);
+    uint64_t nonce = 0;
+    std::string digest;
+    EXPECT_TRUE(kernel.Search(3, 1 << 20, 5, difficulty, nullptr, &nonce,
+                              &digest));
+    EXPECT_EQ(nonce, expected_nonce) << MiningKernel::GetImplName(impl);
+    EXPECT_EQ(digest, GetHashValue(prefix + std::to_string(nonce)));
+
+    // The solution is out of the range.
+    EXPECT_FALSE(kernel.Search(3, expected_nonce - 1, 5, difficulty, nullptr,
+                               &nonce, &digest));
+  }
+}
+
+TEST(MiningKernelTest, SearchStop) {
+  MiningKernel kernel(GetPrefix());
+  uint64_t nonce = 0;
+  std::string digest;
+  EXPECT_FALSE(kernel.Search(
+      0, ~0ull, 1, 256, []() { return true; }, &nonce, &digest));
+}
+
+}  // namespace
+}  // namespace resdb
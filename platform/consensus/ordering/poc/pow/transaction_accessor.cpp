@@ -61,54 +61,26 @@ void TransactionAccessor::TransactionFetching() {
   std::unique_ptr<ResDBTxnAccessor> client = GetResDBTxnAccessor();
   assert(client != nullptr);
 
-  uint64_t last_time = 0;
-  uint64_t current_time = GetCurrentTime();
-  sleep(10);
-  int cur_seq_pbft = 1;
-  srand(12345);
-
-  while (!stop_) {
-    uint64_t cur_seq = max_received_seq_ + 1;
-    if (cur_seq > 10000000) break;
-    auto ret = client->GetTxn(cur_seq, cur_seq + 1000);
-    if (!ret.ok() || (*ret).size() == 0 || (*ret)[0].first != cur_seq) {
-      // LOG(ERROR) << "get txn fail:" << cur_seq;
-      sleep(1);
-      continue;
-    }
-
-    double need_time = 2.0 / 1000;
-    uint64_t current_time1 = GetCurrentTime();
-    for (auto& res : (*ret)) {
-      uint64_t current_time = GetCurrentTime();
-
-      if (last_time > 0) {
-        double sleep_time =
-            std::max((uint64_t)0, current_time - last_time) / 1000000.0;
-        //	LOG(ERROR)<<"sleep:"<<sleep_time<<" "<<(need_time-sleep_time)<<"
-        //"<<(int)((need_time - sleep_time)*1000000);
-        if (need_time - sleep_time > 0) {
-          usleep((int)((need_time - sleep_time) * 1000000));
-        }
-      }
-
-      // LOG(ERROR)<<"current time:"<<current_time;
-      last_time = current_time;
-      std::unique_ptr<ClientTransactions> client_txn =
-          std::make_unique<ClientTransactions>();
-      client_txn->set_transaction_data(res.second);
-      client_txn->set_seq(cur_seq);
-      client_txn->set_create_time(GetCurrentTime());
-      // prometheus_handler_->Inc(TRANSACTION_INPUT, 1);
-      queue_.Push(std::move(client_txn));
-      cur_seq++;
-    }
-    max_received_seq_ = cur_seq;
-
-    std::lock_guard<std::mutex> lk(mutex_);
-    cv_.notify_all();
+  // The committed transactions are pushed from the BFT cluster, so there is
+  // no need to poll or pace the requests.
+  absl::Status status = client->Subscribe(
+      max_received_seq_ + 1,
+      [&](uint64_t seq, const std::string& data) {
+        std::unique_ptr<ClientTransactions> client_txn =
+            std::make_unique<ClientTransactions>();
+        client_txn->set_transaction_data(data);
+        client_txn->set_seq(seq);
+        client_txn->set_create_time(GetCurrentTime());
+        queue_.Push(std::move(client_txn));
+
+        std::lock_guard<std::mutex> lk(mutex_);
+        max_received_seq_ = seq;
+        cv_.notify_all();
+      },
+      [&]() { return stop_.load(); });
+  if (!status.ok()) {
+    LOG(ERROR) << "subscribe transactions fail:" << status;
   }
-  return;
 }
 
 std::unique_ptr<ResDBTxnAccessor> TransactionAccessor::GetResDBTxnAccessor() {
@@ -69,14 +69,11 @@ TEST(TransactionAccessorTest, GetTransactionsFail) {
 
   ResDBPoCConfig config = GetConfig();
   config.SetBatchTransactionNum(1);
-  QueryRequest request;
-  request.set_min_seq(1);
-  request.set_max_seq(1);
   MockTransactionAccessor accessor(config);
   EXPECT_CALL(accessor, GetResDBTxnAccessor).WillRepeatedly(Invoke([&]() {
     auto client =
         std::make_unique<MockResDBTxnAccessor>(*config.GetBFTConfig());
-    EXPECT_CALL(*client, GetTxn(1, 1)).WillOnce(Invoke([&]() {
+    EXPECT_CALL(*client, Subscribe(1, _, _)).WillOnce(Invoke([&]() {
       cli_done.set_value(true);
       return absl::InternalError("recv data fail.");
     }));
@@ -104,24 +101,22 @@ TEST(TransactionAccessorTest, GetTransactions) {
   expected_batch_txn.set_min_seq(1);
   expected_batch_txn.set_max_seq(1);
 
-  QueryRequest request;
-  request.set_min_seq(1);
-  request.set_max_seq(1);
   MockTransactionAccessor accessor(config);
   EXPECT_CALL(accessor, GetResDBTxnAccessor).WillRepeatedly(Invoke([&]() {
     auto client =
         std::make_unique<MockResDBTxnAccessor>(*config.GetBFTConfig());
-    ON_CALL(*client, GetTxn(1, 1)).WillByDefault(Invoke([&]() {
-      std::vector<std::pair<uint64_t, std::string>> resp;
-      resp.push_back(std::make_pair(expected_resp.seq(),
-                                    expected_resp.transaction_data()));
-      cli_done.set_value(true);
-      return resp;
-    }));
-    ON_CALL(*client, GetTxn(2, 2)).WillByDefault(Invoke([&]() {
-      return absl::InternalError("recv data fail.");
-    }));
-
+    EXPECT_CALL(*client, Subscribe(1, _, _))
+        .WillOnce(Invoke(
+            [&](uint64_t seq,
+                std::function<void(uint64_t, const std::string&)> call_back,
+                std::function<bool()> is_stop) {
+              call_back(expected_resp.seq(), expected_resp.transaction_data());
+              cli_done.set_value(true);
+              while (!is_stop()) {
+                usleep(1000);
+              }
+              return absl::OkStatus();
+            }));
     return client;
   }));
   accessor.Start();
@@ -133,6 +128,7 @@ TEST(TransactionAccessorTest, GetTransactions) {
     if (resp == nullptr) {
       continue;
     }
+    resp->mutable_transactions(0)->clear_create_time();
     EXPECT_THAT(resp, Pointee(EqualsProto(expected_batch_txn)));
     break;
   }
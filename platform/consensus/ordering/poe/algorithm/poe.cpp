@@ -21,71 +21,985 @@
 
 #include <glog/logging.h>
 
+#include <algorithm>
+
 #include "common/crypto/signature_verifier.h"
+#include "common/utils/trace.h"
 #include "common/utils/utils.h"
 
 namespace resdb {
 namespace poe {
 
-PoE::PoE(int id, int f, int total_num, SignatureVerifier* verifier)
+PoE::PoE(int id, int f, int total_num, SignatureVerifier* verifier,
+         uint32_t window_size, int view_change_timeout_ms)
     : ProtocolBase(id, f, total_num), verifier_(verifier) {
   LOG(ERROR) << "get proposal graph";
   id_ = id;
   total_num_ = total_num;
   f_ = f;
   is_stop_ = false;
-  seq_ = 0;
+  replaying_ = false;
+  // The executor starts from seq 1.
+  seq_ = 1;
+  low_watermark_ = 1;
+
+  uint32_t slot_num = 1;
+  while (slot_num < window_size) {
+    slot_num <<= 1;
+  }
+  peer_watermark_ = std::vector<std::atomic<int64_t>>(total_num + 1);
+  for (auto& watermark : peer_watermark_) {
+    watermark = 1;
+  }
+  wait_window_ = false;
+  window_size_ = slot_num;
+  slots_ = std::vector<Slot>(2 * slot_num);
+  window_mask_ = 2 * slot_num - 1;
+
+  // A replica may run ahead of the stable checkpoint by about two windows.
+  log_ = std::vector<std::unique_ptr<PreparedTransaction>>(4 * slot_num);
+  log_mask_ = 4 * slot_num - 1;
+  checkpoint_interval_ = std::max<int64_t>(window_size_ / 4, 1);
+  checkpoint_start_ = 1;
+  stable_seq_ = 0;
+
+  view_ = 0;
+  in_view_change_ = false;
+  view_change_view_ = 0;
+  view_change_time_ = 0;
+  last_query_time_ = 0;
+  last_query_low_watermark_ = 0;
+  max_seen_seq_ = 0;
+  last_low_watermark_ = low_watermark_;
+  last_view_ = 0;
+  last_progress_time_ = GetCurrentTime();
+  view_change_timeout_ = static_cast<uint64_t>(view_change_timeout_ms) * 1000;
+  global_stats_ = Stats::GetGlobalStats();
+  monitor_thread_ = std::thread(&PoE::MonitorProgress, this);
 }
 
-PoE::~PoE() { is_stop_ = true; }
+PoE::~PoE() {
+  is_stop_ = true;
+  {
+    std::lock_guard<std::mutex> lk(monitor_mutex_);
+    monitor_cv_.notify_all();
+  }
+  if (monitor_thread_.joinable()) {
+    monitor_thread_.join();
+  }
+}
 
 bool PoE::IsStop() { return is_stop_; }
 
+template <typename Message>
+bool PoE::Sign(Message* msg) {
+  if (verifier_ == nullptr) {
+    return true;
+  }
+  msg->clear_signature();
+  auto signature_or = verifier_->SignMessage(msg->SerializeAsString());
+  if (!signature_or.ok()) {
+    LOG(ERROR) << "sign message fail";
+    return false;
+  }
+  *msg->mutable_signature() = *signature_or;
+  return true;
+}
+
+template <typename Message>
+bool PoE::Verify(const Message& msg, int32_t signer) {
+  if (signer <= 0 || signer > total_num_) {
+    return false;
+  }
+  if (verifier_ == nullptr) {
+    return true;
+  }
+  if (msg.signature().node_id() != signer) {
+    return false;
+  }
+  Message data(msg);
+  data.clear_signature();
+  return verifier_->VerifyMessage(data.SerializeAsString(), msg.signature());
+}
+
+int PoE::SendMessage(int msg_type, const google::protobuf::Message& msg,
+                     int node_id) {
+  if (replaying_) {
+    return 0;
+  }
+  return ProtocolBase::SendMessage(msg_type, msg, node_id);
+}
+
+int PoE::Broadcast(int msg_type, const google::protobuf::Message& msg) {
+  if (replaying_) {
+    return 0;
+  }
+  return ProtocolBase::Broadcast(msg_type, msg);
+}
+
+int64_t PoE::GetLowWatermark() const { return low_watermark_; }
+
+int64_t PoE::GetHighWatermark() const {
+  return low_watermark_ + window_mask_ + 1;
+}
+
+uint64_t PoE::GetStableCheckpoint() { return stable_seq_; }
+
+int64_t PoE::GetView() const { return view_; }
+
+int PoE::GetPrimary() const { return view_ % total_num_ + 1; }
+
+bool PoE::InViewChange() const { return in_view_change_; }
+
+int PoE::GetActiveSlotNum() {
+  int num = 0;
+  for (Slot& slot : slots_) {
+    std::lock_guard<std::mutex> lk(slot.mutex);
+    if (slot.txn != nullptr || !slot.received.empty() || slot.committed) {
+      num++;
+    }
+  }
+  return num;
+}
+
+void PoE::SetNextCommitSeq(int64_t seq) {
+  std::lock_guard<std::mutex> gc_lk(gc_mutex_);
+  std::lock_guard<std::mutex> lk(seq_mutex_);
+  low_watermark_ = seq;
+  seq_ = std::max(seq_, seq);
+  // The transactions before seq are not known, so the first checkpoint
+  // interval has no digest.
+  checkpoint_start_ = seq;
+  checkpoint_digest_.clear();
+  if (stable_seq_ < seq - 1) {
+    stable_seq_ = seq - 1;
+  }
+}
+
+void PoE::SetReplaying(bool replaying) { replaying_ = replaying; }
+
 bool PoE::ReceiveTransaction(std::unique_ptr<Transaction> txn) {
   // LOG(ERROR)<<"recv txn:";
-  txn->set_create_time(GetCurrentTime());
-  txn->set_seq(seq_++);
-  txn->set_proposer(id_);
+  {
+    std::unique_lock<std::mutex> lk(seq_mutex_);
+    if (IsStop()) {
+      return false;
+    }
+    if (in_view_change_ || GetPrimary() != id_) {
+      // Hold it until the new primary is known.
+      bool send = !in_view_change_;
+      lk.unlock();
+      Relay(std::move(txn), send);
+      return true;
+    }
+    // The network workers do not wait for the window, the transaction is
+    // proposed once the old seqs are committed.
+    pending_txns_.push_back(std::move(txn));
+    wait_window_ = true;
+  }
+  ProposePending();
+  return true;
+}
+
+void PoE::ProposePending() {
+  std::vector<std::unique_ptr<Transaction>> proposals;
+  std::vector<std::unique_ptr<Transaction>> relays;
+  {
+    std::lock_guard<std::mutex> lk(seq_mutex_);
+    if (in_view_change_) {
+      return;
+    }
+    if (GetPrimary() != id_) {
+      // The view has changed, hand them to the new primary.
+      for (auto& txn : pending_txns_) {
+        relays.push_back(std::move(txn));
+      }
+      pending_txns_.clear();
+    }
+    // Do not propose beyond the window until the old seqs are committed.
+    while (!pending_txns_.empty() && seq_ < GetProposeBound()) {
+      std::unique_ptr<Transaction> txn = std::move(pending_txns_.front());
+      pending_txns_.pop_front();
+      txn->set_seq(seq_++);
+      txn->set_view(view_);
+      proposals.push_back(std::move(txn));
+    }
+    wait_window_ = !pending_txns_.empty();
+  }
+  for (auto& txn : relays) {
+    Relay(std::move(txn), true);
+  }
+  for (auto& txn : proposals) {
+    txn->set_create_time(GetCurrentTime());
+    txn->set_proposer(id_);
+    Broadcast(MessageType::Propose, *txn);
+  }
+}
+
+void PoE::Relay(std::unique_ptr<Transaction> txn, bool send) {
+  Transaction msg(*txn);
+  {
+    std::lock_guard<std::mutex> lk(relay_mutex_);
+    auto& relayed = relayed_[txn->hash()];
+    if (relayed.second == nullptr) {
+      relayed.first = GetCurrentTime();
+    }
+    relayed.second = std::move(txn);
+  }
+  if (send) {
+    SendMessage(MessageType::Relay, msg, GetPrimary());
+  }
+}
+
+void PoE::RemoveRelayed(const std::string& hash) {
+  std::lock_guard<std::mutex> lk(relay_mutex_);
+  if (!relayed_.empty()) {
+    relayed_.erase(hash);
+  }
+}
+
+int64_t PoE::GetProposeBound() {
+  std::vector<int64_t> watermarks;
+  for (int i = 1; i < static_cast<int>(peer_watermark_.size()); ++i) {
+    watermarks.push_back(i == id_ ? low_watermark_.load()
+                                  : peer_watermark_[i].load());
+  }
+  if (watermarks.size() < static_cast<size_t>(2 * f_ + 1)) {
+    return low_watermark_ + window_size_;
+  }
+  std::nth_element(watermarks.begin(), watermarks.begin() + 2 * f_,
+                   watermarks.end(), std::greater<int64_t>());
+  return std::min<int64_t>(low_watermark_ + window_size_,
+                           watermarks[2 * f_] + 2 * window_size_);
+}
 
-  Broadcast(MessageType::Propose, *txn);
+void PoE::UpdatePeerWatermark(int32_t proposer, int64_t low_watermark) {
+  if (proposer <= 0 || proposer >= static_cast<int>(peer_watermark_.size())) {
+    return;
+  }
+  int64_t old_watermark = peer_watermark_[proposer];
+  while (old_watermark < low_watermark &&
+         !peer_watermark_[proposer].compare_exchange_weak(old_watermark,
+                                                          low_watermark)) {
+  }
+  if (old_watermark < low_watermark && wait_window_) {
+    ProposePending();
+  }
+}
+
+PoE::Slot* PoE::GetSlot(int64_t seq, std::unique_lock<std::mutex>* lk) {
+  if (seq < low_watermark_ || seq >= GetHighWatermark()) {
+    return nullptr;
+  }
+  Slot* slot = &slots_[seq & window_mask_];
+  *lk = std::unique_lock<std::mutex>(slot->mutex);
+  // The low watermark passes a seq under the lock of its slot after the slot
+  // is reclaimed.
+  if (seq < low_watermark_) {
+    lk->unlock();
+    return nullptr;
+  }
+  slot->seq = seq;
+  int64_t max_seen_seq = max_seen_seq_;
+  while (max_seen_seq < seq &&
+         !max_seen_seq_.compare_exchange_weak(max_seen_seq, seq)) {
+  }
+  return slot;
+}
+
+bool PoE::TryCommit(Slot* slot) {
+  if (slot->committed || slot->txn == nullptr) {
+    return false;
+  }
+  // Only the prepares of the view of the proposal count.
+  auto it = slot->received.find({slot->txn->view(), slot->txn->hash()});
+  if (it == slot->received.end() ||
+      it->second.size() < static_cast<size_t>(2 * f_ + 1)) {
+    return false;
+  }
+  CommitSlot(slot);
   return true;
 }
 
-bool PoE::ReceivePropose(std::unique_ptr<Transaction> txn) {
-  std::string hash = txn->hash();
-  int64_t seq = txn->seq();
-  int proposer = txn->proposer();
+void PoE::CommitSlot(Slot* slot) {
+  // The transaction stays in the slot until it is reclaimed, a view change
+  // may need it.
+  slot->committed = true;
+  RESDB_TRACE(kPoECommit, slot->seq, slot->txn->view());
+  commit_(*slot->txn);
+  RemoveRelayed(slot->txn->hash());
+}
+
+void PoE::AdvanceLowWatermark() {
+  bool advanced = false;
+  std::vector<Watermark> checkpoints;
   {
-    std::unique_lock<std::mutex> lk(mutex_);
-    data_[txn->hash()] = std::move(txn);
+    std::lock_guard<std::mutex> gc_lk(gc_mutex_);
+    while (true) {
+      Slot& slot = slots_[low_watermark_ & window_mask_];
+      std::lock_guard<std::mutex> lk(slot.mutex);
+      if (slot.seq != low_watermark_ || !slot.committed) {
+        break;
+      }
+      int64_t seq = low_watermark_;
+      checkpoint_digest_ += slot.txn->hash();
+      // The prepares prove the transaction in a view change.
+      auto prepared = std::make_unique<PreparedTransaction>();
+      auto it = slot.received.find({slot.txn->view(), slot.txn->hash()});
+      if (it != slot.received.end()) {
+        for (auto& prepare : it->second) {
+          *prepared->add_prepares() = std::move(prepare.second);
+        }
+      }
+      prepared->set_allocated_txn(slot.txn.release());
+      log_[seq & log_mask_] = std::move(prepared);
+      slot.received.clear();
+      slot.committed = false;
+      low_watermark_++;
+      advanced = true;
+
+      if (seq % checkpoint_interval_ == 0) {
+        Watermark watermark;
+        watermark.set_proposer(id_);
+        watermark.set_low_watermark(seq + 1);
+        watermark.set_view(view_);
+        if (checkpoint_start_ + checkpoint_interval_ == seq + 1) {
+          watermark.set_digest(
+              SignatureVerifier::CalculateHash(checkpoint_digest_));
+        }
+        checkpoints.push_back(watermark);
+        checkpoint_digest_.clear();
+        checkpoint_start_ = seq + 1;
+      }
+    }
+  }
+  if (advanced && wait_window_) {
+    ProposePending();
   }
+  for (const Watermark& watermark : checkpoints) {
+    Broadcast(MessageType::LowWatermark, watermark);
+  }
+}
 
+void PoE::SendPrepare(const std::string& hash, int64_t seq, int64_t view) {
   Proposal proposal;
   proposal.set_hash(hash);
   proposal.set_seq(seq);
+  proposal.set_view(view);
   proposal.set_proposer(id_);
+  if (!Sign(&proposal)) {
+    return;
+  }
   Broadcast(MessageType::Prepare, proposal);
+}
+
+bool PoE::ReceivePropose(std::unique_ptr<Transaction> txn) {
+  // The proposals of an old view are dropped, the new primary proposes them
+  // again. The proposals of a later view may arrive before its new view.
+  if (txn->view() < view_ || (txn->view() == view_ && in_view_change_)) {
+    return false;
+  }
+  // Only the primary of the view proposes.
+  if (txn->proposer() != txn->view() % total_num_ + 1) {
+    LOG(ERROR) << "proposal from " << txn->proposer()
+               << " is not from the primary of view " << txn->view();
+    return false;
+  }
+  std::string hash = txn->hash();
+  int64_t seq = txn->seq();
+  int64_t view = txn->view();
+  bool committed = false;
+  {
+    std::unique_lock<std::mutex> lk;
+    Slot* slot = GetSlot(seq, &lk);
+    if (slot == nullptr) {
+      RESDB_TRACE(kPoEOutOfWindow, seq, low_watermark_.load(),
+                  GetHighWatermark());
+      return false;
+    }
+    if (slot->committed || slot->txn != nullptr) {
+      return false;
+    }
+    slot->txn = std::move(txn);
+    // The prepares may arrive before the proposal.
+    committed = TryCommit(slot);
+  }
+  if (committed) {
+    AdvanceLowWatermark();
+  }
+  SendPrepare(hash, seq, view);
   return true;
 }
 
 bool PoE::ReceivePrepare(std::unique_ptr<Proposal> proposal) {
-  std::unique_ptr<Transaction> txn = nullptr;
+  // The prepares are kept to be shown in a view change.
+  if (!Verify(*proposal, proposal->proposer())) {
+    LOG(ERROR) << "invalid prepare from " << proposal->proposer();
+    return false;
+  }
+  bool committed = false;
   {
-    std::unique_lock<std::mutex> lk(mutex_);
-    received_[proposal->hash()].insert(proposal->proposer());
-    auto it = data_.find(proposal->hash());
-    if (it != data_.end()) {
-      if (received_[proposal->hash()].size() >= 2 * f_ + 1) {
-        txn = std::move(it->second);
-        data_.erase(it);
+    std::unique_lock<std::mutex> lk;
+    Slot* slot = GetSlot(proposal->seq(), &lk);
+    if (slot == nullptr) {
+      return false;
+    }
+    if (slot->committed) {
+      return true;
+    }
+    auto& received = slot->received[{proposal->view(), proposal->hash()}];
+    int32_t sender = proposal->proposer();
+    received.emplace(sender, std::move(*proposal));
+    committed = TryCommit(slot);
+  }
+  if (committed) {
+    AdvanceLowWatermark();
+  }
+  return true;
+}
+
+bool PoE::ReceiveWatermark(std::unique_ptr<Watermark> watermark) {
+  UpdatePeerWatermark(watermark->proposer(), watermark->low_watermark());
+  if (!watermark->digest().empty()) {
+    AddCheckpointVote(watermark->proposer(), watermark->low_watermark() - 1,
+                      watermark->digest(), watermark->view());
+  }
+  return true;
+}
+
+void PoE::AddCheckpointVote(int32_t proposer, int64_t seq,
+                            const std::string& digest, int64_t view) {
+  int64_t stable_view = 0;
+  {
+    std::lock_guard<std::mutex> lk(checkpoint_mutex_);
+    // The replica can only catch up with the seqs the others still keep in
+    // their logs, the votes beyond them are dropped.
+    if (seq <= stable_seq_ || seq > low_watermark_ + log_mask_ ||
+        seq % checkpoint_interval_ != 0 || proposer <= 0 ||
+        proposer > total_num_) {
+      return;
+    }
+    auto& seq_votes = checkpoint_votes_[seq];
+    // Each replica votes once for a seq.
+    for (const auto& digest_votes : seq_votes) {
+      if (digest_votes.second.count(proposer)) {
+        return;
       }
     }
+    auto& votes = seq_votes[digest];
+    votes[proposer] = view;
+    if (votes.size() < static_cast<size_t>(2 * f_ + 1)) {
+      return;
+    }
+    // At least one correct replica among the voters is in stable_view or a
+    // later view.
+    std::vector<int64_t> views;
+    for (const auto& vote : votes) {
+      views.push_back(vote.second);
+    }
+    std::nth_element(views.begin(), views.begin() + f_, views.end(),
+                     std::greater<int64_t>());
+    stable_view = views[f_];
+    stable_seq_ = seq;
+    checkpoint_votes_.erase(checkpoint_votes_.begin(),
+                            checkpoint_votes_.upper_bound(seq));
+  }
+
+  // The others are making progress without this replica, it may have
+  // missed the new view or be changing the view alone.
+  if (stable_view > view_ || (in_view_change_ && seq >= low_watermark_)) {
+    InstallView(std::max<int64_t>(stable_view, view_), 0);
   }
-  if (txn != nullptr) {
-    commit_(*txn);
+  QueryCommittedTxns();
+}
+
+void PoE::QueryCommittedTxns() {
+  int64_t low_watermark = low_watermark_;
+  int64_t stable_seq = stable_seq_;
+  if (stable_seq < low_watermark) {
+    return;
+  }
+  {
+    // Query again once the last query is answered or timed out.
+    std::lock_guard<std::mutex> lk(query_mutex_);
+    uint64_t current_time = GetCurrentTime();
+    if (low_watermark <= last_query_low_watermark_ &&
+        last_query_time_ + view_change_timeout_ / 2 > current_time) {
+      return;
+    }
+    last_query_time_ = current_time;
+    last_query_low_watermark_ = low_watermark;
   }
+  LOG(ERROR) << "query committed txns [" << low_watermark << ","
+             << stable_seq << "]";
+  TxnQuery query;
+  query.set_proposer(id_);
+  query.set_min_seq(low_watermark);
+  query.set_max_seq(stable_seq);
+  Broadcast(MessageType::Query, query);
+}
+
+bool PoE::ReceiveQuery(std::unique_ptr<TxnQuery> query) {
+  TxnQueryResponse response;
+  response.set_proposer(id_);
+  {
+    std::lock_guard<std::mutex> gc_lk(gc_mutex_);
+    int64_t min_seq = std::max<int64_t>(query->min_seq(),
+                                        low_watermark_ - log_mask_ - 1);
+    int64_t max_seq = std::min<int64_t>(query->max_seq(), low_watermark_ - 1);
+    for (int64_t seq = min_seq; seq <= max_seq; ++seq) {
+      const auto& prepared = log_[seq & log_mask_];
+      if (prepared != nullptr && prepared->txn().seq() == seq) {
+        *response.add_txns() = prepared->txn();
+      }
+    }
+  }
+  if (response.txns_size() == 0) {
+    return false;
+  }
+  SendMessage(MessageType::QueryResponse, response, query->proposer());
   return true;
 }
 
+bool PoE::ReceiveQueryResponse(std::unique_ptr<TxnQueryResponse> response) {
+  {
+    std::lock_guard<std::mutex> lk(query_mutex_);
+    for (const Transaction& txn : response->txns()) {
+      // Only the seqs covered by the stable checkpoint are committed.
+      if (txn.seq() < low_watermark_ ||
+          txn.seq() > static_cast<int64_t>(stable_seq_)) {
+        continue;
+      }
+      QueryResult& result = query_results_[txn.seq()][txn.hash()];
+      result.senders.insert(response->proposer());
+      if (result.txn == nullptr) {
+        result.txn = std::make_unique<Transaction>(txn);
+      }
+    }
+  }
+  CommitQueryResults();
+  return true;
+}
+
+void PoE::CommitQueryResults() {
+  while (!IsStop()) {
+    std::unique_ptr<Transaction> txn;
+    {
+      std::lock_guard<std::mutex> lk(query_mutex_);
+      query_results_.erase(query_results_.begin(),
+                           query_results_.lower_bound(low_watermark_));
+      auto it = query_results_.find(low_watermark_);
+      if (it == query_results_.end()) {
+        return;
+      }
+      // f+1 replicas return the same transaction.
+      for (auto& result : it->second) {
+        if (result.second.senders.size() >= static_cast<size_t>(f_ + 1)) {
+          txn = std::move(result.second.txn);
+          break;
+        }
+      }
+      if (txn == nullptr) {
+        return;
+      }
+      query_results_.erase(it);
+    }
+
+    int64_t seq = txn->seq();
+    {
+      std::unique_lock<std::mutex> lk;
+      Slot* slot = GetSlot(seq, &lk);
+      if (slot == nullptr) {
+        return;
+      }
+      if (!slot->committed) {
+        slot->txn = std::move(txn);
+        CommitSlot(slot);
+      }
+    }
+    AdvanceLowWatermark();
+    if (low_watermark_ <= seq) {
+      return;
+    }
+  }
+}
+
+void PoE::MonitorProgress() {
+  uint64_t interval_ms = std::max<uint64_t>(view_change_timeout_ / 4000, 1);
+  while (!IsStop()) {
+    {
+      std::unique_lock<std::mutex> lk(monitor_mutex_);
+      monitor_cv_.wait_for(lk, std::chrono::milliseconds(interval_ms),
+                           [&] { return IsStop(); });
+    }
+    if (IsStop()) {
+      break;
+    }
+    CheckProgress();
+  }
+}
+
+void PoE::CheckProgress() {
+  uint64_t current_time = GetCurrentTime();
+  if (replaying_) {
+    // The replay is not a lack of progress.
+    last_progress_time_ = current_time;
+    return;
+  }
+  int64_t low_watermark = low_watermark_;
+  if (low_watermark != last_low_watermark_ || view_ != last_view_ ||
+      max_seen_seq_ < low_watermark) {
+    last_low_watermark_ = low_watermark;
+    last_view_ = view_;
+    last_progress_time_ = current_time;
+  }
+
+  // A replica behind the stable checkpoint catches up instead of asking
+  // for a new view.
+  if (static_cast<int64_t>(stable_seq_) >= low_watermark) {
+    QueryCommittedTxns();
+    return;
+  }
+
+  bool timeout = false;
+  int64_t next_view = 0;
+  {
+    std::lock_guard<std::mutex> lk(seq_mutex_);
+    if (in_view_change_) {
+      // The new primary does not send the new view, try the next one.
+      timeout = view_change_time_ + view_change_timeout_ < current_time;
+      next_view = view_change_view_ + 1;
+    } else {
+      timeout = last_progress_time_ + view_change_timeout_ < current_time;
+      next_view = view_ + 1;
+    }
+  }
+  if (!timeout && !in_view_change_) {
+    std::lock_guard<std::mutex> lk(relay_mutex_);
+    for (const auto& relayed : relayed_) {
+      if (relayed.second.first + view_change_timeout_ < current_time) {
+        timeout = true;
+        break;
+      }
+    }
+  }
+  if (timeout) {
+    StartViewChange(next_view);
+  }
+}
+
+void PoE::StartViewChange(int64_t view) {
+  {
+    std::lock_guard<std::mutex> lk(seq_mutex_);
+    if (view <= view_ || (in_view_change_ && view <= view_change_view_)) {
+      return;
+    }
+    in_view_change_ = true;
+    view_change_view_ = view;
+    view_change_time_ = GetCurrentTime();
+  }
+  LOG(ERROR) << "start view change, view:" << view
+             << " primary:" << view % total_num_ + 1;
+
+  ViewChangeMessage view_change;
+  view_change.set_proposer(id_);
+  view_change.set_view(view);
+  int64_t stable_seq = stable_seq_;
+  view_change.set_stable_seq(stable_seq);
+  {
+    std::lock_guard<std::mutex> gc_lk(gc_mutex_);
+    // The committed seqs after the stable checkpoint.
+    for (int64_t seq = std::max<int64_t>(stable_seq + 1,
+                                         low_watermark_ - log_mask_ - 1);
+         seq < low_watermark_; ++seq) {
+      const auto& prepared = log_[seq & log_mask_];
+      if (prepared != nullptr && prepared->txn().seq() == seq) {
+        *view_change.add_txns() = *prepared;
+      }
+    }
+    for (int64_t seq = low_watermark_; seq < GetHighWatermark(); ++seq) {
+      Slot& slot = slots_[seq & window_mask_];
+      std::lock_guard<std::mutex> lk(slot.mutex);
+      if (slot.seq != seq || slot.txn == nullptr) {
+        continue;
+      }
+      PreparedTransaction* prepared = view_change.add_txns();
+      *prepared->mutable_txn() = *slot.txn;
+      auto it = slot.received.find({slot.txn->view(), slot.txn->hash()});
+      if (it != slot.received.end()) {
+        for (const auto& prepare : it->second) {
+          *prepared->add_prepares() = prepare.second;
+        }
+      }
+    }
+  }
+  if (!Sign(&view_change)) {
+    return;
+  }
+  Broadcast(MessageType::ViewChange, view_change);
+}
+
+bool PoE::ReceiveViewChange(std::unique_ptr<ViewChangeMessage> view_change) {
+  int64_t view = view_change->view();
+  if (view <= view_) {
+    return false;
+  }
+  // The new primary shows the view changes in the new view.
+  if (!Verify(*view_change, view_change->proposer())) {
+    LOG(ERROR) << "invalid view change from " << view_change->proposer();
+    return false;
+  }
+  size_t num = 0;
+  int64_t join_view = 0;
+  {
+    std::lock_guard<std::mutex> lk(view_change_mutex_);
+    view_changes_[view][view_change->proposer()] = std::move(view_change);
+    num = view_changes_[view].size();
+
+    // Join the view change if f+1 replicas ask for a later view, one of
+    // them is correct.
+    std::set<int32_t> senders;
+    for (auto it = view_changes_.upper_bound(view_); it != view_changes_.end();
+         ++it) {
+      if (join_view == 0) {
+        join_view = it->first;
+      }
+      for (const auto& msg : it->second) {
+        senders.insert(msg.first);
+      }
+    }
+    if (senders.size() < static_cast<size_t>(f_ + 1)) {
+      join_view = 0;
+    }
+  }
+  if (join_view > 0) {
+    StartViewChange(join_view);
+  }
+  if (view % total_num_ + 1 == id_ &&
+      num >= static_cast<size_t>(2 * f_ + 1)) {
+    TryNewView(view);
+  }
+  return true;
+}
+
+void PoE::TryNewView(int64_t view) {
+  NewViewMessage new_view;
+  {
+    std::lock_guard<std::mutex> lk(view_change_mutex_);
+    auto it = view_changes_.find(view);
+    if (it == view_changes_.end() ||
+        it->second.size() < static_cast<size_t>(2 * f_ + 1)) {
+      return;
+    }
+    for (const auto& msg : it->second) {
+      if (new_view.view_changes_size() == 2 * f_ + 1) {
+        break;
+      }
+      *new_view.add_view_changes() = *msg.second;
+    }
+    view_changes_.erase(view_changes_.begin(),
+                        view_changes_.upper_bound(view));
+  }
+  new_view.set_proposer(id_);
+  new_view.set_view(view);
+  if (!SelectNewViewTxns(view, &new_view)) {
+    return;
+  }
+  LOG(ERROR) << "send new view:" << view << " stable seq:"
+             << new_view.stable_seq() << " txns:" << new_view.txns_size();
+  Broadcast(MessageType::NewView, new_view);
+}
+
+bool PoE::IsPrepared(const PreparedTransaction& prepared) {
+  const Transaction& txn = prepared.txn();
+  if (txn.proposer() != txn.view() % total_num_ + 1) {
+    return false;
+  }
+  std::set<int32_t> senders;
+  for (const Proposal& prepare : prepared.prepares()) {
+    if (prepare.seq() != txn.seq() || prepare.view() != txn.view() ||
+        prepare.hash() != txn.hash() || senders.count(prepare.proposer()) ||
+        !Verify(prepare, prepare.proposer())) {
+      continue;
+    }
+    senders.insert(prepare.proposer());
+  }
+  return senders.size() >= static_cast<size_t>(2 * f_ + 1);
+}
+
+bool PoE::SelectNewViewTxns(int64_t view, NewViewMessage* new_view) {
+  std::set<int32_t> senders;
+  int64_t stable_seq = 0;
+  for (const ViewChangeMessage& view_change : new_view->view_changes()) {
+    if (view_change.view() != view ||
+        !senders.insert(view_change.proposer()).second) {
+      return false;
+    }
+    stable_seq = std::max<int64_t>(stable_seq, view_change.stable_seq());
+  }
+  if (senders.size() < static_cast<size_t>(2 * f_ + 1)) {
+    return false;
+  }
+
+  // The candidates of each seq, indexed by the hash.
+  struct Candidate {
+    bool prepared = false;
+    int64_t view = 0;
+    int report_num = 0;
+    const Transaction* txn = nullptr;
+  };
+  std::map<int64_t, std::map<std::string, Candidate>> candidates;
+  for (const ViewChangeMessage& view_change : new_view->view_changes()) {
+    for (const PreparedTransaction& prepared : view_change.txns()) {
+      const Transaction& txn = prepared.txn();
+      // The replicas do not run further than the log above the stable
+      // checkpoint.
+      if (txn.seq() <= stable_seq || txn.seq() > stable_seq + log_mask_ + 1) {
+        continue;
+      }
+      Candidate& candidate = candidates[txn.seq()][txn.hash()];
+      candidate.report_num++;
+      if (candidate.txn == nullptr) {
+        candidate.txn = &txn;
+      }
+      if (IsPrepared(prepared) &&
+          (!candidate.prepared || txn.view() > candidate.view)) {
+        candidate.prepared = true;
+        candidate.view = txn.view();
+        candidate.txn = &txn;
+      }
+    }
+  }
+
+  // A committed transaction has been prepared by 2f+1 replicas, a correct
+  // one of them is in the view changes. The one prepared in the latest view
+  // is proposed again. If none has been prepared, none has been committed
+  // and the one reported most is kept. The other seqs are filled with empty
+  // transactions.
+  new_view->clear_txns();
+  int64_t max_seq =
+      candidates.empty() ? stable_seq : candidates.rbegin()->first;
+  for (int64_t seq = stable_seq + 1; seq <= max_seq; ++seq) {
+    Transaction* txn = new_view->add_txns();
+    const Candidate* best = nullptr;
+    for (const auto& candidate : candidates[seq]) {
+      const Candidate& c = candidate.second;
+      if (best == nullptr ||
+          std::make_tuple(c.prepared, c.view, c.report_num) >
+              std::make_tuple(best->prepared, best->view, best->report_num)) {
+        best = &c;
+      }
+    }
+    if (best != nullptr) {
+      *txn = *best->txn;
+    }
+    txn->set_seq(seq);
+    txn->set_view(view);
+    txn->set_proposer(view % total_num_ + 1);
+  }
+  new_view->set_stable_seq(stable_seq);
+  return true;
+}
+
+bool PoE::ReceiveNewView(std::unique_ptr<NewViewMessage> new_view) {
+  int64_t view = new_view->view();
+  if (new_view->proposer() != view % total_num_ + 1) {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lk(seq_mutex_);
+    if (view < view_ || (view == view_ && !in_view_change_)) {
+      return false;
+    }
+  }
+  // The transactions must be the ones selected from 2f+1 valid view changes
+  // of the view.
+  for (const ViewChangeMessage& view_change : new_view->view_changes()) {
+    if (!Verify(view_change, view_change.proposer())) {
+      LOG(ERROR) << "invalid view change in new view:" << view;
+      return false;
+    }
+  }
+  NewViewMessage expected;
+  *expected.mutable_view_changes() = new_view->view_changes();
+  if (!SelectNewViewTxns(view, &expected) ||
+      expected.stable_seq() != new_view->stable_seq() ||
+      expected.txns_size() != new_view->txns_size()) {
+    LOG(ERROR) << "invalid new view:" << view;
+    return false;
+  }
+  for (int i = 0; i < expected.txns_size(); ++i) {
+    if (expected.txns(i).SerializeAsString() !=
+        new_view->txns(i).SerializeAsString()) {
+      LOG(ERROR) << "invalid new view:" << view
+                 << " seq:" << expected.txns(i).seq();
+      return false;
+    }
+  }
+
+  int64_t next_seq = new_view->stable_seq() + 1;
+  if (new_view->txns_size() > 0) {
+    next_seq = new_view->txns(new_view->txns_size() - 1).seq() + 1;
+  }
+  InstallView(view, next_seq);
+
+  bool committed = false;
+  for (const Transaction& txn : new_view->txns()) {
+    {
+      std::unique_lock<std::mutex> lk;
+      Slot* slot = GetSlot(txn.seq(), &lk);
+      if (slot != nullptr && !slot->committed) {
+        // The prepares of the new view count from now on.
+        slot->txn = std::make_unique<Transaction>(txn);
+        committed |= TryCommit(slot);
+      }
+    }
+    // Also prepare the committed seqs for the replicas behind.
+    SendPrepare(txn.hash(), txn.seq(), txn.view());
+  }
+  if (committed) {
+    AdvanceLowWatermark();
+  }
+
+  // Hand the relayed transactions to the new primary.
+  std::vector<Transaction> relayed_txns;
+  {
+    std::lock_guard<std::mutex> lk(relay_mutex_);
+    uint64_t current_time = GetCurrentTime();
+    for (auto& relayed : relayed_) {
+      relayed.second.first = current_time;
+      relayed_txns.push_back(*relayed.second.second);
+    }
+  }
+  for (const Transaction& txn : relayed_txns) {
+    SendMessage(MessageType::Relay, txn, GetPrimary());
+  }
+  QueryCommittedTxns();
+  return true;
+}
+
+void PoE::InstallView(int64_t view, int64_t next_seq) {
+  {
+    std::lock_guard<std::mutex> lk(seq_mutex_);
+    if (view < view_) {
+      return;
+    }
+    view_ = view;
+    in_view_change_ = false;
+    view_change_view_ = view;
+    seq_ = std::max<int64_t>({seq_, next_seq, low_watermark_});
+  }
+  {
+    std::lock_guard<std::mutex> lk(view_change_mutex_);
+    view_changes_.erase(view_changes_.begin(),
+                        view_changes_.upper_bound(view));
+  }
+  LOG(ERROR) << "install view:" << view << " primary:" << GetPrimary()
+             << " next seq:" << next_seq;
+  if (wait_window_) {
+    ProposePending();
+  }
+}
+
 }  // namespace poe
 }  // namespace resdb
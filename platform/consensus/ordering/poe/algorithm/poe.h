@@ -19,12 +19,17 @@
 
 #pragma once
 
+#include <condition_variable>
 #include <deque>
 #include <map>
 #include <queue>
+#include <set>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "platform/common/queue/lock_free_queue.h"
+#include "platform/consensus/checkpoint/checkpoint.h"
 #include "platform/consensus/ordering/common/algorithm/protocol_base.h"
 #include "platform/consensus/ordering/poe/proto/proposal.pb.h"
 #include "platform/statistic/stats.h"
@@ -32,25 +37,176 @@
 namespace resdb {
 namespace poe {
 
-class PoE : public common::ProtocolBase {
+class PoE : public common::ProtocolBase, public CheckPoint {
  public:
-  PoE(int id, int f, int total_num, SignatureVerifier* verifier);
+  // The primary proposes at most window_size seqs, rounded up to a power of
+  // two, above its low watermark. The replicas track twice as many seqs and
+  // broadcast a checkpoint every window_size / 4 seqs, the primary also
+  // waits until 2f+1 of them have room for the next seq.
+  // A replica asks for a new view if the seqs it has seen or the
+  // transactions it relayed to the primary are not committed within
+  // view_change_timeout_ms.
+  PoE(int id, int f, int total_num, SignatureVerifier* verifier,
+      uint32_t window_size = 1024, int view_change_timeout_ms = 1000);
   ~PoE();
 
   bool ReceiveTransaction(std::unique_ptr<Transaction> txn);
   bool ReceivePropose(std::unique_ptr<Transaction> txn);
   bool ReceivePrepare(std::unique_ptr<Proposal> proposal);
+  bool ReceiveWatermark(std::unique_ptr<Watermark> watermark);
+  bool ReceiveViewChange(std::unique_ptr<ViewChangeMessage> view_change);
+  bool ReceiveNewView(std::unique_ptr<NewViewMessage> new_view);
+  bool ReceiveQuery(std::unique_ptr<TxnQuery> query);
+  bool ReceiveQueryResponse(std::unique_ptr<TxnQueryResponse> response);
+
+  // Start from seq after replaying the logs from a checkpoint.
+  void SetNextCommitSeq(int64_t seq);
+  // The messages replayed from the logs update the state without sending
+  // anything, the replica may not be connected yet.
+  void SetReplaying(bool replaying);
+
+  // The seqs below the low watermark are committed and their slots are
+  // reclaimed. The messages at or above low watermark + window size are
+  // dropped.
+  int64_t GetLowWatermark() const;
+  int64_t GetHighWatermark() const;
+  // The slots holding a proposal or votes.
+  int GetActiveSlotNum();
+
+  // The last seq whose checkpoint has been agreed by 2f+1 replicas.
+  uint64_t GetStableCheckpoint() override;
+  int64_t GetView() const;
+  int GetPrimary() const;
+  bool InViewChange() const;
 
  private:
+  // The proposal and the prepares of one seq.
+  struct Slot {
+    std::mutex mutex;
+    int64_t seq = 0;
+    std::unique_ptr<Transaction> txn;
+    // The prepares for each view and hash, indexed by the sender.
+    std::map<std::pair<int64_t, std::string>, std::map<int32_t, Proposal> >
+        received;
+    bool committed = false;
+  };
+
+  // The responses of a query for one seq, indexed by the hash.
+  struct QueryResult {
+    std::set<int32_t> senders;
+    std::unique_ptr<Transaction> txn;
+  };
+
   bool IsStop();
+  // Nothing is sent while replaying the logs.
+  int SendMessage(int msg_type, const google::protobuf::Message& msg,
+                  int node_id);
+  int Broadcast(int msg_type, const google::protobuf::Message& msg);
+  // Lock the slot of seq, nullptr if seq is out of the window.
+  Slot* GetSlot(int64_t seq, std::unique_lock<std::mutex>* lk);
+  // Commit the transaction if it has been prepared by 2f+1 replicas.
+  bool TryCommit(Slot* slot);
+  void CommitSlot(Slot* slot);
+  // Reclaim the slots of the committed prefix.
+  void AdvanceLowWatermark();
+  void UpdatePeerWatermark(int32_t proposer, int64_t low_watermark);
+  // The seqs below it can be proposed.
+  int64_t GetProposeBound();
+  void SendPrepare(const std::string& hash, int64_t seq, int64_t view);
+  // Sign the message if there is a verifier, over the message without the
+  // signature.
+  template <typename Message>
+  bool Sign(Message* msg);
+  template <typename Message>
+  bool Verify(const Message& msg, int32_t signer);
+  // The transaction has 2f+1 valid prepares in its view.
+  bool IsPrepared(const PreparedTransaction& prepared);
+  // Propose the pending transactions within the window, or relay them if
+  // the replica is no longer the primary.
+  void ProposePending();
+
+  void Relay(std::unique_ptr<Transaction> txn, bool send);
+  void RemoveRelayed(const std::string& hash);
+  void MonitorProgress();
+  void CheckProgress();
+  void StartViewChange(int64_t view);
+  void TryNewView(int64_t view);
+  // Select the transactions of the new view from its 2f+1 view changes,
+  // false if they are not from 2f+1 replicas.
+  bool SelectNewViewTxns(int64_t view, NewViewMessage* new_view);
+  void InstallView(int64_t view, int64_t next_seq);
+  void AddCheckpointVote(int32_t proposer, int64_t seq,
+                         const std::string& digest, int64_t view);
+  // Ask for the committed transactions up to the stable checkpoint if the
+  // replica falls behind it.
+  void QueryCommittedTxns();
+  void CommitQueryResults();
 
  private:
-  std::mutex mutex_;
-  std::map<std::string, std::set<int32_t> > received_;
-  std::map<std::string, std::unique_ptr<Transaction> > data_;
+  std::vector<Slot> slots_;
+  int64_t window_size_;
+  int64_t window_mask_;
+  std::atomic<int64_t> low_watermark_;
+  std::mutex gc_mutex_;
+
+  // The transactions reclaimed from the slots with their prepares, kept to
+  // answer the queries of the replicas behind and for the view changes.
+  // Protected by gc_mutex_.
+  std::vector<std::unique_ptr<PreparedTransaction> > log_;
+  int64_t log_mask_;
+  // The digest of the transactions since the last checkpoint.
+  std::string checkpoint_digest_;
+  int64_t checkpoint_start_;
+  int64_t checkpoint_interval_;
 
+  std::mutex checkpoint_mutex_;
+  // The votes for each checkpoint seq within the log above the low
+  // watermark, digest -> replica -> view.
+  std::map<int64_t, std::map<std::string, std::map<int32_t, int64_t> > >
+      checkpoint_votes_;
+  std::atomic<int64_t> stable_seq_;
+
+  // The low watermarks reported by the replicas, indexed by id.
+  std::vector<std::atomic<int64_t>> peer_watermark_;
+  std::mutex seq_mutex_;
+  // The transactions received by the primary beyond the window, protected
+  // by seq_mutex_.
+  std::deque<std::unique_ptr<Transaction> > pending_txns_;
+  std::atomic<bool> wait_window_;
   int64_t seq_;
-  bool is_stop_;
+  std::atomic<bool> is_stop_;
+  std::atomic<bool> replaying_;
+
+  // The view and the view change state, protected by seq_mutex_.
+  std::atomic<int64_t> view_;
+  std::atomic<bool> in_view_change_;
+  int64_t view_change_view_;
+  uint64_t view_change_time_;
+  std::mutex view_change_mutex_;
+  std::map<int64_t, std::map<int32_t, std::unique_ptr<ViewChangeMessage> > >
+      view_changes_;
+
+  // The client transactions relayed to the primary, indexed by the hash.
+  std::mutex relay_mutex_;
+  std::unordered_map<std::string,
+                     std::pair<uint64_t, std::unique_ptr<Transaction> > >
+      relayed_;
+
+  std::mutex query_mutex_;
+  std::map<int64_t, std::map<std::string, QueryResult> > query_results_;
+  uint64_t last_query_time_;
+  int64_t last_query_low_watermark_;
+
+  // The max seq of the proposals and the prepares received.
+  std::atomic<int64_t> max_seen_seq_;
+  int64_t last_low_watermark_;
+  int64_t last_view_;
+  uint64_t last_progress_time_;
+  uint64_t view_change_timeout_;
+  std::mutex monitor_mutex_;
+  std::condition_variable monitor_cv_;
+  std::thread monitor_thread_;
+
   SignatureVerifier* verifier_;
   Stats* global_stats_;
 };
@@ -0,0 +1,587 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "platform/consensus/ordering/poe/algorithm/poe.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+
+#include "chain/storage/memory_db.h"
+#include "common/crypto/mock_signature_verifier.h"
+#include "common/utils/utils.h"
+#include "platform/consensus/recovery/recovery.h"
+
+namespace resdb {
+namespace poe {
+namespace {
+
+using ::testing::Invoke;
+using ::testing::NiceMock;
+using ::testing::Test;
+
+// Four replicas delivering their messages to each other in place. The
+// messages from or to a crashed replica are dropped.
+class PoETest : public Test {
+ public:
+  static constexpr int kReplicaNum = 4;
+  static constexpr uint32_t kWindowSize = 16;
+
+  PoETest() {
+    for (int i = 1; i <= kReplicaNum; ++i) {
+      crashed_[i] = false;
+      replicas_.push_back(nullptr);
+      StartReplica(i);
+    }
+  }
+
+  void TearDown() override {
+    for (int i = 1; i <= kReplicaNum; ++i) {
+      crashed_[i] = true;
+    }
+    WaitForDeliver();
+    recovery_ = nullptr;
+    replicas_.clear();
+    std::filesystem::remove_all(LogDir());
+  }
+
+  // The recovery log of each test is kept in its own temp directory.
+  std::string LogDir() {
+    return ::testing::TempDir() + "/poe_log_" +
+           ::testing::UnitTest::GetInstance()->current_test_info()->name();
+  }
+
+  void StartReplica(int id, int view_change_timeout_ms = 1000) {
+    replicas_[id - 1] = std::make_unique<PoE>(
+        id, 1, kReplicaNum, nullptr, kWindowSize, view_change_timeout_ms);
+    PoE* replica = replicas_[id - 1].get();
+    replica->SetBroadcastCallFunc(
+        [this, id](int type, const google::protobuf::Message& msg) {
+          sent_[id]++;
+          Deliver(id, type, msg, 0);
+          return 0;
+        });
+    replica->SetSingleCallFunc(
+        [this, id](int type, const google::protobuf::Message& msg,
+                   int node_id) {
+          sent_[id]++;
+          Deliver(id, type, msg, node_id);
+          return 0;
+        });
+    replica->SetCommitFunc([this, id](const google::protobuf::Message& msg) {
+      std::lock_guard<std::mutex> lk(mutex_);
+      const Transaction& txn = dynamic_cast<const Transaction&>(msg);
+      committed_[id].push_back(txn.seq());
+      committed_hash_[id][txn.seq()] = txn.hash();
+      return 0;
+    });
+  }
+
+  void Restart(int view_change_timeout_ms) {
+    for (int i = 1; i <= kReplicaNum; ++i) {
+      crashed_[i] = true;
+    }
+    WaitForDeliver();
+    for (int i = 1; i <= kReplicaNum; ++i) {
+      StartReplica(i, view_change_timeout_ms);
+      crashed_[i] = false;
+    }
+  }
+
+  void Crash(int id) {
+    crashed_[id] = true;
+    WaitForDeliver();
+    if (id == kReplicaNum) {
+      recovery_ = nullptr;
+    }
+    replicas_[id - 1] = nullptr;
+  }
+
+  void WaitForDeliver() {
+    while (delivering_ > 0) {
+      std::this_thread::yield();
+    }
+  }
+
+  // Send the message to node_id, or to all the replicas if it is 0.
+  void Deliver(int sender, int type, const google::protobuf::Message& msg,
+               int node_id) {
+    delivering_++;
+    if (!crashed_[sender]) {
+      Request request;
+      request.set_type(Request::TYPE_CUSTOM_CONSENSUS);
+      request.set_user_type(type);
+      msg.SerializeToString(request.mutable_data());
+      for (int i = 1; i <= kReplicaNum; ++i) {
+        if ((node_id == 0 || node_id == i) && !crashed_[i]) {
+          Process(i, request, /*log=*/true);
+        }
+      }
+    }
+    delivering_--;
+  }
+
+  // Replica 4 logs the consensus messages if it has a recovery.
+  void Process(int id, Request& request, bool log) {
+    PoE* replica = replicas_[id - 1].get();
+    switch (request.user_type()) {
+      case MessageType::Propose: {
+        auto txn = std::make_unique<Transaction>();
+        txn->ParseFromString(request.data());
+        request.set_seq(txn->seq());
+        Log(id, request, log);
+        replica->ReceivePropose(std::move(txn));
+        break;
+      }
+      case MessageType::Prepare: {
+        auto proposal = std::make_unique<Proposal>();
+        proposal->ParseFromString(request.data());
+        request.set_seq(proposal->seq());
+        Log(id, request, log);
+        replica->ReceivePrepare(std::move(proposal));
+        break;
+      }
+      case MessageType::LowWatermark: {
+        auto watermark = std::make_unique<Watermark>();
+        watermark->ParseFromString(request.data());
+        replica->ReceiveWatermark(std::move(watermark));
+        break;
+      }
+      case MessageType::Relay: {
+        auto txn = std::make_unique<Transaction>();
+        txn->ParseFromString(request.data());
+        replica->ReceiveTransaction(std::move(txn));
+        break;
+      }
+      case MessageType::ViewChange: {
+        auto view_change = std::make_unique<ViewChangeMessage>();
+        view_change->ParseFromString(request.data());
+        replica->ReceiveViewChange(std::move(view_change));
+        break;
+      }
+      case MessageType::NewView: {
+        auto new_view = std::make_unique<NewViewMessage>();
+        new_view->ParseFromString(request.data());
+        request.set_seq(new_view->stable_seq() + 1);
+        Log(id, request, log);
+        replica->ReceiveNewView(std::move(new_view));
+        break;
+      }
+      case MessageType::Query: {
+        auto query = std::make_unique<TxnQuery>();
+        query->ParseFromString(request.data());
+        replica->ReceiveQuery(std::move(query));
+        break;
+      }
+      case MessageType::QueryResponse: {
+        auto response = std::make_unique<TxnQueryResponse>();
+        response->ParseFromString(request.data());
+        replica->ReceiveQueryResponse(std::move(response));
+        break;
+      }
+    }
+  }
+
+  void Log(int id, const Request& request, bool log) {
+    if (log && id == kReplicaNum && recovery_ != nullptr) {
+      recovery_->AddRequest(nullptr, &request);
+    }
+  }
+
+  std::unique_ptr<Recovery> NewRecovery() {
+    ResConfigData data;
+    data.set_recovery_enabled(true);
+    data.set_recovery_path(LogDir() + "/log");
+    data.set_recovery_buffer_size(1024);
+    data.set_recovery_ckpt_time_s(1);
+    ResDBConfig config(data, ReplicaInfo(), KeyInfo(), CertificateInfo());
+    return std::make_unique<Recovery>(config, replicas_[kReplicaNum - 1].get(),
+                                      &system_info_, storage_.get());
+  }
+
+  std::unique_ptr<Transaction> NewTransaction(int id) {
+    auto txn = std::make_unique<Transaction>();
+    txn->set_data("test");
+    txn->set_hash("hash" + std::to_string(id));
+    return txn;
+  }
+
+  // The committed seqs in order, the executor orders the commits.
+  std::vector<int64_t> GetCommitted(int id) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    std::vector<int64_t> seqs = committed_[id];
+    std::sort(seqs.begin(), seqs.end());
+    return seqs;
+  }
+
+  // Wait until the replica has committed the seqs before seq.
+  bool WaitForCommit(int id, int64_t seq) {
+    for (int i = 0; i < 1000; ++i) {
+      if (replicas_[id - 1]->GetLowWatermark() >= seq) {
+        return true;
+      }
+      usleep(10000);
+    }
+    return false;
+  }
+
+  std::vector<int64_t> GetSeqs(int64_t min_seq, int64_t max_seq) {
+    std::vector<int64_t> seqs;
+    for (int64_t seq = min_seq; seq <= max_seq; ++seq) {
+      seqs.push_back(seq);
+    }
+    return seqs;
+  }
+
+ protected:
+  std::vector<std::unique_ptr<PoE>> replicas_;
+  std::mutex mutex_;
+  std::map<int, std::vector<int64_t>> committed_;
+  std::map<int, std::map<int64_t, std::string>> committed_hash_;
+  std::atomic<bool> crashed_[kReplicaNum + 1];
+  std::atomic<int> delivering_ = 0;
+  std::atomic<int> sent_[kReplicaNum + 1] = {};
+  SystemInfo system_info_;
+  std::unique_ptr<Storage> storage_ = storage::NewMemoryDB();
+  std::unique_ptr<Recovery> recovery_;
+};
+
+TEST_F(PoETest, ReclaimCommittedSlots) {
+  const int txn_num = kWindowSize * 10;
+  for (int i = 0; i < txn_num; ++i) {
+    EXPECT_TRUE(replicas_[0]->ReceiveTransaction(NewTransaction(i)));
+  }
+
+  std::vector<int64_t> expected_seqs;
+  for (int i = 1; i <= txn_num; ++i) {
+    expected_seqs.push_back(i);
+  }
+  for (int i = 1; i <= kReplicaNum; ++i) {
+    EXPECT_EQ(committed_[i], expected_seqs);
+    EXPECT_EQ(replicas_[i - 1]->GetLowWatermark(), txn_num + 1);
+    EXPECT_EQ(replicas_[i - 1]->GetActiveSlotNum(), 0);
+  }
+}
+
+TEST_F(PoETest, PrepareBeforePropose) {
+  PoE* replica = replicas_[3].get();
+  for (int proposer = 1; proposer <= 3; ++proposer) {
+    auto proposal = std::make_unique<Proposal>();
+    proposal->set_hash("hash");
+    proposal->set_seq(1);
+    proposal->set_proposer(proposer);
+    replica->ReceivePrepare(std::move(proposal));
+  }
+  EXPECT_TRUE(committed_[4].empty());
+
+  // Only deliver the proposal to replica 4.
+  replica->SetBroadcastCallFunc(
+      [](int type, const google::protobuf::Message& msg) { return 0; });
+  auto txn = std::make_unique<Transaction>();
+  txn->set_hash("hash");
+  txn->set_seq(1);
+  txn->set_proposer(1);
+  replica->ReceivePropose(std::move(txn));
+  EXPECT_EQ(committed_[4], std::vector<int64_t>({1}));
+  EXPECT_EQ(replica->GetLowWatermark(), 2);
+}
+
+TEST_F(PoETest, DropOutOfWindow) {
+  PoE* replica = replicas_[3].get();
+  replica->SetBroadcastCallFunc(
+      [](int type, const google::protobuf::Message& msg) { return 0; });
+
+  auto txn = std::make_unique<Transaction>();
+  txn->set_hash("hash");
+  txn->set_seq(replica->GetHighWatermark());
+  EXPECT_FALSE(replica->ReceivePropose(std::move(txn)));
+
+  auto proposal = std::make_unique<Proposal>();
+  proposal->set_hash("hash");
+  proposal->set_seq(0);
+  proposal->set_proposer(1);
+  EXPECT_FALSE(replica->ReceivePrepare(std::move(proposal)));
+  EXPECT_EQ(replica->GetActiveSlotNum(), 0);
+}
+
+TEST_F(PoETest, DropProposalFromBackup) {
+  PoE* replica = replicas_[3].get();
+  replica->SetBroadcastCallFunc(
+      [](int type, const google::protobuf::Message& msg) { return 0; });
+
+  auto txn = std::make_unique<Transaction>();
+  txn->set_hash("hash");
+  txn->set_seq(1);
+  txn->set_proposer(2);
+  EXPECT_FALSE(replica->ReceivePropose(std::move(txn)));
+
+  // Replica 2 is the primary of view 1.
+  txn = std::make_unique<Transaction>();
+  txn->set_hash("hash");
+  txn->set_seq(1);
+  txn->set_proposer(1);
+  txn->set_view(1);
+  EXPECT_FALSE(replica->ReceivePropose(std::move(txn)));
+  EXPECT_EQ(replica->GetActiveSlotNum(), 0);
+}
+
+TEST_F(PoETest, DropCheckpointVotesBeyondLog) {
+  PoE* replica = replicas_[3].get();
+  replica->SetBroadcastCallFunc(
+      [](int type, const google::protobuf::Message& msg) { return 0; });
+
+  // The log keeps 4 windows above the low watermark.
+  const int64_t max_seq = 4 * kWindowSize;
+  for (int64_t seq : {2 * max_seq, max_seq}) {
+    for (int proposer = 1; proposer <= 3; ++proposer) {
+      auto watermark = std::make_unique<Watermark>();
+      watermark->set_proposer(proposer);
+      watermark->set_low_watermark(seq + 1);
+      watermark->set_digest("digest");
+      replica->ReceiveWatermark(std::move(watermark));
+    }
+  }
+  EXPECT_EQ(replica->GetStableCheckpoint(), max_seq);
+}
+
+TEST_F(PoETest, ProposeWithinWindow) {
+  // The other replicas do not answer, nothing gets committed.
+  PoE* primary = replicas_[0].get();
+  std::vector<int64_t> proposed;
+  primary->SetBroadcastCallFunc(
+      [&](int type, const google::protobuf::Message& msg) {
+        if (type == MessageType::Propose) {
+          proposed.push_back(dynamic_cast<const Transaction&>(msg).seq());
+        }
+        return 0;
+      });
+  for (uint32_t i = 0; i < kWindowSize; ++i) {
+    EXPECT_TRUE(primary->ReceiveTransaction(NewTransaction(i)));
+  }
+  EXPECT_EQ(proposed, GetSeqs(1, kWindowSize));
+
+  // The transaction beyond the window is queued without blocking.
+  EXPECT_TRUE(primary->ReceiveTransaction(NewTransaction(kWindowSize)));
+  EXPECT_EQ(proposed.size(), kWindowSize);
+
+  // Commit seq 1 to open the window.
+  auto txn = NewTransaction(0);
+  txn->set_seq(1);
+  txn->set_proposer(1);
+  primary->ReceivePropose(std::move(txn));
+  for (int proposer = 1; proposer <= 3; ++proposer) {
+    auto proposal = std::make_unique<Proposal>();
+    proposal->set_hash("hash0");
+    proposal->set_seq(1);
+    proposal->set_proposer(proposer);
+    primary->ReceivePrepare(std::move(proposal));
+  }
+  EXPECT_EQ(primary->GetLowWatermark(), 2);
+  EXPECT_EQ(proposed, GetSeqs(1, kWindowSize + 1));
+}
+
+TEST_F(PoETest, SelectNewViewTxns) {
+  PoE* replica = replicas_[3].get();
+  replica->SetBroadcastCallFunc(
+      [](int type, const google::protobuf::Message& msg) { return 0; });
+  replica->SetSingleCallFunc(
+      [](int type, const google::protobuf::Message& msg, int node_id) {
+        return 0;
+      });
+
+  auto new_prepared = [](const std::string& hash, int64_t prepare_view) {
+    PreparedTransaction prepared;
+    prepared.mutable_txn()->set_hash(hash);
+    prepared.mutable_txn()->set_seq(1);
+    prepared.mutable_txn()->set_proposer(1);
+    for (int id = 1; id <= 3; ++id) {
+      Proposal* prepare = prepared.add_prepares();
+      prepare->set_hash(hash);
+      prepare->set_seq(1);
+      prepare->set_view(prepare_view);
+      prepare->set_proposer(id);
+    }
+    return prepared;
+  };
+  // Replica 1 has prepared hash_a. Replicas 2 and 3 report hash_b with the
+  // prepares of another view, which do not count.
+  NewViewMessage new_view;
+  new_view.set_proposer(2);
+  new_view.set_view(1);
+  for (int id = 1; id <= 3; ++id) {
+    ViewChangeMessage* view_change = new_view.add_view_changes();
+    view_change->set_proposer(id);
+    view_change->set_view(1);
+    *view_change->add_txns() =
+        id == 1 ? new_prepared("hash_a", 0) : new_prepared("hash_b", 1);
+  }
+  auto add_txn = [](NewViewMessage* new_view, const std::string& hash) {
+    Transaction* txn = new_view->add_txns();
+    txn->set_hash(hash);
+    txn->set_seq(1);
+    txn->set_view(1);
+    txn->set_proposer(2);
+  };
+
+  auto forged = std::make_unique<NewViewMessage>(new_view);
+  add_txn(forged.get(), "hash_b");
+  EXPECT_FALSE(replica->ReceiveNewView(std::move(forged)));
+
+  // The view changes of 2f+1 replicas are needed.
+  auto partial = std::make_unique<NewViewMessage>(new_view);
+  partial->mutable_view_changes()->RemoveLast();
+  add_txn(partial.get(), "hash_a");
+  EXPECT_FALSE(replica->ReceiveNewView(std::move(partial)));
+  EXPECT_EQ(replica->GetView(), 0);
+
+  auto valid = std::make_unique<NewViewMessage>(new_view);
+  add_txn(valid.get(), "hash_a");
+  EXPECT_TRUE(replica->ReceiveNewView(std::move(valid)));
+  EXPECT_EQ(replica->GetView(), 1);
+}
+
+TEST_F(PoETest, VerifyViewChangesInNewView) {
+  NiceMock<MockSignatureVerifier> verifier;
+  ON_CALL(verifier, VerifyMessage)
+      .WillByDefault(
+          Invoke([](const std::string& data, const SignatureInfo& sign) {
+            return sign.signature() == "valid";
+          }));
+  PoE replica(4, 1, kReplicaNum, &verifier, kWindowSize);
+  replica.SetBroadcastCallFunc(
+      [](int type, const google::protobuf::Message& msg) { return 0; });
+  replica.SetSingleCallFunc(
+      [](int type, const google::protobuf::Message& msg, int node_id) {
+        return 0;
+      });
+
+  auto new_view = [](const std::string& signature) {
+    auto new_view = std::make_unique<NewViewMessage>();
+    new_view->set_proposer(2);
+    new_view->set_view(1);
+    for (int id = 1; id <= 3; ++id) {
+      ViewChangeMessage* view_change = new_view->add_view_changes();
+      view_change->set_proposer(id);
+      view_change->set_view(1);
+      view_change->mutable_signature()->set_node_id(id);
+      view_change->mutable_signature()->set_signature(signature);
+    }
+    return new_view;
+  };
+  EXPECT_FALSE(replica.ReceiveNewView(new_view("forged")));
+  EXPECT_EQ(replica.GetView(), 0);
+  EXPECT_TRUE(replica.ReceiveNewView(new_view("valid")));
+  EXPECT_EQ(replica.GetView(), 1);
+}
+
+TEST_F(PoETest, ChangeViewOnPrimaryFailure) {
+  Restart(/*view_change_timeout_ms=*/100);
+  const int txn_num = kWindowSize;
+  for (int i = 0; i < txn_num; ++i) {
+    EXPECT_TRUE(replicas_[0]->ReceiveTransaction(NewTransaction(i)));
+  }
+  for (int i = 1; i <= kReplicaNum; ++i) {
+    EXPECT_TRUE(WaitForCommit(i, txn_num + 1));
+  }
+
+  // The primary crashes after sending the next proposal to replica 2 only.
+  Crash(1);
+  auto txn = NewTransaction(txn_num);
+  txn->set_seq(txn_num + 1);
+  txn->set_proposer(1);
+  EXPECT_TRUE(replicas_[1]->ReceivePropose(std::move(txn)));
+  // Replica 3 relays a client transaction to the crashed primary.
+  EXPECT_TRUE(replicas_[2]->ReceiveTransaction(NewTransaction(txn_num + 1)));
+
+  // Replica 2 becomes the primary, proposes the transaction prepared by
+  // itself again and then the relayed one.
+  for (int i = 2; i <= kReplicaNum; ++i) {
+    EXPECT_TRUE(WaitForCommit(i, txn_num + 3));
+    EXPECT_EQ(replicas_[i - 1]->GetView(), 1);
+    EXPECT_EQ(replicas_[i - 1]->GetPrimary(), 2);
+    EXPECT_FALSE(replicas_[i - 1]->InViewChange());
+    EXPECT_EQ(GetCommitted(i), GetSeqs(1, txn_num + 2));
+    std::lock_guard<std::mutex> lk(mutex_);
+    EXPECT_EQ(committed_hash_[i][txn_num + 1],
+              "hash" + std::to_string(txn_num));
+    EXPECT_EQ(committed_hash_[i][txn_num + 2],
+              "hash" + std::to_string(txn_num + 1));
+  }
+
+  EXPECT_TRUE(replicas_[1]->ReceiveTransaction(NewTransaction(txn_num + 2)));
+  for (int i = 2; i <= kReplicaNum; ++i) {
+    EXPECT_TRUE(WaitForCommit(i, txn_num + 4));
+  }
+}
+
+TEST_F(PoETest, RecoverAfterRestart) {
+  std::filesystem::remove_all(LogDir());
+  recovery_ = NewRecovery();
+
+  const int txn_num = 2 * kWindowSize;
+  int id = 0;
+  for (; id < txn_num; ++id) {
+    EXPECT_TRUE(replicas_[0]->ReceiveTransaction(NewTransaction(id)));
+  }
+  EXPECT_EQ(GetCommitted(4), GetSeqs(1, txn_num));
+
+  // The others move on while replica 4 is down.
+  Crash(4);
+  for (; id < 2 * txn_num; ++id) {
+    EXPECT_TRUE(replicas_[0]->ReceiveTransaction(NewTransaction(id)));
+  }
+  EXPECT_EQ(GetCommitted(1), GetSeqs(1, 2 * txn_num));
+
+  // Replica 4 replays its log after restarting.
+  {
+    std::lock_guard<std::mutex> lk(mutex_);
+    committed_[4].clear();
+  }
+  StartReplica(4);
+  recovery_ = NewRecovery();
+  sent_[4] = 0;
+  replicas_[3]->SetReplaying(true);
+  recovery_->ReadLogs(
+      [&](const SystemInfoData& data) {},
+      [&](std::unique_ptr<Context> context, std::unique_ptr<Request> request) {
+        Process(4, *request, /*log=*/false);
+      },
+      [&](int seq) { replicas_[3]->SetNextCommitSeq(seq + 1); });
+  replicas_[3]->SetReplaying(false);
+  // The replay sends nothing.
+  EXPECT_EQ(sent_[4], 0);
+  EXPECT_EQ(GetCommitted(4), GetSeqs(1, txn_num));
+  EXPECT_EQ(replicas_[3]->GetLowWatermark(), txn_num + 1);
+  crashed_[4] = false;
+
+  // Then it fetches the seqs covered by the checkpoints of the others.
+  for (; id < 3 * txn_num; ++id) {
+    EXPECT_TRUE(replicas_[0]->ReceiveTransaction(NewTransaction(id)));
+  }
+  EXPECT_TRUE(WaitForCommit(4, 3 * txn_num + 1));
+  EXPECT_EQ(GetCommitted(4), GetSeqs(1, 3 * txn_num));
+  EXPECT_EQ(replicas_[3]->GetStableCheckpoint(), 3 * txn_num);
+}
+
+}  // namespace
+}  // namespace poe
+}  // namespace resdb
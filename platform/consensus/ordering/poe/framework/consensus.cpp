@@ -55,12 +55,34 @@ Consensus::Consensus(const ResDBConfig& config,
           .public_key()
           .public_key_info()
           .type() != CertificateKeyInfo::CLIENT) {
-    poe_ = std::make_unique<PoE>(config_.GetSelfInfo().id(), f, total_replicas,
-                                 GetSignatureVerifier());
+    poe_ = std::make_unique<PoE>(
+        config_.GetSelfInfo().id(), f, total_replicas, GetSignatureVerifier(),
+        8 * config_.GetMaxProcessTxn(), config_.GetViewchangeCommitTimeout());
     InitProtocol(poe_.get());
+    recovery_ = std::make_unique<Recovery>(config_, poe_.get(), &system_info_,
+                                           transaction_executor_->GetStorage());
+    RecoverFromLogs();
   }
 }
 
+void Consensus::RecoverFromLogs() {
+  // The replica is not connected yet and the others have seen the messages.
+  poe_->SetReplaying(true);
+  recovery_->ReadLogs(
+      [&](const SystemInfoData& data) {
+        system_info_.SetCurrentView(data.view());
+        system_info_.SetPrimary(data.primary_id());
+      },
+      [&](std::unique_ptr<Context> context, std::unique_ptr<Request> request) {
+        ProcessCustomConsensus(std::move(request));
+      },
+      [&](int seq) {
+        transaction_executor_->SetPendingExecutedSeq(seq + 1);
+        poe_->SetNextCommitSeq(seq + 1);
+      });
+  poe_->SetReplaying(false);
+}
+
 int Consensus::ProcessCustomConsensus(std::unique_ptr<Request> request) {
   if (request->user_type() == MessageType::Propose) {
     std::unique_ptr<Transaction> txn = std::make_unique<Transaction>();
@@ -69,6 +91,8 @@ int Consensus::ProcessCustomConsensus(std::unique_ptr<Request> request) {
       LOG(ERROR) << "parse proposal fail";
       return -1;
     }
+    request->set_seq(txn->seq());
+    AddLog(*request);
     poe_->ReceivePropose(std::move(txn));
     return 0;
   } else if (request->user_type() == MessageType::Prepare) {
@@ -78,12 +102,77 @@ int Consensus::ProcessCustomConsensus(std::unique_ptr<Request> request) {
       assert(1 == 0);
       return -1;
     }
+    request->set_seq(proposal->seq());
+    AddLog(*request);
     poe_->ReceivePrepare(std::move(proposal));
     return 0;
+  } else if (request->user_type() == MessageType::LowWatermark) {
+    std::unique_ptr<Watermark> watermark = std::make_unique<Watermark>();
+    if (!watermark->ParseFromString(request->data())) {
+      LOG(ERROR) << "parse watermark fail";
+      return -1;
+    }
+    poe_->ReceiveWatermark(std::move(watermark));
+    return 0;
+  } else if (request->user_type() == MessageType::Relay) {
+    std::unique_ptr<Transaction> txn = std::make_unique<Transaction>();
+    if (!txn->ParseFromString(request->data())) {
+      LOG(ERROR) << "parse relayed txn fail";
+      return -1;
+    }
+    poe_->ReceiveTransaction(std::move(txn));
+    return 0;
+  } else if (request->user_type() == MessageType::ViewChange) {
+    std::unique_ptr<ViewChangeMessage> view_change =
+        std::make_unique<ViewChangeMessage>();
+    if (!view_change->ParseFromString(request->data())) {
+      LOG(ERROR) << "parse view change fail";
+      return -1;
+    }
+    poe_->ReceiveViewChange(std::move(view_change));
+    return 0;
+  } else if (request->user_type() == MessageType::NewView) {
+    std::unique_ptr<NewViewMessage> new_view =
+        std::make_unique<NewViewMessage>();
+    if (!new_view->ParseFromString(request->data())) {
+      LOG(ERROR) << "parse new view fail";
+      return -1;
+    }
+    request->set_seq(new_view->stable_seq() + 1);
+    AddLog(*request);
+    if (poe_->ReceiveNewView(std::move(new_view))) {
+      system_info_.SetCurrentView(poe_->GetView());
+      system_info_.SetPrimary(poe_->GetPrimary());
+    }
+    return 0;
+  } else if (request->user_type() == MessageType::Query) {
+    std::unique_ptr<TxnQuery> query = std::make_unique<TxnQuery>();
+    if (!query->ParseFromString(request->data())) {
+      LOG(ERROR) << "parse query fail";
+      return -1;
+    }
+    poe_->ReceiveQuery(std::move(query));
+    return 0;
+  } else if (request->user_type() == MessageType::QueryResponse) {
+    std::unique_ptr<TxnQueryResponse> response =
+        std::make_unique<TxnQueryResponse>();
+    if (!response->ParseFromString(request->data())) {
+      LOG(ERROR) << "parse query response fail";
+      return -1;
+    }
+    poe_->ReceiveQueryResponse(std::move(response));
+    return 0;
   }
   return 0;
 }
 
+void Consensus::AddLog(const Request& request) {
+  // The replayed messages are in the logs already.
+  if (!request.is_recovery()) {
+    recovery_->AddRequest(nullptr, &request);
+  }
+}
+
 int Consensus::ProcessNewTransaction(std::unique_ptr<Request> request) {
   std::unique_ptr<Transaction> txn = std::make_unique<Transaction>();
   txn->set_data(request->data());
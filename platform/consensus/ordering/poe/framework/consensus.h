@@ -20,9 +20,11 @@
 #pragma once
 
 #include "executor/common/transaction_manager.h"
+#include "platform/consensus/execution/system_info.h"
 #include "platform/consensus/ordering/common/framework/consensus.h"
 #include "platform/consensus/ordering/poe/algorithm/poe.h"
 #include "platform/consensus/ordering/poe/framework/performance_manager.h"
+#include "platform/consensus/recovery/recovery.h"
 #include "platform/networkstrate/consensus_manager.h"
 
 namespace resdb {
@@ -41,11 +43,17 @@ class Consensus : public common::Consensus {
   int CommitMsgInternal(const Transaction& txn);
 
   int Prepare(const Transaction& txn);
+  // Replay the consensus messages in the logs after the last checkpoint.
+  void RecoverFromLogs();
+  void AddLog(const Request& request);
 
   std::unique_ptr<PoEPerformanceManager> GetPerformanceManager();
 
  protected:
   std::unique_ptr<PoE> poe_;
+  SystemInfo system_info_;
+  // Declared after poe_, it reads the stable checkpoint from poe_.
+  std::unique_ptr<Recovery> recovery_;
   Stats* global_stats_;
   int64_t start_;
   std::mutex mutex_;
@@ -0,0 +1,122 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "platform/consensus/recovery/log_codec.h"
+
+#include <glog/logging.h>
+#include <string.h>
+
+#include "snappy.h"
+#include "zlib.h"
+
+namespace resdb {
+
+namespace {
+
+// The bytes before the data of a block: the codec and the data length.
+constexpr size_t kPrefixSize = sizeof(uint8_t) + sizeof(size_t);
+
+}  // namespace
+
+bool CompressLogBlock(ResConfigData::RecoveryCodec codec, std::string_view data,
+                      std::string* output) {
+  size_t len = data.size();
+  switch (codec) {
+    case ResConfigData::CODEC_NONE:
+      break;
+    case ResConfigData::CODEC_SNAPPY: {
+      output->resize(kPrefixSize + snappy::MaxCompressedLength(len));
+      size_t compressed_len = 0;
+      snappy::RawCompress(data.data(), len, output->data() + kPrefixSize,
+                          &compressed_len);
+      output->resize(kPrefixSize + compressed_len);
+      break;
+    }
+    case ResConfigData::CODEC_ZLIB: {
+      uLongf compressed_len = compressBound(len);
+      output->resize(kPrefixSize + compressed_len);
+      int ret = compress2(
+          reinterpret_cast<Bytef*>(output->data() + kPrefixSize),
+          &compressed_len, reinterpret_cast<const Bytef*>(data.data()), len,
+          Z_BEST_SPEED);
+      if (ret != Z_OK) {
+        LOG(ERROR) << "zlib compress fail:" << ret;
+        codec = ResConfigData::CODEC_NONE;
+        break;
+      }
+      output->resize(kPrefixSize + compressed_len);
+      break;
+    }
+    default:
+      LOG(ERROR) << "unknown codec:" << codec;
+      return false;
+  }
+
+  if (codec == ResConfigData::CODEC_NONE ||
+      output->size() >= kPrefixSize + len) {
+    codec = ResConfigData::CODEC_NONE;
+    output->resize(kPrefixSize);
+    output->append(data);
+  }
+  (*output)[0] = static_cast<char>(codec);
+  memcpy(output->data() + sizeof(uint8_t), &len, sizeof(len));
+  return true;
+}
+
+bool UncompressLogBlock(std::string_view data, std::string* output) {
+  if (data.size() < kPrefixSize) {
+    return false;
+  }
+  uint8_t codec = data[0];
+  size_t len;
+  memcpy(&len, data.data() + sizeof(uint8_t), sizeof(len));
+  data.remove_prefix(kPrefixSize);
+  switch (codec) {
+    case ResConfigData::CODEC_NONE:
+      if (data.size() != len) {
+        return false;
+      }
+      output->assign(data);
+      return true;
+    case ResConfigData::CODEC_SNAPPY: {
+      size_t uncompressed_len = 0;
+      if (!snappy::GetUncompressedLength(data.data(), data.size(),
+                                         &uncompressed_len) ||
+          uncompressed_len != len) {
+        return false;
+      }
+      output->resize(len);
+      return snappy::RawUncompress(data.data(), data.size(), output->data());
+    }
+    case ResConfigData::CODEC_ZLIB: {
+      output->resize(len);
+      uLongf uncompressed_len = len;
+      int ret =
+          uncompress(reinterpret_cast<Bytef*>(output->data()),
+                     &uncompressed_len,
+                     reinterpret_cast<const Bytef*>(data.data()), data.size());
+      return ret == Z_OK && uncompressed_len == len;
+    }
+    default:
+      LOG(ERROR) << "unknown codec:" << static_cast<int>(codec);
+      return false;
+  }
+}
+
+}  // namespace resdb
@@ -0,0 +1,37 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "platform/proto/replica_info.pb.h"
+
+namespace resdb {
+
+// Compress a block of the recovery log with the codec. The output starts
+// with the codec and the length of the data so that it can be uncompressed
+// alone. The data is kept as it is if the codec does not make it smaller.
+bool CompressLogBlock(ResConfigData::RecoveryCodec codec, std::string_view data,
+                      std::string* output);
+
+bool UncompressLogBlock(std::string_view data, std::string* output);
+
+}  // namespace resdb
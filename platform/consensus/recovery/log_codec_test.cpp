@@ -0,0 +1,75 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "platform/consensus/recovery/log_codec.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace resdb {
+namespace {
+
+const std::vector<ResConfigData::RecoveryCodec> codecs = {
+    ResConfigData::CODEC_NONE, ResConfigData::CODEC_SNAPPY,
+    ResConfigData::CODEC_ZLIB};
+
+TEST(LogCodecTest, CompressAndUncompress) {
+  std::string data;
+  for (int i = 0; i < 1000; ++i) {
+    data += "key_" + std::to_string(i) + "_value_" + std::to_string(i % 7);
+  }
+  for (ResConfigData::RecoveryCodec codec : codecs) {
+    for (const std::string& block : {std::string(), data}) {
+      std::string compressed, uncompressed;
+      ASSERT_TRUE(CompressLogBlock(codec, block, &compressed));
+      ASSERT_TRUE(UncompressLogBlock(compressed, &uncompressed));
+      EXPECT_EQ(uncompressed, block);
+    }
+  }
+}
+
+TEST(LogCodecTest, KeepIncompressibleData) {
+  std::string data;
+  for (int i = 0; i < 1000; ++i) {
+    data.push_back(static_cast<char>(rand()));
+  }
+  for (ResConfigData::RecoveryCodec codec : codecs) {
+    std::string compressed, uncompressed;
+    ASSERT_TRUE(CompressLogBlock(codec, data, &compressed));
+    EXPECT_EQ(compressed[0], ResConfigData::CODEC_NONE);
+    EXPECT_EQ(compressed.size(), data.size() + 1 + sizeof(size_t));
+    ASSERT_TRUE(UncompressLogBlock(compressed, &uncompressed));
+    EXPECT_EQ(uncompressed, data);
+  }
+}
+
+TEST(LogCodecTest, BrokenData) {
+  std::string data(1000, 'a');
+  for (ResConfigData::RecoveryCodec codec : codecs) {
+    std::string compressed, uncompressed;
+    ASSERT_TRUE(CompressLogBlock(codec, data, &compressed));
+    EXPECT_FALSE(UncompressLogBlock(compressed.substr(0, 4), &uncompressed));
+    EXPECT_FALSE(UncompressLogBlock(compressed.substr(0, compressed.size() - 1),
+                                    &uncompressed));
+  }
+}
+
+}  // namespace
+}  // namespace resdb
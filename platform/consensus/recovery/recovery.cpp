@@ -22,18 +22,74 @@
 #include <fcntl.h>
 #include <glog/logging.h>
 #include <stdio.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <condition_variable>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <limits>
 
+#include "common/utils/crc32c.h"
 #include "common/utils/utils.h"
+#include "platform/consensus/recovery/log_codec.h"
 
 namespace resdb {
 
+namespace {
+
+// The number of records covered by each index entry.
+constexpr int64_t kIndexInterval = 64;
+// The number of blocks decoded ahead of the replay callback.
+constexpr size_t kReplayWindow = 1024;
+// The length which starts the index footer so that the readers stop there.
+constexpr size_t kIndexMarker = std::numeric_limits<size_t>::max();
+// The footer ends with its offset and the magic.
+constexpr uint64_t kIndexMagic = 0x5245534442494458;
+
+// The files start with the header and each block is written as its length,
+// the CRC32C of the length and the data, and then the data. The files
+// written before the header have no checksums. The blocks of the version 2
+// files are compressed by CompressLogBlock.
+constexpr uint64_t kSegmentMagic = 0x5245534442574c31;
+constexpr uint32_t kSegmentVersion = 2;
+constexpr uint32_t kCompressedSegmentVersion = 2;
+
+struct SegmentHeader {
+  uint64_t magic = kSegmentMagic;
+  uint32_t version = 1;
+  // The codec of the blocks written when the file was created.
+  uint32_t codec = ResConfigData::CODEC_NONE;
+};
+
+uint32_t GetBlockCrc(const char* data, size_t len) {
+  return ExtendCrc32c(Crc32c(reinterpret_cast<const char*>(&len), sizeof(len)),
+                      data, len);
+}
+
+// Return the size of the block with a checksum at pos, or 0 if there is no
+// valid one.
+size_t GetValidBlockSize(std::string_view data, size_t pos) {
+  size_t prefix_len = sizeof(size_t) + sizeof(uint32_t);
+  if (pos + prefix_len > data.size()) {
+    return 0;
+  }
+  size_t len;
+  uint32_t crc;
+  memcpy(&len, data.data() + pos, sizeof(len));
+  memcpy(&crc, data.data() + pos + sizeof(len), sizeof(crc));
+  if (len > data.size() - pos - prefix_len ||
+      crc != GetBlockCrc(data.data() + pos + prefix_len, len)) {
+    return 0;
+  }
+  return prefix_len + len;
+}
+
+}  // namespace
+
 Recovery::Recovery(const ResDBConfig& config, CheckPoint* checkpoint,
                    SystemInfo* system_info, Storage* storage)
     : config_(config),
@@ -67,6 +123,13 @@ Recovery::Recovery(const ResDBConfig& config, CheckPoint* checkpoint,
   LOG(INFO) << "file path:" << file_path_
             << " dir:" << std::filesystem::path(file_path_).parent_path();
 
+  codec_ = config_.GetConfigData().recovery_codec();
+  replay_thread_num_ = config_.GetConfigData().recovery_replay_thread_num();
+  if (replay_thread_num_ <= 0) {
+    replay_thread_num_ =
+        std::min(8, std::max(1, (int)std::thread::hardware_concurrency()));
+  }
+
   recovery_ckpt_time_s_ = config_.GetConfigData().recovery_ckpt_time_s();
   if (recovery_ckpt_time_s_ == 0) {
     recovery_ckpt_time_s_ = 60;
@@ -106,6 +169,8 @@ Recovery::~Recovery() {
 
 int64_t Recovery::GetMaxSeq() { return max_seq_; }
 
+bool Recovery::IsEnabled() const { return recovery_enabled_; }
+
 int64_t Recovery::GetMinSeq() { return min_seq_; }
 
 void Recovery::UpdateStableCheckPoint() {
@@ -184,6 +249,10 @@ void Recovery::FinishFile(int64_t seq) {
     }
   }
   std::string new_file_path = GenerateFile(seq, min_seq_, max_seq_);
+  if (index_chunk_.num > 0) {
+    index_.push_back(index_chunk_);
+  }
+  WriteIndex(fd_, file_offset_, index_);
   close(fd_);
 
   min_seq_ = -1;
@@ -204,16 +273,32 @@ void Recovery::SwitchFile(const std::string& file_path) {
   min_seq_ = -1;
   max_seq_ = -1;
 
-  ReadLogsFromFiles(
+  std::vector<IndexEntry> index;
+  int64_t end = ReadLogsFromFiles(
       file_path, 0, 0, [&](const SystemInfoData& data) {},
       [&](std::unique_ptr<Context> context, std::unique_ptr<Request> request) {
         min_seq_ == -1
             ? min_seq_ = request->seq()
             : std::min(min_seq_, static_cast<int64_t>(request->seq()));
         max_seq_ = std::max(max_seq_, static_cast<int64_t>(request->seq()));
-      });
+      },
+      &index);
+
+  // Drop the broken tail or the index footer left by a crash before
+  // appending the new records.
+  std::error_code ec;
+  int64_t size = std::filesystem::file_size(file_path, ec);
+  if (!ec && end >= 0 && end < size) {
+    LOG(ERROR) << "truncate file:" << file_path << " offset:" << end
+               << " bytes dropped:" << size - end;
+    if (truncate(file_path.c_str(), end)) {
+      LOG(ERROR) << "truncate file fail:" << file_path
+                 << " error:" << strerror(errno);
+    }
+  }
 
   OpenFile(file_path);
+  index_ = index;
   LOG(INFO) << "switch to file:" << file_path << " seq:"
             << "[" << min_seq_ << "," << max_seq_ << "]";
 }
@@ -222,7 +307,7 @@ void Recovery::OpenFile(const std::string& path) {
   if (fd_ >= 0) {
     close(fd_);
   }
-  fd_ = open(path.c_str(), O_CREAT | O_WRONLY, 0666);
+  fd_ = open(path.c_str(), O_CREAT | O_RDWR, 0666);
   if (fd_ < 0) {
     LOG(ERROR) << "open file fail:" << path << " error:" << strerror(errno);
   }
@@ -231,10 +316,23 @@ void Recovery::OpenFile(const std::string& path) {
   LOG(INFO) << "file path:" << path << " len:" << pos << " fd:" << fd_;
 
   if (pos == 0) {
+    SegmentHeader header;
+    if (codec_ != ResConfigData::CODEC_NONE) {
+      header.version = kCompressedSegmentVersion;
+      header.codec = codec_;
+    }
+    Write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file_format_.has_checksum = true;
+    file_format_.compressed = header.version >= kCompressedSegmentVersion;
     WriteSystemInfo();
+  } else {
+    // Keep the format the file was created with.
+    file_format_ = GetFileFormat(fd_);
   }
 
-  lseek(fd_, 0, SEEK_END);
+  file_offset_ = lseek(fd_, 0, SEEK_END);
+  index_.clear();
+  index_chunk_ = IndexEntry();
   LOG(ERROR) << "open file:" << path << " pos:" << lseek(fd_, 0, SEEK_CUR)
              << " fd:" << fd_;
   assert(fd_ >= 0);
@@ -264,6 +362,8 @@ void Recovery::AddRequest(const Context* context, const Request* request) {
     case Request::TYPE_PREPARE:
     case Request::TYPE_COMMIT:
     case Request::TYPE_NEWVIEW:
+    // The messages of the protocols built on ProtocolBase, which set the seq.
+    case Request::TYPE_CUSTOM_CONSENSUS:
       return WriteLog(context, request);
     default:
       break;
@@ -286,10 +386,241 @@ void Recovery::WriteLog(const Context* context, const Request* request) {
                  ? request->seq()
                  : std::min(min_seq_, static_cast<int64_t>(request->seq()));
   max_seq_ = std::max(max_seq_, static_cast<int64_t>(request->seq()));
+  int64_t offset = file_offset_;
   AppendData(data);
   AppendData(sig);
 
   Flush();
+  AddIndex(request->seq(), offset, file_offset_, &index_chunk_, &index_);
+}
+
+void Recovery::AddIndex(int64_t seq, int64_t offset, int64_t end,
+                        IndexEntry* chunk, std::vector<IndexEntry>* index) {
+  if (chunk->num == 0) {
+    chunk->offset = offset;
+    chunk->min_seq = seq;
+    chunk->max_seq = seq;
+  }
+  chunk->min_seq = std::min(chunk->min_seq, seq);
+  chunk->max_seq = std::max(chunk->max_seq, seq);
+  chunk->end = end;
+  if (++chunk->num >= kIndexInterval) {
+    index->push_back(*chunk);
+    *chunk = IndexEntry();
+  }
+}
+
+bool Recovery::WriteIndex(int fd, int64_t offset,
+                          const std::vector<IndexEntry>& index) {
+  std::string footer;
+  footer.append(reinterpret_cast<const char*>(&kIndexMarker),
+                sizeof(kIndexMarker));
+  for (const IndexEntry& entry : index) {
+    footer.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+  }
+  footer.append(reinterpret_cast<const char*>(&offset), sizeof(offset));
+  footer.append(reinterpret_cast<const char*>(&kIndexMagic),
+                sizeof(kIndexMagic));
+
+  size_t pos = 0;
+  while (pos < footer.size()) {
+    int ret = pwrite(fd, footer.c_str() + pos, footer.size() - pos,
+                     offset + pos);
+    if (ret <= 0) {
+      LOG(ERROR) << "write index fail:" << strerror(errno);
+      return false;
+    }
+    pos += ret;
+  }
+  fsync(fd);
+  return true;
+}
+
+bool Recovery::LoadIndex(int fd, std::vector<IndexEntry>* index) {
+  int64_t size = lseek(fd, 0, SEEK_END);
+  int64_t offset = 0;
+  uint64_t magic = 0;
+  int64_t trailer_size = sizeof(offset) + sizeof(magic);
+  if (size < trailer_size) {
+    return false;
+  }
+  lseek(fd, size - trailer_size, SEEK_SET);
+  if (!Read(fd, sizeof(offset), reinterpret_cast<char*>(&offset)) ||
+      !Read(fd, sizeof(magic), reinterpret_cast<char*>(&magic)) ||
+      magic != kIndexMagic) {
+    return false;
+  }
+  int64_t entry_start = offset + sizeof(kIndexMarker);
+  if (offset < 0 || entry_start > size - trailer_size ||
+      (size - trailer_size - entry_start) % sizeof(IndexEntry) != 0) {
+    return false;
+  }
+  index->resize((size - trailer_size - entry_start) / sizeof(IndexEntry));
+  lseek(fd, entry_start, SEEK_SET);
+  if (!Read(fd, index->size() * sizeof(IndexEntry),
+            reinterpret_cast<char*>(index->data()))) {
+    index->clear();
+    return false;
+  }
+  return true;
+}
+
+std::vector<Recovery::IndexEntry> Recovery::GetIndex(const std::string& path) {
+  {
+    std::unique_lock<std::mutex> lk(mutex_);
+    if (path == file_path_) {
+      std::vector<IndexEntry> index = index_;
+      if (index_chunk_.num > 0) {
+        index.push_back(index_chunk_);
+      }
+      return index;
+    }
+  }
+
+  std::unique_lock<std::mutex> lk(index_mutex_);
+  std::vector<IndexEntry> index;
+  int fd = open(path.c_str(), O_RDWR);
+  if (fd < 0) {
+    LOG(ERROR) << "open file fail:" << path << " error:" << strerror(errno);
+    return index;
+  }
+  if (!LoadIndex(fd, &index)) {
+    index.clear();
+    int64_t end = ReadLogsFromFiles(
+        path, 0, 0, [&](const SystemInfoData& data) {},
+        [&](std::unique_ptr<Context> context,
+            std::unique_ptr<Request> request) {},
+        &index);
+    LOG(INFO) << "rebuild index:" << path << " entries:" << index.size();
+    // Only save the index if all the records are valid.
+    if (end == lseek(fd, 0, SEEK_END)) {
+      WriteIndex(fd, end, index);
+    }
+  }
+  close(fd);
+  return index;
+}
+
+std::vector<std::unique_ptr<Recovery::RecoveryData>> Recovery::ReadRange(
+    const std::string& path, int fd, int64_t offset, int64_t end,
+    const FileFormat& format) {
+  std::vector<std::unique_ptr<RecoveryData>> request_list;
+  std::string data(end - offset, 0);
+  lseek(fd, offset, SEEK_SET);
+  if (!Read(fd, data.size(), data.data())) {
+    LOG(ERROR) << "read data fail, offset:" << offset << " end:" << end;
+    return request_list;
+  }
+
+  for (const LogBlock& block : SplitBlocks(path, data, offset, format)) {
+    std::string buffer;
+    std::string_view block_data;
+    if (!GetBlockData(block, &buffer, &block_data)) {
+      LOG(ERROR) << "block is corrupted, offset:" << block.offset;
+      continue;
+    }
+    for (auto& recovery_data : ParseData(block_data)) {
+      request_list.push_back(std::move(recovery_data));
+    }
+  }
+  return request_list;
+}
+
+int64_t Recovery::ParseFileFormat(std::string_view data, FileFormat* format) {
+  *format = FileFormat();
+  SegmentHeader header;
+  if (data.size() < sizeof(header)) {
+    return 0;
+  }
+  memcpy(&header, data.data(), sizeof(header));
+  if (header.magic != kSegmentMagic) {
+    return 0;
+  }
+  if (header.version > kSegmentVersion) {
+    LOG(ERROR) << "unsupported log version:" << header.version;
+    return -1;
+  }
+  format->has_checksum = true;
+  format->compressed = header.version >= kCompressedSegmentVersion;
+  return sizeof(header);
+}
+
+Recovery::FileFormat Recovery::GetFileFormat(int fd) {
+  std::string data(sizeof(SegmentHeader), 0);
+  FileFormat format;
+  if (pread(fd, data.data(), data.size(), 0) ==
+      static_cast<ssize_t>(data.size())) {
+    ParseFileFormat(data, &format);
+  }
+  return format;
+}
+
+bool Recovery::GetBlockData(const LogBlock& block, std::string* buffer,
+                            std::string_view* data) {
+  if (block.corrupted) {
+    return false;
+  }
+  if (!block.compressed) {
+    *data = block.data;
+    return true;
+  }
+  if (!UncompressLogBlock(block.data, buffer)) {
+    return false;
+  }
+  *data = *buffer;
+  return true;
+}
+
+std::vector<Recovery::LogBlock> Recovery::SplitBlocks(
+    const std::string& path, std::string_view data, int64_t offset,
+    const FileFormat& format) {
+  std::vector<LogBlock> blocks;
+  size_t prefix_len =
+      sizeof(size_t) + (format.has_checksum ? sizeof(uint32_t) : 0);
+  size_t pos = 0;
+  while (pos + prefix_len <= data.size()) {
+    size_t len;
+    memcpy(&len, data.data() + pos, sizeof(len));
+    if (len == kIndexMarker) {
+      break;
+    }
+    if (!format.has_checksum) {
+      if (len > data.size() - pos - prefix_len) {
+        LOG(ERROR) << "bad block length in:" << path
+                   << " offset:" << offset + pos
+                   << " bytes dropped:" << data.size() - pos;
+        break;
+      }
+    } else if (GetValidBlockSize(data, pos) == 0) {
+      // Go on from the next valid block, or the index footer.
+      size_t next = pos + 1;
+      while (next + prefix_len <= data.size() &&
+             GetValidBlockSize(data, next) == 0 &&
+             memcmp(data.data() + next, &kIndexMarker, sizeof(len)) != 0) {
+        ++next;
+      }
+      if (next + prefix_len > data.size()) {
+        next = data.size();
+      }
+      LOG(ERROR) << "corrupted block in:" << path << " offset:" << offset + pos
+                 << " bytes dropped:" << next - pos;
+      LogBlock block;
+      block.offset = offset + pos;
+      block.end = offset + next;
+      block.corrupted = true;
+      blocks.push_back(block);
+      pos = next;
+      continue;
+    }
+    LogBlock block;
+    block.offset = offset + pos;
+    block.end = block.offset + prefix_len + len;
+    block.data = data.substr(pos + prefix_len, len);
+    block.compressed = format.compressed;
+    blocks.push_back(block);
+    pos += prefix_len + len;
+  }
+  return blocks;
 }
 
 void Recovery::AppendData(const std::string& data) {
@@ -299,33 +630,38 @@ void Recovery::AppendData(const std::string& data) {
 }
 
 std::vector<std::unique_ptr<Recovery::RecoveryData>> Recovery::ParseData(
-    const std::string& data) {
+    std::string_view data) {
   std::vector<std::unique_ptr<RecoveryData>> request_list;
 
-  std::vector<std::string> data_list;
-  int pos = 0;
-  while (pos < data.size()) {
+  std::vector<std::string_view> data_list;
+  size_t pos = 0;
+  while (pos + sizeof(size_t) <= data.size()) {
     size_t len;
-    memcpy(&len, data.c_str() + pos, sizeof(len));
+    memcpy(&len, data.data() + pos, sizeof(len));
     pos += sizeof(len);
+    if (len > data.size() - pos) {
+      LOG(ERROR) << "data is truncated, len:" << len;
+      return {};
+    }
 
-    std::string item = data.substr(pos, len);
+    data_list.push_back(data.substr(pos, len));
     pos += len;
-    data_list.push_back(item);
   }
 
-  for (size_t i = 0; i < data_list.size(); i += 2) {
+  for (size_t i = 0; i + 1 < data_list.size(); i += 2) {
     std::unique_ptr<RecoveryData> recovery_data =
         std::make_unique<RecoveryData>();
     recovery_data->request = std::make_unique<Request>();
     recovery_data->context = std::make_unique<Context>();
 
-    if (!recovery_data->request->ParseFromString(data_list[i])) {
+    if (!recovery_data->request->ParseFromArray(data_list[i].data(),
+                                                data_list[i].size())) {
       LOG(ERROR) << "Parse from data fail";
       break;
     }
 
-    if (!recovery_data->context->signature.ParseFromString(data_list[i + 1])) {
+    if (!recovery_data->context->signature.ParseFromArray(
+            data_list[i + 1].data(), data_list[i + 1].size())) {
       LOG(ERROR) << "Parse from data fail";
       break;
     }
@@ -357,13 +693,28 @@ void Recovery::MayFlush() {
 }
 
 void Recovery::Flush() {
-  size_t len = buffer_.size();
-  if (len == 0) {
+  if (buffer_.empty()) {
     return;
   }
 
+  std::string compressed;
+  if (file_format_.compressed) {
+    if (!CompressLogBlock(codec_, buffer_, &compressed)) {
+      CompressLogBlock(ResConfigData::CODEC_NONE, buffer_, &compressed);
+    }
+    buffer_.swap(compressed);
+  }
+
+  size_t len = buffer_.size();
   Write(reinterpret_cast<const char*>(&len), sizeof(len));
+  file_offset_ += sizeof(len);
+  if (file_format_.has_checksum) {
+    uint32_t crc = GetBlockCrc(buffer_.c_str(), len);
+    Write(reinterpret_cast<const char*>(&crc), sizeof(crc));
+    file_offset_ += sizeof(crc);
+  }
   Write(reinterpret_cast<const char*>(buffer_.c_str()), len);
+  file_offset_ += len;
   buffer_.clear();
   fsync(fd_);
 }
@@ -468,83 +819,203 @@ void Recovery::ReadLogs(
   }
 }
 
-void Recovery::ReadLogsFromFiles(
+int64_t Recovery::ReadLogsFromFiles(
     const std::string& path, int64_t ckpt, int file_idx,
     std::function<void(const SystemInfoData& data)> system_callback,
     std::function<void(std::unique_ptr<Context> context,
                        std::unique_ptr<Request> request)>
-        call_back) {
+        call_back,
+    std::vector<IndexEntry>* index) {
   int fd = open(path.c_str(), O_CREAT | O_RDONLY, 0666);
   if (fd < 0) {
     LOG(ERROR) << " open file fail:" << path;
+    return -1;
+  }
+  int64_t size = lseek(fd, 0, SEEK_END);
+  LOG(INFO) << "read logs:" << path << " size:" << size;
+  if (size <= 0) {
+    close(fd);
+    return 0;
   }
-  LOG(INFO) << "read logs:" << path << " pos:" << lseek(fd, 0, SEEK_CUR);
-  assert(fd >= 0);
 
-  size_t data_len = 0;
-  Read(fd, sizeof(data_len), reinterpret_cast<char*>(&data_len));
-  {
-    std::string data;
-    char* buf = new char[data_len];
-    if (!Read(fd, data_len, buf)) {
-      LOG(ERROR) << "Read system info fail";
-      return;
-    }
-    data = std::string(buf, data_len);
-    delete buf;
-    std::vector<std::string> data_list = ParseRawData(data);
+  void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    LOG(ERROR) << "mmap file fail:" << path << " error:" << strerror(errno);
+    return -1;
+  }
+  madvise(addr, size, MADV_SEQUENTIAL);
+  std::string_view file_data(static_cast<const char*>(addr), size);
+
+  FileFormat format;
+  int64_t start = ParseFileFormat(file_data, &format);
+  if (start < 0) {
+    LOG(ERROR) << "unsupported log file:" << path;
+    munmap(addr, size);
+    return -1;
+  }
 
-    SystemInfoData info;
-    if (data_list.empty() || !info.ParseFromString(data_list[0])) {
-      LOG(ERROR) << "parse info fail:" << data.size();
-      return;
+  std::vector<LogBlock> blocks =
+      SplitBlocks(path, file_data.substr(start), start, format);
+
+  // A file without any valid block is written again from the start.
+  int64_t end = 0;
+  if (!blocks.empty()) {
+    const LogBlock& block = blocks[0];
+    std::string buffer;
+    std::string_view block_data;
+    if (!GetBlockData(block, &buffer, &block_data)) {
+      if (blocks.size() > 1) {
+        LOG(ERROR) << "system info is corrupted:" << path;
+        end = ReplayBlocks(blocks, ckpt, call_back, index);
+      }
+    } else {
+      end = block.end;
+      std::vector<std::string> data_list =
+          ParseRawData(std::string(block_data));
+      SystemInfoData info;
+      if (data_list.empty() || !info.ParseFromString(data_list[0])) {
+        LOG(ERROR) << "parse info fail:" << block.data.size();
+      } else {
+        LOG(ERROR) << "read system info:" << info.DebugString();
+        system_callback(info);
+        end = ReplayBlocks(blocks, ckpt, call_back, index);
+      }
     }
-    LOG(ERROR) << "read system info:" << info.DebugString();
-    system_callback(info);
   }
+  munmap(addr, size);
 
-  std::vector<std::unique_ptr<RecoveryData>> request_list;
+  LOG(ERROR) << "read log from files:" << path << " done"
+             << " valid end:" << end << " size:" << size;
+  return end;
+}
 
-  while (Read(fd, sizeof(data_len), reinterpret_cast<char*>(&data_len))) {
-    std::string data;
-    char* buf = new char[data_len];
-    if (!Read(fd, data_len, buf)) {
-      LOG(ERROR) << "Read data log fail";
-      break;
+int64_t Recovery::ReplayBlocks(
+    const std::vector<LogBlock>& blocks,
+    int64_t ckpt,
+    std::function<void(std::unique_ptr<Context> context,
+                       std::unique_ptr<Request> request)>
+        call_back,
+    std::vector<IndexEntry>* index) {
+  // The blocks are decoded by the workers into a ring of kReplayWindow slots
+  // and handed to the callback in order. The first block is the system info.
+  struct Slot {
+    bool done = false;
+    bool corrupted = false;
+    std::vector<std::unique_ptr<RecoveryData>> list;
+  };
+  std::vector<Slot> slots(kReplayWindow);
+  std::mutex mutex;
+  std::condition_variable decoded, consumed;
+  size_t next = 1, delivered = 1;
+  bool stop = false;
+
+  auto decode = [&]() {
+    while (true) {
+      size_t idx;
+      {
+        std::unique_lock<std::mutex> lk(mutex);
+        consumed.wait(lk, [&] {
+          return stop || next >= blocks.size() ||
+                 next < delivered + kReplayWindow;
+        });
+        if (stop || next >= blocks.size()) {
+          return;
+        }
+        idx = next++;
+      }
+      std::string buffer;
+      std::string_view data;
+      bool corrupted = !GetBlockData(blocks[idx], &buffer, &data);
+      std::vector<std::unique_ptr<RecoveryData>> list;
+      if (!corrupted) {
+        list = ParseData(data);
+      }
+      {
+        std::unique_lock<std::mutex> lk(mutex);
+        slots[idx % kReplayWindow].list = std::move(list);
+        slots[idx % kReplayWindow].corrupted = corrupted;
+        slots[idx % kReplayWindow].done = true;
+      }
+      decoded.notify_all();
     }
-    data = std::string(buf, data_len);
-    delete buf;
+  };
 
-    std::vector<std::unique_ptr<RecoveryData>> list = ParseData(data);
-    if (list.size() == 0) {
-      request_list.clear();
-      break;
-    }
-    for (auto& l : list) {
-      request_list.push_back(std::move(l));
-    }
-  }
-  if (request_list.size() == 0) {
-    ftruncate(fd, 0);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < replay_thread_num_; ++i) {
+    workers.push_back(std::thread(decode));
   }
+
+  IndexEntry chunk;
+  int64_t end = blocks[0].end;
   uint64_t max_seq = 0;
-  for (std::unique_ptr<RecoveryData>& recovery_data : request_list) {
-    // LOG(ERROR)<<" ckpt :"<<ckpt<<" recovery data
-    // seq:"<<recovery_data->request->seq()<<"
-    // type:"<<recovery_data->request->type();
-    if (ckpt < recovery_data->request->seq() ||
-        recovery_data->request->type() == Request::TYPE_NEWVIEW) {
-      recovery_data->request->set_is_recovery(true);
-      max_seq = recovery_data->request->seq();
-      call_back(std::move(recovery_data->context),
-                std::move(recovery_data->request));
+  int corrupted_num = 0;
+  for (size_t i = 1; i < blocks.size(); ++i) {
+    std::vector<std::unique_ptr<RecoveryData>> list;
+    bool corrupted = false;
+    {
+      std::unique_lock<std::mutex> lk(mutex);
+      Slot& slot = slots[i % kReplayWindow];
+      decoded.wait(lk, [&] { return slot.done; });
+      list = std::move(slot.list);
+      corrupted = slot.corrupted;
+      slot.done = false;
+      delivered = i + 1;
+    }
+    consumed.notify_all();
+
+    if (corrupted) {
+      // The last block may be torn by a crash and is dropped. A corrupted
+      // block followed by valid ones is skipped and reported.
+      if (i + 1 == blocks.size()) {
+        LOG(ERROR) << "drop the torn block at offset:" << blocks[i].offset;
+        break;
+      }
+      LOG(ERROR) << "skip the corrupted block at offset:" << blocks[i].offset;
+      corrupted_num++;
+      end = blocks[i].end;
+      continue;
+    }
+    if (list.empty()) {
+      LOG(ERROR) << "skip the block failed to parse at offset:"
+                 << blocks[i].offset;
+      corrupted_num++;
+      end = blocks[i].end;
+      continue;
+    }
+    for (std::unique_ptr<RecoveryData>& recovery_data : list) {
+      if (index) {
+        AddIndex(recovery_data->request->seq(), blocks[i].offset,
+                 blocks[i].end, &chunk, index);
+      }
+      if (ckpt < recovery_data->request->seq() ||
+          recovery_data->request->type() == Request::TYPE_NEWVIEW) {
+        recovery_data->request->set_is_recovery(true);
+        max_seq = recovery_data->request->seq();
+        call_back(std::move(recovery_data->context),
+                  std::move(recovery_data->request));
+      }
     }
+    end = blocks[i].end;
   }
 
-  LOG(ERROR) << "read log from files:" << path << " done"
-             << " recovery max seq:" << max_seq;
+  {
+    std::unique_lock<std::mutex> lk(mutex);
+    stop = true;
+  }
+  consumed.notify_all();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
 
-  close(fd);
+  if (index && chunk.num > 0) {
+    index->push_back(chunk);
+  }
+  if (corrupted_num > 0) {
+    LOG(ERROR) << "found corrupted blocks in the middle:" << corrupted_num;
+  }
+  LOG(ERROR) << "recovery max seq:" << max_seq;
+  return end;
 }
 
 int Recovery::GetData(const RecoveryRequest& request,
@@ -589,39 +1060,50 @@ Recovery::GetDataFromRecoveryFiles(uint64_t need_min_seq,
     int64_t time =
         std::stoll(file_name.substr(time_pos + 1, min_seq_pos - time_pos - 1));
 
-    // LOG(ERROR)<<" min seq:"<<min_seq << " max seq:"<<max_seq<<"
-    // need:"<<need_min_seq<<" "<<need_max_seq;
     if (min_seq == -1) {
       e_list.push_back(std::make_pair(time, entry.path()));
-    } else if (max_seq < need_min_seq || min_seq > need_max_seq) {
+      continue;
+    } else if (max_seq < static_cast<int64_t>(need_min_seq) ||
+               min_seq > static_cast<int64_t>(need_max_seq)) {
       continue;
     }
-    // LOG(ERROR)<<" get min seq:"<<min_seq << " max seq:"<<max_seq<<"
-    // need:"<<need_min_seq<<" "<<need_max_seq;
     list.push_back(std::make_pair(time, entry.path()));
   }
 
+  // Only the latest unfinished file is the current one.
   sort(e_list.begin(), e_list.end());
-  list.push_back(e_list.back());
+  if (!e_list.empty()) {
+    list.push_back(e_list.back());
+  }
   sort(list.begin(), list.end());
 
   std::map<uint64_t, std::vector<std::pair<std::unique_ptr<Context>,
                                            std::unique_ptr<Request>>>>
       res;
   for (const auto& path : list) {
-    ReadLogsFromFiles(
-        path.second, need_min_seq - 1, 0, [&](const SystemInfoData& data) {},
-        [&](std::unique_ptr<Context> context,
-            std::unique_ptr<Request> request) {
-          // LOG(ERROR) << "check get data from recovery file seq:"
-          //           << request->seq();
-          if (request->seq() >= need_min_seq &&
-              request->seq() <= need_max_seq) {
-            LOG(ERROR) << "get data from recovery file seq:" << request->seq();
-            res[request->seq()].push_back(
-                std::make_pair(std::move(context), std::move(request)));
-          }
-        });
+    std::vector<IndexEntry> index = GetIndex(path.second);
+    int fd = open(path.second.c_str(), O_RDONLY);
+    if (fd < 0) {
+      LOG(ERROR) << "open file fail:" << path.second;
+      continue;
+    }
+    FileFormat format = GetFileFormat(fd);
+    for (const IndexEntry& entry : index) {
+      if (entry.max_seq < static_cast<int64_t>(need_min_seq) ||
+          entry.min_seq > static_cast<int64_t>(need_max_seq)) {
+        continue;
+      }
+      for (auto& recovery_data :
+           ReadRange(path.second, fd, entry.offset, entry.end, format)) {
+        uint64_t seq = recovery_data->request->seq();
+        if (seq >= need_min_seq && seq <= need_max_seq) {
+          recovery_data->request->set_is_recovery(true);
+          res[seq].push_back(std::make_pair(std::move(recovery_data->context),
+                                            std::move(recovery_data->request)));
+        }
+      }
+    }
+    close(fd);
   }
 
   return res;
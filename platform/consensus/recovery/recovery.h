@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include <string_view>
 #include <thread>
 
 #include "chain/storage/storage.h"
@@ -48,6 +49,7 @@ class Recovery {
 
   int64_t GetMaxSeq();
   int64_t GetMinSeq();
+  bool IsEnabled() const;
 
   int GetData(const RecoveryRequest& request, RecoveryResponse& response);
 
@@ -61,9 +63,36 @@ class Recovery {
     std::unique_ptr<Request> request;
   };
 
+  // A sparse index entry covering the records in [offset, end) of a log
+  // file. The finished files keep their entries in a footer.
+  struct IndexEntry {
+    int64_t offset = 0;
+    int64_t end = 0;
+    int64_t min_seq = -1;
+    int64_t max_seq = -1;
+    int64_t num = 0;
+  };
+
+  // The format of a log file, which is read from its header.
+  struct FileFormat {
+    bool has_checksum = false;
+    bool compressed = false;
+  };
+
+  // A block of a log file, which is written by one Flush.
+  struct LogBlock {
+    int64_t offset = 0;
+    int64_t end = 0;
+    std::string_view data;
+    // Set for the bytes skipped because the length or the checksum of the
+    // block there does not match.
+    bool corrupted = false;
+    bool compressed = false;
+  };
+
   void WriteLog(const Context* context, const Request* request);
   void AppendData(const std::string& data);
-  std::vector<std::unique_ptr<RecoveryData>> ParseData(const std::string& data);
+  std::vector<std::unique_ptr<RecoveryData>> ParseData(std::string_view data);
   std::vector<std::string> ParseRawData(const std::string& data);
   void Flush();
   void MayFlush();
@@ -82,15 +111,55 @@ class Recovery {
   void UpdateStableCheckPoint();
   std::pair<std::vector<std::pair<int64_t, std::string>>, int64_t>
   GetRecoveryFiles(int64_t ckpt);
-  void ReadLogsFromFiles(
+  // Replay the records of the file after the ckpt from an mmap of the file
+  // and build its index if index is not null. Return the end of the valid
+  // records, or -1 if the file can not be read.
+  int64_t ReadLogsFromFiles(
       const std::string& path, int64_t ckpt, int file_idx,
       std::function<void(const SystemInfoData& data)> system_callback,
       std::function<void(std::unique_ptr<Context> context,
                          std::unique_ptr<Request> request)>
-          call_back);
+          call_back,
+      std::vector<IndexEntry>* index = nullptr);
+  // Decode the blocks on replay_thread_num_ workers and call the callback
+  // in order.
+  int64_t ReplayBlocks(
+      const std::vector<LogBlock>& blocks,
+      int64_t ckpt,
+      std::function<void(std::unique_ptr<Context> context,
+                         std::unique_ptr<Request> request)>
+          call_back,
+      std::vector<IndexEntry>* index);
 
   void InsertCache(const Context& context, const Request& request);
 
+  void AddIndex(int64_t seq, int64_t offset, int64_t end, IndexEntry* chunk,
+                std::vector<IndexEntry>* index);
+  // Write the index footer at the offset of the file.
+  bool WriteIndex(int fd, int64_t offset, const std::vector<IndexEntry>& index);
+  bool LoadIndex(int fd, std::vector<IndexEntry>* index);
+  // Return the index of a log file. The index of a finished file is
+  // rebuilt and saved if it is missing.
+  std::vector<IndexEntry> GetIndex(const std::string& path);
+  std::vector<std::unique_ptr<RecoveryData>> ReadRange(
+      const std::string& path, int fd, int64_t offset, int64_t end,
+      const FileFormat& format);
+  // Read the format from the start of a file. Return the size of its header,
+  // or -1 if the format is not supported.
+  int64_t ParseFileFormat(std::string_view data, FileFormat* format);
+  FileFormat GetFileFormat(int fd);
+  // Split the blocks of the data at the offset of a file, verifying their
+  // checksums. The bytes from a corrupted block to the next valid one are
+  // returned as a corrupted block. Without checksums it stops at the first
+  // bad length. It stops at the index footer.
+  std::vector<LogBlock> SplitBlocks(const std::string& path,
+                                    std::string_view data, int64_t offset,
+                                    const FileFormat& format);
+  // Uncompress the block into the buffer if needed. Return false if the
+  // block is corrupted.
+  bool GetBlockData(const LogBlock& block, std::string* buffer,
+                    std::string_view* data);
+
  protected:
   ResDBConfig config_;
   CheckPoint* checkpoint_;
@@ -100,13 +169,20 @@ class Recovery {
   std::string file_path_, base_file_path_;
   size_t buffer_size_ = 0;
   int fd_;
-  std::mutex mutex_, data_mutex_;
+  std::mutex mutex_, data_mutex_, index_mutex_;
+  // The write offset and the index of the current file.
+  int64_t file_offset_ = 0;
+  FileFormat file_format_;
+  ResConfigData::RecoveryCodec codec_ = ResConfigData::CODEC_NONE;
+  std::vector<IndexEntry> index_;
+  IndexEntry index_chunk_;
 
   int64_t last_ckpt_;
   int64_t min_seq_, max_seq_;
   std::mutex ckpt_mutex_;
   std::atomic<bool> stop_;
   int recovery_ckpt_time_s_;
+  int replay_thread_num_ = 1;
   SystemInfo* system_info_;
   Storage* storage_;
 };
@@ -23,7 +23,9 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <filesystem>
+#include <fstream>
 #include <future>
 
 #include "chain/storage/mock_storage.h"
@@ -36,6 +38,7 @@ namespace {
 
 using ::resdb::testing::EqualsProto;
 using ::testing::Invoke;
+using ::testing::NiceMock;
 using ::testing::Return;
 using ::testing::Test;
 
@@ -68,12 +71,15 @@ class RecoveryTest : public Test {
         system_info_() {
     std::string dir = std::filesystem::path(log_path).parent_path();
     std::filesystem::remove_all(dir);
+    ON_CALL(storage_, Flush).WillByDefault(Return(true));
   }
 
  protected:
   ResDBConfig config_;
   SystemInfo system_info_;
   MockCheckPoint checkpoint_;
+  // Used by the tests that do not check the storage.
+  NiceMock<MockStorage> storage_;
 };
 
 TEST_F(RecoveryTest, ReadLog) {
@@ -81,13 +87,16 @@ TEST_F(RecoveryTest, ReadLog) {
                             Request::TYPE_COMMIT,      Request::TYPE_CHECKPOINT,
                             Request::TYPE_NEWVIEW,     Request::TYPE_NEW_TXNS};
 
+  // The checkpoints and the new transactions are not logged.
   std::vector<int> expected_types = {
-      Request::TYPE_PRE_PREPARE, Request::TYPE_PREPARE, Request::TYPE_COMMIT,
-      Request::TYPE_CHECKPOINT,  Request::TYPE_NEWVIEW,
+      Request::TYPE_PRE_PREPARE,
+      Request::TYPE_PREPARE,
+      Request::TYPE_COMMIT,
+      Request::TYPE_NEWVIEW,
   };
 
   {
-    Recovery recovery(config_, &checkpoint_, &system_info_, nullptr);
+    Recovery recovery(config_, &checkpoint_, &system_info_, &storage_);
 
     for (int t : types) {
       std::unique_ptr<Request> request =
@@ -98,14 +107,14 @@ TEST_F(RecoveryTest, ReadLog) {
   }
   {
     std::vector<Request> list;
-    Recovery recovery(config_, &checkpoint_, &system_info_, nullptr);
+    Recovery recovery(config_, &checkpoint_, &system_info_, &storage_);
     recovery.ReadLogs(
         [&](const SystemInfoData &data) {},
         [&](std::unique_ptr<Context> context,
             std::unique_ptr<Request> request) { list.push_back(*request); },
         nullptr);
 
-    EXPECT_EQ(list.size(), expected_types.size());
+    ASSERT_EQ(list.size(), expected_types.size());
 
     for (size_t i = 0; i < expected_types.size(); ++i) {
       EXPECT_EQ(list[i].type(), expected_types[i]);
@@ -121,13 +130,16 @@ TEST_F(RecoveryTest, ReadLog_FlushOnce) {
                             Request::TYPE_COMMIT,      Request::TYPE_CHECKPOINT,
                             Request::TYPE_NEWVIEW,     Request::TYPE_NEW_TXNS};
 
+  // The checkpoints and the new transactions are not logged.
   std::vector<int> expected_types = {
-      Request::TYPE_PRE_PREPARE, Request::TYPE_PREPARE, Request::TYPE_COMMIT,
-      Request::TYPE_CHECKPOINT,  Request::TYPE_NEWVIEW,
+      Request::TYPE_PRE_PREPARE,
+      Request::TYPE_PREPARE,
+      Request::TYPE_COMMIT,
+      Request::TYPE_NEWVIEW,
   };
 
   {
-    Recovery recovery(config, &checkpoint_, &system_info_, nullptr);
+    Recovery recovery(config, &checkpoint_, &system_info_, &storage_);
 
     for (int t : types) {
       std::unique_ptr<Request> request =
@@ -138,7 +150,7 @@ TEST_F(RecoveryTest, ReadLog_FlushOnce) {
   }
   {
     std::vector<Request> list;
-    Recovery recovery(config, &checkpoint_, &system_info_, nullptr);
+    Recovery recovery(config, &checkpoint_, &system_info_, &storage_);
     recovery.ReadLogs([&](const SystemInfoData &data) {},
                       [&](std::unique_ptr<Context> context,
                           std::unique_ptr<Request> request) {
@@ -147,7 +159,7 @@ TEST_F(RecoveryTest, ReadLog_FlushOnce) {
                       },
                       nullptr);
 
-    EXPECT_EQ(list.size(), expected_types.size());
+    ASSERT_EQ(list.size(), expected_types.size());
 
     for (size_t i = 0; i < expected_types.size(); ++i) {
       EXPECT_EQ(list[i].type(), expected_types[i]);
@@ -180,7 +192,7 @@ TEST_F(RecoveryTest, CheckPoint) {
   }));
 
   {
-    Recovery recovery(config, &checkpoint_, &system_info_, nullptr);
+    Recovery recovery(config, &checkpoint_, &system_info_, &storage_);
 
     for (int i = 1; i < 10; ++i) {
       for (int t : types) {
@@ -205,7 +217,7 @@ TEST_F(RecoveryTest, CheckPoint) {
   EXPECT_EQ(log_list.size(), 2);
   {
     std::vector<Request> list;
-    Recovery recovery(config, &checkpoint_, &system_info_, nullptr);
+    Recovery recovery(config, &checkpoint_, &system_info_, &storage_);
     recovery.ReadLogs([&](const SystemInfoData &data) {},
                       [&](std::unique_ptr<Context> context,
                           std::unique_ptr<Request> request) {
@@ -340,6 +352,424 @@ TEST_F(RecoveryTest, CheckPoint2) {
   }
 }
 
+TEST_F(RecoveryTest, GetDataWithIndex) {
+  ResDBConfig config(GetConfigData(1024), ReplicaInfo(), KeyInfo(),
+                     CertificateInfo());
+  MockStorage storage;
+  EXPECT_CALL(storage, Flush).WillRepeatedly(Return(true));
+
+  std::vector<int> types = {Request::TYPE_PRE_PREPARE, Request::TYPE_PREPARE,
+                            Request::TYPE_COMMIT};
+
+  std::promise<bool> insert_done, ckpt;
+  std::future<bool> insert_done_future = insert_done.get_future(),
+                    ckpt_future = ckpt.get_future();
+  int time = 1;
+  EXPECT_CALL(checkpoint_, GetStableCheckpoint()).WillRepeatedly(Invoke([&]() {
+    if (time == 1) {
+      insert_done_future.get();
+    } else if (time == 2) {
+      ckpt.set_value(true);
+    }
+    time++;
+    return 200;
+  }));
+
+  auto add_requests = [&](Recovery *recovery, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      for (int t : types) {
+        std::unique_ptr<Request> request =
+            NewRequest(static_cast<resdb::Request_Type>(t), Request(), i);
+        request->set_seq(i);
+        recovery->AddRequest(nullptr, request.get());
+      }
+    }
+  };
+
+  auto check_data = [&](Recovery *recovery) {
+    auto res = recovery->GetDataFromRecoveryFiles(150, 205);
+    EXPECT_EQ(res.size(), 56);
+    for (uint64_t seq = 150; seq <= 205; ++seq) {
+      ASSERT_EQ(res[seq].size(), types.size());
+      for (size_t i = 0; i < types.size(); ++i) {
+        EXPECT_EQ(res[seq][i].second->seq(), seq);
+        EXPECT_EQ(res[seq][i].second->type(), types[i]);
+      }
+    }
+  };
+
+  {
+    Recovery recovery(config, &checkpoint_, &system_info_, &storage);
+    add_requests(&recovery, 1, 201);
+    insert_done.set_value(true);
+    ckpt_future.get();
+    add_requests(&recovery, 201, 211);
+    check_data(&recovery);
+  }
+
+  std::string finished_file;
+  for (const std::string &path : Listlogs(log_path)) {
+    if (path.find("_-1_-1_") == std::string::npos) {
+      finished_file = path;
+    }
+  }
+  ASSERT_FALSE(finished_file.empty());
+
+  // Drop the index footer of the finished file and it will be rebuilt.
+  size_t file_size = std::filesystem::file_size(finished_file);
+  int64_t footer_offset = 0;
+  {
+    std::ifstream file(finished_file, std::ios::binary);
+    file.seekg(file_size - sizeof(int64_t) - sizeof(uint64_t));
+    file.read(reinterpret_cast<char *>(&footer_offset), sizeof(footer_offset));
+  }
+  ASSERT_GT(footer_offset, 0);
+  ASSERT_LT(footer_offset, file_size);
+  std::filesystem::resize_file(finished_file, footer_offset);
+
+  {
+    Recovery recovery(config, &checkpoint_, &system_info_, &storage);
+    check_data(&recovery);
+    EXPECT_EQ(std::filesystem::file_size(finished_file), file_size);
+    check_data(&recovery);
+  }
+}
+
+TEST_F(RecoveryTest, ReadLogsInOrderWithTornTail) {
+  ResConfigData config_data = GetConfigData(1024);
+  config_data.set_recovery_replay_thread_num(4);
+  ResDBConfig config(config_data, ReplicaInfo(), KeyInfo(), CertificateInfo());
+  MockStorage storage;
+  EXPECT_CALL(checkpoint_, GetStableCheckpoint()).WillRepeatedly(Return(0));
+
+  auto add_requests = [&](Recovery *recovery, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      std::unique_ptr<Request> request =
+          NewRequest(Request::TYPE_PRE_PREPARE, Request(), i);
+      request->set_seq(i);
+      recovery->AddRequest(nullptr, request.get());
+    }
+  };
+
+  auto read_logs = [&](Recovery *recovery) {
+    std::vector<uint64_t> seqs;
+    recovery->ReadLogs([&](const SystemInfoData &data) {},
+                       [&](std::unique_ptr<Context> context,
+                           std::unique_ptr<Request> request) {
+                         seqs.push_back(request->seq());
+                       },
+                       nullptr);
+    return seqs;
+  };
+
+  {
+    Recovery recovery(config, &checkpoint_, &system_info_, &storage);
+    add_requests(&recovery, 1, 3001);
+  }
+
+  // Append a block which is not fully written.
+  std::vector<std::string> log_list = Listlogs(log_path);
+  ASSERT_EQ(log_list.size(), 1);
+  {
+    std::ofstream file(log_list[0], std::ios::binary | std::ios::app);
+    size_t len = 100;
+    file.write(reinterpret_cast<const char *>(&len), sizeof(len));
+    file.write("torn", 4);
+  }
+
+  {
+    Recovery recovery(config, &checkpoint_, &system_info_, &storage);
+    std::vector<uint64_t> seqs = read_logs(&recovery);
+    ASSERT_EQ(seqs.size(), 3000);
+    for (size_t i = 0; i < seqs.size(); ++i) {
+      EXPECT_EQ(seqs[i], i + 1);
+    }
+    add_requests(&recovery, 3001, 3002);
+  }
+
+  {
+    Recovery recovery(config, &checkpoint_, &system_info_, &storage);
+    std::vector<uint64_t> seqs = read_logs(&recovery);
+    ASSERT_EQ(seqs.size(), 3001);
+    EXPECT_EQ(seqs.back(), 3001);
+  }
+}
+
+TEST_F(RecoveryTest, ChecksumMismatch) {
+  ResDBConfig config(GetConfigData(1024), ReplicaInfo(), KeyInfo(),
+                     CertificateInfo());
+  MockStorage storage;
+  EXPECT_CALL(checkpoint_, GetStableCheckpoint()).WillRepeatedly(Return(0));
+
+  auto add_requests = [&](Recovery *recovery, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      std::unique_ptr<Request> request =
+          NewRequest(Request::TYPE_PRE_PREPARE, Request(), i);
+      request->set_seq(i);
+      request->set_data("payload_" + std::to_string(i) + "_");
+      recovery->AddRequest(nullptr, request.get());
+    }
+  };
+
+  auto read_logs = [&]() {
+    std::vector<uint64_t> seqs;
+    Recovery recovery(config, &checkpoint_, &system_info_, &storage);
+    recovery.ReadLogs([&](const SystemInfoData &data) {},
+                      [&](std::unique_ptr<Context> context,
+                          std::unique_ptr<Request> request) {
+                        seqs.push_back(request->seq());
+                      },
+                      nullptr);
+    return seqs;
+  };
+
+  auto corrupt = [&](const std::string &path, int seq) {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    std::string data((std::istreambuf_iterator<char>(file)),
+                     std::istreambuf_iterator<char>());
+    size_t pos = data.find("payload_" + std::to_string(seq) + "_");
+    ASSERT_NE(pos, std::string::npos);
+    file.seekp(pos);
+    file.put('P');
+  };
+
+  {
+    Recovery recovery(config, &checkpoint_, &system_info_, &storage);
+    add_requests(&recovery, 1, 101);
+  }
+  std::vector<std::string> log_list = Listlogs(log_path);
+  ASSERT_EQ(log_list.size(), 1);
+
+  // A corrupted record in the middle is skipped.
+  corrupt(log_list[0], 50);
+  std::vector<uint64_t> seqs = read_logs();
+  EXPECT_EQ(seqs.size(), 99);
+  EXPECT_EQ(std::count(seqs.begin(), seqs.end(), 50), 0);
+  EXPECT_EQ(seqs.back(), 100);
+
+  // A corrupted record at the tail is truncated.
+  corrupt(log_list[0], 100);
+  size_t file_size = std::filesystem::file_size(log_list[0]);
+  {
+    Recovery recovery(config, &checkpoint_, &system_info_, &storage);
+    EXPECT_LT(std::filesystem::file_size(log_list[0]), file_size);
+    add_requests(&recovery, 101, 102);
+  }
+  seqs = read_logs();
+  EXPECT_EQ(seqs.size(), 99);
+  EXPECT_EQ(std::count(seqs.begin(), seqs.end(), 100), 0);
+  EXPECT_EQ(seqs.back(), 101);
+}
+
+TEST_F(RecoveryTest, CorruptedBlockLength) {
+  ResDBConfig config(GetConfigData(1024), ReplicaInfo(), KeyInfo(),
+                     CertificateInfo());
+  MockStorage storage;
+  EXPECT_CALL(checkpoint_, GetStableCheckpoint()).WillRepeatedly(Return(0));
+
+  auto add_requests = [&](Recovery *recovery, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      std::unique_ptr<Request> request =
+          NewRequest(Request::TYPE_PRE_PREPARE, Request(), i);
+      request->set_seq(i);
+      request->set_data("payload_" + std::to_string(i) + "_");
+      recovery->AddRequest(nullptr, request.get());
+    }
+  };
+
+  auto read_logs = [&]() {
+    std::vector<uint64_t> seqs;
+    Recovery recovery(config, &checkpoint_, &system_info_, &storage);
+    recovery.ReadLogs([&](const SystemInfoData &data) {},
+                      [&](std::unique_ptr<Context> context,
+                          std::unique_ptr<Request> request) {
+                        seqs.push_back(request->seq());
+                      },
+                      nullptr);
+    return seqs;
+  };
+
+  {
+    Recovery recovery(config, &checkpoint_, &system_info_, &storage);
+    add_requests(&recovery, 1, 101);
+  }
+  std::vector<std::string> log_list = Listlogs(log_path);
+  ASSERT_EQ(log_list.size(), 1);
+
+  // Overwrite the length of the block holding seq 50, which the block
+  // starts with: the header of the file is 16 bytes and each block is
+  // prefixed with its length and checksum.
+  {
+    std::fstream file(log_list[0],
+                      std::ios::binary | std::ios::in | std::ios::out);
+    std::string data((std::istreambuf_iterator<char>(file)),
+                     std::istreambuf_iterator<char>());
+    size_t target = data.find("payload_50_");
+    ASSERT_NE(target, std::string::npos);
+    size_t pos = 16;
+    while (true) {
+      size_t len;
+      memcpy(&len, data.data() + pos, sizeof(len));
+      size_t next = pos + sizeof(len) + sizeof(uint32_t) + len;
+      if (next > target) {
+        break;
+      }
+      pos = next;
+    }
+    size_t bad_len = 1ull << 40;
+    file.seekp(pos);
+    file.write(reinterpret_cast<const char *>(&bad_len), sizeof(bad_len));
+  }
+
+  // The blocks after the bad length are still read and kept in the file.
+  std::vector<uint64_t> seqs = read_logs();
+  EXPECT_EQ(std::count(seqs.begin(), seqs.end(), 50), 0);
+  EXPECT_EQ(seqs.back(), 100);
+  size_t num = seqs.size();
+
+  {
+    Recovery recovery(config, &checkpoint_, &system_info_, &storage);
+    add_requests(&recovery, 101, 102);
+  }
+  seqs = read_logs();
+  EXPECT_EQ(seqs.size(), num + 1);
+  EXPECT_EQ(std::count(seqs.begin(), seqs.end(), 100), 1);
+  EXPECT_EQ(seqs.back(), 101);
+}
+
+TEST_F(RecoveryTest, ReadLogWithoutChecksum) {
+  ResDBConfig config(GetConfigData(1024), ReplicaInfo(), KeyInfo(),
+                     CertificateInfo());
+  MockStorage storage;
+  EXPECT_CALL(checkpoint_, GetStableCheckpoint()).WillRepeatedly(Return(0));
+
+  // Write a log in the format without the header and the checksums.
+  auto append_item = [](std::string *block, const std::string &item) {
+    size_t len = item.size();
+    block->append(reinterpret_cast<const char *>(&len), sizeof(len));
+    block->append(item);
+  };
+  std::string data;
+  {
+    SystemInfoData info;
+    info.set_primary_id(1);
+    std::string block;
+    append_item(&block, info.SerializeAsString());
+    append_item(&data, block);
+  }
+  for (int i = 1; i <= 10; ++i) {
+    Request request;
+    request.set_type(Request::TYPE_PRE_PREPARE);
+    request.set_seq(i);
+    std::string block;
+    append_item(&block, request.SerializeAsString());
+    append_item(&block, "");
+    append_item(&data, block);
+  }
+  std::filesystem::create_directories(
+      std::filesystem::path(log_path).parent_path());
+  {
+    std::ofstream file(log_path + "_1_-1_-1_0.log", std::ios::binary);
+    file.write(data.data(), data.size());
+  }
+
+  std::vector<uint64_t> seqs;
+  {
+    Recovery recovery(config, &checkpoint_, &system_info_, &storage);
+    recovery.ReadLogs([&](const SystemInfoData &data) {},
+                      [&](std::unique_ptr<Context> context,
+                          std::unique_ptr<Request> request) {
+                        seqs.push_back(request->seq());
+                      },
+                      nullptr);
+    EXPECT_EQ(seqs.size(), 10);
+    std::unique_ptr<Request> request =
+        NewRequest(Request::TYPE_PRE_PREPARE, Request(), 11);
+    request->set_seq(11);
+    recovery.AddRequest(nullptr, request.get());
+    EXPECT_EQ(recovery.GetDataFromRecoveryFiles(5, 11).size(), 7);
+  }
+}
+
+TEST_F(RecoveryTest, ReadMixedCompressedLogs) {
+  ResConfigData config_data = GetConfigData(1024);
+  ResDBConfig config(config_data, ReplicaInfo(), KeyInfo(), CertificateInfo());
+  config_data.set_recovery_codec(ResConfigData::CODEC_ZLIB);
+  ResDBConfig zlib_config(config_data, ReplicaInfo(), KeyInfo(),
+                          CertificateInfo());
+  MockStorage storage;
+  EXPECT_CALL(storage, Flush).WillRepeatedly(Return(true));
+
+  auto add_requests = [&](Recovery *recovery, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      std::unique_ptr<Request> request =
+          NewRequest(Request::TYPE_PRE_PREPARE, Request(), i);
+      request->set_seq(i);
+      request->set_data(std::string(1000, 'a' + i % 26));
+      recovery->AddRequest(nullptr, request.get());
+    }
+  };
+
+  {
+    MockCheckPoint checkpoint;
+    EXPECT_CALL(checkpoint, GetStableCheckpoint()).WillRepeatedly(Return(0));
+    Recovery recovery(config, &checkpoint, &system_info_, &storage);
+    add_requests(&recovery, 1, 11);
+  }
+
+  // The current file keeps its format and the next file is compressed.
+  std::promise<bool> insert_done, ckpt;
+  std::future<bool> insert_done_future = insert_done.get_future(),
+                    ckpt_future = ckpt.get_future();
+  int time = 1;
+  EXPECT_CALL(checkpoint_, GetStableCheckpoint()).WillRepeatedly(Invoke([&]() {
+    if (time == 1) {
+      insert_done_future.get();
+    } else if (time == 2) {
+      ckpt.set_value(true);
+    }
+    time++;
+    return 20;
+  }));
+  {
+    Recovery recovery(zlib_config, &checkpoint_, &system_info_, &storage);
+    add_requests(&recovery, 11, 21);
+    insert_done.set_value(true);
+    ckpt_future.get();
+    add_requests(&recovery, 21, 31);
+  }
+
+  std::vector<std::string> log_list = Listlogs(log_path);
+  ASSERT_EQ(log_list.size(), 2);
+  for (const std::string &path : log_list) {
+    if (path.find("_-1_-1_") != std::string::npos) {
+      EXPECT_LT(std::filesystem::file_size(path), 10 * 1000);
+    } else {
+      EXPECT_GT(std::filesystem::file_size(path), 20 * 1000);
+    }
+  }
+
+  {
+    Recovery recovery(config, &checkpoint_, &system_info_, &storage);
+    auto res = recovery.GetDataFromRecoveryFiles(1, 30);
+    ASSERT_EQ(res.size(), 30);
+    for (int i = 1; i <= 30; ++i) {
+      ASSERT_EQ(res[i].size(), 1);
+      EXPECT_EQ(res[i][0].second->data(), std::string(1000, 'a' + i % 26));
+    }
+
+    std::vector<uint64_t> seqs;
+    recovery.ReadLogs([&](const SystemInfoData &data) {},
+                      [&](std::unique_ptr<Context> context,
+                          std::unique_ptr<Request> request) {
+                        seqs.push_back(request->seq());
+                      },
+                      nullptr);
+    EXPECT_EQ(seqs.size(), 10);
+    EXPECT_EQ(seqs.back(), 30);
+  }
+}
+
 TEST_F(RecoveryTest, SystemInfo) {
   ResDBConfig config(GetConfigData(1024), ReplicaInfo(), KeyInfo(),
                      CertificateInfo());
@@ -26,98 +26,125 @@
 
 namespace resdb {
 
+namespace {
+
+// The receive buffer of a session is given back to the pool after a frame
+// larger than it, so that the large buffers are shared by the sessions.
+constexpr size_t kMaxKeptBufferSize = 1 << 20;
+
+int64_t GetSteadyTimeS() {
+  return std::chrono::duration_cast<std::chrono::seconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+}  // namespace
+
 AsyncAcceptor::Session::Session(boost::asio::io_service* io_service,
+                                BufferPool* buffer_pool,
+                                const AsyncAcceptorOptions& options,
                                 CallBack call_back_func)
-    : io_service_(io_service),
-      client_socket_(*io_service_),
-      recv_buffer_(nullptr),
-      status_(0),
-      call_back_func_(call_back_func) {}
+    : client_socket_(*io_service),
+      strand_(*io_service),
+      buffer_pool_(buffer_pool),
+      options_(options),
+      call_back_func_(call_back_func) {
+  Touch();
+}
 
-AsyncAcceptor::Session::~Session() { Close(); }
+AsyncAcceptor::Session::~Session() {}
 
 boost::asio::ip::tcp::socket* AsyncAcceptor::Session::GetSocket() {
   return &client_socket_;
 }
 
+void AsyncAcceptor::Session::Touch() { last_active_time_ = GetSteadyTimeS(); }
+
+bool AsyncAcceptor::Session::IsClosed() const { return closed_; }
+
+bool AsyncAcceptor::Session::IsIdle() const {
+  return options_.idle_timeout_s > 0 &&
+         GetSteadyTimeS() - last_active_time_ >= options_.idle_timeout_s;
+}
+
 void AsyncAcceptor::Session::Close() {
-  if (client_socket_.is_open()) {
-    client_socket_.cancel();
-  }
-  if (recv_buffer_ && status_ != 0) {
-    delete recv_buffer_;
-    recv_buffer_ = nullptr;
-  }
+  auto self = shared_from_this();
+  strand_.post([self]() { self->OnClose(); });
+}
+
+void AsyncAcceptor::Session::OnClose() {
+  closed_ = true;
+  boost::system::error_code ignored;
+  client_socket_.close(ignored);
+  recv_buffer_.Reset();
 }
 
 void AsyncAcceptor::Session::StartRead() {
-  if (status_ == 0) {
-    // read len
-    recv_buffer_ = reinterpret_cast<char*>(&data_size_);
-    data_size_ = 0;
-    need_size_ = sizeof(data_size_);
-    current_idx_ = 0;
-    memset(recv_buffer_, 0, need_size_);
-    OnRead();
-  } else {
-    need_size_ = data_size_;
-    current_idx_ = 0;
-    if (recv_buffer_) {
-      delete recv_buffer_;
-    }
-    recv_buffer_ = new char[need_size_];
-    memset(recv_buffer_, 0, need_size_);
-    OnRead();
-  }
+  auto self = shared_from_this();
+  strand_.post([self]() { self->ReadHeader(); });
 }
 
-void AsyncAcceptor::Session::ReadDone() {
-  if (status_ == 1) {
-    call_back_func_(recv_buffer_, data_size_);
-    delete recv_buffer_;
-  } else {
-    data_size_ = *reinterpret_cast<size_t*>(recv_buffer_);
-    if (data_size_ > 1e10) {
-      LOG(ERROR) << "read data size:" << data_size_
-                 << " data size:" << sizeof(data_size_) << " close socket";
-      Close();
-      return;
-    }
+void AsyncAcceptor::Session::ReadHeader() {
+  auto self = shared_from_this();
+  boost::asio::async_read(
+      client_socket_, boost::asio::buffer(&data_size_, sizeof(data_size_)),
+      strand_.wrap([self](const boost::system::error_code& error, size_t) {
+        if (error) {
+          self->OnClose();
+          return;
+        }
+        self->Touch();
+        if (self->data_size_ > self->options_.max_frame_size) {
+          LOG(ERROR) << "read data size:" << self->data_size_
+                     << " is larger than:" << self->options_.max_frame_size
+                     << " close socket";
+          self->OnClose();
+          return;
+        }
+        if (self->data_size_ == 0) {
+          self->ReadHeader();
+          return;
+        }
+        self->ReadData();
+      }));
+}
+
+void AsyncAcceptor::Session::ReadData() {
+  if (recv_buffer_.GetCapacity() < data_size_) {
+    recv_buffer_ = buffer_pool_->Get(data_size_);
   }
-  status_ ^= 1;
-  recv_buffer_ = nullptr;
-  // continue to read next msg.
-  StartRead();
-}
-
-void AsyncAcceptor::Session::OnRead() {
-  client_socket_.async_read_some(
-      boost::asio::buffer(recv_buffer_ + current_idx_,
-                          need_size_ - current_idx_),
-      [&](const boost::system::error_code& error,  // Result of operation.
-          std::size_t bytes_transferred) {
-        if (error || bytes_transferred == 0) {
-          Close();
-        } else {
-          current_idx_ += bytes_transferred;
-          if (current_idx_ >= need_size_) {
-            ReadDone();
-          } else {
-            OnRead();
-          }
+  auto self = shared_from_this();
+  boost::asio::async_read(
+      client_socket_, boost::asio::buffer(recv_buffer_.GetData(), data_size_),
+      strand_.wrap([self](const boost::system::error_code& error, size_t) {
+        if (error) {
+          self->OnClose();
+          return;
+        }
+        self->Touch();
+        self->call_back_func_(self->recv_buffer_.GetData(), self->data_size_);
+        if (self->recv_buffer_.GetCapacity() > kMaxKeptBufferSize) {
+          self->recv_buffer_.Reset();
         }
-      });
+        // continue to read next msg.
+        self->ReadHeader();
+      }));
 }
 
 AsyncAcceptor::AsyncAcceptor(const std::string& ip, int port, int thread_num,
-                             CallBack call_back_func)
-    : endpoint_(boost::asio::ip::address::from_string(ip), port),
+                             CallBack call_back_func,
+                             const AsyncAcceptorOptions& options)
+    : options_(options),
+      endpoint_(boost::asio::ip::address::from_string(ip), port),
       acceptor_(io_service_, endpoint_),
+      prune_timer_(io_service_),
       call_back_func_(call_back_func) {
+  global_stats_ = Stats::GetGlobalStats();
   worker_ = std::make_unique<boost::asio::io_service::work>(io_service_);
   for (int i = 0; i < thread_num; ++i) {
     worker_thread_.push_back(std::thread([&]() { io_service_.run(); }));
   }
+  StartPrune();
 }
 
 AsyncAcceptor::~AsyncAcceptor() {
@@ -125,22 +152,17 @@ AsyncAcceptor::~AsyncAcceptor() {
   worker_ = nullptr;
   io_service_.stop();
 
-  for (auto& sess : sessions_) {
-    if (sess) {
-      sess->Close();
-    }
-  }
-
   for (auto& worker : worker_thread_) {
     if (worker.joinable()) {
       worker.join();
     }
   }
+  sessions_.clear();
 }
 
 void AsyncAcceptor::StartAccept() {
   boost::shared_ptr<Session> client_session(
-      new Session(&io_service_, call_back_func_));
+      new Session(&io_service_, &buffer_pool_, options_, call_back_func_));
   acceptor_.async_accept(*client_session->GetSocket(),
                          std::bind(&AsyncAcceptor::OnAccept, this,
                                    client_session, std::placeholders::_1));
@@ -155,8 +177,52 @@ void AsyncAcceptor::OnAccept(boost::shared_ptr<Session> client_session,
 
   StartAccept();  // Add the next accept event.
 
-  sessions_.push_back(client_session);
+  {
+    std::lock_guard<std::mutex> lk(sessions_mutex_);
+    sessions_.push_back(client_session);
+  }
   client_session->StartRead();
 }
 
+size_t AsyncAcceptor::GetSessionNum() {
+  std::lock_guard<std::mutex> lk(sessions_mutex_);
+  return sessions_.size();
+}
+
+void AsyncAcceptor::StartPrune() {
+  prune_timer_.expires_from_now(
+      std::chrono::milliseconds(options_.prune_interval_ms));
+  prune_timer_.async_wait([&](const boost::system::error_code& error) {
+    if (error) {
+      return;
+    }
+    Prune();
+    StartPrune();
+  });
+}
+
+// Remove the closed sessions and close the idle ones, which will be removed
+// in the next round.
+void AsyncAcceptor::Prune() {
+  size_t session_num = 0;
+  {
+    std::lock_guard<std::mutex> lk(sessions_mutex_);
+    std::vector<boost::shared_ptr<Session>> sessions;
+    for (auto& session : sessions_) {
+      if (session->IsClosed()) {
+        continue;
+      }
+      if (session->IsIdle()) {
+        session->Close();
+      }
+      sessions.push_back(std::move(session));
+    }
+    sessions_.swap(sessions);
+    session_num = sessions_.size();
+  }
+  global_stats_->SetAcceptorSessions(session_num);
+  global_stats_->SetRecvBufferPool(buffer_pool_.GetInUseBytes(),
+                                   buffer_pool_.GetCachedBytes());
+}
+
 }  // namespace resdb
@@ -19,58 +19,96 @@
 
 #pragma once
 #include <boost/asio.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
 #include <memory>
+#include <mutex>
+
+#include "platform/common/data_comm/buffer_pool.h"
+#include "platform/statistic/stats.h"
 
 namespace resdb {
 
+struct AsyncAcceptorOptions {
+  // A frame larger than it closes the connection.
+  size_t max_frame_size = 1 << 30;
+  // Close the connections which have received nothing for the time. 0 keeps
+  // the idle connections.
+  int idle_timeout_s = 300;
+  // How often the closed and idle sessions are pruned.
+  int prune_interval_ms = 1000;
+};
+
 class AsyncAcceptor {
  public:
   typedef std::function<void(const char* buffer, size_t len)> CallBack;
 
-  AsyncAcceptor(const std::string& ip, int thread_num, int port,
-                CallBack call_back_func);
+  AsyncAcceptor(
+      const std::string& ip, int port, int thread_num, CallBack call_back_func,
+      const AsyncAcceptorOptions& options = AsyncAcceptorOptions());
   virtual ~AsyncAcceptor();
 
   void StartAccept();
 
+  // The number of the sessions which have not been pruned.
+  size_t GetSessionNum();
+
  private:
-  class Session {
+  // Session reads the frames of one connection into a receive buffer which
+  // is reused by the following frames. All its handlers run in its strand.
+  class Session : public boost::enable_shared_from_this<Session> {
    public:
-    Session(boost::asio::io_service* io_service, CallBack call_back_func);
+    Session(boost::asio::io_service* io_service, BufferPool* buffer_pool,
+            const AsyncAcceptorOptions& options, CallBack call_back_func);
     ~Session();
 
     boost::asio::ip::tcp::socket* GetSocket();
 
     void StartRead();
+    // Close the connection. It can be called from any thread.
     void Close();
+    bool IsClosed() const;
+    bool IsIdle() const;
 
    private:
-    void ReadDone();
-    void OnRead();
+    void ReadHeader();
+    void ReadData();
+    void OnClose();
+    void Touch();
 
    private:
-    boost::asio::io_service* io_service_ = nullptr;
     boost::asio::ip::tcp::socket client_socket_;
+    boost::asio::io_service::strand strand_;
+    BufferPool* buffer_pool_;
+    AsyncAcceptorOptions options_;
     size_t data_size_ = 0;
-    size_t need_size_ = 0;
-    size_t current_idx_ = 0;
-    char* recv_buffer_ = nullptr;
-    bool status_ = 0;
+    BufferPool::Buffer recv_buffer_;
+    std::atomic<bool> closed_ = false;
+    std::atomic<int64_t> last_active_time_;
     CallBack call_back_func_;
   };
 
  private:
   void OnAccept(boost::shared_ptr<Session> client_socket,
                 const boost::system::error_code ec);
+  void StartPrune();
+  void Prune();
 
  private:
+  AsyncAcceptorOptions options_;
+  // Declared before io_service_ as the sessions release their buffers to
+  // it when the pending handlers are destroyed.
+  BufferPool buffer_pool_;
   boost::asio::io_service io_service_;
   boost::asio::ip::tcp::endpoint endpoint_;
   boost::asio::ip::tcp::acceptor acceptor_;
+  boost::asio::steady_timer prune_timer_;
   std::unique_ptr<boost::asio::io_service::work> worker_;
   CallBack call_back_func_;
   std::vector<std::thread> worker_thread_;
+  std::mutex sessions_mutex_;
   std::vector<boost::shared_ptr<Session>> sessions_;
+  Stats* global_stats_;
 };
 
 }  // namespace resdb
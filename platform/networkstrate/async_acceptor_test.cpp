@@ -23,6 +23,7 @@
 #include <gtest/gtest.h>
 
 #include <future>
+#include <thread>
 
 #include "platform/common/network/tcp_socket.h"
 
@@ -130,6 +131,83 @@ TEST(AsyncAcceptorTest, RecvClose) {
   bc_done.get();
 }
 
+void WaitSessionNum(AsyncAcceptor* acceptor, size_t num) {
+  while (acceptor->GetSessionNum() != num) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+}
+
+TEST(AsyncAcceptorTest, PruneClosedSession) {
+  std::promise<bool> bc;
+  std::future<bool> bc_done = bc.get_future();
+  AsyncAcceptorOptions options;
+  options.prune_interval_ms = 10;
+  AsyncAcceptor acceptor(
+      "127.0.0.1", 1234, 1,
+      [&](const char* buff, size_t data_len) { bc.set_value(true); },
+      options);
+
+  acceptor.StartAccept();
+
+  TcpSocket client_socket;
+  int ret = client_socket.Connect("127.0.0.1", 1234);
+  ASSERT_EQ(ret, 0);
+  ret = client_socket.Send("test");
+  ASSERT_EQ(ret, 0);
+  bc_done.get();
+  EXPECT_EQ(acceptor.GetSessionNum(), 1);
+
+  client_socket.Close();
+  WaitSessionNum(&acceptor, 0);
+}
+
+TEST(AsyncAcceptorTest, CloseOversizedFrame) {
+  std::promise<std::string> bc;
+  std::future<std::string> bc_done = bc.get_future();
+  AsyncAcceptorOptions options;
+  options.max_frame_size = 8;
+  options.prune_interval_ms = 10;
+  AsyncAcceptor acceptor(
+      "127.0.0.1", 1234, 1,
+      [&](const char* buff, size_t data_len) {
+        bc.set_value(std::string(buff, data_len));
+      },
+      options);
+
+  acceptor.StartAccept();
+
+  TcpSocket client_socket;
+  int ret = client_socket.Connect("127.0.0.1", 1234);
+  ASSERT_EQ(ret, 0);
+  WaitSessionNum(&acceptor, 1);
+  ret = client_socket.Send(std::string(9, 'a'));
+  ASSERT_EQ(ret, 0);
+  WaitSessionNum(&acceptor, 0);
+
+  TcpSocket new_socket;
+  ret = new_socket.Connect("127.0.0.1", 1234);
+  ASSERT_EQ(ret, 0);
+  ret = new_socket.Send("test");
+  ASSERT_EQ(ret, 0);
+  EXPECT_EQ(bc_done.get(), "test");
+}
+
+TEST(AsyncAcceptorTest, CloseIdleSession) {
+  AsyncAcceptorOptions options;
+  options.idle_timeout_s = 1;
+  options.prune_interval_ms = 10;
+  AsyncAcceptor acceptor("127.0.0.1", 1234, 1,
+                         [&](const char* buff, size_t data_len) {}, options);
+
+  acceptor.StartAccept();
+
+  TcpSocket client_socket;
+  int ret = client_socket.Connect("127.0.0.1", 1234);
+  ASSERT_EQ(ret, 0);
+  WaitSessionNum(&acceptor, 1);
+  WaitSessionNum(&acceptor, 0);
+}
+
 }  // namespace
 
 }  // namespace resdb
@@ -19,24 +19,64 @@
 
 #include "platform/networkstrate/async_replica_client.h"
 
-#include <boost/bind/bind.hpp>
+#include <glog/logging.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
 
 #include "platform/common/queue/lock_free_queue.h"
 #include "platform/proto/replica_info.pb.h"
 
 namespace resdb {
 
-AsyncReplicaClient::AsyncReplicaClient(boost::asio::io_service* io_service,
-                                       const std::string& ip, int port,
-                                       bool is_use_long_conn)
-    : socket_(*io_service),
+AsyncReplicaClient::AsyncReplicaClient(
+    boost::asio::io_service* io_service, const std::string& ip, int port,
+    bool is_use_long_conn, const AsyncReplicaClientOptions& options)
+    : options_(options),
+      socket_(*io_service),
       endpoint_(boost::asio::ip::address::from_string(ip), port),
-      in_process_(false) {}
+      timer_(*io_service),
+      in_process_(false) {
+  global_stats_ = Stats::GetGlobalStats();
+}
 
 AsyncReplicaClient::~AsyncReplicaClient() {}
 
+namespace {
+
+size_t GetSize(const AsyncReplicaClient::MessageParts& parts) {
+  size_t size = 0;
+  for (const auto& part : parts) {
+    size += part->size();
+  }
+  return size;
+}
+
+}  // namespace
+
+void AsyncReplicaClient::SetPeerId(int64_t peer_id) { peer_id_ = peer_id; }
+
+std::shared_ptr<AsyncReplicaClient> AsyncReplicaClient::Hold() {
+  return weak_from_this().lock();
+}
+
+void AsyncReplicaClient::Close() {
+  closed_ = true;
+  boost::asio::post(socket_.get_executor(), [this, self = Hold()]() {
+    boost::system::error_code ignored;
+    timer_.cancel(ignored);
+    socket_.close(ignored);
+  });
+}
+
 int AsyncReplicaClient::SendMessage(const std::string& data) {
-  queue_.Push(std::make_unique<std::string>(data));
+  return SendMessageParts({std::make_shared<const std::string>(data)});
+}
+
+int AsyncReplicaClient::SendMessageParts(MessageParts parts) {
+  if (closed_) {
+    return -1;
+  }
+  queue_.Push(std::make_unique<MessageParts>(std::move(parts)));
   if (!in_process_.load()) {
     bool old_value = false;
     if (in_process_.compare_exchange_strong(old_value, true,
@@ -48,60 +88,155 @@ int AsyncReplicaClient::SendMessage(const std::string& data) {
   return 0;
 }
 
+// Pop the queued messages until the batch is full.
+void AsyncReplicaClient::PopMessages() {
+  while (batch_bytes_ < options_.max_coalesce_bytes) {
+    std::unique_ptr<MessageParts> data =
+        next_data_ ? std::move(next_data_) : queue_.Pop(0);
+    if (data == nullptr) {
+      break;
+    }
+    size_t data_size = GetSize(*data);
+    if (data_size == 0) {
+      continue;
+    }
+    size_t frame_size = sizeof(size_t) + data_size;
+    if (!batch_.empty() &&
+        batch_bytes_ + frame_size > options_.max_coalesce_bytes) {
+      next_data_ = std::move(data);
+      break;
+    }
+    batch_bytes_ += frame_size;
+    batch_.push_back(std::move(data));
+  }
+}
+
 void AsyncReplicaClient::OnSendNewMessage() {
-  std::unique_ptr<std::string> data = queue_.Pop(0);
-  if (data == nullptr || data->empty()) {
+  batch_.clear();
+  batch_bytes_ = 0;
+  PopMessages();
+  if (batch_.empty()) {
     in_process_ = false;
+    // A message may be pushed before in_process_ is reset.
+    if (!queue_.Empty()) {
+      bool old_value = false;
+      if (in_process_.compare_exchange_strong(old_value, true,
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_acq_rel)) {
+        OnSendNewMessage();
+      }
+    }
     return;
   }
-  pending_data_ = std::move(data);
-  status_ = 0;
-  OnSendMessage();
-}
-
-void AsyncReplicaClient::OnSendMessage() {
-  if (status_ == 0) {
-    data_size_ = pending_data_->size();
-    sending_data_size_ = sizeof(data_size_);
-    sending_data_ptr_ = reinterpret_cast<char*>(&data_size_);
-    sending_data_idx_ = 0;
-    status_ = 1;
-    OnSend();
-  } else if (status_ == 1) {
-    sending_data_size_ = data_size_;
-    sending_data_ptr_ = pending_data_->c_str();
-    sending_data_idx_ = 0;
-    status_ = 2;
-    OnSend();
-  } else {
-    status_ = 0;
-    OnSendNewMessage();
+  if (options_.coalesce_delay_us > 0 &&
+      batch_bytes_ < options_.max_coalesce_bytes) {
+    timer_.expires_from_now(
+        std::chrono::microseconds(options_.coalesce_delay_us));
+    timer_.async_wait([this, self = Hold()](
+                          const boost::system::error_code& error) {
+      PopMessages();
+      WriteBatch();
+    });
+    return;
   }
+  WriteBatch();
 }
 
-void AsyncReplicaClient::OnSend() {
-  socket_.async_write_some(
-      boost::asio::buffer(sending_data_ptr_ + sending_data_idx_,
-                          sending_data_size_ - sending_data_idx_),
+void AsyncReplicaClient::WriteBatch() {
+  if (closed_) {
+    return;
+  }
+  if (IsPeerClosed()) {
+    ReConnect();
+    return;
+  }
+  headers_.resize(batch_.size());
+  buffers_.clear();
+  for (size_t i = 0; i < batch_.size(); ++i) {
+    headers_[i] = GetSize(*batch_[i]);
+    buffers_.push_back(boost::asio::buffer(&headers_[i], sizeof(size_t)));
+    for (const auto& part : *batch_[i]) {
+      buffers_.push_back(boost::asio::buffer(*part));
+    }
+  }
+  write_calls_ = 0;
+  SetCork(true);
+  boost::asio::async_write(
+      socket_, buffers_,
+      // The completion condition runs once before the first write and once
+      // after each write, only the latter transfer data.
       [&](const boost::system::error_code& error, size_t send_size) {
+        if (send_size > 0) {
+          write_calls_++;
+        }
+        return boost::asio::transfer_all()(error, send_size);
+      },
+      [this, self = Hold()](const boost::system::error_code& error,
+                            size_t send_size) {
         if (error) {
           ReConnect();
         } else {
-          sending_data_idx_ += send_size;
-          if (sending_data_idx_ >= sending_data_size_) {
-            OnSendMessage();
-          } else {
-            OnSend();
-          }
+          OnBatchDone();
         }
       });
 }
 
+void AsyncReplicaClient::OnBatchDone() {
+  SetCork(false);
+  global_stats_->SocketSend(batch_.size(), batch_bytes_, write_calls_);
+  OnSendNewMessage();
+}
+
+void AsyncReplicaClient::SetSocketOptions() {
+  boost::system::error_code error;
+  socket_.set_option(boost::asio::ip::tcp::no_delay(options_.tcp_nodelay),
+                     error);
+  if (error) {
+    LOG(ERROR) << "set tcp nodelay fail:" << error.message();
+  }
+}
+
+void AsyncReplicaClient::SetCork(bool cork) {
+#ifdef TCP_CORK
+  if (!options_.tcp_cork) {
+    return;
+  }
+  boost::system::error_code error;
+  socket_.set_option(
+      boost::asio::detail::socket_option::boolean<IPPROTO_TCP, TCP_CORK>(cork),
+      error);
+#endif
+}
+
+// The replica never writes back, so a readable socket means it has been
+// closed. Writes to a closed peer may still succeed and the data would be
+// lost, so check it before each batch.
+bool AsyncReplicaClient::IsPeerClosed() {
+  if (!socket_.is_open()) {
+    return false;
+  }
+  char data;
+  int ret = recv(socket_.native_handle(), &data, 1, MSG_PEEK | MSG_DONTWAIT);
+  return ret == 0 || (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
 void AsyncReplicaClient::ReConnect() {
-  socket_.async_connect(endpoint_, [&](const boost::system::error_code& error) {
+  if (closed_) {
+    return;
+  }
+  if (connected_) {
+    connected_ = false;
+    global_stats_->PeerReconnect(peer_id_);
+  }
+  boost::system::error_code ignored;
+  socket_.close(ignored);
+  socket_.async_connect(endpoint_, [this, self = Hold()](
+                                       const boost::system::error_code& error) {
     if (!error) {
-      status_ = 0;
-      OnSendMessage();
+      connected_ = true;
+      SetSocketOptions();
+      // Send the whole batch again on the new connection.
+      WriteBatch();
     } else {
       usleep(10000);
       ReConnect();
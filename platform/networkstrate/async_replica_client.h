@@ -24,40 +24,81 @@
 #include "interface/rdbc/net_channel.h"
 #include "platform/common/queue/lock_free_queue.h"
 #include "platform/proto/replica_info.pb.h"
+#include "platform/statistic/stats.h"
 
 namespace resdb {
 
-class AsyncReplicaClient {
+struct AsyncReplicaClientOptions {
+  // The max bytes of the frames coalesced into one write.
+  size_t max_coalesce_bytes = 1 << 20;
+  // Wait for more frames before writing a batch which is not full.
+  int coalesce_delay_us = 0;
+  bool tcp_nodelay = true;
+  // Hold the partial packets until the whole batch has been written.
+  bool tcp_cork = false;
+  // The connection to a destination outside the replica set is torn down
+  // after it has been idle this long, 0 keeps it.
+  int idle_timeout_s = 300;
+};
+
+// AsyncReplicaClient sends the messages to one replica through a long
+// connection. The messages queued while a write is in flight are coalesced
+// into one vectored write, each one framed by its length.
+class AsyncReplicaClient
+    : public std::enable_shared_from_this<AsyncReplicaClient> {
  public:
-  AsyncReplicaClient(boost::asio::io_service* io_service, const std::string& ip,
-                     int port, bool is_use_long_conn = false);
+  // A message sent as the concatenation of its parts. The parts are never
+  // copied and may be shared with the other clients.
+  using MessageParts = std::vector<std::shared_ptr<const std::string>>;
+
+  AsyncReplicaClient(
+      boost::asio::io_service* io_service, const std::string& ip, int port,
+      bool is_use_long_conn = false,
+      const AsyncReplicaClientOptions& options = AsyncReplicaClientOptions());
   virtual ~AsyncReplicaClient();
 
   virtual int SendMessage(const std::string& data);
+  virtual int SendMessageParts(MessageParts parts);
+
+  // The node id of the replica, used to report the reconnections.
+  void SetPeerId(int64_t peer_id);
+
+  // Close the connection and stop reconnecting, the queued messages are
+  // dropped. The handlers in flight still run. They keep a client owned by
+  // a shared_ptr alive, any other client must outlive them.
+  void Close();
 
  private:
+  std::shared_ptr<AsyncReplicaClient> Hold();
   void ReConnect();
+  void SetSocketOptions();
+  void SetCork(bool cork);
+  bool IsPeerClosed();
   void OnSendNewMessage();
-  void OnSendMessage();
-  void OnSend();
+  void PopMessages();
+  void WriteBatch();
+  void OnBatchDone();
 
  private:
-  LockFreeQueue<std::string> queue_;
-  std::unique_ptr<NetChannel> client_;
+  AsyncReplicaClientOptions options_;
+  LockFreeQueue<MessageParts> queue_;
   boost::asio::ip::tcp::socket socket_;
   boost::asio::ip::tcp::endpoint endpoint_;
-  std::mutex mutex_;
+  boost::asio::steady_timer timer_;
   std::atomic<bool> in_process_;
+  std::atomic<bool> closed_ = false;
+  bool connected_ = false;
+  int64_t peer_id_ = 0;
+  Stats* global_stats_;
 
   // ===== for async send =====
-  std::unique_ptr<std::string> pending_data_;
-
-  size_t data_size_ = 0;          // the size of the data needed to be sent.
-  size_t sending_data_idx_ = 0;   // the current pos to be sent in data_ptr.
-  size_t sending_data_size_ = 0;  // the size needed to be sent.
-  const char* sending_data_ptr_ = nullptr;  // point to the data.
-
-  int status_ = 0;  // sending status.
+  // The message popped which does not fit in the current batch.
+  std::unique_ptr<MessageParts> next_data_;
+  std::vector<std::unique_ptr<MessageParts>> batch_;
+  size_t batch_bytes_ = 0;
+  std::vector<size_t> headers_;
+  std::vector<boost::asio::const_buffer> buffers_;
+  size_t write_calls_ = 0;
 };
 
 }  // namespace resdb
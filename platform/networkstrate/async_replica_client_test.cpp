@@ -48,10 +48,10 @@ TEST(AsyncReplicaClientTest, SendMessage) {
   });
 
   boost::asio::io_service io_service;
-  std::thread t([&]() { io_service.run(); });
-
   boost::asio::io_service::work *work =
       new boost::asio::io_service::work(io_service);
+  std::thread t([&]() { io_service.run(); });
+
   AsyncReplicaClient client(&io_service, "127.0.0.1", 1234);
   EXPECT_EQ(client.SendMessage("test"), 0);
   bc_done.get();
@@ -81,10 +81,10 @@ TEST(AsyncReplicaClientTest, SendLargeMessage) {
   });
 
   boost::asio::io_service io_service;
-  std::thread t([&]() { io_service.run(); });
-
   boost::asio::io_service::work *work =
       new boost::asio::io_service::work(io_service);
+  std::thread t([&]() { io_service.run(); });
+
   AsyncReplicaClient client(&io_service, "127.0.0.1", 1234);
   EXPECT_EQ(client.SendMessage(std::string(1000000, 't')), 0);
   bc_done.get();
@@ -114,9 +114,9 @@ TEST(AsyncReplicaClientTest, MultiSendMessage) {
   });
 
   boost::asio::io_service io_service;
-  std::thread t([&]() { io_service.run(); });
   boost::asio::io_service::work *work =
       new boost::asio::io_service::work(io_service);
+  std::thread t([&]() { io_service.run(); });
   AsyncReplicaClient client(&io_service, "127.0.0.1", 1234);
   for (int i = 0; i < 10; ++i) {
     EXPECT_EQ(client.SendMessage("test"), 0);
@@ -150,9 +150,9 @@ TEST(AsyncReplicaClientTest, Reconnect) {
   });
 
   boost::asio::io_service io_service;
-  std::thread t([&]() { io_service.run(); });
   boost::asio::io_service::work *work =
       new boost::asio::io_service::work(io_service);
+  std::thread t([&]() { io_service.run(); });
   AsyncReplicaClient client(&io_service, "127.0.0.1", 1234);
   for (int i = 0; i < 2; ++i) {
     EXPECT_EQ(client.SendMessage("test"), 0);
@@ -165,6 +165,77 @@ TEST(AsyncReplicaClientTest, Reconnect) {
   t.join();
 }
 
+TEST(AsyncReplicaClientTest, CoalesceMessages) {
+  std::promise<bool> bc;
+  std::future<bool> bc_done = bc.get_future();
+
+  std::thread svr_thead = std::thread([&]() {
+    TcpSocket svr_TcpSocket;
+    svr_TcpSocket.Listen("127.0.0.1", 1234);
+    auto client_socket = svr_TcpSocket.Accept();
+    for (int i = 0; i < 100; ++i) {
+      char *buf = nullptr;
+      size_t len = 0;
+      int ret = client_socket->Recv((void **)&buf, &len);
+      EXPECT_EQ(ret, i + 1);
+      EXPECT_EQ(std::string(buf, len), std::string(i + 1, 't'));
+      free(buf);
+    }
+    bc.set_value(true);
+  });
+
+  boost::asio::io_service io_service;
+  boost::asio::io_service::work *work =
+      new boost::asio::io_service::work(io_service);
+  std::thread t([&]() { io_service.run(); });
+  AsyncReplicaClientOptions options;
+  options.max_coalesce_bytes = 256;
+  options.coalesce_delay_us = 100;
+  options.tcp_cork = true;
+  AsyncReplicaClient client(&io_service, "127.0.0.1", 1234, true, options);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(client.SendMessage(std::string(i + 1, 't')), 0);
+  }
+  bc_done.get();
+  delete work;
+  work = nullptr;
+  svr_thead.join();
+  t.join();
+}
+
+TEST(AsyncReplicaClientTest, SendMessageParts) {
+  std::promise<bool> bc;
+  std::future<bool> bc_done = bc.get_future();
+
+  std::thread svr_thead = std::thread([&]() {
+    TcpSocket svr_TcpSocket;
+    svr_TcpSocket.Listen("127.0.0.1", 1234);
+    auto client_socket = svr_TcpSocket.Accept();
+    char *buf = nullptr;
+    size_t len = 0;
+    int ret = client_socket->Recv((void **)&buf, &len);
+    EXPECT_EQ(ret, 4);
+    EXPECT_EQ(std::string(buf, len), "test");
+    free(buf);
+    bc.set_value(true);
+  });
+
+  boost::asio::io_service io_service;
+  boost::asio::io_service::work *work =
+      new boost::asio::io_service::work(io_service);
+  std::thread t([&]() { io_service.run(); });
+  AsyncReplicaClient client(&io_service, "127.0.0.1", 1234);
+  auto shared_part = std::make_shared<const std::string>("st");
+  EXPECT_EQ(client.SendMessageParts(
+                {std::make_shared<const std::string>("te"), shared_part}),
+            0);
+  bc_done.get();
+  delete work;
+  work = nullptr;
+  svr_thead.join();
+  t.join();
+}
+
 }  // namespace
 
 }  // namespace resdb
@@ -22,6 +22,9 @@
 #include <glog/logging.h>
 #include <unistd.h>
 
+#include <algorithm>
+
+#include "common/utils/utils.h"
 #include "platform/proto/broadcast.pb.h"
 
 namespace resdb {
@@ -38,6 +41,20 @@ bool ReplicaExisted(const ReplicaInfo& replica_info,
   return false;
 }
 
+bool SameReplicas(const std::vector<ReplicaInfo>& a,
+                  const std::vector<ReplicaInfo>& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].id() != b[i].id() || a[i].ip() != b[i].ip() ||
+        a[i].port() != b[i].port()) {
+      return false;
+    }
+  }
+  return true;
+}
+
 }  // namespace
 
 ConsensusManager::ConsensusManager(const ResDBConfig& config)
@@ -107,29 +124,38 @@ void ConsensusManager::HeartBeat() {
   }
 }
 
-void ConsensusManager::SendHeartBeat() {
+// The hash of all the public keys, used to find out whether the keys of
+// two nodes are different without sending them.
+std::string ConsensusManager::GetKeySetHash() {
+  if (verifier_ == nullptr) {
+    return "";
+  }
   auto keys = verifier_->GetAllPublicKeys();
+  std::sort(keys.begin(), keys.end(),
+            [](const CertificateKey& a, const CertificateKey& b) {
+              return a.public_key_info().node_id() <
+                     b.public_key_info().node_id();
+            });
+  std::string data;
+  for (const auto& key : keys) {
+    data += key.SerializeAsString();
+  }
+  return SignatureVerifier::CalculateHash(data);
+}
 
-  std::vector<ReplicaInfo> replicas = GetAllReplicas();
-  LOG(ERROR) << "all replicas:" << replicas.size();
-  std::vector<ReplicaInfo> client_replicas = GetClientReplicas();
+HeartBeatInfo ConsensusManager::GetHeartBeatInfo(bool with_keys) {
   HeartBeatInfo hb_info;
   hb_info.set_sender(config_.GetSelfInfo().id());
   hb_info.set_ip(config_.GetSelfInfo().ip());
   hb_info.set_port(config_.GetSelfInfo().port());
   hb_info.set_hb_version(version_);
-  for (const auto& key : keys) {
-    *hb_info.add_public_keys() = key;
-    hb_info.add_node_version(hb_[key.public_key_info().node_id()]);
-  }
-  for (const auto& client : client_replicas) {
-    replicas.push_back(client);
-  }
-  auto client = GetReplicaClient(replicas, false);
-  if (client == nullptr) {
-    return;
+  hb_info.set_key_set_hash(GetKeySetHash());
+  if (with_keys && verifier_) {
+    for (const auto& key : verifier_->GetAllPublicKeys()) {
+      *hb_info.add_public_keys() = key;
+      hb_info.add_node_version(hb_[key.public_key_info().node_id()]);
+    }
   }
-
   // If it is not a client node, broadcost the current primary to the client.
   if (config_.GetPublicKeyCertificateInfo()
           .public_key()
@@ -138,26 +164,80 @@ void ConsensusManager::SendHeartBeat() {
     hb_info.set_primary(GetPrimary());
     hb_info.set_version(GetVersion());
   }
-  LOG(ERROR) << " server:" << config_.GetSelfInfo().id() << " sends HB"
-             << " is ready:" << is_ready_
-             << " client size:" << client_replicas.size()
-             << " svr size:" << replicas.size()
-             << "  primary:" << hb_info.primary()
-             << " version:" << hb_info.version();
+  return hb_info;
+}
 
+Request ConsensusManager::GetHeartBeatRequest(const HeartBeatInfo& hb_info) {
   Request request;
   request.set_type(Request::TYPE_HEART_BEAT);
   request.mutable_region_info()->set_region_id(
       config_.GetConfigData().self_region_id());
   hb_info.SerializeToString(request.mutable_data());
+  return request;
+}
 
-  int ret = client->SendHeartBeat(request);
+// The heart beat client keeps its connections until the replicas change.
+ReplicaCommunicator* ConsensusManager::GetHeartBeatClient(
+    const std::vector<ReplicaInfo>& replicas) {
+  if (hb_client_ == nullptr || !SameReplicas(replicas, hb_replicas_)) {
+    hb_client_ = GetReplicaClient(replicas, true);
+    hb_replicas_ = replicas;
+  }
+  return hb_client_.get();
+}
+
+void ConsensusManager::SendHeartBeat() {
+  std::vector<ReplicaInfo> replicas = GetAllReplicas();
+  LOG(ERROR) << "all replicas:" << replicas.size();
+  std::vector<ReplicaInfo> client_replicas = GetClientReplicas();
+  for (const auto& client : client_replicas) {
+    replicas.push_back(client);
+  }
+  auto client = GetHeartBeatClient(replicas);
+  if (client == nullptr) {
+    return;
+  }
+
+  // The keys are only sent before the replicas are ready. Afterward the
+  // others fetch them if the hash of their keys is different.
+  HeartBeatInfo hb_info = GetHeartBeatInfo(!is_ready_);
+  uint64_t now = GetCurrentTime();
+  hb_info.set_send_time_us(now);
+  for (const auto& replica : replicas) {
+    if (replica.id() <= 0) {
+      continue;
+    }
+    PeerHeartBeat& peer = peer_hb_[replica.id()];
+    if (!peer.acked) {
+      global_stats_->PeerHeartBeatLoss(replica.id());
+    }
+    peer.send_time_us = now;
+    peer.acked = false;
+  }
+
+  LOG(ERROR) << " server:" << config_.GetSelfInfo().id() << " sends HB"
+             << " is ready:" << is_ready_
+             << " client size:" << client_replicas.size()
+             << " svr size:" << replicas.size()
+             << "  primary:" << hb_info.primary()
+             << " version:" << hb_info.version()
+             << " keys:" << hb_info.public_keys_size();
+
+  int ret = client->SendHeartBeat(GetHeartBeatRequest(hb_info));
   if (ret <= 0) {
     LOG(ERROR) << " server:" << config_.GetSelfInfo().id()
                << " sends HB fail:" << ret;
   }
 }
 
+void ConsensusManager::ReplyHeartBeat(const HeartBeatInfo& hb_info,
+                                      const ReplicaInfo& replica) {
+  if (hb_client_ == nullptr) {
+    return;
+  }
+  hb_client_->ReplyHeartBeat(GetHeartBeatRequest(hb_info), replica);
+}
+
 // Porcess the packages received from the network.
 // context contains the client socket which can be used for sending response to
 // the client, the signature for the request will be filled inside the context
@@ -225,6 +305,29 @@ int ConsensusManager::ProcessHeartBeat(std::unique_ptr<Context> context,
     return -1;
   }
 
+  ReplicaInfo sender_info;
+  sender_info.set_ip(hb_info.ip());
+  sender_info.set_port(hb_info.port());
+  sender_info.set_id(hb_info.sender());
+
+  if (hb_info.is_ack()) {
+    auto it = peer_hb_.find(hb_info.sender());
+    if (it != peer_hb_.end() && !it->second.acked &&
+        it->second.send_time_us == hb_info.send_time_us()) {
+      it->second.acked = true;
+      global_stats_->PeerHeartBeatAck(
+          hb_info.sender(), GetCurrentTime() - hb_info.send_time_us());
+    }
+    return 0;
+  }
+  if (!hb_info.ip().empty() && hb_info.send_time_us() > 0) {
+    HeartBeatInfo ack;
+    ack.set_sender(config_.GetSelfInfo().id());
+    ack.set_send_time_us(hb_info.send_time_us());
+    ack.set_is_ack(true);
+    ReplyHeartBeat(ack, sender_info);
+  }
+
   LOG(ERROR) << "receive public size:" << hb_info.public_keys().size()
              << " primary:" << hb_info.primary()
              << " version:" << hb_info.version()
@@ -281,15 +384,22 @@ int ConsensusManager::ProcessHeartBeat(std::unique_ptr<Context> context,
     }
   }
 
-  if (!hb_info.ip().empty() && hb_info.hb_version() > 0 &&
-      hb_[hb_info.sender()] != hb_info.hb_version()) {
-    ReplicaInfo info;
-    info.set_ip(hb_info.ip());
-    info.set_port(hb_info.port());
-    info.set_id(hb_info.sender());
-    // bc_client_->Flush(info);
-    hb_[hb_info.sender()] = hb_info.hb_version();
-    SendHeartBeat();
+  if (!hb_info.ip().empty()) {
+    if (hb_info.hb_version() > 0 &&
+        hb_[hb_info.sender()] != hb_info.hb_version()) {
+      // The sender has restarted, send it all the keys.
+      hb_[hb_info.sender()] = hb_info.hb_version();
+      ReplyHeartBeat(GetHeartBeatInfo(true), sender_info);
+    } else if (hb_info.request_keys()) {
+      ReplyHeartBeat(GetHeartBeatInfo(true), sender_info);
+    } else if (hb_info.public_keys_size() == 0 &&
+               !hb_info.key_set_hash().empty() &&
+               hb_info.key_set_hash() != GetKeySetHash()) {
+      // Fetch the keys of the sender and send it ours as it may miss some.
+      HeartBeatInfo request_info = GetHeartBeatInfo(true);
+      request_info.set_request_keys(true);
+      ReplyHeartBeat(request_info, sender_info);
+    }
   }
 
   if (!is_ready_ && replica_num >= config_.GetMinDataReceiveNum()) {
@@ -351,12 +461,19 @@ void ConsensusManager::SendMessage(const google::protobuf::Message& message,
 
 std::unique_ptr<ReplicaCommunicator> ConsensusManager::GetReplicaClient(
     const std::vector<ReplicaInfo>& replicas, bool is_use_long_conn) {
+  AsyncReplicaClientOptions client_options;
+  client_options.max_coalesce_bytes = config_.GetMaxCoalesceBytes();
+  client_options.coalesce_delay_us = config_.GetCoalesceDelayUs();
+  client_options.tcp_nodelay = config_.IsTcpNoDelay();
+  client_options.tcp_cork = config_.IsTcpCork();
+  client_options.idle_timeout_s = config_.GetSessionIdleTimeoutS();
   return std::make_unique<ReplicaCommunicator>(
       replicas,
       verifier_ == nullptr || config_.GetConfigData().not_need_signature()
           ? nullptr
           : verifier_.get(),
-      is_use_long_conn, config_.GetOutputWorkerNum(), config_.GetTcpBatchNum());
+      is_use_long_conn, config_.GetOutputWorkerNum(), config_.GetTcpBatchNum(),
+      client_options);
 }
 
 void ConsensusManager::AddNewReplica(const ReplicaInfo& info) {}
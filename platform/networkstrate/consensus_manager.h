@@ -90,6 +90,12 @@ class ConsensusManager : public ServiceInterface {
  private:
   void HeartBeat();
   void SendHeartBeat();
+  void ReplyHeartBeat(const HeartBeatInfo& hb_info, const ReplicaInfo& replica);
+  HeartBeatInfo GetHeartBeatInfo(bool with_keys);
+  Request GetHeartBeatRequest(const HeartBeatInfo& hb_info);
+  ReplicaCommunicator* GetHeartBeatClient(
+      const std::vector<ReplicaInfo>& replicas);
+  std::string GetKeySetHash();
   void BroadCastThread();
 
  protected:
@@ -109,6 +115,15 @@ class ConsensusManager : public ServiceInterface {
   uint64_t version_;
   std::map<int, uint64_t> hb_;
   std::mutex hb_mutex_;
+
+  // The heart beats are sent through the long connections of hb_client_.
+  std::unique_ptr<ReplicaCommunicator> hb_client_;
+  std::vector<ReplicaInfo> hb_replicas_;
+  struct PeerHeartBeat {
+    uint64_t send_time_us = 0;
+    bool acked = true;
+  };
+  std::map<int64_t, PeerHeartBeat> peer_hb_;
 };
 
 }  // namespace resdb
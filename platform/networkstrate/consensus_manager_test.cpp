@@ -298,6 +298,63 @@ TEST_F(ConsensusManagerTest, DispatchOK) {
   }
 }
 
+TEST_F(ConsensusManagerTest, ReplyHBWithAckAndKeyRequest) {
+  std::promise<bool> hb, ack, key_request;
+  std::future<bool> hb_done = hb.get_future();
+  std::future<bool> ack_done = ack.get_future();
+  std::future<bool> key_request_done = key_request.get_future();
+  EXPECT_CALL(*impl_, GetReplicaClient)
+      .WillRepeatedly(
+          Invoke([&](const std::vector<ReplicaInfo>& replicas, bool) {
+            auto client = std::make_unique<MockReplicaCommunicator>(replicas);
+            EXPECT_CALL(*client, SendHeartBeat)
+                .WillRepeatedly(Invoke([&](const Request& request) {
+                  HeartBeatInfo hb_info;
+                  EXPECT_TRUE(hb_info.ParseFromString(request.data()));
+                  EXPECT_FALSE(hb_info.key_set_hash().empty());
+                  EXPECT_GT(hb_info.send_time_us(), 0);
+                  try {
+                    hb.set_value(true);
+                  } catch (...) {
+                  }
+                  return 1;
+                }));
+            EXPECT_CALL(*client, ReplyHeartBeat)
+                .WillRepeatedly(Invoke(
+                    [&](const Request& request, const ReplicaInfo& replica) {
+                      EXPECT_EQ(replica.id(), 2);
+                      HeartBeatInfo hb_info;
+                      EXPECT_TRUE(hb_info.ParseFromString(request.data()));
+                      if (hb_info.is_ack()) {
+                        EXPECT_EQ(hb_info.send_time_us(), 100);
+                        ack.set_value(true);
+                      } else {
+                        EXPECT_TRUE(hb_info.request_keys());
+                        key_request.set_value(true);
+                      }
+                      return 1;
+                    }));
+            return client;
+          }));
+  impl_->Start();
+  hb_done.get();
+
+  HeartBeatInfo hb_info;
+  hb_info.set_sender(2);
+  hb_info.set_ip("127.0.0.1");
+  hb_info.set_port(1235);
+  hb_info.set_send_time_us(100);
+  hb_info.set_key_set_hash("other keys");
+
+  auto request = std::make_unique<Request>();
+  request->set_type(Request::TYPE_HEART_BEAT);
+  hb_info.SerializeToString(request->mutable_data());
+  EXPECT_EQ(impl_->Dispatch(std::make_unique<Context>(), std::move(request)),
+            0);
+  ack_done.get();
+  key_request_done.get();
+}
+
 }  // namespace
 
 }  // namespace resdb
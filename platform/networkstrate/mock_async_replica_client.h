@@ -30,6 +30,14 @@ class MockAsyncReplicaClient : public AsyncReplicaClient {
   MockAsyncReplicaClient(boost::asio::io_service *io_service)
       : AsyncReplicaClient(io_service, "127.0.0.1", 0) {}
   MOCK_METHOD(int, SendMessage, (const std::string &), (override));
+
+  int SendMessageParts(MessageParts parts) override {
+    std::string data;
+    for (const auto &part : parts) {
+      data += *part;
+    }
+    return SendMessage(data);
+  }
 };
 
 }  // namespace resdb
@@ -32,6 +32,8 @@ class MockReplicaCommunicator : public ReplicaCommunicator {
       : ReplicaCommunicator(replicas) {}
 
   MOCK_METHOD(int, SendHeartBeat, (const Request&), (override));
+  MOCK_METHOD(int, ReplyHeartBeat, (const Request&, const ReplicaInfo&),
+              (override));
   MOCK_METHOD(int, SendMessage, (const google::protobuf::Message&), (override));
 
   MOCK_METHOD(void, BroadCast, (const google::protobuf::Message&), (override));
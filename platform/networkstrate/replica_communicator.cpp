@@ -20,43 +20,55 @@
 #include "platform/networkstrate/replica_communicator.h"
 
 #include <glog/logging.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 
 #include <thread>
 
+#include "common/utils/utils.h"
 #include "platform/proto/broadcast.pb.h"
 
 namespace resdb {
 
+namespace {
+
+// Set in ReplicaChannel::push_state once the channel is retired.
+constexpr uint64_t kRetired = 1ull << 63;
+
+}  // namespace
+
 ReplicaCommunicator::ReplicaCommunicator(
     const std::vector<ReplicaInfo>& replicas, SignatureVerifier* verifier,
-    bool is_use_long_conn, int epoll_num, int tcp_batch)
+    bool is_use_long_conn, int epoll_num, int tcp_batch,
+    const AsyncReplicaClientOptions& client_options)
     : replicas_(replicas),
       verifier_(verifier),
-      is_running_(false),
-      batch_queue_("bc_batch", tcp_batch),
+      is_running_(true),
       is_use_long_conn_(is_use_long_conn),
-      tcp_batch_(tcp_batch) {
+      tcp_batch_(tcp_batch),
+      client_options_(client_options) {
   global_stats_ = Stats::GetGlobalStats();
   if (is_use_long_conn_) {
     worker_ = std::make_unique<boost::asio::io_service::work>(io_service_);
     for (int i = 0; i < epoll_num; ++i) {
       worker_threads_.push_back(std::thread([&]() { io_service_.run(); }));
     }
+    for (const auto& replica : replicas_) {
+      auto& channel = replica_index_.by_addr[std::make_pair(replica.ip(),
+                                                            replica.port())];
+      if (channel == nullptr) {
+        channel = NewChannel(replica);
+      }
+      replica_index_.by_id[replica.id()] = channel;
+      broadcast_channels_.push_back(channel);
+    }
   }
   LOG(ERROR) << " tcp batch:" << tcp_batch;
-
-  StartBroadcastInBackGround();
 }
 
 ReplicaCommunicator::~ReplicaCommunicator() {
   is_running_ = false;
-  if (broadcast_thread_.joinable()) {
-    broadcast_thread_.join();
-  }
   if (is_use_long_conn_) {
-    for (auto& cli : client_pools_) {
-      cli.second.reset();
-    }
     worker_.reset();
     worker_ = nullptr;
     io_service_.stop();
@@ -65,6 +77,12 @@ ReplicaCommunicator::~ReplicaCommunicator() {
         worker_th.join();
       }
     }
+    // The handlers not run yet hold their channels and clients until
+    // io_service_ is destroyed.
+    std::atomic_store(&channel_index_, std::shared_ptr<const ChannelIndex>());
+    broadcast_channels_.clear();
+    replica_index_ = ChannelIndex();
+    client_pools_.clear();
   }
 }
 
@@ -82,14 +100,34 @@ bool ReplicaCommunicator::IsRunning() const { return is_running_; }
 
 void ReplicaCommunicator::UpdateClientReplicas(
     const std::vector<ReplicaInfo>& replicas) {
+  std::lock_guard<std::mutex> lk(channel_mutex_);
   clients_ = replicas;
+  // The ids of the clients may point to new addresses.
+  auto index = std::atomic_load(&channel_index_);
+  if (index == nullptr) {
+    return;
+  }
+  auto new_index = std::make_shared<ChannelIndex>();
+  new_index->by_addr = index->by_addr;
+  std::atomic_store(&channel_index_,
+                    std::shared_ptr<const ChannelIndex>(std::move(new_index)));
 }
 
 std::vector<ReplicaInfo> ReplicaCommunicator::GetClientReplicas() {
+  std::lock_guard<std::mutex> lk(channel_mutex_);
   return clients_;
 }
 
 int ReplicaCommunicator::SendHeartBeat(const Request& hb_info) {
+  if (is_use_long_conn_) {
+    // Reuse the async connections instead of connecting each time.
+    Frame frame = std::make_shared<const std::string>(
+        NetChannel::GetRawMessageString(hb_info, nullptr));
+    for (const auto& channel : broadcast_channels_) {
+      Push(channel, frame);
+    }
+    return broadcast_channels_.size();
+  }
   int ret = 0;
   for (const auto& replica : replicas_) {
     NetChannel client(replica.ip(), replica.port());
@@ -100,106 +138,316 @@ int ReplicaCommunicator::SendHeartBeat(const Request& hb_info) {
   return ret;
 }
 
-void ReplicaCommunicator::StartBroadcastInBackGround() {
-  is_running_ = true;
-  broadcast_thread_ = std::thread([&]() {
-    while (IsRunning()) {
-      std::vector<std::unique_ptr<QueueItem>> batch_req =
-          batch_queue_.Pop(10000);
-      if (batch_req.empty()) {
-        continue;
-      }
-      BroadcastData broadcast_data;
-      for (auto& queue_item : batch_req) {
-        broadcast_data.add_data()->swap(queue_item->data);
-      }
+int ReplicaCommunicator::ReplyHeartBeat(const Request& hb_info,
+                                        const ReplicaInfo& replica_info) {
+  if (is_use_long_conn_) {
+    Push(GetChannel(replica_info),
+         std::make_shared<const std::string>(
+             NetChannel::GetRawMessageString(hb_info, nullptr)));
+    return 1;
+  }
+  NetChannel client(replica_info.ip(), replica_info.port());
+  return client.SendRawMessage(hb_info) == 0 ? 1 : 0;
+}
 
-      global_stats_->SendBroadCastMsg(broadcast_data.data_size());
-      int ret = SendMessageFromPool(broadcast_data, replicas_);
-      if (ret < 0) {
-        LOG(ERROR) << "broadcast request fail:";
-      }
+std::shared_ptr<ReplicaCommunicator::ReplicaChannel>
+ReplicaCommunicator::NewChannel(const ReplicaInfo& replica_info) {
+  auto channel = std::make_shared<ReplicaChannel>();
+  channel->replica = replica_info;
+  channel->keep_alive = IsInPool(replica_info);
+  channel->last_active_time = GetCurrentTime();
+  if (!channel->keep_alive && client_options_.idle_timeout_s > 0) {
+    channel->idle_timer =
+        std::make_unique<boost::asio::steady_timer>(io_service_);
+    WaitIdle(channel,
+             static_cast<uint64_t>(client_options_.idle_timeout_s) * 1000000);
+  }
+  return channel;
+}
+
+std::shared_ptr<ReplicaCommunicator::ReplicaChannel>
+ReplicaCommunicator::AddChannel(const ReplicaInfo& replica_info, bool by_id) {
+  std::lock_guard<std::mutex> lk(channel_mutex_);
+  auto index = std::atomic_load(&channel_index_);
+  auto new_index = index == nullptr ? std::make_shared<ChannelIndex>()
+                                    : std::make_shared<ChannelIndex>(*index);
+  std::shared_ptr<ReplicaChannel>& channel = new_index->by_addr[std::make_pair(
+      replica_info.ip(), replica_info.port())];
+  if (channel == nullptr || (channel->push_state.load() & kRetired)) {
+    channel = NewChannel(replica_info);
+  }
+  if (by_id) {
+    new_index->by_id[replica_info.id()] = channel;
+  }
+  std::shared_ptr<ReplicaChannel> ret = channel;
+  std::atomic_store(&channel_index_,
+                    std::shared_ptr<const ChannelIndex>(std::move(new_index)));
+  return ret;
+}
+
+void ReplicaCommunicator::RemoveChannel(
+    const std::shared_ptr<ReplicaChannel>& channel) {
+  std::lock_guard<std::mutex> lk(channel_mutex_);
+  auto index = std::atomic_load(&channel_index_);
+  if (index == nullptr) {
+    return;
+  }
+  auto new_index = std::make_shared<ChannelIndex>(*index);
+  auto it = new_index->by_addr.find(
+      std::make_pair(channel->replica.ip(), channel->replica.port()));
+  if (it != new_index->by_addr.end() && it->second == channel) {
+    new_index->by_addr.erase(it);
+  }
+  for (auto it = new_index->by_id.begin(); it != new_index->by_id.end();) {
+    if (it->second == channel) {
+      it = new_index->by_id.erase(it);
+    } else {
+      ++it;
     }
-  });
+  }
+  std::atomic_store(&channel_index_,
+                    std::shared_ptr<const ChannelIndex>(std::move(new_index)));
 }
 
-void ReplicaCommunicator::StartSingleInBackGround(const std::string& ip,
-                                                  int port) {
-  single_bq_[std::make_pair(ip, port)] =
-      std::make_unique<BatchQueue<std::unique_ptr<QueueItem>>>("s_batch",
-                                                               tcp_batch_);
+std::shared_ptr<ReplicaCommunicator::ReplicaChannel>
+ReplicaCommunicator::GetChannel(const ReplicaInfo& replica_info) {
+  auto addr = std::make_pair(replica_info.ip(), replica_info.port());
+  auto replica_it = replica_index_.by_addr.find(addr);
+  if (replica_it != replica_index_.by_addr.end()) {
+    return replica_it->second;
+  }
+  auto index = std::atomic_load(&channel_index_);
+  if (index != nullptr) {
+    auto it = index->by_addr.find(addr);
+    if (it != index->by_addr.end()) {
+      return it->second;
+    }
+  }
+  return AddChannel(replica_info, false);
+}
 
-  ReplicaInfo replica_info;
+std::shared_ptr<ReplicaCommunicator::ReplicaChannel>
+ReplicaCommunicator::GetChannel(int64_t node_id) {
+  auto replica_it = replica_index_.by_id.find(node_id);
+  if (replica_it != replica_index_.by_id.end()) {
+    return replica_it->second;
+  }
+  auto index = std::atomic_load(&channel_index_);
+  if (index != nullptr) {
+    auto it = index->by_id.find(node_id);
+    if (it != index->by_id.end()) {
+      return it->second;
+    }
+  }
+  ReplicaInfo target_replica;
   for (const auto& replica : replicas_) {
-    if (replica.ip() == ip && replica.port() == port) {
-      replica_info = replica;
+    if (replica.id() == node_id) {
+      target_replica = replica;
       break;
     }
   }
-
-  if (replica_info.ip().empty()) {
+  if (target_replica.ip().empty()) {
     for (const auto& replica : GetClientReplicas()) {
-      if (replica.ip() == ip && replica.port() == port) {
-        replica_info = replica;
+      if (replica.id() == node_id) {
+        target_replica = replica;
         break;
       }
     }
   }
+  if (target_replica.ip().empty()) {
+    return nullptr;
+  }
+  return AddChannel(target_replica, true);
+}
+
+namespace {
+
+// The key of a BroadcastData.data entry followed by the length of the
+// entry, as the serialized BroadcastData would have it.
+std::string GetDataPrefix(size_t size) {
+  // The field is length delimited, whose wire type is 2.
+  constexpr uint32_t kDataTag = (BroadcastData::kDataFieldNumber << 3) | 2;
+  std::string prefix;
+  {
+    google::protobuf::io::StringOutputStream stream(&prefix);
+    google::protobuf::io::CodedOutputStream output(&stream);
+    output.WriteTag(kDataTag);
+    output.WriteVarint32(size);
+  }
+  return prefix;
+}
 
-  single_thread_.push_back(std::thread(
-      [&](BatchQueue<std::unique_ptr<QueueItem>>* bq,
-          ReplicaInfo replica_info) {
-        while (IsRunning()) {
-          std::vector<std::unique_ptr<QueueItem>> batch_req = bq->Pop(50000);
-          if (batch_req.empty()) {
-            continue;
-          }
-          BroadcastData broadcast_data;
-          for (auto& queue_item : batch_req) {
-            broadcast_data.add_data()->swap(queue_item->data);
-          }
-
-          global_stats_->SendBroadCastMsg(broadcast_data.data_size());
-          // LOG(ERROR)<<" send to ip:"<<replica_info.ip()<<"
-          // port:"<<replica_info.port()<<" bq size:"<<batch_req.size();
-          int ret = SendMessageFromPool(broadcast_data, {replica_info});
-          if (ret < 0) {
-            LOG(ERROR) << "broadcast request fail:";
-          }
-          // LOG(ERROR)<<" send to ip:"<<replica_info.ip()<<"
+}  // namespace
+
+void ReplicaCommunicator::WriteFrames(std::shared_ptr<ReplicaChannel> channel) {
+  if (!IsRunning()) {
+    return;
+  }
+  std::vector<Frame> batch;
+  size_t num = channel->queue.Pop(&batch, std::max(tcp_batch_, 1), 0);
+  if (num > 0) {
+    channel->last_active_time = GetCurrentTime();
+    if (channel->client == nullptr) {
+      std::lock_guard<std::mutex> lk(mutex_);
+      channel->client =
+          GetClientFromPool(channel->replica.ip(), channel->replica.port());
+      if (channel->client != nullptr) {
+        channel->client->SetPeerId(channel->replica.id());
+      }
+    }
+  }
+  if (channel->client != nullptr && num > 0) {
+    global_stats_->SendBroadCastMsg(batch.size());
+    global_stats_->SendBroadCastMsgPerRep();
+
+    // Encode the batch as a BroadcastData which refers to the shared
+    // frames instead of copying them.
+    AsyncReplicaClient::MessageParts parts;
+    for (auto& frame : batch) {
+      parts.push_back(
+          std::make_shared<const std::string>(GetDataPrefix(frame->size())));
+      parts.push_back(std::move(frame));
+    }
+    if (channel->client->SendMessageParts(std::move(parts))) {
+      LOG(ERROR) << "send to:" << channel->replica.ip() << " fail";
+    }
+  } else if (num > 0) {
+    LOG(ERROR) << "no connection to:" << channel->replica.ip() << ":"
+               << channel->replica.port() << ", drop " << num << " messages";
+  }
+
+  if (channel->pending_num.fetch_sub(num, std::memory_order_acq_rel) > num) {
+    // Let the other channels use the worker before the rest.
+    boost::asio::post(io_service_,
+                      [this, channel]() { WriteFrames(channel); });
+  } else if (channel->push_state.load(std::memory_order_acquire) & kRetired) {
+    CloseRetired(channel);
+  }
+}
+
+void ReplicaCommunicator::WaitIdle(std::shared_ptr<ReplicaChannel> channel,
+                                   uint64_t wait_us) {
+  channel->idle_timer->expires_from_now(std::chrono::microseconds(wait_us));
+  channel->idle_timer->async_wait(
+      [this, channel](const boost::system::error_code& error) {
+        if (error || !IsRunning()) {
+          return;
         }
-      },
-      single_bq_[std::make_pair(ip, port)].get(), replica_info));
+        uint64_t idle_timeout_us =
+            static_cast<uint64_t>(client_options_.idle_timeout_s) * 1000000;
+        uint64_t now = GetCurrentTime();
+        uint64_t last_active_time = channel->last_active_time;
+        uint64_t idle_us =
+            now > last_active_time ? now - last_active_time : 0;
+        if (idle_us >= idle_timeout_us && TryRetire(channel)) {
+          return;
+        }
+        WaitIdle(channel, idle_us >= idle_timeout_us
+                              ? idle_timeout_us
+                              : idle_timeout_us - idle_us);
+      });
+}
+
+bool ReplicaCommunicator::TryRetire(
+    const std::shared_ptr<ReplicaChannel>& channel) {
+  {
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (channel->pending_num.load(std::memory_order_acquire) > 0) {
+      return false;
+    }
+    uint64_t no_push = 0;
+    if (!channel->push_state.compare_exchange_strong(
+            no_push, kRetired, std::memory_order_acq_rel)) {
+      return false;
+    }
+    // No push gets in from now on. The channel replacing this one takes its
+    // client from the pool after this, so it gets a new connection.
+    auto it = client_pools_.find(
+        std::make_pair(channel->replica.ip(), channel->replica.port()));
+    if (it != client_pools_.end()) {
+      channel->retired_client = std::move(it->second);
+      client_pools_.erase(it);
+    }
+  }
+  RemoveChannel(channel);
+  // A push done since the check above is written first.
+  if (channel->pending_num.load(std::memory_order_acquire) == 0) {
+    CloseRetired(channel);
+  }
+  return true;
+}
+
+void ReplicaCommunicator::CloseRetired(
+    const std::shared_ptr<ReplicaChannel>& channel) {
+  std::shared_ptr<AsyncReplicaClient> client;
+  {
+    std::lock_guard<std::mutex> lk(mutex_);
+    client = std::move(channel->retired_client);
+  }
+  if (client != nullptr) {
+    client->Close();
+  }
+}
+
+ReplicaCommunicator::Frame ReplicaCommunicator::GetFrame(
+    const google::protobuf::Message& message) {
+  return std::make_shared<const std::string>(
+      NetChannel::GetRawMessageString(message, verifier_));
+}
+
+bool ReplicaCommunicator::TryPush(
+    const std::shared_ptr<ReplicaChannel>& channel, const Frame& frame) {
+  if (channel->push_state.fetch_add(1, std::memory_order_acq_rel) &
+      kRetired) {
+    channel->push_state.fetch_sub(1, std::memory_order_acq_rel);
+    return false;
+  }
+  Frame data = frame;
+  channel->queue.Push(std::move(data));
+  if (channel->pending_num.fetch_add(1, std::memory_order_acq_rel) == 0) {
+    boost::asio::post(io_service_,
+                      [this, channel]() { WriteFrames(channel); });
+  }
+  channel->push_state.fetch_sub(1, std::memory_order_acq_rel);
+  return true;
+}
+
+void ReplicaCommunicator::Push(std::shared_ptr<ReplicaChannel> channel,
+                               const Frame& frame) {
+  while (!TryPush(channel, frame)) {
+    // Retired while idle, a new channel takes over the destination.
+    channel = AddChannel(channel->replica, channel->replica.id() != 0);
+  }
 }
 
 int ReplicaCommunicator::SendSingleMessage(
     const google::protobuf::Message& message, const ReplicaInfo& replica_info) {
-  std::string ip = replica_info.ip();
-  int port = replica_info.port();
-
-  // LOG(ERROR)<<" send msg ip:"<<ip<<" port:"<<port;
   global_stats_->BroadCastMsg();
   if (is_use_long_conn_) {
-    auto item = std::make_unique<QueueItem>();
-    item->data = NetChannel::GetRawMessageString(message, verifier_);
-    std::lock_guard<std::mutex> lk(smutex_);
-    if (single_bq_.find(std::make_pair(ip, port)) == single_bq_.end()) {
-      StartSingleInBackGround(ip, port);
-    }
-    assert(single_bq_[std::make_pair(ip, port)] != nullptr);
-    single_bq_[std::make_pair(ip, port)]->Push(std::move(item));
+    Push(GetChannel(replica_info), GetFrame(message));
     return 0;
   } else {
-    return SendMessageInternal(message, replicas_);
+    return SendMessageInternal(message, {replica_info});
   }
 }
 
 int ReplicaCommunicator::SendMessage(const google::protobuf::Message& message) {
   global_stats_->BroadCastMsg();
   if (is_use_long_conn_) {
-    auto item = std::make_unique<QueueItem>();
-    item->data = NetChannel::GetRawMessageString(message, verifier_);
-    batch_queue_.Push(std::move(item));
+    // Sign once and share the frame with all the replicas.
+    Frame frame = GetFrame(message);
+    if (frame->empty()) {
+      return 0;
+    }
+    for (const auto& channel : broadcast_channels_) {
+      Push(channel, frame);
+    }
+    // Only the signed messages save the signatures of the other replicas.
+    if (verifier_ != nullptr && broadcast_channels_.size() > 1) {
+      global_stats_->SignOnceBroadcast(
+          broadcast_channels_.size() - 1,
+          (broadcast_channels_.size() - 1) * frame->size());
+    }
     return 0;
   } else {
     return SendMessageInternal(message, replicas_);
@@ -209,27 +457,17 @@ int ReplicaCommunicator::SendMessage(const google::protobuf::Message& message) {
 int ReplicaCommunicator::SendMessage(const google::protobuf::Message& message,
                                      const ReplicaInfo& replica_info) {
   return SendSingleMessage(message, replica_info);
-
-  if (is_use_long_conn_) {
-    std::string data = NetChannel::GetRawMessageString(message, verifier_);
-    BroadcastData broadcast_data;
-    broadcast_data.add_data()->swap(data);
-    return SendMessageFromPool(broadcast_data, {replica_info});
-  } else {
-    return SendMessageInternal(message, {replica_info});
-  }
 }
 
 int ReplicaCommunicator::SendBatchMessage(
     const std::vector<std::unique_ptr<Request>>& messages,
     const ReplicaInfo& replica_info) {
   if (is_use_long_conn_) {
-    BroadcastData broadcast_data;
+    std::shared_ptr<ReplicaChannel> channel = GetChannel(replica_info);
     for (const auto& message : messages) {
-      std::string data = NetChannel::GetRawMessageString(*message, verifier_);
-      broadcast_data.add_data()->swap(data);
+      Push(channel, GetFrame(*message));
     }
-    return SendMessageFromPool(broadcast_data, {replica_info});
+    return 1;
   } else {
     int ret = 0;
     for (const auto& message : messages) {
@@ -239,56 +477,38 @@ int ReplicaCommunicator::SendBatchMessage(
   }
 }
 
-int ReplicaCommunicator::SendMessageFromPool(
-    const google::protobuf::Message& message,
-    const std::vector<ReplicaInfo>& replicas) {
-  int ret = 0;
-  std::string data;
-  message.SerializeToString(&data);
-  global_stats_->SendBroadCastMsgPerRep();
-  std::lock_guard<std::mutex> lk(mutex_);
-  for (const auto& replica : replicas) {
-    auto client = GetClientFromPool(replica.ip(), replica.port());
-    if (client == nullptr) {
-      continue;
-    }
-    // LOG(ERROR) << "send to:" << replica.ip();
-    if (client->SendMessage(data) == 0) {
-      ret++;
-    } else {
-      LOG(ERROR) << "send to:" << replica.ip() << " fail";
-    }
-    // LOG(ERROR) << "send to:" << replica.ip()<<" done";
-  }
-  return ret;
-}
-
 int ReplicaCommunicator::SendMessageInternal(
     const google::protobuf::Message& message,
     const std::vector<ReplicaInfo>& replicas) {
+  // Sign once for all the replicas.
+  std::string data = NetChannel::GetRawMessageString(message, verifier_);
+  if (data.empty()) {
+    return 0;
+  }
   int ret = 0;
   for (const auto& replica : replicas) {
     auto client = GetClient(replica.ip(), replica.port());
     if (client == nullptr) {
       continue;
     }
-    if (verifier_ != nullptr) {
-      client->SetSignatureVerifier(verifier_);
-    }
-    if (client->SendRawMessage(message) == 0) {
+    if (client->SendRawMessageData(data) == 0) {
       ret++;
     }
   }
+  // Count the signatures saved for the replicas which got the message.
+  if (verifier_ != nullptr && ret > 1) {
+    global_stats_->SignOnceBroadcast(ret - 1, (ret - 1) * data.size());
+  }
   return ret;
 }
 
 AsyncReplicaClient* ReplicaCommunicator::GetClientFromPool(
     const std::string& ip, int port) {
   if (client_pools_.find(std::make_pair(ip, port)) == client_pools_.end()) {
-    auto client = std::make_unique<AsyncReplicaClient>(
-        &io_service_, ip, port + (is_use_long_conn_ ? 10000 : 0), true);
+    auto client = std::make_shared<AsyncReplicaClient>(
+        &io_service_, ip, port + (is_use_long_conn_ ? 10000 : 0), true,
+        client_options_);
     client_pools_[std::make_pair(ip, port)] = std::move(client);
-    // StartSingleInBackGround(ip, port);
   }
   return client_pools_[std::make_pair(ip, port)].get();
 }
@@ -307,6 +527,17 @@ void ReplicaCommunicator::BroadCast(const google::protobuf::Message& message) {
 
 void ReplicaCommunicator::SendMessage(const google::protobuf::Message& message,
                                       int64_t node_id) {
+  if (is_use_long_conn_) {
+    std::shared_ptr<ReplicaChannel> channel = GetChannel(node_id);
+    if (channel == nullptr) {
+      LOG(ERROR) << "no replica info";
+      return;
+    }
+    global_stats_->BroadCastMsg();
+    Push(channel, GetFrame(message));
+    return;
+  }
+
   ReplicaInfo target_replica;
   for (const auto& replica : replicas_) {
     if (replica.id() == node_id) {
@@ -18,11 +18,11 @@
  */
 
 #pragma once
+#include <memory>
 #include <thread>
 
 #include "interface/rdbc/net_channel.h"
-#include "platform/common/queue/batch_queue.h"
-#include "platform/common/queue/lock_free_queue.h"
+#include "platform/common/queue/mpsc_queue.h"
 #include "platform/networkstrate/async_replica_client.h"
 #include "platform/proto/replica_info.pb.h"
 #include "platform/proto/resdb.pb.h"
@@ -37,12 +37,17 @@ class ReplicaCommunicator {
   ReplicaCommunicator(const std::vector<ReplicaInfo>& replicas,
                       SignatureVerifier* verifier = nullptr,
                       bool is_use_long_conn = false, int epoll_num = 1,
-                      int tcp_batch = 1);
+                      int tcp_batch = 1,
+                      const AsyncReplicaClientOptions& client_options =
+                          AsyncReplicaClientOptions());
   virtual ~ReplicaCommunicator();
 
   // HeartBeat message is used to broadcast public keys.
   // It doesn't need the signature.
   virtual int SendHeartBeat(const Request& hb_info);
+  // Send a heart beat to one replica, like an ack or the requested keys.
+  virtual int ReplyHeartBeat(const Request& hb_info,
+                             const ReplicaInfo& replica_info);
 
   virtual int SendMessage(const google::protobuf::Message& message);
   virtual int SendMessage(const google::protobuf::Message& message,
@@ -64,32 +69,78 @@ class ReplicaCommunicator {
   virtual AsyncReplicaClient* GetClientFromPool(const std::string& ip,
                                                 int port);
 
-  void StartBroadcastInBackGround();
   int SendMessageInternal(const google::protobuf::Message& message,
                           const std::vector<ReplicaInfo>& replicas);
-  int SendMessageFromPool(const google::protobuf::Message& message,
-                          const std::vector<ReplicaInfo>& replicas);
 
   bool IsRunning() const;
   bool IsInPool(const ReplicaInfo& replica_info);
 
-  void StartSingleInBackGround(const std::string& ip, int port);
-
   int SendSingleMessage(const google::protobuf::Message& message,
                         const ReplicaInfo& replica_info);
 
+ private:
+  // A signed message. The frame of a broadcast is shared by the queues of
+  // all the destinations.
+  using Frame = std::shared_ptr<const std::string>;
+
+  // Each destination owns a queue of signed messages. The first message
+  // pushed to an empty queue posts a write to io_service_, which sends the
+  // queued messages in batches over the async connection until none is
+  // left. So the messages of a destination are written by one worker at a
+  // time, in the order they were queued.
+  struct ReplicaChannel {
+    ReplicaInfo replica;
+    MPSCQueue<Frame> queue;
+    // The messages pushed and not written yet.
+    std::atomic<uint64_t> pending_num = 0;
+    // The pushes in flight, with kRetired set once the channel is retired.
+    std::atomic<uint64_t> push_state = 0;
+    std::atomic<uint64_t> last_active_time = 0;
+    // Only used by the write of the channel.
+    AsyncReplicaClient* client = nullptr;
+    // Taken from the pool when the channel is retired and closed once the
+    // queue is written, guarded by mutex_.
+    std::shared_ptr<AsyncReplicaClient> retired_client;
+    // The channels of the replica set are never torn down, the others are
+    // checked by the timer once idle.
+    bool keep_alive = false;
+    std::unique_ptr<boost::asio::steady_timer> idle_timer;
+  };
+  // The channels by address and by node id. An index is never changed once
+  // published, adding or removing a channel publishes a new one.
+  struct ChannelIndex {
+    std::map<std::pair<std::string, int>, std::shared_ptr<ReplicaChannel>>
+        by_addr;
+    std::map<int64_t, std::shared_ptr<ReplicaChannel>> by_id;
+  };
+
+  std::shared_ptr<ReplicaChannel> NewChannel(const ReplicaInfo& replica_info);
+  std::shared_ptr<ReplicaChannel> GetChannel(const ReplicaInfo& replica_info);
+  std::shared_ptr<ReplicaChannel> GetChannel(int64_t node_id);
+  // Add a channel unless the index has one which is not retired.
+  std::shared_ptr<ReplicaChannel> AddChannel(const ReplicaInfo& replica_info,
+                                             bool by_id);
+  void RemoveChannel(const std::shared_ptr<ReplicaChannel>& channel);
+  Frame GetFrame(const google::protobuf::Message& message);
+  // Return false if the channel has been retired, the frame is not queued
+  // then.
+  bool TryPush(const std::shared_ptr<ReplicaChannel>& channel,
+               const Frame& frame);
+  // Push to the channel, or to the one replacing it once it is retired.
+  void Push(std::shared_ptr<ReplicaChannel> channel, const Frame& frame);
+  void WriteFrames(std::shared_ptr<ReplicaChannel> channel);
+  void WaitIdle(std::shared_ptr<ReplicaChannel> channel, uint64_t wait_us);
+  // Retire the channel if it is still idle and has no push in flight.
+  bool TryRetire(const std::shared_ptr<ReplicaChannel>& channel);
+  // Close the connection of a retired channel once its queue is written.
+  void CloseRetired(const std::shared_ptr<ReplicaChannel>& channel);
+
  private:
   std::vector<ReplicaInfo> replicas_;
   SignatureVerifier* verifier_;
-  std::map<std::pair<std::string, int>, std::unique_ptr<AsyncReplicaClient>>
+  std::map<std::pair<std::string, int>, std::shared_ptr<AsyncReplicaClient>>
       client_pools_;
-  std::thread broadcast_thread_;
   std::atomic<bool> is_running_;
-  struct QueueItem {
-    std::string data;
-    std::vector<ReplicaInfo> dest_replicas;
-  };
-  BatchQueue<std::unique_ptr<QueueItem>> batch_queue_;
   bool is_use_long_conn_ = false;
 
   Stats* global_stats_;
@@ -99,12 +150,16 @@ class ReplicaCommunicator {
   std::vector<ReplicaInfo> clients_;
   std::mutex mutex_;
 
-  std::map<std::pair<std::string, int>,
-           std::unique_ptr<BatchQueue<std::unique_ptr<QueueItem>>>>
-      single_bq_;
-  std::vector<std::thread> single_thread_;
+  // The channels of 'replicas_', used by broadcast and never changed.
+  std::vector<std::shared_ptr<ReplicaChannel>> broadcast_channels_;
+  ChannelIndex replica_index_;
+  // The channels of the other destinations.
+  // Read with std::atomic_load, the senders hold the index they read.
+  std::shared_ptr<const ChannelIndex> channel_index_;
+  // Guards adding and removing channels.
+  std::mutex channel_mutex_;
   int tcp_batch_;
-  std::mutex smutex_;
+  AsyncReplicaClientOptions client_options_;
 };
 
 }  // namespace resdb
@@ -21,11 +21,13 @@
 
 #include <gtest/gtest.h>
 
+#include <condition_variable>
 #include <future>
 
 #include "interface/rdbc/mock_net_channel.h"
 #include "platform/common/network/mock_socket.h"
 #include "platform/networkstrate/mock_async_replica_client.h"
+#include "platform/proto/broadcast.pb.h"
 
 namespace resdb {
 namespace {
@@ -43,8 +45,10 @@ ReplicaInfo GenerateReplicaInfo(const std::string& ip, int port) {
 class MockReplicaCommunicator : public ReplicaCommunicator {
  public:
   MockReplicaCommunicator(const std::vector<ReplicaInfo>& replicas,
-                          bool use_lonn_conn = false)
-      : ReplicaCommunicator(replicas, nullptr, use_lonn_conn){};
+                          bool use_lonn_conn = false,
+                          const AsyncReplicaClientOptions& options =
+                              AsyncReplicaClientOptions())
+      : ReplicaCommunicator(replicas, nullptr, use_lonn_conn, 1, 1, options){};
   MOCK_METHOD(std::unique_ptr<NetChannel>, GetClient, (const std::string&, int),
               (override));
   MOCK_METHOD(AsyncReplicaClient*, GetClientFromPool, (const std::string&, int),
@@ -134,6 +138,151 @@ TEST(ReplicaCommunicatorTest, Lonnconnection) {
   bc_done.get();
 }
 
+TEST(ReplicaCommunicatorTest, LongConnectionSendToNode) {
+  std::promise<bool> bc;
+  std::future<bool> bc_done = bc.get_future();
+  std::vector<ReplicaInfo> replicas;
+  replicas.push_back(GenerateReplicaInfo("127.0.0.1", 1234));
+  replicas.back().set_id(1);
+
+  Request expected_request;
+  expected_request.set_type(Request::TYPE_HEART_BEAT);
+
+  boost::asio::io_service io_service;
+  auto resdb_client = std::make_unique<MockAsyncReplicaClient>(&io_service);
+  EXPECT_CALL(*resdb_client, SendMessage)
+      .WillRepeatedly(Invoke([&](const std::string& data) {
+        BroadcastData broadcast_data;
+        EXPECT_TRUE(broadcast_data.ParseFromString(data));
+        for (const auto& message : broadcast_data.data()) {
+          EXPECT_EQ(message,
+                    NetChannel::GetRawMessageString(expected_request));
+          bc.set_value(true);
+        }
+        return 0;
+      }));
+
+  MockReplicaCommunicator client(replicas, true);
+  std::vector<ReplicaInfo> client_replicas;
+  client_replicas.push_back(GenerateReplicaInfo("127.0.0.1", 1236));
+  client_replicas.back().set_id(3);
+  client.UpdateClientReplicas(client_replicas);
+
+  EXPECT_CALL(client, GetClientFromPool("127.0.0.1", 1236))
+      .WillOnce(Return(resdb_client.get()));
+  client.SendMessage(expected_request, 3);
+  bc_done.get();
+}
+
+TEST(ReplicaCommunicatorTest, LongConnectionRemoveIdleChannel) {
+  std::vector<ReplicaInfo> replicas;
+  replicas.push_back(GenerateReplicaInfo("127.0.0.1", 1234));
+  replicas.back().set_id(1);
+
+  Request expected_request;
+  expected_request.set_type(Request::TYPE_HEART_BEAT);
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  int received = 0;
+  boost::asio::io_service io_service;
+  auto resdb_client = std::make_unique<MockAsyncReplicaClient>(&io_service);
+  EXPECT_CALL(*resdb_client, SendMessage)
+      .WillRepeatedly(Invoke([&](const std::string& data) {
+        std::lock_guard<std::mutex> lk(mutex);
+        received++;
+        cv.notify_all();
+        return 0;
+      }));
+
+  AsyncReplicaClientOptions options;
+  options.idle_timeout_s = 1;
+  MockReplicaCommunicator client(replicas, true, options);
+  ReplicaInfo proxy = GenerateReplicaInfo("127.0.0.1", 1236);
+
+  // The channel to the proxy is torn down once idle, the next message makes
+  // a new one with a new connection.
+  EXPECT_CALL(client, GetClientFromPool("127.0.0.1", 1236))
+      .Times(2)
+      .WillRepeatedly(Return(resdb_client.get()));
+  client.SendMessage(expected_request, proxy);
+  {
+    std::unique_lock<std::mutex> lk(mutex);
+    cv.wait(lk, [&]() { return received == 1; });
+  }
+  sleep(2);
+  client.SendMessage(expected_request, proxy);
+  std::unique_lock<std::mutex> lk(mutex);
+  cv.wait(lk, [&]() { return received == 2; });
+}
+
+TEST(ReplicaCommunicatorTest, LongConnectionBroadcast) {
+  std::vector<ReplicaInfo> replicas;
+  replicas.push_back(GenerateReplicaInfo("127.0.0.1", 1234));
+  replicas.push_back(GenerateReplicaInfo("127.0.0.1", 1235));
+
+  Request expected_request;
+  expected_request.set_type(Request::TYPE_HEART_BEAT);
+
+  boost::asio::io_service io_service;
+  std::vector<std::unique_ptr<MockAsyncReplicaClient>> resdb_clients;
+  std::vector<std::promise<bool>> bc(2);
+  for (int i = 0; i < 2; ++i) {
+    resdb_clients.push_back(
+        std::make_unique<MockAsyncReplicaClient>(&io_service));
+    EXPECT_CALL(*resdb_clients.back(), SendMessage)
+        .WillOnce(Invoke([&, i](const std::string& data) {
+          BroadcastData broadcast_data;
+          EXPECT_TRUE(broadcast_data.ParseFromString(data));
+          EXPECT_EQ(broadcast_data.data_size(), 1);
+          EXPECT_EQ(broadcast_data.data(0),
+                    NetChannel::GetRawMessageString(expected_request));
+          bc[i].set_value(true);
+          return 0;
+        }));
+  }
+
+  MockReplicaCommunicator client(replicas, true);
+  EXPECT_CALL(client, GetClientFromPool("127.0.0.1", 1234))
+      .WillOnce(Return(resdb_clients[0].get()));
+  EXPECT_CALL(client, GetClientFromPool("127.0.0.1", 1235))
+      .WillOnce(Return(resdb_clients[1].get()));
+  EXPECT_EQ(client.SendMessage(expected_request), 0);
+  for (auto& done : bc) {
+    done.get_future().get();
+  }
+}
+
+TEST(ReplicaCommunicatorTest, LongConnectionHeartBeat) {
+  std::promise<bool> bc;
+  std::future<bool> bc_done = bc.get_future();
+  std::vector<ReplicaInfo> replicas;
+  replicas.push_back(GenerateReplicaInfo("127.0.0.1", 1234));
+
+  Request hb_request;
+  hb_request.set_type(Request::TYPE_HEART_BEAT);
+
+  boost::asio::io_service io_service;
+  auto resdb_client = std::make_unique<MockAsyncReplicaClient>(&io_service);
+  EXPECT_CALL(*resdb_client, SendMessage)
+      .WillOnce(Invoke([&](const std::string& data) {
+        BroadcastData broadcast_data;
+        EXPECT_TRUE(broadcast_data.ParseFromString(data));
+        EXPECT_EQ(broadcast_data.data_size(), 1);
+        EXPECT_EQ(broadcast_data.data(0),
+                  NetChannel::GetRawMessageString(hb_request));
+        bc.set_value(true);
+        return 0;
+      }));
+
+  MockReplicaCommunicator client(replicas, true);
+  EXPECT_CALL(client, GetClientFromPool("127.0.0.1", 1234))
+      .WillOnce(Return(resdb_client.get()));
+  EXPECT_CALL(client, GetClient).Times(0);
+  EXPECT_EQ(client.SendHeartBeat(hb_request), 1);
+  bc_done.get();
+}
+
 }  // namespace
 
 }  // namespace resdb
@@ -24,6 +24,7 @@
 
 #include <thread>
 
+#include "common/utils/trace.h"
 #include "platform/common/network/tcp_socket.h"
 #include "platform/proto/broadcast.pb.h"
 
@@ -42,14 +43,21 @@ ServiceNetwork::ServiceNetwork(const ResDBConfig& config,
     perror("failed to ignore SIGPIPE; sigaction");
     exit(EXIT_FAILURE);
   }
+  trace::SetLevel(config_.GetTraceLevel());
+  trace::SetBufferSize(config_.GetTraceBufferSize());
+  trace::InstallSignalHandler(config_.GetTracePath());
 
   acceptor_ = std::make_unique<Acceptor>(config, &input_queue_);
 
+  AsyncAcceptorOptions acceptor_options;
+  acceptor_options.max_frame_size = config_.GetMaxRecvFrameBytes();
+  acceptor_options.idle_timeout_s = config_.GetSessionIdleTimeoutS();
   async_acceptor_ = std::make_unique<AsyncAcceptor>(
       config.GetSelfInfo().ip(), config_.GetSelfInfo().port() + 10000,
       config.GetInputWorkerNum(),
       std::bind(&ServiceNetwork::AcceptorHandler, this, std::placeholders::_1,
-                std::placeholders::_2));
+                std::placeholders::_2),
+      acceptor_options);
   async_acceptor_->StartAccept();
   global_stats_ = Stats::GetGlobalStats();
 }
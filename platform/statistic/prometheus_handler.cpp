@@ -38,12 +38,27 @@ std::map<MetricName, std::pair<TableName, std::string>> metric_names = {
     {CLIENT_CALL, {CLIENT, "client_call"}},
     {CLIENT_REQ, {CLIENT, "client_req"}},
     {SOCKET_RECV, {IO_THREAD, "socket_recv"}},
+    {SOCKET_SEND, {IO_THREAD, "socket_send"}},
+    {SOCKET_SEND_BYTES, {IO_THREAD, "socket_send_bytes"}},
+    {SOCKET_SEND_CALL, {IO_THREAD, "socket_send_call"}},
+    {SAVED_SIGNATURE, {IO_THREAD, "saved_signature"}},
+    {SAVED_COPY_BYTES, {IO_THREAD, "saved_copy_bytes"}},
+    {PEER_HEART_BEAT_RTT, {IO_THREAD, "peer_heart_beat_rtt"}},
+    {PEER_HEART_BEAT_LOSS, {IO_THREAD, "peer_heart_beat_loss"}},
+    {PEER_RECONNECT, {IO_THREAD, "peer_reconnect"}},
+    {ACCEPTOR_SESSION, {IO_THREAD, "acceptor_session"}},
+    {RECV_BUFFER_IN_USE, {IO_THREAD, "recv_buffer_in_use"}},
+    {RECV_BUFFER_CACHED, {IO_THREAD, "recv_buffer_cached"}},
     {BROAD_CAST, {IO_THREAD, "broad_cast"}},
     {PROPOSE, {CONSENSUS, "propose"}},
     {PREPARE, {CONSENSUS, "prepare"}},
     {COMMIT, {CONSENSUS, "commit"}},
     {EXECUTE, {CONSENSUS, "execute"}},
-    {NUM_EXECUTE_TX, {CONSENSUS, "num_execute_tx"}}};
+    {NUM_EXECUTE_TX, {CONSENSUS, "num_execute_tx"}},
+    {GEO_DECODE_QUEUE, {CONSENSUS, "geo_decode_queue"}},
+    {GEO_ORDER_QUEUE, {CONSENSUS, "geo_order_queue"}},
+    {GEO_REGION_WAIT, {CONSENSUS, "geo_region_wait"}},
+    {GEO_WAN_BYTES, {IO_THREAD, "geo_wan_bytes"}}};
 
 PrometheusHandler::PrometheusHandler(const std::string& server_address) {
   exposer_ =
@@ -42,12 +42,27 @@ enum MetricName {
   CLIENT_CALL,
   CLIENT_REQ,
   SOCKET_RECV,
+  SOCKET_SEND,
+  SOCKET_SEND_BYTES,
+  SOCKET_SEND_CALL,
+  SAVED_SIGNATURE,
+  SAVED_COPY_BYTES,
+  PEER_HEART_BEAT_RTT,
+  PEER_HEART_BEAT_LOSS,
+  PEER_RECONNECT,
+  ACCEPTOR_SESSION,
+  RECV_BUFFER_IN_USE,
+  RECV_BUFFER_CACHED,
   BROAD_CAST,
   PROPOSE,
   PREPARE,
   COMMIT,
   EXECUTE,
   NUM_EXECUTE_TX,
+  GEO_DECODE_QUEUE,
+  GEO_ORDER_QUEUE,
+  GEO_REGION_WAIT,
+  GEO_WAN_BYTES,
 };
 
 class PrometheusHandler {
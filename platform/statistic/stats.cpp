@@ -64,6 +64,19 @@ Stats::Stats(int sleep_time) {
   socket_recv_ = 0;
   broad_cast_msg_ = 0;
   send_broad_cast_msg_ = 0;
+  socket_send_msg_ = 0;
+  socket_send_bytes_ = 0;
+  socket_send_calls_ = 0;
+  sign_once_broadcast_ = 0;
+  saved_signatures_ = 0;
+  saved_copy_bytes_ = 0;
+  acceptor_sessions_ = 0;
+  recv_buffer_in_use_ = 0;
+  recv_buffer_cached_ = 0;
+  geo_decode_queue_ = 0;
+  geo_order_queue_ = 0;
+  geo_wan_batch_ = 0;
+  geo_wan_bytes_ = 0;
 
   prometheus_ = nullptr;
   global_thread_ =
@@ -373,6 +386,8 @@ void Stats::MonitorGlobal() {
            pending_execute = 0, execute = 0, execute_done = 0;
   uint64_t broad_cast_msg = 0, send_broad_cast_msg = 0;
   uint64_t send_broad_cast_msg_per_rep = 0;
+  uint64_t socket_send_msg = 0, socket_send_bytes = 0, socket_send_calls = 0;
+  uint64_t sign_once_broadcast = 0, saved_signatures = 0, saved_copy_bytes = 0;
   uint64_t server_call = 0, server_process = 0;
   uint64_t seq_gap = 0;
   uint64_t total_request = 0, total_geo_request = 0, geo_request = 0;
@@ -390,9 +405,15 @@ void Stats::MonitorGlobal() {
   uint64_t last_client_call = 0, last_socket_recv = 0;
   uint64_t last_broad_cast_msg = 0, last_send_broad_cast_msg = 0;
   uint64_t last_send_broad_cast_msg_per_rep = 0;
+  uint64_t last_socket_send_msg = 0, last_socket_send_bytes = 0,
+           last_socket_send_calls = 0;
+  uint64_t last_sign_once_broadcast = 0, last_saved_signatures = 0,
+           last_saved_copy_bytes = 0;
   uint64_t last_server_call = 0, last_server_process = 0;
   uint64_t last_total_request = 0, last_total_geo_request = 0,
            last_geo_request = 0;
+  uint64_t geo_wan_batch = 0, geo_wan_bytes = 0, last_geo_wan_batch = 0,
+           last_geo_wan_bytes = 0;
   uint64_t time = 0;
 
   while (!stop_) {
@@ -411,15 +432,27 @@ void Stats::MonitorGlobal() {
     broad_cast_msg = broad_cast_msg_;
     send_broad_cast_msg = send_broad_cast_msg_;
     send_broad_cast_msg_per_rep = send_broad_cast_msg_per_rep_;
+    socket_send_msg = socket_send_msg_;
+    socket_send_bytes = socket_send_bytes_;
+    socket_send_calls = socket_send_calls_;
+    sign_once_broadcast = sign_once_broadcast_;
+    saved_signatures = saved_signatures_;
+    saved_copy_bytes = saved_copy_bytes_;
     server_call = server_call_;
     server_process = server_process_;
     seq_gap = seq_gap_;
     total_request = total_request_;
     total_geo_request = total_geo_request_;
     geo_request = geo_request_;
+    geo_wan_batch = geo_wan_batch_;
+    geo_wan_bytes = geo_wan_bytes_;
 
     run_req_num = run_req_num_;
     run_req_run_time = run_req_run_time_;
+    double socket_send_num =
+        std::max<uint64_t>(1, socket_send_msg - last_socket_send_msg);
+    double sign_once_num = std::max<uint64_t>(
+        1, sign_once_broadcast - last_sign_once_broadcast);
 
     LOG(ERROR) << "=========== monitor =========\n"
                << "server call:" << server_call - last_server_call
@@ -440,6 +473,18 @@ void Stats::MonitorGlobal() {
                << " "
                   "per send broad_cast:"
                << send_broad_cast_msg_per_rep - last_send_broad_cast_msg_per_rep
+               << " socket send:" << socket_send_msg - last_socket_send_msg
+               << " bytes per send:"
+               << (socket_send_bytes - last_socket_send_bytes) / socket_send_num
+               << " writes per send:"
+               << (socket_send_calls - last_socket_send_calls) / socket_send_num
+               << " saved sign per broadcast:"
+               << (saved_signatures - last_saved_signatures) / sign_once_num
+               << " saved copy bytes per broadcast:"
+               << (saved_copy_bytes - last_saved_copy_bytes) / sign_once_num
+               << " acceptor sessions:" << acceptor_sessions_
+               << " recv buffer in use:" << recv_buffer_in_use_
+               << " recv buffer cached:" << recv_buffer_cached_
                << " "
                   "propose:"
                << num_propose - last_num_propose
@@ -465,11 +510,28 @@ void Stats::MonitorGlobal() {
                << " total geo request per:"
                << (total_geo_request - last_total_geo_request) / 5
                << " geo request:" << (geo_request - last_geo_request)
+               << " geo wan bytes per batch:"
+               << (geo_wan_bytes - last_geo_wan_bytes) /
+                      std::max<uint64_t>(1, geo_wan_batch - last_geo_wan_batch)
+               << " geo decode queue:" << geo_decode_queue_
+               << " geo order queue:" << geo_order_queue_
                << " "
                   "seq fail:"
                << seq_fail - last_seq_fail << " time:" << time
                << " "
                   "\n--------------- monitor ------------";
+    for (const auto& it : GetPeerStats()) {
+      LOG(ERROR) << "  peer:" << it.first << " rtt(us):" << it.second.rtt_us
+                 << " heart beat ack:" << it.second.heart_beat_ack
+                 << " loss:" << it.second.heart_beat_loss
+                 << " reconnect:" << it.second.reconnect;
+    }
+    for (const auto& it : GetGeoRegionStats()) {
+      LOG(ERROR) << "  geo region:" << it.first
+                 << " batches:" << it.second.batch_num << " avg wait(us):"
+                 << it.second.wait_us / std::max<uint64_t>(
+                                            1, it.second.batch_num);
+    }
     if (run_req_num - last_run_req_num > 0) {
       LOG(ERROR) << "  req client latency:"
                  << static_cast<double>(run_req_run_time -
@@ -491,6 +553,12 @@ void Stats::MonitorGlobal() {
     last_broad_cast_msg = broad_cast_msg;
     last_send_broad_cast_msg = send_broad_cast_msg;
     last_send_broad_cast_msg_per_rep = send_broad_cast_msg_per_rep;
+    last_socket_send_msg = socket_send_msg;
+    last_socket_send_bytes = socket_send_bytes;
+    last_socket_send_calls = socket_send_calls;
+    last_sign_once_broadcast = sign_once_broadcast;
+    last_saved_signatures = saved_signatures;
+    last_saved_copy_bytes = saved_copy_bytes;
 
     last_server_call = server_call;
     last_server_process = server_process;
@@ -500,6 +568,8 @@ void Stats::MonitorGlobal() {
     last_total_request = total_request;
     last_total_geo_request = total_geo_request;
     last_geo_request = geo_request;
+    last_geo_wan_batch = geo_wan_batch;
+    last_geo_wan_bytes = geo_wan_bytes;
   }
 }
 
@@ -564,6 +634,76 @@ void Stats::SendBroadCastMsg(uint32_t num) { send_broad_cast_msg_ += num; }
 
 void Stats::SendBroadCastMsgPerRep() { send_broad_cast_msg_per_rep_++; }
 
+void Stats::SocketSend(uint32_t msg_num, uint64_t bytes,
+                       uint32_t write_calls) {
+  if (prometheus_) {
+    prometheus_->Inc(SOCKET_SEND, msg_num);
+    prometheus_->Inc(SOCKET_SEND_BYTES, bytes);
+    prometheus_->Inc(SOCKET_SEND_CALL, write_calls);
+  }
+  socket_send_msg_ += msg_num;
+  socket_send_bytes_ += bytes;
+  socket_send_calls_ += write_calls;
+}
+
+void Stats::SignOnceBroadcast(uint32_t saved_signatures,
+                              uint64_t saved_bytes) {
+  if (prometheus_) {
+    prometheus_->Inc(SAVED_SIGNATURE, saved_signatures);
+    prometheus_->Inc(SAVED_COPY_BYTES, saved_bytes);
+  }
+  sign_once_broadcast_++;
+  saved_signatures_ += saved_signatures;
+  saved_copy_bytes_ += saved_bytes;
+}
+
+void Stats::PeerHeartBeatAck(int64_t peer_id, uint64_t rtt_us) {
+  if (prometheus_) {
+    prometheus_->Set(PEER_HEART_BEAT_RTT, rtt_us);
+  }
+  std::lock_guard<std::mutex> lk(peer_mutex_);
+  PeerStats& peer = peer_stats_[peer_id];
+  peer.heart_beat_ack++;
+  peer.rtt_us = rtt_us;
+}
+
+void Stats::PeerHeartBeatLoss(int64_t peer_id) {
+  if (prometheus_) {
+    prometheus_->Inc(PEER_HEART_BEAT_LOSS, 1);
+  }
+  std::lock_guard<std::mutex> lk(peer_mutex_);
+  peer_stats_[peer_id].heart_beat_loss++;
+}
+
+void Stats::PeerReconnect(int64_t peer_id) {
+  if (prometheus_) {
+    prometheus_->Inc(PEER_RECONNECT, 1);
+  }
+  std::lock_guard<std::mutex> lk(peer_mutex_);
+  peer_stats_[peer_id].reconnect++;
+}
+
+std::map<int64_t, PeerStats> Stats::GetPeerStats() {
+  std::lock_guard<std::mutex> lk(peer_mutex_);
+  return peer_stats_;
+}
+
+void Stats::SetAcceptorSessions(uint64_t session_num) {
+  if (prometheus_) {
+    prometheus_->Set(ACCEPTOR_SESSION, session_num);
+  }
+  acceptor_sessions_ = session_num;
+}
+
+void Stats::SetRecvBufferPool(uint64_t in_use_bytes, uint64_t cached_bytes) {
+  if (prometheus_) {
+    prometheus_->Set(RECV_BUFFER_IN_USE, in_use_bytes);
+    prometheus_->Set(RECV_BUFFER_CACHED, cached_bytes);
+  }
+  recv_buffer_in_use_ = in_use_bytes;
+  recv_buffer_cached_ = cached_bytes;
+}
+
 void Stats::SeqFail() { seq_fail_++; }
 
 void Stats::IncTotalRequest(uint32_t num) {
@@ -577,6 +717,38 @@ void Stats::IncTotalGeoRequest(uint32_t num) { total_geo_request_ += num; }
 
 void Stats::IncGeoRequest() { geo_request_++; }
 
+void Stats::SetGeoQueueDepth(uint64_t decode_num, uint64_t order_num) {
+  if (prometheus_) {
+    prometheus_->Set(GEO_DECODE_QUEUE, decode_num);
+    prometheus_->Set(GEO_ORDER_QUEUE, order_num);
+  }
+  geo_decode_queue_ = decode_num;
+  geo_order_queue_ = order_num;
+}
+
+void Stats::GeoWanSend(uint32_t batch_num, uint64_t bytes) {
+  if (prometheus_) {
+    prometheus_->Inc(GEO_WAN_BYTES, bytes);
+  }
+  geo_wan_batch_ += batch_num;
+  geo_wan_bytes_ += bytes;
+}
+
+void Stats::GeoRegionWait(int region_id, uint64_t wait_us) {
+  if (prometheus_) {
+    prometheus_->Set(GEO_REGION_WAIT, wait_us);
+  }
+  std::lock_guard<std::mutex> lk(geo_mutex_);
+  GeoRegionStats& region = geo_region_stats_[region_id];
+  region.batch_num++;
+  region.wait_us += wait_us;
+}
+
+std::map<int, GeoRegionStats> Stats::GetGeoRegionStats() {
+  std::lock_guard<std::mutex> lk(geo_mutex_);
+  return geo_region_stats_;
+}
+
 void Stats::ServerCall() {
   if (prometheus_) {
     prometheus_->Inc(SERVER_CALL_NAME, 1);
@@ -71,6 +71,21 @@ struct VisualData {
   struct rusage process_stats_;
 };
 
+// The health of the connection to one peer.
+struct PeerStats {
+  uint64_t heart_beat_ack = 0;
+  uint64_t heart_beat_loss = 0;
+  uint64_t reconnect = 0;
+  // The round trip time of the last acked heart beat.
+  uint64_t rtt_us = 0;
+};
+
+// The batches of one region waiting for their turn in the global order.
+struct GeoRegionStats {
+  uint64_t batch_num = 0;
+  uint64_t wait_us = 0;
+};
+
 class Stats {
  public:
   static Stats* GetGlobalStats(int sleep_seconds = 5);
@@ -111,10 +126,31 @@ class Stats {
   void BroadCastMsg();
   void SendBroadCastMsg(uint32_t num);
   void SendBroadCastMsgPerRep();
+  // Messages and bytes written to the replica connections and the number of
+  // write calls used.
+  void SocketSend(uint32_t msg_num, uint64_t bytes, uint32_t write_calls);
+  // The signatures and the copied bytes saved by sharing one signed frame
+  // across the destinations of a broadcast.
+  void SignOnceBroadcast(uint32_t saved_signatures, uint64_t saved_bytes);
+  void PeerHeartBeatAck(int64_t peer_id, uint64_t rtt_us);
+  void PeerHeartBeatLoss(int64_t peer_id);
+  void PeerReconnect(int64_t peer_id);
+  std::map<int64_t, PeerStats> GetPeerStats();
+  // The sessions of the async acceptor and the bytes of its receive buffer
+  // pool.
+  void SetAcceptorSessions(uint64_t session_num);
+  void SetRecvBufferPool(uint64_t in_use_bytes, uint64_t cached_bytes);
   void SeqFail();
   void IncTotalRequest(uint32_t num);
   void IncTotalGeoRequest(uint32_t num);
   void IncGeoRequest();
+  // The global batches waiting to be decoded and decoded batches waiting for
+  // their turn in the global order.
+  void SetGeoQueueDepth(uint64_t decode_num, uint64_t order_num);
+  void GeoRegionWait(int region_id, uint64_t wait_us);
+  std::map<int, GeoRegionStats> GetGeoRegionStats();
+  // The global batches sent to the other regions and the bytes sent for them.
+  void GeoWanSend(uint32_t batch_num, uint64_t bytes);
 
   void SeqGap(uint64_t seq_gap);
   // Network in->worker
@@ -143,12 +179,24 @@ class Stats {
   std::atomic<uint64_t> client_call_, socket_recv_;
   std::atomic<uint64_t> broad_cast_msg_, send_broad_cast_msg_,
       send_broad_cast_msg_per_rep_;
+  std::atomic<uint64_t> socket_send_msg_, socket_send_bytes_,
+      socket_send_calls_;
+  std::atomic<uint64_t> sign_once_broadcast_, saved_signatures_,
+      saved_copy_bytes_;
   std::atomic<uint64_t> seq_fail_;
+  std::atomic<uint64_t> acceptor_sessions_, recv_buffer_in_use_,
+      recv_buffer_cached_;
+  std::mutex peer_mutex_;
+  std::map<int64_t, PeerStats> peer_stats_;
   std::atomic<uint64_t> server_call_, server_process_;
   std::atomic<uint64_t> run_req_num_;
   std::atomic<uint64_t> run_req_run_time_;
   std::atomic<uint64_t> seq_gap_;
   std::atomic<uint64_t> total_request_, total_geo_request_, geo_request_;
+  std::atomic<uint64_t> geo_decode_queue_, geo_order_queue_;
+  std::atomic<uint64_t> geo_wan_batch_, geo_wan_bytes_;
+  std::mutex geo_mutex_;
+  std::map<int, GeoRegionStats> geo_region_stats_;
   int monitor_sleep_time_ = 5;  // default 5s.
 
   std::thread crow_thread_;
@@ -22,10 +22,14 @@
 
 #include <fstream>
 
+#include "chain/storage/memory_db.h"
 #include "executor/utxo/executor/utxo_executor.h"
 #include "platform/config/resdb_config_utils.h"
 #include "platform/statistic/stats.h"
 #include "service/utils/server_factory.h"
+#ifdef ENABLE_LEVELDB
+#include "chain/storage/leveldb.h"
+#endif
 
 using google::protobuf::util::JsonParseOptions;
 using resdb::ConsensusManagerPBFT;
@@ -34,6 +38,7 @@ using resdb::GenerateResDBConfig;
 using resdb::ResConfigData;
 using resdb::ResDBConfig;
 using resdb::Stats;
+using resdb::Storage;
 using resdb::utxo::QueryExecutor;
 using resdb::utxo::Transaction;
 using resdb::utxo::UTXOExecutor;
@@ -54,6 +59,16 @@ resdb::utxo::Config ReadConfigFromFile(const std::string& file_name) {
   return config_data;
 }
 
+std::unique_ptr<Storage> NewStorage(const std::string& db_path,
+                                    const ResConfigData& config_data) {
+#ifdef ENABLE_LEVELDB
+  LOG(INFO) << "use leveldb storage.";
+  return resdb::storage::NewResLevelDB(db_path, config_data.leveldb_info());
+#endif
+  LOG(INFO) << "use memory storage.";
+  return resdb::storage::NewMemoryDB();
+}
+
 void ShowUsage() {
   printf(
       "<config> <private_key> <cert_file> <durability_option> [logging_dir]\n");
@@ -82,15 +97,20 @@ int main(int argc, char** argv) {
       GenerateResDBConfig(config_file, private_key_file, cert_file);
   ResConfigData config_data = config->GetConfigData();
 
-  std::unique_ptr<Wallet> wallet = std::make_unique<Wallet>();
+  std::string db_path =
+      std::to_string(config->GetSelfInfo().port()) + "_utxo_db/";
+  LOG(ERROR) << "db path:" << db_path;
+  std::unique_ptr<Storage> storage = NewStorage(db_path, config_data);
+
+  std::unique_ptr<Wallet> wallet = std::make_unique<Wallet>(storage.get());
   std::unique_ptr<Transaction> transaction =
-      std::make_unique<Transaction>(utxo_config, wallet.get());
+      std::make_unique<Transaction>(utxo_config, wallet.get(), storage.get());
 
   auto server = CustomGenerateResDBServer<ConsensusManagerPBFT>(
       config_file, private_key_file, cert_file,
       std::make_unique<UTXOExecutor>(utxo_config, transaction.get(),
                                      wallet.get()),
-      std::make_unique<QueryExecutor>(transaction.get(), wallet.get()));
+      std::make_unique<QueryExecutor>(transaction.get()));
 
   server->Run();
 }
@@ -0,0 +1,42 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdio.h>
+
+#include "common/utils/trace.h"
+
+using namespace resdb;
+
+// Print the records of a trace dump in time order, one per line.
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    printf("<trace dump path>\n");
+    return 0;
+  }
+  auto records_or = trace::ReadDump(argv[1]);
+  if (!records_or.ok()) {
+    fprintf(stderr, "read trace dump fail: %s\n",
+            std::string(records_or.status().message()).c_str());
+    return 1;
+  }
+  for (const trace::TraceRecord& record : *records_or) {
+    printf("%s\n", trace::Format(record).c_str());
+  }
+  return 0;
+}